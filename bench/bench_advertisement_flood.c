@@ -0,0 +1,201 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+/*
+ * Allocation benchmark of a discovery flood: the same device advertising over and over, with manufacturer and service
+ * data that is either identical every time or changes every time. The payloads are built up front, so every allocation
+ * counted is made by the device while applying them. The rebuild case runs the per-advertisement hash table code the
+ * library used before.
+ *
+ * Needs dbus-daemon to start a private bus for the adapter and device objects.
+ */
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <string.h>
+#include "adapter.h"
+#include "adapter_internal.h"
+#include "device_internal.h"
+
+#define ITERATIONS 200000
+#define PAYLOAD_VARIANTS 16
+
+static const char *const ADAPTER_PATH = "/org/bluez/hci0";
+static const char *const DEVICE_PATH = "/org/bluez/hci0/dev_C4_00_00_1A_00_7E";
+static const char *const SERVICE_UUID = "0000feaa-0000-1000-8000-00805f9b34fb";
+
+static volatile guint sink;
+static gsize allocations;
+
+#ifdef __GLIBC__
+// Count every allocation made through malloc, which g_malloc and friends end up in
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    allocations++;
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+static void report(const char *name, gint64 start, gsize start_allocations, guint64 operations) {
+    double elapsed_ns = (double) (g_get_monotonic_time() - start) * 1000.0;
+    double allocations_per_op = (double) (allocations - start_allocations) / (double) operations;
+    printf("%-44s %10.1f ns/op %8.2f allocs/op\n", name, elapsed_ns / (double) operations, allocations_per_op);
+}
+
+static GVariant *create_payload(guint variant, guint length) {
+    guint8 data[64];
+    for (guint i = 0; i < length; i++) {
+        data[i] = (guint8) (variant * 31 + i);
+    }
+    return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, data, length, sizeof(guint8));
+}
+
+static GVariant *create_manufacturer_data(guint variant) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{qv}"));
+    g_variant_builder_add(&builder, "{qv}", (guint16) 0x004C, create_payload(variant, 23));
+    g_variant_builder_add(&builder, "{qv}", (guint16) 0x0059, create_payload(variant, 8));
+    return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+static GVariant *create_service_data(guint variant) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder, "{sv}", SERVICE_UUID, create_payload(variant, 18));
+    return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+static void byte_array_free(GByteArray *byteArray) { g_byte_array_free(byteArray, TRUE); }
+
+/**
+ * The update as it was done before the inline store: fresh tables and byte arrays for every advertisement
+ */
+static void rebuild_manufacturer_data(GHashTable **table, GVariant *property_value) {
+    if (*table != NULL) {
+        g_hash_table_destroy(*table);
+    }
+    *table = g_hash_table_new_full(g_int_hash, g_int_equal, g_free, (GDestroyNotify) byte_array_free);
+
+    GVariantIter iter;
+    GVariant *array;
+    guint16 key;
+    g_variant_iter_init(&iter, property_value);
+    while (g_variant_iter_loop(&iter, "{qv}", &key, &array)) {
+        gsize data_length = 0;
+        const guint8 *data = g_variant_get_fixed_array(array, &data_length, sizeof(guint8));
+        GByteArray *byteArray = g_byte_array_sized_new((guint) data_length);
+        g_byte_array_append(byteArray, data, (guint) data_length);
+        int *keyCopy = g_new0(int, 1);
+        *keyCopy = key;
+        g_hash_table_insert(*table, keyCopy, byteArray);
+    }
+}
+
+static void bench_flood(Device *device, GVariant **manufacturer_data, GVariant **service_data) {
+    GHashTable *table = NULL;
+    gint64 start = g_get_monotonic_time();
+    gsize start_allocations = allocations;
+    for (guint i = 0; i < ITERATIONS; i++) {
+        rebuild_manufacturer_data(&table, manufacturer_data[i % PAYLOAD_VARIANTS]);
+        sink += g_hash_table_size(table);
+    }
+    report("manufacturer data, rebuilt tables", start, start_allocations, ITERATIONS);
+    g_hash_table_destroy(table);
+
+    start = g_get_monotonic_time();
+    start_allocations = allocations;
+    for (guint i = 0; i < ITERATIONS; i++) {
+        binc_internal_device_update_property(device, "ManufacturerData", manufacturer_data[0]);
+        binc_internal_device_update_property(device, "ServiceData", service_data[0]);
+        sink += binc_internal_device_take_changes(device);
+    }
+    report("identical advertisements, inline store", start, start_allocations, ITERATIONS);
+
+    start = g_get_monotonic_time();
+    start_allocations = allocations;
+    for (guint i = 0; i < ITERATIONS; i++) {
+        binc_internal_device_update_property(device, "ManufacturerData", manufacturer_data[i % PAYLOAD_VARIANTS]);
+        binc_internal_device_update_property(device, "ServiceData", service_data[i % PAYLOAD_VARIANTS]);
+        sink += binc_internal_device_take_changes(device);
+    }
+    report("changing advertisements, inline store", start, start_allocations, ITERATIONS);
+
+    // A client reading the data after every change pays for the views, the store itself stays allocation free
+    start = g_get_monotonic_time();
+    start_allocations = allocations;
+    for (guint i = 0; i < ITERATIONS; i++) {
+        binc_internal_device_update_property(device, "ManufacturerData", manufacturer_data[i % PAYLOAD_VARIANTS]);
+        sink += g_hash_table_size(binc_device_get_manufacturer_data(device));
+    }
+    report("changing advertisements, table view read", start, start_allocations, ITERATIONS);
+}
+
+int main(void) {
+    GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    GError *error = NULL;
+    GDBusConnection *connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    if (connection == NULL) {
+        fprintf(stderr, "failed to connect to the test bus: %s\n", error->message);
+        g_clear_error(&error);
+        g_test_dbus_down(bus);
+        g_object_unref(bus);
+        return 1;
+    }
+
+    GVariant *manufacturer_data[PAYLOAD_VARIANTS];
+    GVariant *service_data[PAYLOAD_VARIANTS];
+    for (guint i = 0; i < PAYLOAD_VARIANTS; i++) {
+        manufacturer_data[i] = create_manufacturer_data(i);
+        service_data[i] = create_service_data(i);
+    }
+
+    Adapter *adapter = binc_adapter_create(connection, ADAPTER_PATH);
+    Device *device = binc_device_create(DEVICE_PATH, adapter);
+    bench_flood(device, manufacturer_data, service_data);
+
+    binc_device_free(device);
+    binc_adapter_free(adapter);
+    for (guint i = 0; i < PAYLOAD_VARIANTS; i++) {
+        g_variant_unref(manufacturer_data[i]);
+        g_variant_unref(service_data[i]);
+    }
+    g_object_unref(connection);
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+/*
+ * Microbenchmark of the discovery filter and device lookup paths.
+ * Each case runs the string based code the library used before next to the binary UUID and address code it uses now.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "address.h"
+#include "uuid.h"
+
+#define ITERATIONS 1000000
+#define DEVICE_COUNT 1000
+
+static const char *const device_uuids[] = {
+        "0000180a-0000-1000-8000-00805f9b34fb",
+        "0000180f-0000-1000-8000-00805f9b34fb",
+        "0000fe9f-0000-1000-8000-00805f9b34fb",
+        "6e400001-b5a3-f393-e0a9-e50e24dcca9e",
+        "0000feaa-0000-1000-8000-00805f9b34fb"
+};
+
+// None of these are advertised, so every match walks all filters and uuids
+static const char *const filter_uuids[] = {
+        "00001809-0000-1000-8000-00805f9b34fb",
+        "0000180d-0000-1000-8000-00805f9b34fb",
+        "00001810-0000-1000-8000-00805f9b34fb",
+        "0000181d-0000-1000-8000-00805f9b34fb"
+};
+
+static volatile guint sink;
+
+static void report(const char *name, gint64 start, guint64 operations) {
+    double elapsed_ns = (double) (g_get_monotonic_time() - start) * 1000.0;
+    printf("%-44s %10.1f ns/op\n", name, elapsed_ns / (double) operations);
+}
+
+static gboolean string_has_service(const GList *uuids, const char *service_uuid) {
+    for (const GList *iterator = uuids; iterator; iterator = iterator->next) {
+        if (g_str_equal(service_uuid, (char *) iterator->data)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean string_matches_filter(const GList *uuids, const GPtrArray *filter) {
+    for (guint i = 0; i < filter->len; i++) {
+        if (string_has_service(uuids, g_ptr_array_index(filter, i))) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean binary_matches_filter(const GArray *uuids, GHashTable *filter) {
+    for (guint i = 0; i < uuids->len; i++) {
+        if (g_hash_table_contains(filter, &g_array_index(uuids, BincUuid, i))) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void bench_filter_match(void) {
+    GList *uuids = NULL;
+    GArray *binary_uuids = g_array_new(FALSE, FALSE, sizeof(BincUuid));
+    for (guint i = 0; i < G_N_ELEMENTS(device_uuids); i++) {
+        uuids = g_list_append(uuids, g_strdup(device_uuids[i]));
+        BincUuid uuid;
+        binc_uuid_parse(device_uuids[i], &uuid);
+        g_array_append_val(binary_uuids, uuid);
+    }
+
+    GPtrArray *string_filter = g_ptr_array_new_with_free_func(g_free);
+    GHashTable *binary_filter = g_hash_table_new_full(binc_uuid_hash, binc_uuid_equal, g_free, NULL);
+    for (guint i = 0; i < G_N_ELEMENTS(filter_uuids); i++) {
+        g_ptr_array_add(string_filter, g_strdup(filter_uuids[i]));
+        BincUuid *uuid = g_new(BincUuid, 1);
+        binc_uuid_parse(filter_uuids[i], uuid);
+        g_hash_table_add(binary_filter, uuid);
+    }
+
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        sink += string_matches_filter(uuids, string_filter);
+    }
+    report("filter match, string compares", start, ITERATIONS);
+
+    start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        sink += binary_matches_filter(binary_uuids, binary_filter);
+    }
+    report("filter match, binary uuid set", start, ITERATIONS);
+
+    g_hash_table_destroy(binary_filter);
+    g_ptr_array_free(string_filter, TRUE);
+    g_array_free(binary_uuids, TRUE);
+    g_list_free_full(uuids, g_free);
+}
+
+static void bench_uuid_parse(void) {
+    BincUuid uuid;
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        sink += binc_uuid_parse(device_uuids[i % G_N_ELEMENTS(device_uuids)], &uuid);
+    }
+    report("uuid parse, 128-bit", start, ITERATIONS);
+
+    start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        sink += binc_uuid_parse("180d", &uuid);
+    }
+    report("uuid parse, 16-bit short form", start, ITERATIONS);
+}
+
+static char *replace_char(char *str, char find, char replace) {
+    for (char *current = strchr(str, find); current != NULL; current = strchr(current, find)) {
+        *current = replace;
+    }
+    return str;
+}
+
+static void bench_address_lookup(void) {
+    const char *adapter_path = "/org/bluez/hci0";
+    char **addresses = g_new0(char *, DEVICE_COUNT + 1);
+    GHashTable *by_path = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    GHashTable *by_address = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    for (guint i = 0; i < DEVICE_COUNT; i++) {
+        addresses[i] = g_strdup_printf("C4:%02X:%02X:1A:%02X:7E", i >> 8, i & 0xFF, (i * 7) & 0xFF);
+
+        char *path = g_strdup_printf("%s/dev_%s", adapter_path, addresses[i]);
+        g_hash_table_insert(by_path, replace_char(path, ':', '_'), GUINT_TO_POINTER(i + 1));
+
+        BincAddress address;
+        binc_address_parse(addresses[i], BINC_ADDRESS_PUBLIC, &address);
+        guint64 *key = g_new(guint64, 1);
+        *key = binc_address_pack(&address);
+        g_hash_table_insert(by_address, key, GUINT_TO_POINTER(i + 1));
+    }
+
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        char *path = g_strdup_printf("%s/dev_%s", adapter_path, addresses[i % DEVICE_COUNT]);
+        path = replace_char(path, ':', '_');
+        sink += GPOINTER_TO_UINT(g_hash_table_lookup(by_path, path));
+        g_free(path);
+    }
+    report("address lookup, device path string", start, ITERATIONS);
+
+    start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        BincAddress address;
+        binc_address_parse(addresses[i % DEVICE_COUNT], BINC_ADDRESS_PUBLIC, &address);
+        guint64 key = binc_address_pack(&address);
+        sink += GPOINTER_TO_UINT(g_hash_table_lookup(by_address, &key));
+    }
+    report("address lookup, parse and packed key", start, ITERATIONS);
+
+    g_hash_table_destroy(by_address);
+    g_hash_table_destroy(by_path);
+    g_strfreev(addresses);
+}
+
+int main(void) {
+    bench_filter_match();
+    bench_uuid_parse();
+    bench_address_lookup();
+    return 0;
+}
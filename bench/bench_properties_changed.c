@@ -0,0 +1,253 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+/*
+ * Benchmark of the PropertiesChanged decode path over payloads recorded with dbus-monitor during discovery and
+ * a heart rate notification stream. The chain case runs the g_str_equal if/else dispatch the library used before,
+ * the table case runs the property dispatcher it uses now. Both end in the same handlers, which only read the value,
+ * so the difference is the cost of getting from the property name to its handler.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "property_dispatch.h"
+
+#define ITERATIONS 200000
+
+static const char *const recorded_payloads[] = {
+        "('org.bluez.GattCharacteristic1', {'Value': <[byte 0x16, 0x48, 0x03, 0x04, 0x02, 0x04]>}, @as [])",
+        "('org.bluez.Device1', {'RSSI': <int16 -67>}, @as [])",
+        "('org.bluez.GattCharacteristic1', {'Value': <[byte 0x16, 0x47, 0x0f, 0x04]>}, @as [])",
+        "('org.bluez.Device1', {'RSSI': <int16 -71>, 'ManufacturerData': <{uint16 76: <[byte 0x10, 0x05, 0x01, 0x18, 0x4d, 0x5a, 0x3b]>}>}, @as [])",
+        "('org.bluez.GattCharacteristic1', {'Value': <[byte 0x16, 0x47, 0x11, 0x04]>}, @as [])",
+        "('org.bluez.Device1', {'RSSI': <int16 -70>, 'TxPower': <int16 -8>, 'ServiceData': <{'0000feaa-0000-1000-8000-00805f9b34fb': <[byte 0x10, 0xf8, 0x03, 0x67, 0x6f, 0x6f]>}>}, @as [])",
+        "('org.bluez.GattCharacteristic1', {'Value': <[byte 0x16, 0x48, 0x0c, 0x04]>}, @as [])",
+        "('org.bluez.Device1', {'Name': <'Polar H10 7E1A2C3D'>, 'Alias': <'Polar H10 7E1A2C3D'>, 'UUIDs': <['00001800-0000-1000-8000-00805f9b34fb', '0000180d-0000-1000-8000-00805f9b34fb', '0000180f-0000-1000-8000-00805f9b34fb']>}, @as [])",
+        "('org.bluez.Device1', {'RSSI': <int16 -66>}, @as [])",
+        "('org.bluez.Device1', {'Connected': <true>}, @as [])",
+        "('org.bluez.Device1', {'ServicesResolved': <true>}, @as [])",
+        "('org.bluez.GattCharacteristic1', {'Notifying': <true>}, @as [])",
+        "('org.bluez.Adapter1', {'Discovering': <true>}, @as [])",
+        "('org.bluez.Device1', {'RSSI': <int16 -74>, 'ManufacturerData': <{uint16 76: <[byte 0x10, 0x05, 0x01, 0x18, 0x4d, 0x5a, 0x3c]>}>}, @as [])",
+        "('org.bluez.Device1', {'Paired': <true>, 'Trusted': <true>}, @as [])",
+        "('org.bluez.Adapter1', {'Powered': <true>, 'Discoverable': <false>}, @as [])",
+};
+
+static volatile guint sink;
+
+static void report(const char *name, gint64 start, guint64 operations) {
+    double elapsed_ns = (double) (g_get_monotonic_time() - start) * 1000.0;
+    printf("%-44s %10.1f ns/op\n", name, elapsed_ns / (double) operations);
+}
+
+static void read_string(__attribute__((unused)) gpointer object, GVariant *value) {
+    gsize length = 0;
+    g_variant_get_string(value, &length);
+    sink += (guint) length;
+}
+
+static void read_boolean(__attribute__((unused)) gpointer object, GVariant *value) {
+    sink += (guint) g_variant_get_boolean(value);
+}
+
+static void read_int16(__attribute__((unused)) gpointer object, GVariant *value) {
+    sink += (guint) g_variant_get_int16(value);
+}
+
+static void read_children(__attribute__((unused)) gpointer object, GVariant *value) {
+    sink += (guint) g_variant_n_children(value);
+}
+
+static void read_bytes(__attribute__((unused)) gpointer object, GVariant *value) {
+    gsize length = 0;
+    g_variant_get_fixed_array(value, &length, sizeof(guint8));
+    sink += (guint) length;
+}
+
+static void chain_adapter(const char *name, GVariant *value) {
+    if (g_str_equal(name, "Address")) {
+        read_string(NULL, value);
+    } else if (g_str_equal(name, "Powered")) {
+        read_boolean(NULL, value);
+    } else if (g_str_equal(name, "Discovering")) {
+        read_boolean(NULL, value);
+    } else if (g_str_equal(name, "Discoverable")) {
+        read_boolean(NULL, value);
+    }
+}
+
+static void chain_device(const char *name, GVariant *value) {
+    if (g_str_equal(name, "Address")) {
+        read_string(NULL, value);
+    } else if (g_str_equal(name, "AddressType")) {
+        read_string(NULL, value);
+    } else if (g_str_equal(name, "Alias")) {
+        read_string(NULL, value);
+    } else if (g_str_equal(name, "Connected")) {
+        read_boolean(NULL, value);
+    } else if (g_str_equal(name, "Name")) {
+        read_string(NULL, value);
+    } else if (g_str_equal(name, "Paired")) {
+        read_boolean(NULL, value);
+    } else if (g_str_equal(name, "RSSI")) {
+        read_int16(NULL, value);
+    } else if (g_str_equal(name, "Trusted")) {
+        read_boolean(NULL, value);
+    } else if (g_str_equal(name, "TxPower")) {
+        read_int16(NULL, value);
+    } else if (g_str_equal(name, "UUIDs")) {
+        read_children(NULL, value);
+    } else if (g_str_equal(name, "ManufacturerData")) {
+        read_children(NULL, value);
+    } else if (g_str_equal(name, "ServiceData")) {
+        read_children(NULL, value);
+    } else if (g_str_equal(name, "ServicesResolved")) {
+        read_boolean(NULL, value);
+    }
+}
+
+static void chain_characteristic(const char *name, GVariant *value) {
+    if (g_str_equal(name, "Notifying")) {
+        read_boolean(NULL, value);
+    } else if (g_str_equal(name, "Value")) {
+        read_bytes(NULL, value);
+    }
+}
+
+static void decode_with_chain(GVariant *payload) {
+    const char *interface = NULL;
+    GVariant *properties = NULL;
+    g_variant_get(payload, "(&s@a{sv}@as)", &interface, &properties, NULL);
+
+    const char *property_name;
+    GVariant *property_value;
+    GVariantIter iter;
+    g_variant_iter_init(&iter, properties);
+    while (g_variant_iter_loop(&iter, "{&sv}", &property_name, &property_value)) {
+        if (g_str_equal(interface, "org.bluez.Device1")) {
+            chain_device(property_name, property_value);
+        } else if (g_str_equal(interface, "org.bluez.GattCharacteristic1")) {
+            chain_characteristic(property_name, property_value);
+        } else if (g_str_equal(interface, "org.bluez.Adapter1")) {
+            chain_adapter(property_name, property_value);
+        }
+    }
+    g_variant_unref(properties);
+}
+
+static const PropertyHandlerEntry adapter_handlers[] = {
+        {"Address",      "s", read_string},
+        {"Powered",      "b", read_boolean},
+        {"Discovering",  "b", read_boolean},
+        {"Discoverable", "b", read_boolean},
+};
+
+static const PropertyHandlerEntry device_handlers[] = {
+        {"Address",          "s",     read_string},
+        {"AddressType",      "s",     read_string},
+        {"Alias",            "s",     read_string},
+        {"Connected",        "b",     read_boolean},
+        {"Name",             "s",     read_string},
+        {"Paired",           "b",     read_boolean},
+        {"RSSI",             "n",     read_int16},
+        {"Trusted",          "b",     read_boolean},
+        {"TxPower",          "n",     read_int16},
+        {"UUIDs",            "as",    read_children},
+        {"ManufacturerData", "a{qv}", read_children},
+        {"ServiceData",      "a{sv}", read_children},
+        {"ServicesResolved", "b",     read_boolean},
+};
+
+static const PropertyHandlerEntry characteristic_handlers[] = {
+        {"Notifying", "b",  read_boolean},
+        {"Value",     "ay", read_bytes},
+};
+
+static PropertyDispatcher adapter_dispatcher = BINC_PROPERTY_DISPATCHER(adapter_handlers);
+static PropertyDispatcher device_dispatcher = BINC_PROPERTY_DISPATCHER(device_handlers);
+static PropertyDispatcher characteristic_dispatcher = BINC_PROPERTY_DISPATCHER(characteristic_handlers);
+
+static void decode_with_table(GVariant *payload) {
+    const char *interface = NULL;
+    GVariant *properties = NULL;
+    g_variant_get(payload, "(&s@a{sv}@as)", &interface, &properties, NULL);
+
+    // Each signal subscription in the library is per interface, so the dispatcher is known up front
+    if (g_str_equal(interface, "org.bluez.Device1")) {
+        binc_property_dispatch_all(&device_dispatcher, NULL, properties);
+    } else if (g_str_equal(interface, "org.bluez.GattCharacteristic1")) {
+        binc_property_dispatch_all(&characteristic_dispatcher, NULL, properties);
+    } else if (g_str_equal(interface, "org.bluez.Adapter1")) {
+        binc_property_dispatch_all(&adapter_dispatcher, NULL, properties);
+    }
+    g_variant_unref(properties);
+}
+
+int main(void) {
+    guint count = G_N_ELEMENTS(recorded_payloads);
+    GVariant **payloads = g_new0(GVariant *, count);
+    guint property_count = 0;
+    for (guint i = 0; i < count; i++) {
+        GError *error = NULL;
+        payloads[i] = g_variant_parse(G_VARIANT_TYPE("(sa{sv}as)"), recorded_payloads[i], NULL, NULL, &error);
+        if (payloads[i] == NULL) {
+            fprintf(stderr, "payload %u: %s\n", i, error->message);
+            return 1;
+        }
+        GVariant *properties = g_variant_get_child_value(payloads[i], 1);
+        property_count += (guint) g_variant_n_children(properties);
+        g_variant_unref(properties);
+    }
+
+    // Warm up, this also builds the dispatcher indexes
+    for (guint i = 0; i < count; i++) {
+        decode_with_chain(payloads[i]);
+        decode_with_table(payloads[i]);
+    }
+
+    guint64 operations = (guint64) ITERATIONS * count;
+    printf("%u recorded payloads, %u properties\n", count, property_count);
+
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        for (guint j = 0; j < count; j++) {
+            decode_with_chain(payloads[j]);
+        }
+    }
+    report("PropertiesChanged decode, strcmp chain", start, operations);
+
+    start = g_get_monotonic_time();
+    for (guint i = 0; i < ITERATIONS; i++) {
+        for (guint j = 0; j < count; j++) {
+            decode_with_table(payloads[j]);
+        }
+    }
+    report("PropertiesChanged decode, dispatch table", start, operations);
+
+    for (guint i = 0; i < count; i++) {
+        g_variant_unref(payloads[i]);
+    }
+    g_free(payloads);
+    return 0;
+}
@@ -21,20 +21,34 @@
  *
  */
 
-#include "adapter.h"
+#include "adapter_internal.h"
 #include "device.h"
 #include "device_internal.h"
 #include "logger.h"
 #include "utility.h"
 #include "advertisement.h"
+#include "advertisement_monitor.h"
 #include "application.h"
+#include "signal_dispatcher.h"
+#include "property_dispatch.h"
+#include "device_snapshot.h"
+#include "gatt_cache.h"
+#include "connection_manager_internal.h"
+#include "poll_scheduler_internal.h"
+#include "scan_aggregator_internal.h"
 
 static const char *const TAG = "Adapter";
+
+// GetManagedObjects calls made before there is an adapter to take the call timeout from
+#define OBJECT_MANAGER_CALL_TIMEOUT_MS 10000
 static const char *const BLUEZ_DBUS = "org.bluez";
+static const char *const BLUEZ_PATH = "/org/bluez";
 static const char *const INTERFACE_ADAPTER = "org.bluez.Adapter1";
 static const char *const INTERFACE_DEVICE = "org.bluez.Device1";
+static const char *const INTERFACE_GATT_SERVICE = "org.bluez.GattService1";
 static const char *const INTERFACE_OBJECT_MANAGER = "org.freedesktop.DBus.ObjectManager";
 static const char *const INTERFACE_GATT_MANAGER = "org.bluez.GattManager1";
+static const char *const INTERFACE_ADVERTISEMENT_MONITOR_MANAGER = "org.bluez.AdvertisementMonitorManager1";
 static const char *const INTERFACE_PROPERTIES = "org.freedesktop.DBus.Properties";
 
 static const char *const METHOD_START_DISCOVERY = "StartDiscovery";
@@ -42,10 +56,11 @@ static const char *const METHOD_STOP_DISCOVERY = "StopDiscovery";
 static const char *const METHOD_REMOVE_DEVICE = "RemoveDevice";
 static const char *const METHOD_SET_DISCOVERY_FILTER = "SetDiscoveryFilter";
 
-static const char *const ADAPTER_PROPERTY_POWERED = "Powered";
-static const char *const ADAPTER_PROPERTY_DISCOVERING = "Discovering";
-static const char *const ADAPTER_PROPERTY_ADDRESS = "Address";
-static const char *const ADAPTER_PROPERTY_DISCOVERABLE = "Discoverable";
+// Defines rather than constants so they can be used in the property tables
+#define ADAPTER_PROPERTY_POWERED "Powered"
+#define ADAPTER_PROPERTY_DISCOVERING "Discovering"
+#define ADAPTER_PROPERTY_ADDRESS "Address"
+#define ADAPTER_PROPERTY_DISCOVERABLE "Discoverable"
 
 static const char *const DEVICE_PROPERTY_RSSI = "RSSI";
 static const char *const DEVICE_PROPERTY_UUIDS = "UUIDs";
@@ -65,7 +80,7 @@ static const char *discovery_state_names[] = {
 
 typedef struct binc_discovery_filter {
     short rssi;
-    GPtrArray *services;
+    GHashTable *services; // Owned, set of BincUuid
     const char *pattern;
 } DiscoveryFilter;
 
@@ -79,42 +94,74 @@ struct binc_adapter {
     DiscoveryFilter discovery_filter;
 
     GDBusConnection *connection;  // Borrowed
-    guint device_prop_changed;
     guint adapter_prop_changed;
-    guint iface_added;
-    guint iface_removed;
 
     AdapterDiscoveryResultCallback discoveryResultCallback;
+    AdapterDiscoveryBatchCallback discoveryBatchCallback;
     AdapterDiscoveryStateChangeCallback discoveryStateCallback;
     AdapterPoweredStateChangeCallback poweredStateCallback;
     RemoteCentralConnectionStateCallback centralStateCallback;
+    AdapterDeviceEvictedCallback deviceEvictedCallback;
     void *user_data; // Borrowed
     GHashTable *devices_cache; // Owned
-
+    GHashTable *connected_devices; // Owned, set of borrowed devices that are connected
+    GHashTable *devices_by_address; // Owned, packed address -> borrowed device
+
+    guint cache_max_devices;
+    guint cache_idle_ttl_seconds;
+    gboolean cache_remove_from_bluez;
+    guint cache_sweep_id;
+    GQueue cache_lru; // Least recently seen first, links owned by cache_entries
+    GHashTable *cache_entries; // Owned, borrowed device -> CacheEntry
+
+    guint batch_window_ms;
+    guint batch_min_interval_ms;
+    guint batch_timeout_id;
+    GPtrArray *batch_queue; // Owned, devices borrowed
+    GHashTable *batch_queued; // Owned, set of borrowed devices
+    GHashTable *batch_last_delivered; // Owned, borrowed device -> gint64 timestamp
+    GPtrArray *batch_result; // Owned, devices borrowed
+
+    AdapterScanStats scan_stats;
+    gint64 scan_stats_since;
+
+    RssiFilterConfig rssi_filter;
+    guint rssi_report_delta;
+    GArray *proximity_zones; // Owned, descending short thresholds
+
+    ScanAggregator *scan_aggregator; // Borrowed
+    GattCache *gatt_cache; // Owned, NULL when GATT caching is disabled
+    ConnectionManager *connection_manager; // Owned, NULL until first used
+    PollScheduler *poll_scheduler; // Owned, NULL until first used
     Advertisement *advertisement; // Borrowed
+    GCancellable *cancellable; // Owned, cancelled when the adapter is freed
+    gint call_timeout_ms;
 };
 
+typedef struct cache_entry {
+    GList link; // link.data is the borrowed device
+    gint64 last_seen;
+    gboolean pinned; // Pinned devices are not linked into cache_lru
+} CacheEntry;
+
+static void discovery_batch_remove_device(Adapter *adapter, Device *device);
+
+static void discovery_batch_free(Adapter *adapter);
+
+static void discovery_batch_clear(Adapter *adapter);
+
 static void remove_signal_subscribers(Adapter *adapter) {
     g_assert(adapter != NULL);
 
-    g_dbus_connection_signal_unsubscribe(adapter->connection, adapter->device_prop_changed);
-    adapter->device_prop_changed = 0;
+    binc_signal_dispatcher_unregister(adapter->connection, adapter->path, adapter);
     g_dbus_connection_signal_unsubscribe(adapter->connection, adapter->adapter_prop_changed);
-    adapter->device_prop_changed = 0;
-    g_dbus_connection_signal_unsubscribe(adapter->connection, adapter->iface_added);
-    adapter->iface_added = 0;
-    g_dbus_connection_signal_unsubscribe(adapter->connection, adapter->iface_removed);
-    adapter->iface_removed = 0;
+    adapter->adapter_prop_changed = 0;
 }
 
 static void free_discovery_filter(Adapter *adapter) {
     g_assert(adapter != NULL);
 
-    for (guint i = 0; i < adapter->discovery_filter.services->len; i++) {
-        char *uuid_filter = g_ptr_array_index(adapter->discovery_filter.services, i);
-        g_free(uuid_filter);
-    }
-    g_ptr_array_free(adapter->discovery_filter.services, TRUE);
+    g_hash_table_destroy(adapter->discovery_filter.services);
     adapter->discovery_filter.services = NULL;
 
     g_free((char *) adapter->discovery_filter.pattern);
@@ -124,36 +171,92 @@ static void free_discovery_filter(Adapter *adapter) {
 void binc_adapter_free(Adapter *adapter) {
     g_assert(adapter != NULL);
 
+    if (adapter->scan_aggregator != NULL) {
+        binc_scan_aggregator_remove_adapter(adapter->scan_aggregator, adapter);
+    }
+
+    // Callbacks of cancelled calls return without touching the adapter
+    g_cancellable_cancel(adapter->cancellable);
+
     remove_signal_subscribers(adapter);
+    discovery_batch_free(adapter);
+
+    if (adapter->connection_manager != NULL) {
+        binc_internal_connection_manager_free(adapter->connection_manager);
+        adapter->connection_manager = NULL;
+    }
+
+    if (adapter->poll_scheduler != NULL) {
+        binc_internal_poll_scheduler_free(adapter->poll_scheduler);
+        adapter->poll_scheduler = NULL;
+    }
+
+    if (adapter->cache_sweep_id != 0) {
+        binc_source_remove(adapter->cache_sweep_id);
+        adapter->cache_sweep_id = 0;
+    }
+
+    if (adapter->cache_entries != NULL) {
+        g_hash_table_destroy(adapter->cache_entries);
+        adapter->cache_entries = NULL;
+    }
 
     if (adapter->discovery_filter.services != NULL) {
         free_discovery_filter(adapter);
         adapter->discovery_filter.services = NULL;
     }
 
+    if (adapter->proximity_zones != NULL) {
+        g_array_free(adapter->proximity_zones, TRUE);
+        adapter->proximity_zones = NULL;
+    }
+
+    if (adapter->connected_devices != NULL) {
+        g_hash_table_destroy(adapter->connected_devices);
+        adapter->connected_devices = NULL;
+    }
+
+    if (adapter->devices_by_address != NULL) {
+        g_hash_table_destroy(adapter->devices_by_address);
+        adapter->devices_by_address = NULL;
+    }
+
     if (adapter->devices_cache != NULL) {
         g_hash_table_destroy(adapter->devices_cache);
         adapter->devices_cache = NULL;
     }
 
+    if (adapter->gatt_cache != NULL) {
+        binc_gatt_cache_free(adapter->gatt_cache);
+        adapter->gatt_cache = NULL;
+    }
+
     g_free((char *) adapter->path);
     adapter->path = NULL;
 
     g_free((char *) adapter->address);
     adapter->address = NULL;
 
+    g_object_unref(adapter->cancellable);
+    adapter->cancellable = NULL;
+
     adapter->connection = NULL;
     g_free(adapter);
 }
 
-static void binc_internal_adapter_call_method_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_adapter_call_method_cb(GObject *source_object,
                                                  GAsyncResult *res,
                                                  gpointer user_data) {
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -176,8 +279,8 @@ static void binc_internal_adapter_call_method(Adapter *adapter, const char *meth
                            parameters,
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
                            (GAsyncReadyCallback) binc_internal_adapter_call_method_cb,
                            adapter);
 }
@@ -187,11 +290,72 @@ static void binc_internal_set_discovery_state(Adapter *adapter, DiscoveryState d
     if (adapter->discovery_state == discovery_state) return;
 
     adapter->discovery_state = discovery_state;
+
+    // Results that were queued while discovering are stale once discovery stops
+    if (discovery_state == BINC_DISCOVERY_STOPPING || discovery_state == BINC_DISCOVERY_STOPPED) {
+        discovery_batch_clear(adapter);
+    }
+
     if (adapter->discoveryStateCallback != NULL) {
         adapter->discoveryStateCallback(adapter, adapter->discovery_state, NULL);
     }
 }
 
+static void adapter_powered_changed(gpointer object, GVariant *value) {
+    Adapter *adapter = (Adapter *) object;
+    adapter->powered = g_variant_get_boolean(value);
+    if (adapter->poweredStateCallback != NULL) {
+        adapter->poweredStateCallback(adapter, adapter->powered);
+    }
+}
+
+static void adapter_discovering_changed(gpointer object, GVariant *value) {
+    Adapter *adapter = (Adapter *) object;
+    adapter->discovering = g_variant_get_boolean(value);
+
+    // It could be that some other app is causing discovery to be stopped, e.g. power off
+    if (adapter->discovering == FALSE) {
+        // Update discovery state to reflect discovery state
+        binc_internal_set_discovery_state(adapter, BINC_DISCOVERY_STOPPED);
+    }
+}
+
+static void adapter_update_address(gpointer object, GVariant *value) {
+    Adapter *adapter = (Adapter *) object;
+    g_free((char *) adapter->address);
+    adapter->address = g_strdup(g_variant_get_string(value, NULL));
+}
+
+static void adapter_update_powered(gpointer object, GVariant *value) {
+    ((Adapter *) object)->powered = g_variant_get_boolean(value);
+}
+
+static void adapter_update_discovering(gpointer object, GVariant *value) {
+    ((Adapter *) object)->discovering = g_variant_get_boolean(value);
+}
+
+static void adapter_update_discoverable(gpointer object, GVariant *value) {
+    ((Adapter *) object)->discoverable = g_variant_get_boolean(value);
+}
+
+// Signals trigger callbacks, the initial load only stores the values
+static const PropertyHandlerEntry adapter_changed_handlers[] = {
+        {ADAPTER_PROPERTY_POWERED,      "b", adapter_powered_changed},
+        {ADAPTER_PROPERTY_DISCOVERING,  "b", adapter_discovering_changed},
+        {ADAPTER_PROPERTY_DISCOVERABLE, "b", adapter_update_discoverable},
+};
+
+static const PropertyHandlerEntry adapter_property_handlers[] = {
+        {ADAPTER_PROPERTY_ADDRESS,      "s", adapter_update_address},
+        {ADAPTER_PROPERTY_POWERED,      "b", adapter_update_powered},
+        {ADAPTER_PROPERTY_DISCOVERING,  "b", adapter_update_discovering},
+        {ADAPTER_PROPERTY_DISCOVERABLE, "b", adapter_update_discoverable},
+};
+
+static PropertyDispatcher adapter_changed_dispatcher = BINC_PROPERTY_DISPATCHER(adapter_changed_handlers);
+
+static PropertyDispatcher adapter_property_dispatcher = BINC_PROPERTY_DISPATCHER(adapter_property_handlers);
+
 static void binc_internal_adapter_changed(__attribute__((unused)) GDBusConnection *conn,
                                           __attribute__((unused)) const gchar *sender,
                                           __attribute__((unused)) const gchar *path,
@@ -212,22 +376,7 @@ static void binc_internal_adapter_changed(__attribute__((unused)) GDBusConnectio
     g_assert(g_str_equal(g_variant_get_type_string(parameters), "(sa{sv}as)"));
     g_variant_get(parameters, "(&sa{sv}as)", &iface, &properties_changed, &properties_invalidated);
     while (g_variant_iter_loop(properties_changed, "{&sv}", &property_name, &property_value)) {
-        if (g_str_equal(property_name, ADAPTER_PROPERTY_POWERED)) {
-            adapter->powered = g_variant_get_boolean(property_value);
-            if (adapter->poweredStateCallback != NULL) {
-                adapter->poweredStateCallback(adapter, adapter->powered);
-            }
-        } else if (g_str_equal(property_name, ADAPTER_PROPERTY_DISCOVERING)) {
-            adapter->discovering = g_variant_get_boolean(property_value);
-
-            // It could be that some other app is causing discovery to be stopped, e.g. power off
-            if (adapter->discovering == FALSE) {
-                // Update discovery state to reflect discovery state
-                binc_internal_set_discovery_state(adapter, BINC_DISCOVERY_STOPPED);
-            }
-        } else if (g_str_equal(property_name, ADAPTER_PROPERTY_DISCOVERABLE)) {
-            adapter->discoverable = g_variant_get_boolean(property_value);
-        }
+        binc_property_dispatch(&adapter_changed_dispatcher, adapter, property_name, property_value);
     }
 
     if (properties_changed != NULL)
@@ -241,7 +390,8 @@ static gboolean matches_discovery_filter(Adapter *adapter, Device *device) {
     g_assert(adapter != NULL);
     g_assert(device != NULL);
 
-    if (binc_device_get_rssi(device) < adapter->discovery_filter.rssi) return FALSE;
+    // Use the smoothed value like reporting does, so a device near the threshold doesn't flip on every sample
+    if (binc_device_get_smoothed_rssi(device) < adapter->discovery_filter.rssi) return FALSE;
 
     const char *pattern = adapter->discovery_filter.pattern;
     if (pattern != NULL) {
@@ -250,14 +400,13 @@ static gboolean matches_discovery_filter(Adapter *adapter, Device *device) {
             return FALSE;
     }
 
-    GPtrArray *services_filter = adapter->discovery_filter.services;
-    if (services_filter != NULL) {
-        guint count = services_filter->len;
-        if (count == 0) return TRUE;
+    GHashTable *services_filter = adapter->discovery_filter.services;
+    if (services_filter != NULL && g_hash_table_size(services_filter) > 0) {
+        const GArray *uuids = binc_internal_device_get_binary_uuids(device);
+        if (uuids == NULL) return FALSE;
 
-        for (guint i = 0; i < count; i++) {
-            const char *uuid_filter = g_ptr_array_index(services_filter, i);
-            if (binc_device_has_service(device, uuid_filter)) {
+        for (guint i = 0; i < uuids->len; i++) {
+            if (g_hash_table_contains(services_filter, &g_array_index(uuids, BincUuid, i))) {
                 return TRUE;
             }
         }
@@ -266,18 +415,390 @@ static gboolean matches_discovery_filter(Adapter *adapter, Device *device) {
     return TRUE;
 }
 
+static void scan_stats_record_callback(Adapter *adapter, gint64 start) {
+    guint64 duration = (guint64) (g_get_monotonic_time() - start);
+    AdapterScanStats *stats = &adapter->scan_stats;
+    stats->callbacks++;
+    stats->callback_time_total_us += duration;
+    stats->callback_time_max_us = MAX(stats->callback_time_max_us, duration);
+
+    guint bucket = 0;
+    guint64 bound = 4;
+    while (bucket < BINC_SCAN_STATS_HISTOGRAM_BUCKETS - 1 && duration >= bound) {
+        bucket++;
+        bound *= 4;
+    }
+    stats->callback_time_histogram[bucket]++;
+}
+
+static gboolean discovery_batch_flush(gpointer user_data) {
+    Adapter *adapter = (Adapter *) user_data;
+    g_assert(adapter != NULL);
+
+    if (adapter->discovery_state != BINC_DISCOVERY_STARTED) {
+        adapter->batch_timeout_id = 0;
+        discovery_batch_clear(adapter);
+        return G_SOURCE_REMOVE;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gint64 min_interval = (gint64) adapter->batch_min_interval_ms * G_TIME_SPAN_MILLISECOND;
+
+    // Collect the devices that are due, devices that are rate limited stay queued for the next tick
+    g_ptr_array_set_size(adapter->batch_result, 0);
+    guint kept = 0;
+    for (guint i = 0; i < adapter->batch_queue->len; i++) {
+        Device *device = g_ptr_array_index(adapter->batch_queue, i);
+        gint64 *last_delivered = g_hash_table_lookup(adapter->batch_last_delivered, device);
+        if (last_delivered != NULL && now - *last_delivered < min_interval) {
+            g_ptr_array_index(adapter->batch_queue, kept++) = device;
+            continue;
+        }
+
+        g_hash_table_remove(adapter->batch_queued, device);
+        if (binc_device_get_connection_state(device) != BINC_DISCONNECTED) continue;
+
+        if (last_delivered == NULL) {
+            last_delivered = g_new0(gint64, 1);
+            g_hash_table_insert(adapter->batch_last_delivered, device, last_delivered);
+        }
+        *last_delivered = now;
+        g_ptr_array_add(adapter->batch_result, device);
+    }
+    g_ptr_array_set_size(adapter->batch_queue, (gint) kept);
+
+    if (adapter->batch_result->len > 0) {
+        adapter->scan_stats.results_delivered += adapter->batch_result->len;
+        if (adapter->scan_aggregator != NULL) {
+            for (guint i = 0; i < adapter->batch_result->len; i++) {
+                binc_internal_scan_aggregator_result(adapter->scan_aggregator, g_ptr_array_index(adapter->batch_result, i));
+            }
+        }
+        if (adapter->discoveryBatchCallback != NULL) {
+            gint64 start = g_get_monotonic_time();
+            adapter->discoveryBatchCallback(adapter, adapter->batch_result);
+            scan_stats_record_callback(adapter, start);
+        } else if (adapter->discoveryResultCallback != NULL) {
+            for (guint i = 0; i < adapter->batch_result->len; i++) {
+                gint64 start = g_get_monotonic_time();
+                adapter->discoveryResultCallback(adapter, g_ptr_array_index(adapter->batch_result, i));
+                scan_stats_record_callback(adapter, start);
+            }
+        }
+        g_ptr_array_set_size(adapter->batch_result, 0);
+    }
+
+    if (adapter->batch_queue->len == 0) {
+        adapter->batch_timeout_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void discovery_batch_add_device(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    // The device object always holds the latest state, so queueing it once per window is enough
+    if (!g_hash_table_contains(adapter->batch_queued, device)) {
+        g_hash_table_add(adapter->batch_queued, device);
+        g_ptr_array_add(adapter->batch_queue, device);
+    }
+
+    if (adapter->batch_timeout_id == 0) {
+        adapter->batch_timeout_id = binc_timeout_add(adapter->batch_window_ms, discovery_batch_flush, adapter);
+    }
+}
+
+static void discovery_batch_remove_device(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    if (adapter->batch_queue == NULL) return;
+
+    if (g_hash_table_remove(adapter->batch_queued, device)) {
+        g_ptr_array_remove(adapter->batch_queue, device);
+    }
+    g_hash_table_remove(adapter->batch_last_delivered, device);
+}
+
+static void discovery_batch_clear(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    if (adapter->batch_timeout_id != 0) {
+        binc_source_remove(adapter->batch_timeout_id);
+        adapter->batch_timeout_id = 0;
+    }
+
+    if (adapter->batch_queue != NULL) {
+        g_ptr_array_set_size(adapter->batch_queue, 0);
+        g_hash_table_remove_all(adapter->batch_queued);
+    }
+}
+
+static void discovery_batch_free(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    if (adapter->batch_timeout_id != 0) {
+        binc_source_remove(adapter->batch_timeout_id);
+        adapter->batch_timeout_id = 0;
+    }
+
+    if (adapter->batch_queue != NULL) {
+        g_ptr_array_free(adapter->batch_queue, TRUE);
+        adapter->batch_queue = NULL;
+    }
+
+    if (adapter->batch_result != NULL) {
+        g_ptr_array_free(adapter->batch_result, TRUE);
+        adapter->batch_result = NULL;
+    }
+
+    if (adapter->batch_queued != NULL) {
+        g_hash_table_destroy(adapter->batch_queued);
+        adapter->batch_queued = NULL;
+    }
+
+    if (adapter->batch_last_delivered != NULL) {
+        g_hash_table_destroy(adapter->batch_last_delivered);
+        adapter->batch_last_delivered = NULL;
+    }
+}
+
 static void deliver_discovery_result(Adapter *adapter, Device *device) {
     g_assert(adapter != NULL);
     g_assert(device != NULL);
 
     if (binc_device_get_connection_state(device) == BINC_DISCONNECTED) {
         // Double check if the device matches the discovery filter
-        if (!matches_discovery_filter(adapter, device)) return;
+        if (!matches_discovery_filter(adapter, device)) {
+            adapter->scan_stats.results_filtered++;
+            return;
+        }
 
+        if (adapter->batch_window_ms > 0) {
+            discovery_batch_add_device(adapter, device);
+            return;
+        }
+
+        adapter->scan_stats.results_delivered++;
+        if (adapter->scan_aggregator != NULL) {
+            binc_internal_scan_aggregator_result(adapter->scan_aggregator, device);
+        }
         if (adapter->discoveryResultCallback != NULL) {
+            gint64 start = g_get_monotonic_time();
             adapter->discoveryResultCallback(adapter, device);
+            scan_stats_record_callback(adapter, start);
+        }
+    }
+}
+
+static gboolean is_pinned(const Device *device) {
+    return binc_device_get_connection_state(device) != BINC_DISCONNECTED ||
+           binc_device_get_bonding_state(device) == BINC_BONDED;
+}
+
+static void address_index_add(Adapter *adapter, Device *device) {
+    guint64 *key = g_new(guint64, 1);
+    *key = binc_address_pack(binc_device_get_binary_address(device));
+    g_hash_table_insert(adapter->devices_by_address, key, device);
+}
+
+static void address_index_remove(Adapter *adapter, guint64 key, const Device *device) {
+    if (g_hash_table_lookup(adapter->devices_by_address, &key) == device) {
+        g_hash_table_remove(adapter->devices_by_address, &key);
+    }
+}
+
+void binc_internal_adapter_device_address_changed(Adapter *adapter, Device *device, guint64 old_address_key) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    // Devices that are not cached yet are indexed when they are added
+    if (g_hash_table_lookup(adapter->devices_cache, binc_device_get_path(device)) != device) return;
+
+    address_index_remove(adapter, old_address_key, device);
+    address_index_add(adapter, device);
+}
+
+static void adapter_cache_touch(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    CacheEntry *entry = g_hash_table_lookup(adapter->cache_entries, device);
+    if (entry == NULL) return;
+
+    entry->last_seen = g_get_monotonic_time();
+    if (entry->pinned) return;
+
+    g_queue_unlink(&adapter->cache_lru, &entry->link);
+    g_queue_push_tail_link(&adapter->cache_lru, &entry->link);
+}
+
+static void adapter_cache_update_pinned(Adapter *adapter, Device *device) {
+    CacheEntry *entry = g_hash_table_lookup(adapter->cache_entries, device);
+    if (entry == NULL) return;
+
+    gboolean pinned = is_pinned(device);
+    if (pinned == entry->pinned) return;
+
+    entry->pinned = pinned;
+    if (pinned) {
+        g_queue_unlink(&adapter->cache_lru, &entry->link);
+    } else {
+        // The idle time of a device that was just released starts now
+        entry->last_seen = g_get_monotonic_time();
+        g_queue_push_tail_link(&adapter->cache_lru, &entry->link);
+    }
+}
+
+static void adapter_cache_make_room(Adapter *adapter);
+
+static void adapter_cache_add(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    adapter_cache_make_room(adapter);
+    adapter->scan_stats.devices_created++;
+    g_hash_table_insert(adapter->devices_cache, g_strdup(binc_device_get_path(device)), device);
+    address_index_add(adapter, device);
+    if (binc_device_get_connection_state(device) == BINC_CONNECTED) {
+        g_hash_table_add(adapter->connected_devices, device);
+    }
+
+    CacheEntry *entry = g_new0(CacheEntry, 1);
+    entry->link.data = device;
+    entry->last_seen = g_get_monotonic_time();
+    entry->pinned = is_pinned(device);
+    g_hash_table_insert(adapter->cache_entries, device, entry);
+    if (!entry->pinned) {
+        g_queue_push_tail_link(&adapter->cache_lru, &entry->link);
+    }
+}
+
+static void adapter_cache_remove(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    discovery_batch_remove_device(adapter, device);
+    g_hash_table_remove(adapter->connected_devices, device);
+    if (adapter->connection_manager != NULL) {
+        binc_internal_connection_manager_device_removed(adapter->connection_manager, device);
+    }
+    if (adapter->poll_scheduler != NULL) {
+        binc_internal_poll_scheduler_device_removed(adapter->poll_scheduler, device);
+    }
+    if (adapter->scan_aggregator != NULL) {
+        binc_internal_scan_aggregator_device_removed(adapter->scan_aggregator, device);
+    }
+    address_index_remove(adapter, binc_address_pack(binc_device_get_binary_address(device)), device);
+
+    CacheEntry *entry = g_hash_table_lookup(adapter->cache_entries, device);
+    if (entry != NULL) {
+        if (!entry->pinned) {
+            g_queue_unlink(&adapter->cache_lru, &entry->link);
+        }
+        g_hash_table_remove(adapter->cache_entries, device);
+    }
+
+    // Frees the device
+    g_hash_table_remove(adapter->devices_cache, binc_device_get_path(device));
+}
+
+static void adapter_cache_evict(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    log_debug(TAG, "evicting %s from device cache", binc_device_get_path(device));
+    adapter->scan_stats.devices_evicted++;
+    if (adapter->deviceEvictedCallback != NULL) {
+        adapter->deviceEvictedCallback(adapter, device);
+    }
+
+    if (adapter->cache_remove_from_bluez) {
+        binc_adapter_remove_device(adapter, device);
+    }
+    adapter_cache_remove(adapter, device);
+}
+
+static void adapter_cache_evict_above(Adapter *adapter, guint limit) {
+    g_assert(adapter != NULL);
+
+    // The evicted callback may remove other devices, so start from the head again after every eviction
+    while (adapter->cache_lru.head != NULL && g_hash_table_size(adapter->devices_cache) > limit) {
+        Device *device = adapter->cache_lru.head->data;
+        if (is_pinned(device)) {
+            adapter_cache_update_pinned(adapter, device);
+            continue;
+        }
+        adapter_cache_evict(adapter, device);
+    }
+}
+
+static void adapter_cache_make_room(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    if (adapter->cache_max_devices == 0) return;
+    adapter_cache_evict_above(adapter, adapter->cache_max_devices - 1);
+}
+
+static gboolean adapter_cache_sweep(gpointer user_data) {
+    Adapter *adapter = (Adapter *) user_data;
+    g_assert(adapter != NULL);
+
+    gint64 now = g_get_monotonic_time();
+    gint64 ttl = (gint64) adapter->cache_idle_ttl_seconds * G_TIME_SPAN_SECOND;
+    while (adapter->cache_lru.head != NULL) {
+        CacheEntry *entry = (CacheEntry *) adapter->cache_lru.head;
+        if (now - entry->last_seen < ttl) break;
+
+        Device *device = entry->link.data;
+        if (is_pinned(device)) {
+            adapter_cache_update_pinned(adapter, device);
+            continue;
         }
+        adapter_cache_evict(adapter, device);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static guint proximity_zone(const Adapter *adapter, short rssi) {
+    guint zone = 0;
+    while (zone < adapter->proximity_zones->len && rssi < g_array_index(adapter->proximity_zones, short, zone)) {
+        zone++;
+    }
+    return zone;
+}
+
+/**
+ * Decide whether an RSSI-only change is worth reporting and remember what was reported
+ */
+static gboolean is_rssi_change_reportable(Adapter *adapter, Device *device, gboolean force) {
+    short rssi = binc_device_get_smoothed_rssi(device);
+    guint zone = adapter->proximity_zones != NULL ? proximity_zone(adapter, rssi) : 0;
+
+    gboolean reportable = force || (adapter->rssi_report_delta == 0 && adapter->proximity_zones == NULL);
+    if (!reportable && adapter->rssi_report_delta > 0) {
+        reportable = (guint) ABS(rssi - binc_internal_device_get_reported_rssi(device)) >= adapter->rssi_report_delta;
+    }
+    if (!reportable && adapter->proximity_zones != NULL) {
+        reportable = zone != binc_device_get_proximity_zone(device);
+    }
+
+    if (reportable) {
+        binc_internal_device_set_reported_rssi(device, rssi, zone);
+    }
+    return reportable;
+}
+
+// BlueZ adds and removes the service objects of a resolved device when the device indicates Service Changed
+static void gatt_service_changed(Adapter *adapter, const char *service_path) {
+    char *device_path = g_path_get_dirname(service_path);
+    Device *device = g_hash_table_lookup(adapter->devices_cache, device_path);
+    if (device != NULL) {
+        binc_internal_device_gatt_changed(device);
     }
+    g_free(device_path);
 }
 
 static void binc_internal_device_disappeared(__attribute__((unused)) GDBusConnection *conn,
@@ -294,15 +815,19 @@ static void binc_internal_device_disappeared(__attribute__((unused)) GDBusConnec
 
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
+    adapter->scan_stats.signals_received++;
 
     g_assert(g_str_equal(g_variant_get_type_string(parameters), "(oas)"));
     g_variant_get(parameters, "(&oas)", &object, &interfaces);
     while (g_variant_iter_loop(interfaces, "s", &interface_name)) {
         if (g_str_equal(interface_name, INTERFACE_DEVICE)) {
             log_debug(TAG, "Device %s removed", object);
-            if (g_hash_table_lookup(adapter->devices_cache, object) != NULL) {
-                g_hash_table_remove(adapter->devices_cache, object);
+            Device *device = g_hash_table_lookup(adapter->devices_cache, object);
+            if (device != NULL) {
+                adapter_cache_remove(adapter, device);
             }
+        } else if (g_str_equal(interface_name, INTERFACE_GATT_SERVICE)) {
+            gatt_service_changed(adapter, object);
         }
     }
 
@@ -325,12 +850,18 @@ static void binc_internal_device_appeared(__attribute__((unused)) GDBusConnectio
 
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
+    adapter->scan_stats.signals_received++;
 
     g_assert(g_str_equal(g_variant_get_type_string(parameters), "(oa{sa{sv}})"));
     g_variant_get(parameters, "(&oa{sa{sv}})", &object, &interfaces);
     while (g_variant_iter_loop(interfaces, "{&s@a{sv}}", &interface_name, &properties)) {
         if (g_str_equal(interface_name, INTERFACE_DEVICE)) {
-            Device *device = binc_device_create(object, adapter);
+            // Reuse an existing device so pointers handed out earlier stay valid
+            Device *device = g_hash_table_lookup(adapter->devices_cache, object);
+            if (device == NULL) {
+                device = binc_device_create(object, adapter);
+                adapter_cache_add(adapter, device);
+            }
 
             char *property_name = NULL;
             GVariantIter iter;
@@ -339,10 +870,12 @@ static void binc_internal_device_appeared(__attribute__((unused)) GDBusConnectio
             while (g_variant_iter_loop(&iter, "{&sv}", &property_name, &property_value)) {
                 binc_internal_device_update_property(device, property_name, property_value);
             }
-
-            g_hash_table_insert(adapter->devices_cache,
-                                g_strdup(binc_device_get_path(device)),
-                                device);
+            adapter->scan_stats.signals_decoded++;
+            binc_internal_device_set_restored(device, FALSE);
+            binc_internal_device_count_advertisement(device);
+            adapter_cache_touch(adapter, device);
+            binc_internal_device_take_changes(device);
+            is_rssi_change_reportable(adapter, device, TRUE);
 
             if (adapter->discovery_state == BINC_DISCOVERY_STARTED && binc_device_get_connection_state(device) == BINC_DISCONNECTED) {
                 deliver_discovery_result(adapter, device);
@@ -356,6 +889,8 @@ static void binc_internal_device_appeared(__attribute__((unused)) GDBusConnectio
                     adapter->centralStateCallback(adapter, device);
                 }
             }
+        } else if (g_str_equal(interface_name, INTERFACE_GATT_SERVICE)) {
+            gatt_service_changed(adapter, object);
         }
     }
 
@@ -363,21 +898,42 @@ static void binc_internal_device_appeared(__attribute__((unused)) GDBusConnectio
         g_variant_iter_free(interfaces);
 }
 
-static void binc_internal_device_getall_properties_cb(__attribute__((unused)) GObject *source_object,
+typedef struct getall_data {
+    Adapter *adapter;
+    char *path;
+} GetAllData;
+
+static void binc_internal_device_getall_properties_cb(GObject *source_object,
                                                       GAsyncResult *res,
                                                       gpointer user_data) {
 
-    Device *device = (Device *) user_data;
-    g_assert(device != NULL);
+    GetAllData *data = (GetAllData *) user_data;
+    g_assert(data != NULL);
 
     GError *error = NULL;
-    GVariant *result = g_dbus_connection_call_finish(binc_device_get_dbus_connection(device), res, &error);
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        g_free(data->path);
+        g_free(data);
+        return;
+    }
 
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", "GetAll", error->code, error->message);
         g_clear_error(&error);
     }
 
+    // The device may have been evicted or removed while the call was pending
+    Device *device = g_hash_table_lookup(data->adapter->devices_cache, data->path);
+    g_free(data->path);
+    g_free(data);
+    if (device == NULL) {
+        if (result != NULL) g_variant_unref(result);
+        return;
+    }
+
     if (result != NULL) {
         GVariantIter *iter = NULL;
         const char *property_name = NULL;
@@ -397,6 +953,9 @@ static void binc_internal_device_getall_properties_cb(__attribute__((unused)) GO
 }
 
 static void binc_internal_device_getall_properties(Adapter *adapter, Device *device) {
+    GetAllData *data = g_new0(GetAllData, 1);
+    data->adapter = adapter;
+    data->path = g_strdup(binc_device_get_path(device));
     g_dbus_connection_call(adapter->connection,
                            BLUEZ_DBUS,
                            binc_device_get_path(device),
@@ -405,13 +964,38 @@ static void binc_internal_device_getall_properties(Adapter *adapter, Device *dev
                            g_variant_new("(s)", INTERFACE_DEVICE),
                            G_VARIANT_TYPE("(a{sv})"),
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
                            (GAsyncReadyCallback) binc_internal_device_getall_properties_cb,
-                           device);
+                           data);
 }
 
 
+static void binc_internal_load_device_from_tree(Adapter *adapter, const ObjectTree *tree, const char *path);
+
+Device *binc_internal_adapter_find_or_load_device(Adapter *adapter, const char *path) {
+    g_assert(adapter != NULL);
+    g_assert(path != NULL);
+
+    Device *device = g_hash_table_lookup(adapter->devices_cache, path);
+    if (device != NULL) {
+        adapter_cache_touch(adapter, device);
+        return device;
+    }
+
+    // Prefer a seeded mirror, only ask BlueZ when the object is not in it yet
+    ObjectTree *tree = binc_signal_dispatcher_get_object_tree(adapter->connection);
+    if (tree != NULL && binc_object_tree_has_interface(tree, path, INTERFACE_DEVICE)) {
+        binc_internal_load_device_from_tree(adapter, tree, path);
+        return g_hash_table_lookup(adapter->devices_cache, path);
+    }
+
+    device = binc_device_create(path, adapter);
+    adapter_cache_add(adapter, device);
+    binc_internal_device_getall_properties(adapter, device);
+    return device;
+}
+
 static void binc_internal_device_changed(__attribute__((unused)) GDBusConnection *conn,
                                          __attribute__((unused)) const gchar *sender,
                                          const gchar *path,
@@ -428,15 +1012,15 @@ static void binc_internal_device_changed(__attribute__((unused)) GDBusConnection
 
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
+    adapter->scan_stats.signals_received++;
 
     Device *device = g_hash_table_lookup(adapter->devices_cache, path);
     if (device == NULL) {
-        device = binc_device_create(path, adapter);
-        g_hash_table_insert(adapter->devices_cache, g_strdup(binc_device_get_path(device)), device);
-        binc_internal_device_getall_properties(adapter, device);
+        binc_internal_adapter_find_or_load_device(adapter, path);
     } else {
-        gboolean isDiscoveryResult = FALSE;
+        gboolean isAdvertisement = FALSE;
         ConnectionState oldState = binc_device_get_connection_state(device);
+        binc_internal_device_take_changes(device);
         g_assert(g_str_equal(g_variant_get_type_string(parameters), "(sa{sv}as)"));
         g_variant_get(parameters, "(&sa{sv}as)", &iface, &properties_changed, &properties_invalidated);
         while (g_variant_iter_loop(properties_changed, "{&sv}", &property_name, &property_value)) {
@@ -444,9 +1028,30 @@ static void binc_internal_device_changed(__attribute__((unused)) GDBusConnection
             if (g_str_equal(property_name, DEVICE_PROPERTY_RSSI) ||
                 g_str_equal(property_name, DEVICE_PROPERTY_MANUFACTURER_DATA) ||
                 g_str_equal(property_name, DEVICE_PROPERTY_SERVICE_DATA)) {
-                isDiscoveryResult = TRUE;
+                isAdvertisement = TRUE;
             }
         }
+        adapter->scan_stats.signals_decoded++;
+        if (binc_device_is_restored(device)) {
+            // Only part of the properties changed, fetch the rest to replace what came from the snapshot
+            binc_internal_device_set_restored(device, FALSE);
+            binc_internal_device_getall_properties(adapter, device);
+        }
+        if (isAdvertisement) {
+            binc_internal_device_count_advertisement(device);
+            adapter_cache_touch(adapter, device);
+        }
+
+        // Repeated advertisements with identical content are not reported again, RSSI-only changes are subject
+        // to the report delta and proximity zones
+        guint changes = binc_internal_device_take_changes(device);
+        gboolean isDiscoveryResult = FALSE;
+        if (changes & (BINC_DEVICE_CHANGED_MANUFACTURER_DATA | BINC_DEVICE_CHANGED_SERVICE_DATA)) {
+            isDiscoveryResult = TRUE;
+            is_rssi_change_reportable(adapter, device, TRUE);
+        } else if (changes & BINC_DEVICE_CHANGED_RSSI) {
+            isDiscoveryResult = is_rssi_change_reportable(adapter, device, FALSE);
+        }
         if (adapter->discovery_state == BINC_DISCOVERY_STARTED && isDiscoveryResult) {
             deliver_discovery_result(adapter, device);
         }
@@ -472,17 +1077,17 @@ static void binc_internal_device_changed(__attribute__((unused)) GDBusConnection
         g_variant_iter_free(properties_invalidated);
 }
 
+static void binc_internal_object_tree_seeded(ObjectTree *tree, gpointer user_data);
+
 static void setup_signal_subscribers(Adapter *adapter) {
-    adapter->device_prop_changed = g_dbus_connection_signal_subscribe(adapter->connection,
-                                                                      BLUEZ_DBUS,
-                                                                      INTERFACE_PROPERTIES,
-                                                                      SIGNAL_PROPERTIES_CHANGED,
-                                                                      NULL,
-                                                                      INTERFACE_DEVICE,
-                                                                      G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                      binc_internal_device_changed,
-                                                                      adapter,
-                                                                      NULL);
+    // Device signals come in through the shared dispatcher, which only routes objects under our path to us
+    ObjectSignalHandlers handlers = {
+            .properties_changed = binc_internal_device_changed,
+            .interfaces_added = binc_internal_device_appeared,
+            .interfaces_removed = binc_internal_device_disappeared,
+            .seeded = binc_internal_object_tree_seeded
+    };
+    binc_signal_dispatcher_register(adapter->connection, adapter->path, &handlers, adapter);
 
     adapter->adapter_prop_changed = g_dbus_connection_signal_subscribe(adapter->connection,
                                                                        BLUEZ_DBUS,
@@ -494,28 +1099,6 @@ static void setup_signal_subscribers(Adapter *adapter) {
                                                                        binc_internal_adapter_changed,
                                                                        adapter,
                                                                        NULL);
-
-    adapter->iface_added = g_dbus_connection_signal_subscribe(adapter->connection,
-                                                              BLUEZ_DBUS,
-                                                              INTERFACE_OBJECT_MANAGER,
-                                                              "InterfacesAdded",
-                                                              NULL,
-                                                              NULL,
-                                                              G_DBUS_SIGNAL_FLAGS_NONE,
-                                                              binc_internal_device_appeared,
-                                                              adapter,
-                                                              NULL);
-
-    adapter->iface_removed = g_dbus_connection_signal_subscribe(adapter->connection,
-                                                                BLUEZ_DBUS,
-                                                                INTERFACE_OBJECT_MANAGER,
-                                                                "InterfacesRemoved",
-                                                                NULL,
-                                                                NULL,
-                                                                G_DBUS_SIGNAL_FLAGS_NONE,
-                                                                binc_internal_device_disappeared,
-                                                                adapter,
-                                                                NULL);
 }
 
 const char *binc_adapter_get_name(const Adapter *adapter) {
@@ -529,7 +1112,7 @@ const char *binc_adapter_get_address(const Adapter *adapter) {
     return adapter->address;
 }
 
-static Adapter *binc_adapter_create(GDBusConnection *connection, const char *path) {
+Adapter *binc_adapter_create(GDBusConnection *connection, const char *path) {
     g_assert(connection != NULL);
     g_assert(path != NULL);
     g_assert(strlen(path) > 0);
@@ -540,148 +1123,340 @@ static Adapter *binc_adapter_create(GDBusConnection *connection, const char *pat
     adapter->discovery_filter.rssi = -255;
     adapter->devices_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
                                                    g_free, (GDestroyNotify) binc_device_free);
+    adapter->devices_by_address = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    adapter->connected_devices = g_hash_table_new(g_direct_hash, g_direct_equal);
+    adapter->cache_entries = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    g_queue_init(&adapter->cache_lru);
+    adapter->scan_stats_since = g_get_monotonic_time();
+    adapter->cancellable = g_cancellable_new();
+    adapter->call_timeout_ms = -1;
     adapter->user_data = NULL;
     setup_signal_subscribers(adapter);
     return adapter;
 }
 
-static Adapter *binc_internal_get_adapter_by_path(GPtrArray *adapters, const char *path) {
-    g_assert(adapters != NULL);
-    g_assert(path != NULL);
-    g_assert(strlen(path) > 0);
+static gboolean is_device_of_adapter(const Adapter *adapter, const char *device_path) {
+    size_t length = strlen(adapter->path);
+    return strncmp(device_path, adapter->path, length) == 0 && device_path[length] == '/';
+}
 
-    for (guint i = 0; i < adapters->len; i++) {
-        Adapter *adapter = g_ptr_array_index(adapters, i);
-        const char *adapter_path = binc_adapter_get_path(adapter);
-        if (g_str_has_prefix(path, adapter_path)) {
-            return adapter;
-        }
-    }
-    return NULL;
+static void binc_internal_adapter_update_properties(Adapter *adapter, GVariant *properties) {
+    binc_property_dispatch_all(&adapter_property_dispatcher, adapter, properties);
 }
 
-GPtrArray *binc_adapter_find_all(GDBusConnection *dbusConnection) {
-    g_assert(dbusConnection != NULL);
+typedef struct adapter_tree_walk {
+    GDBusConnection *connection; // Borrowed
+    const ObjectTree *tree; // Borrowed
+    GPtrArray *adapters; // Borrowed
+} AdapterTreeWalk;
 
-    GPtrArray *binc_adapters = g_ptr_array_new();
-    log_debug(TAG, "finding adapters");
+static void binc_internal_create_adapter_from_tree(const char *path, gpointer user_data) {
+    AdapterTreeWalk *walk = (AdapterTreeWalk *) user_data;
 
-    GError *error = NULL;
-    GVariant *result = g_dbus_connection_call_sync(dbusConnection,
-                                                   BLUEZ_DBUS,
-                                                   "/",
+    GVariant *properties = binc_object_tree_get_properties(walk->tree, path, INTERFACE_ADAPTER);
+    if (properties != NULL) {
+        Adapter *adapter = binc_adapter_create(walk->connection, path);
+        binc_internal_adapter_update_properties(adapter, properties);
+        g_ptr_array_add(walk->adapters, adapter);
+    }
+}
+
+/**
+ * Create the adapters, without their devices, from an object tree
+ */
+static GPtrArray *binc_internal_create_adapters(GDBusConnection *dbusConnection, const ObjectTree *tree) {
+    GPtrArray *binc_adapters = g_ptr_array_new();
+    AdapterTreeWalk walk = {.connection = dbusConnection, .tree = tree, .adapters = binc_adapters};
+    binc_object_tree_foreach_child(tree, BLUEZ_PATH, binc_internal_create_adapter_from_tree, &walk);
+    return binc_adapters;
+}
+
+/**
+ * Build a throwaway tree from a GetManagedObjects result, used as long as the mirror isn't seeded
+ */
+static ObjectTree *binc_internal_create_snapshot(GVariant *result) {
+    ObjectTree *snapshot = binc_object_tree_create();
+    if (result != NULL) {
+        binc_object_tree_seed(snapshot, result);
+    }
+    return snapshot;
+}
+
+static void binc_internal_load_device_from_tree(Adapter *adapter, const ObjectTree *tree, const char *path) {
+    GVariant *properties = binc_object_tree_get_properties(tree, path, INTERFACE_DEVICE);
+    if (properties == NULL) return;
+
+    // Devices restored from a snapshot are refreshed, other known devices are up to date already
+    Device *device = g_hash_table_lookup(adapter->devices_cache, path);
+    if (device != NULL && !binc_device_is_restored(device)) return;
+
+    if (device == NULL) {
+        device = binc_device_create(path, adapter);
+        adapter_cache_add(adapter, device);
+    }
+    binc_internal_device_set_restored(device, FALSE);
+
+    char *property_name;
+    GVariantIter iter;
+    GVariant *property_value;
+    g_variant_iter_init(&iter, properties);
+    while (g_variant_iter_loop(&iter, "{&sv}", &property_name, &property_value)) {
+        binc_internal_device_update_property(device, property_name, property_value);
+    }
+    log_debug(TAG, "found device %s '%s'", path, binc_device_get_name(device));
+}
+
+typedef struct device_tree_walk {
+    Adapter *adapter; // Borrowed
+    const ObjectTree *tree; // Borrowed
+} DeviceTreeWalk;
+
+static void binc_internal_load_device_from_walk(const char *path, gpointer user_data) {
+    DeviceTreeWalk *walk = (DeviceTreeWalk *) user_data;
+    binc_internal_load_device_from_tree(walk->adapter, walk->tree, path);
+}
+
+/**
+ * Create the devices of an adapter from an object tree
+ */
+static void binc_internal_adapter_load_devices(Adapter *adapter, const ObjectTree *tree) {
+    DeviceTreeWalk walk = {.adapter = adapter, .tree = tree};
+    binc_object_tree_foreach_child(tree, adapter->path, binc_internal_load_device_from_walk, &walk);
+}
+
+/**
+ * Get the tree to find adapters and devices in. That is the mirror once it is seeded, otherwise a snapshot
+ * of GetManagedObjects which is also returned in snapshot and must be freed by the caller.
+ */
+static const ObjectTree *binc_internal_get_object_tree_sync(GDBusConnection *dbusConnection,
+                                                            ObjectTree **snapshot) {
+    const ObjectTree *tree = binc_signal_dispatcher_get_object_tree(dbusConnection);
+    if (tree != NULL) return tree;
+
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_sync(dbusConnection,
+                                                   BLUEZ_DBUS,
+                                                   "/",
                                                    INTERFACE_OBJECT_MANAGER,
                                                    "GetManagedObjects",
                                                    NULL,
                                                    G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
                                                    G_DBUS_CALL_FLAGS_NONE,
-                                                   -1,
+                                                   OBJECT_MANAGER_CALL_TIMEOUT_MS,
                                                    NULL,
                                                    &error);
 
-    if (result) {
-        GVariantIter *iter;
-        const char *object_path;
-        GVariant *ifaces_and_properties;
-
-        g_assert(g_str_equal(g_variant_get_type_string(result), "(a{oa{sa{sv}}})"));
-        g_variant_get(result, "(a{oa{sa{sv}}})", &iter);
-        while (g_variant_iter_loop(iter, "{&o@a{sa{sv}}}", &object_path, &ifaces_and_properties)) {
-            const char *interface_name;
-            GVariant *properties;
-            GVariantIter iter2;
-
-            g_variant_iter_init(&iter2, ifaces_and_properties);
-            while (g_variant_iter_loop(&iter2, "{&s@a{sv}}", &interface_name, &properties)) {
-                if (g_str_equal(interface_name, INTERFACE_ADAPTER)) {
-                    Adapter *adapter = binc_adapter_create(dbusConnection, object_path);
-                    char *property_name;
-                    GVariantIter iter3;
-                    GVariant *property_value;
-                    g_variant_iter_init(&iter3, properties);
-                    while (g_variant_iter_loop(&iter3, "{&sv}", &property_name, &property_value)) {
-                        if (g_str_equal(property_name, ADAPTER_PROPERTY_ADDRESS)) {
-                            adapter->address = g_strdup(g_variant_get_string(property_value, NULL));
-                        } else if (g_str_equal(property_name, ADAPTER_PROPERTY_POWERED)) {
-                            adapter->powered = g_variant_get_boolean(property_value);
-                        } else if (g_str_equal(property_name, ADAPTER_PROPERTY_DISCOVERING)) {
-                            adapter->discovering = g_variant_get_boolean(property_value);
-                        } else if (g_str_equal(property_name, ADAPTER_PROPERTY_DISCOVERABLE)) {
-                            adapter->discoverable = g_variant_get_boolean(property_value);
-                        }
-                    }
-                    g_ptr_array_add(binc_adapters, adapter);
-                } else if (g_str_equal(interface_name, INTERFACE_DEVICE)) {
-                    Adapter *adapter = binc_internal_get_adapter_by_path(binc_adapters, object_path);
-                    Device *device = binc_device_create(object_path, adapter);
-                    g_hash_table_insert(adapter->devices_cache, g_strdup(binc_device_get_path(device)), device);
-
-                    char *property_name;
-                    GVariantIter iter4;
-                    GVariant *property_value;
-                    g_variant_iter_init(&iter4, properties);
-                    while (g_variant_iter_loop(&iter4, "{&sv}", &property_name, &property_value)) {
-                        binc_internal_device_update_property(device, property_name, property_value);
-                    }
-                    log_debug(TAG, "found device %s '%s'", object_path, binc_device_get_name(device));
-                }
-            }
-        }
+    if (error != NULL) {
+        log_error(TAG, "Error GetManagedObjects: %s", error->message);
+        g_clear_error(&error);
+    }
 
-        if (iter != NULL) {
-            g_variant_iter_free(iter);
-        }
+    *snapshot = binc_internal_create_snapshot(result);
+    if (result != NULL) {
         g_variant_unref(result);
     }
+    return *snapshot;
+}
 
-    if (error != NULL) {
-        log_error(TAG, "Error GetManagedObjects: %s", error->message);
-        g_clear_error(&error);
+/**
+ * Pick one adapter by name, or the first one if name is NULL, and free all others before loading any devices
+ */
+static Adapter *binc_internal_pick_adapter(GPtrArray *adapters, const char *name, const ObjectTree *tree) {
+    Adapter *picked = NULL;
+    for (guint i = 0; i < adapters->len; i++) {
+        Adapter *adapter = g_ptr_array_index(adapters, i);
+        if (picked == NULL && (name == NULL || g_str_equal(binc_adapter_get_name(adapter), name))) {
+            picked = adapter;
+        } else {
+            binc_adapter_free(adapter);
+        }
     }
+    g_ptr_array_free(adapters, TRUE);
 
-    log_debug(TAG, "found %d adapter%s", binc_adapters->len, binc_adapters->len > 1 ? "s" : "");
-    return binc_adapters;
+    if (picked != NULL) {
+        binc_internal_adapter_load_devices(picked, tree);
+    }
+    return picked;
 }
 
-Adapter *binc_adapter_get_default(GDBusConnection *dbusConnection) {
+static void binc_internal_load_all_devices(GPtrArray *adapters, const ObjectTree *tree) {
+    for (guint i = 0; i < adapters->len; i++) {
+        binc_internal_adapter_load_devices(g_ptr_array_index(adapters, i), tree);
+    }
+}
+
+GPtrArray *binc_adapter_find_all(GDBusConnection *dbusConnection) {
     g_assert(dbusConnection != NULL);
 
-    Adapter *adapter = NULL;
-    GPtrArray *adapters = binc_adapter_find_all(dbusConnection);
-    if (adapters->len > 0) {
-        // Choose the first one in the array, typically the 'hciX' with the highest X
-        adapter = g_ptr_array_index(adapters, 0);
+    log_debug(TAG, "finding adapters");
+    ObjectTree *snapshot = NULL;
+    const ObjectTree *tree = binc_internal_get_object_tree_sync(dbusConnection, &snapshot);
+    GPtrArray *binc_adapters = binc_internal_create_adapters(dbusConnection, tree);
+    binc_internal_load_all_devices(binc_adapters, tree);
+    if (snapshot != NULL) {
+        binc_object_tree_free(snapshot);
+    }
 
-        // Free any other adapters we are not going to use
-        for (guint i = 1; i < adapters->len; i++) {
-            binc_adapter_free(g_ptr_array_index(adapters, i));
-        }
-        g_ptr_array_free(adapters, TRUE);
+    log_debug(TAG, "found %d adapter%s", binc_adapters->len, binc_adapters->len > 1 ? "s" : "");
+    return binc_adapters;
+}
+
+static Adapter *binc_internal_get_adapter_sync(GDBusConnection *dbusConnection, const char *name) {
+    ObjectTree *snapshot = NULL;
+    const ObjectTree *tree = binc_internal_get_object_tree_sync(dbusConnection, &snapshot);
+    Adapter *adapter = binc_internal_pick_adapter(binc_internal_create_adapters(dbusConnection, tree), name, tree);
+    if (snapshot != NULL) {
+        binc_object_tree_free(snapshot);
     }
     return adapter;
 }
 
+Adapter *binc_adapter_get_default(GDBusConnection *dbusConnection) {
+    g_assert(dbusConnection != NULL);
+
+    // Choose the first one in the array, typically the 'hciX' with the highest X
+    return binc_internal_get_adapter_sync(dbusConnection, NULL);
+}
+
 Adapter *binc_adapter_get(GDBusConnection *dbusConnection, const char *name) {
     g_assert(dbusConnection != NULL);
     g_assert(name != NULL && strlen(name) > 0);
 
-    Adapter *result = NULL;
-    GPtrArray *adapters = binc_adapter_find_all(dbusConnection);
-    if (adapters->len > 0) {
-        for (guint i = 0; i < adapters->len; i++) {
-            Adapter *adapter = g_ptr_array_index(adapters, i);
-            if (g_str_equal(binc_adapter_get_name(adapter), name)) {
-                result = adapter;
-            } else {
-                binc_adapter_free(g_ptr_array_index(adapters, i));
-            }
-        }
-        g_ptr_array_free(adapters, TRUE);
+    return binc_internal_get_adapter_sync(dbusConnection, name);
+}
+
+typedef struct find_adapters_data {
+    GDBusConnection *connection; // Borrowed
+    char *name; // Owned
+    gboolean pick_one;
+    AdapterFindAllCallback find_all_callback;
+    AdapterGetCallback get_callback;
+    gpointer user_data; // Borrowed
+    GCancellable *cancellable; // Owned, may be NULL
+} FindAdaptersData;
+
+static void binc_internal_find_adapters_complete(FindAdaptersData *data, GVariant *result, const GError *error) {
+    // A reply is used as is, without a reply the mirror is used if it is still seeded, unless the caller cancelled
+    ObjectTree *snapshot = NULL;
+    gboolean cancelled = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    const ObjectTree *tree = NULL;
+    if (result == NULL && !cancelled) {
+        tree = binc_signal_dispatcher_get_object_tree(data->connection);
     }
-    return result;
+    if (tree == NULL) {
+        tree = snapshot = binc_internal_create_snapshot(result);
+    }
+
+    GPtrArray *binc_adapters = binc_internal_create_adapters(data->connection, tree);
+    if (data->pick_one) {
+        data->get_callback(binc_internal_pick_adapter(binc_adapters, data->name, tree), error, data->user_data);
+    } else {
+        binc_internal_load_all_devices(binc_adapters, tree);
+        data->find_all_callback(binc_adapters, error, data->user_data);
+    }
+
+    if (snapshot != NULL) {
+        binc_object_tree_free(snapshot);
+    }
+
+    if (data->cancellable != NULL) {
+        g_object_unref(data->cancellable);
+    }
+    g_free(data->name);
+    g_free(data);
+}
+
+static void binc_internal_find_adapters_cb(__attribute__((unused)) GObject *source_object,
+                                           GAsyncResult *res,
+                                           gpointer user_data) {
+    FindAdaptersData *data = (FindAdaptersData *) user_data;
+    g_assert(data != NULL);
+
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish(data->connection, res, &error);
+    if (error != NULL) {
+        log_error(TAG, "Error GetManagedObjects: %s", error->message);
+    }
+
+    binc_internal_find_adapters_complete(data, result, error);
+
+    if (result != NULL) {
+        g_variant_unref(result);
+    }
+    g_clear_error(&error);
+}
+
+static void binc_internal_find_adapters_call(FindAdaptersData *data) {
+    g_dbus_connection_call(data->connection,
+                           BLUEZ_DBUS,
+                           "/",
+                           INTERFACE_OBJECT_MANAGER,
+                           "GetManagedObjects",
+                           NULL,
+                           G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           OBJECT_MANAGER_CALL_TIMEOUT_MS,
+                           data->cancellable,
+                           (GAsyncReadyCallback) binc_internal_find_adapters_cb,
+                           data);
+}
+
+static gboolean binc_internal_find_adapters_idle(gpointer user_data) {
+    FindAdaptersData *data = (FindAdaptersData *) user_data;
+
+    GError *error = NULL;
+    if (g_cancellable_set_error_if_cancelled(data->cancellable, &error)) {
+        binc_internal_find_adapters_complete(data, NULL, error);
+        g_clear_error(&error);
+    } else if (binc_signal_dispatcher_get_object_tree(data->connection) == NULL) {
+        // The last adapter on the connection was freed in the meantime, which took the mirror with it
+        binc_internal_find_adapters_call(data);
+    } else {
+        binc_internal_find_adapters_complete(data, NULL, NULL);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void binc_internal_find_adapters_async(FindAdaptersData *data, GCancellable *cancellable) {
+    if (cancellable != NULL) {
+        data->cancellable = g_object_ref(cancellable);
+    }
+
+    // Served from the mirror when possible, but the callback is never called before returning
+    if (binc_signal_dispatcher_get_object_tree(data->connection) != NULL) {
+        binc_idle_add(binc_internal_find_adapters_idle, data);
+        return;
+    }
+    binc_internal_find_adapters_call(data);
+}
+
+void binc_adapter_find_all_async(GDBusConnection *dbusConnection, GCancellable *cancellable,
+                                 AdapterFindAllCallback callback, gpointer user_data) {
+    g_assert(dbusConnection != NULL);
+    g_assert(callback != NULL);
+
+    FindAdaptersData *data = g_new0(FindAdaptersData, 1);
+    data->connection = dbusConnection;
+    data->find_all_callback = callback;
+    data->user_data = user_data;
+    binc_internal_find_adapters_async(data, cancellable);
 }
 
-static void binc_internal_start_discovery_cb(__attribute__((unused)) GObject *source_object,
+void binc_adapter_get_async(GDBusConnection *dbusConnection, const char *name, GCancellable *cancellable,
+                            AdapterGetCallback callback, gpointer user_data) {
+    g_assert(dbusConnection != NULL);
+    g_assert(callback != NULL);
+
+    FindAdaptersData *data = g_new0(FindAdaptersData, 1);
+    data->connection = dbusConnection;
+    data->name = g_strdup(name);
+    data->pick_one = TRUE;
+    data->get_callback = callback;
+    data->user_data = user_data;
+    binc_internal_find_adapters_async(data, cancellable);
+}
+
+static void binc_internal_start_discovery_cb(GObject *source_object,
                                              GAsyncResult *res,
                                              gpointer user_data) {
 
@@ -689,7 +1464,12 @@ static void binc_internal_start_discovery_cb(__attribute__((unused)) GObject *so
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
 
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", METHOD_START_DISCOVERY, error->code, error->message);
@@ -720,21 +1500,26 @@ void binc_adapter_start_discovery(Adapter *adapter) {
                                NULL,
                                NULL,
                                G_DBUS_CALL_FLAGS_NONE,
-                               -1,
-                               NULL,
+                               adapter->call_timeout_ms,
+                               adapter->cancellable,
                                (GAsyncReadyCallback) binc_internal_start_discovery_cb,
                                adapter);
     }
 }
 
-static void binc_internal_stop_discovery_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_stop_discovery_cb(GObject *source_object,
                                             GAsyncResult *res,
                                             gpointer user_data) {
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
 
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", METHOD_STOP_DISCOVERY, error->code, error->message);
@@ -763,8 +1548,8 @@ void binc_adapter_stop_discovery(Adapter *adapter) {
                                NULL,
                                NULL,
                                G_DBUS_CALL_FLAGS_NONE,
-                               -1,
-                               NULL,
+                               adapter->call_timeout_ms,
+                               adapter->cancellable,
                                (GAsyncReadyCallback) binc_internal_stop_discovery_cb,
                                adapter);
     }
@@ -786,21 +1571,85 @@ GList *binc_adapter_get_devices(const Adapter *adapter) {
 
 GList *binc_adapter_get_connected_devices(const Adapter *adapter) {
     g_assert (adapter != NULL);
+    return g_hash_table_get_keys(adapter->connected_devices);
+}
+
+guint binc_adapter_get_connected_device_count(const Adapter *adapter) {
+    g_assert (adapter != NULL);
+    return g_hash_table_size(adapter->connected_devices);
+}
 
-    GList *all_devices = binc_adapter_get_devices(adapter);
-    if (g_list_length(all_devices) <= 0)
-        return all_devices;
+void binc_internal_adapter_device_connection_changed(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
 
-    GList *result = NULL;
-    for (GList *iterator = all_devices; iterator; iterator = iterator->next) {
-        Device *device = (Device *) iterator->data;
-        if (binc_device_get_connection_state(device) == BINC_CONNECTED) {
-            result = g_list_append(result, device);
+    if (binc_device_get_connection_state(device) == BINC_CONNECTED) {
+        // Devices that are not cached yet are added by adapter_cache_add
+        if (g_hash_table_lookup(adapter->devices_cache, binc_device_get_path(device)) == device) {
+            g_hash_table_add(adapter->connected_devices, device);
         }
+    } else {
+        g_hash_table_remove(adapter->connected_devices, device);
     }
+    adapter_cache_update_pinned(adapter, device);
 
-    g_list_free(all_devices);
-    return result;
+    if (adapter->connection_manager != NULL) {
+        binc_internal_connection_manager_connection_changed(adapter->connection_manager, device);
+    }
+}
+
+void binc_internal_adapter_device_bonding_changed(Adapter *adapter, Device *device) {
+    g_assert(adapter != NULL);
+    g_assert(device != NULL);
+
+    adapter_cache_update_pinned(adapter, device);
+}
+
+void binc_adapter_foreach_device(const Adapter *adapter, AdapterDeviceForeachFunc func, gpointer user_data) {
+    g_assert(adapter != NULL);
+    g_assert(func != NULL);
+
+    DeviceIter iter;
+    Device *device;
+    binc_adapter_device_iter_init(&iter, adapter);
+    while (binc_device_iter_next(&iter, &device)) {
+        func(device, user_data);
+    }
+}
+
+void binc_adapter_foreach_connected_device(const Adapter *adapter, AdapterDeviceForeachFunc func, gpointer user_data) {
+    g_assert(adapter != NULL);
+    g_assert(func != NULL);
+
+    DeviceIter iter;
+    Device *device;
+    binc_adapter_connected_device_iter_init(&iter, adapter);
+    while (binc_device_iter_next(&iter, &device)) {
+        func(device, user_data);
+    }
+}
+
+void binc_adapter_device_iter_init(DeviceIter *iter, const Adapter *adapter) {
+    g_assert(iter != NULL);
+    g_assert(adapter != NULL);
+    g_hash_table_iter_init(&iter->iter, adapter->cache_entries);
+}
+
+void binc_adapter_connected_device_iter_init(DeviceIter *iter, const Adapter *adapter) {
+    g_assert(iter != NULL);
+    g_assert(adapter != NULL);
+    g_hash_table_iter_init(&iter->iter, adapter->connected_devices);
+}
+
+gboolean binc_device_iter_next(DeviceIter *iter, Device **device) {
+    g_assert(iter != NULL);
+    g_assert(device != NULL);
+
+    // Both tables are keyed by the device itself
+    gpointer key;
+    if (!g_hash_table_iter_next(&iter->iter, &key, NULL)) return FALSE;
+    *device = (Device *) key;
+    return TRUE;
 }
 
 void binc_adapter_set_discovery_filter(Adapter *adapter, short rssi_threshold, const GPtrArray *service_uuids,
@@ -813,7 +1662,7 @@ void binc_adapter_set_discovery_filter(Adapter *adapter, short rssi_threshold, c
     if (adapter->discovery_filter.services != NULL) {
         free_discovery_filter(adapter);
     }
-    adapter->discovery_filter.services = g_ptr_array_new();
+    adapter->discovery_filter.services = g_hash_table_new_full(binc_uuid_hash, binc_uuid_equal, g_free, NULL);
     adapter->discovery_filter.rssi = rssi_threshold;
     adapter->discovery_filter.pattern = g_strdup(pattern);
 
@@ -829,10 +1678,19 @@ void binc_adapter_set_discovery_filter(Adapter *adapter, short rssi_threshold, c
     if (service_uuids != NULL && service_uuids->len > 0) {
         GVariantBuilder *uuids = g_variant_builder_new(G_VARIANT_TYPE_STRING_ARRAY);
         for (guint i = 0; i < service_uuids->len; i++) {
-            char *uuid = g_ptr_array_index(service_uuids, i);
-            g_assert(g_uuid_string_is_valid(uuid));
-            g_variant_builder_add(uuids, "s", uuid);
-            g_ptr_array_add(adapter->discovery_filter.services, g_strdup(uuid));
+            const char *uuid_filter = g_ptr_array_index(service_uuids, i);
+            BincUuid *uuid = g_new0(BincUuid, 1);
+            if (!binc_uuid_parse(uuid_filter, uuid)) {
+                log_debug(TAG, "ignoring invalid uuid '%s' in discovery filter", uuid_filter);
+                g_free(uuid);
+                continue;
+            }
+
+            // Always hand BlueZ the full 128-bit form, so short SIG UUIDs match as well
+            char uuid_str[BINC_UUID_STRING_LENGTH];
+            binc_uuid_format(uuid, uuid_str);
+            g_variant_builder_add(uuids, "s", uuid_str);
+            g_hash_table_add(adapter->discovery_filter.services, uuid);
         }
         g_variant_builder_add(arguments, "{sv}", DEVICE_PROPERTY_UUIDS, g_variant_builder_end(uuids));
         g_variant_builder_unref(uuids);
@@ -843,14 +1701,19 @@ void binc_adapter_set_discovery_filter(Adapter *adapter, short rssi_threshold, c
     binc_internal_adapter_call_method(adapter, METHOD_SET_DISCOVERY_FILTER, g_variant_new_tuple(&filter, 1));
 }
 
-static void binc_internal_set_property_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_set_property_cb(GObject *source_object,
                                           GAsyncResult *res,
                                           gpointer user_data) {
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -874,8 +1737,8 @@ static void adapter_set_property(Adapter *adapter, const char *property, GVarian
                            g_variant_new("(ssv)", INTERFACE_ADAPTER, property, value),
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
                            (GAsyncReadyCallback) binc_internal_set_property_cb,
                            adapter);
 }
@@ -912,6 +1775,318 @@ void binc_adapter_set_discovery_cb(Adapter *adapter, AdapterDiscoveryResultCallb
     adapter->discoveryResultCallback = callback;
 }
 
+void binc_adapter_set_discovery_batch_cb(Adapter *adapter, AdapterDiscoveryBatchCallback callback) {
+    g_assert(adapter != NULL);
+    g_assert(callback != NULL);
+
+    adapter->discoveryBatchCallback = callback;
+}
+
+void binc_adapter_set_discovery_batching(Adapter *adapter, guint window_ms, guint min_interval_ms) {
+    g_assert(adapter != NULL);
+
+    // Deliver whatever is still queued before switching modes
+    if (adapter->batch_timeout_id != 0) {
+        binc_source_remove(adapter->batch_timeout_id);
+        adapter->batch_timeout_id = 0;
+        adapter->batch_min_interval_ms = 0;
+        discovery_batch_flush(adapter);
+    }
+    discovery_batch_free(adapter);
+
+    adapter->batch_window_ms = window_ms;
+    adapter->batch_min_interval_ms = min_interval_ms;
+    if (window_ms > 0) {
+        adapter->batch_queue = g_ptr_array_new();
+        adapter->batch_result = g_ptr_array_new();
+        adapter->batch_queued = g_hash_table_new(g_direct_hash, g_direct_equal);
+        adapter->batch_last_delivered = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+}
+
+void binc_adapter_set_device_cache_policy(Adapter *adapter, guint max_devices, guint idle_ttl_seconds,
+                                          gboolean remove_from_bluez) {
+    g_assert(adapter != NULL);
+
+    adapter->cache_max_devices = max_devices;
+    adapter->cache_idle_ttl_seconds = idle_ttl_seconds;
+    adapter->cache_remove_from_bluez = remove_from_bluez;
+
+    if (adapter->cache_sweep_id != 0) {
+        binc_source_remove(adapter->cache_sweep_id);
+        adapter->cache_sweep_id = 0;
+    }
+
+    if (idle_ttl_seconds > 0) {
+        guint interval = CLAMP(idle_ttl_seconds / 4, 1, 60);
+        adapter->cache_sweep_id = binc_timeout_add_seconds(interval, adapter_cache_sweep, adapter);
+    }
+    if (max_devices > 0) {
+        adapter_cache_evict_above(adapter, max_devices);
+    }
+}
+
+void binc_adapter_set_device_evicted_cb(Adapter *adapter, AdapterDeviceEvictedCallback callback) {
+    g_assert(adapter != NULL);
+    g_assert(callback != NULL);
+
+    adapter->deviceEvictedCallback = callback;
+}
+
+const RssiFilterConfig *binc_internal_adapter_get_rssi_filter(const Adapter *adapter) {
+    g_assert(adapter != NULL);
+    return &adapter->rssi_filter;
+}
+
+static void adapter_set_rssi_filter(Adapter *adapter, const RssiFilterConfig *config) {
+    adapter->rssi_filter = *config;
+
+    // Start all devices from scratch, old state doesn't apply to the new filter
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, adapter->devices_cache);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        binc_internal_device_reset_rssi_filter((Device *) value);
+    }
+}
+
+void binc_adapter_set_rssi_filter_ema(Adapter *adapter, double alpha) {
+    g_assert(adapter != NULL);
+    g_assert(alpha > 0 && alpha <= 1);
+
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_EMA, .ema_alpha = alpha};
+    adapter_set_rssi_filter(adapter, &config);
+}
+
+void binc_adapter_set_rssi_filter_kalman(Adapter *adapter, double process_noise, double measurement_noise) {
+    g_assert(adapter != NULL);
+    g_assert(process_noise >= 0);
+    g_assert(measurement_noise > 0);
+
+    RssiFilterConfig config = {
+            .type = BINC_RSSI_FILTER_KALMAN,
+            .kalman_process_noise = process_noise,
+            .kalman_measurement_noise = measurement_noise
+    };
+    adapter_set_rssi_filter(adapter, &config);
+}
+
+void binc_adapter_set_rssi_filter_median(Adapter *adapter, guint window) {
+    g_assert(adapter != NULL);
+    g_assert(window > 0 && window <= BINC_RSSI_MEDIAN_MAX_WINDOW);
+
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_MEDIAN, .median_window = window};
+    adapter_set_rssi_filter(adapter, &config);
+}
+
+void binc_adapter_disable_rssi_filter(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_NONE};
+    adapter_set_rssi_filter(adapter, &config);
+}
+
+void binc_adapter_set_rssi_report_delta(Adapter *adapter, guint delta_db) {
+    g_assert(adapter != NULL);
+    adapter->rssi_report_delta = delta_db;
+}
+
+void binc_adapter_set_proximity_zones(Adapter *adapter, const short *thresholds, guint count) {
+    g_assert(adapter != NULL);
+    g_assert(count == 0 || thresholds != NULL);
+
+    if (adapter->proximity_zones != NULL) {
+        g_array_free(adapter->proximity_zones, TRUE);
+        adapter->proximity_zones = NULL;
+    }
+
+    if (count > 0) {
+        adapter->proximity_zones = g_array_sized_new(FALSE, FALSE, sizeof(short), count);
+        for (guint i = 0; i < count; i++) {
+            g_assert(i == 0 || thresholds[i] < thresholds[i - 1]);
+            g_array_append_val(adapter->proximity_zones, thresholds[i]);
+        }
+    }
+}
+
+void binc_internal_adapter_set_scan_aggregator(Adapter *adapter, ScanAggregator *aggregator) {
+    g_assert(adapter != NULL);
+    adapter->scan_aggregator = aggregator;
+}
+
+ScanAggregator *binc_internal_adapter_get_scan_aggregator(const Adapter *adapter) {
+    g_assert(adapter != NULL);
+    return adapter->scan_aggregator;
+}
+
+void binc_adapter_get_scan_stats(const Adapter *adapter, AdapterScanStats *stats) {
+    g_assert(adapter != NULL);
+    g_assert(stats != NULL);
+
+    *stats = adapter->scan_stats;
+    stats->elapsed_us = g_get_monotonic_time() - adapter->scan_stats_since;
+}
+
+void binc_adapter_reset_scan_stats(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    memset(&adapter->scan_stats, 0, sizeof(AdapterScanStats));
+    adapter->scan_stats_since = g_get_monotonic_time();
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, adapter->devices_cache);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        binc_internal_device_reset_advertisement_rate((Device *) value);
+    }
+}
+
+gboolean binc_adapter_save_device_cache(const Adapter *adapter, const char *filename) {
+    g_assert(adapter != NULL);
+    g_assert(filename != NULL);
+
+    GByteArray *snapshot = binc_device_snapshot_encode(adapter);
+    GError *error = NULL;
+    gboolean result = g_file_set_contents(filename, (const gchar *) snapshot->data, snapshot->len, &error);
+    g_byte_array_free(snapshot, TRUE);
+
+    if (error != NULL) {
+        log_debug(TAG, "failed to save device cache (error %d: %s)", error->code, error->message);
+        g_clear_error(&error);
+    }
+    return result;
+}
+
+/**
+ * Replace the snapshot state of a restored device with what BlueZ reports, or drop it when BlueZ doesn't know it
+ */
+static void binc_internal_reconcile_restored_device(Adapter *adapter, const ObjectTree *tree, Device *device) {
+    const char *path = binc_device_get_path(device);
+    if (binc_object_tree_has_interface(tree, path, INTERFACE_DEVICE)) {
+        binc_internal_load_device_from_tree(adapter, tree, path);
+    } else {
+        log_debug(TAG, "dropping restored device %s, unknown to BlueZ", path);
+        adapter_cache_remove(adapter, device);
+    }
+}
+
+static void binc_internal_object_tree_seeded(ObjectTree *tree, gpointer user_data) {
+    Adapter *adapter = (Adapter *) user_data;
+    g_assert(adapter != NULL);
+
+    // Collect first, reconciling removes devices from the cache
+    GPtrArray *restored = g_ptr_array_new();
+    GHashTableIter iter;
+    Device *device = NULL;
+    g_hash_table_iter_init(&iter, adapter->devices_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &device)) {
+        if (binc_device_is_restored(device)) {
+            g_ptr_array_add(restored, device);
+        }
+    }
+
+    for (guint i = 0; i < restored->len; i++) {
+        binc_internal_reconcile_restored_device(adapter, tree, g_ptr_array_index(restored, i));
+    }
+    g_ptr_array_free(restored, TRUE);
+}
+
+static void binc_internal_restore_device(const char *path, GVariant *properties, BondingState bonding_state,
+                                         gpointer user_data) {
+    Adapter *adapter = (Adapter *) user_data;
+
+    // Live state always wins over the snapshot
+    if (g_hash_table_contains(adapter->devices_cache, path)) return;
+
+    // Once the mirror is seeded it is known whether BlueZ still has the device
+    ObjectTree *tree = binc_signal_dispatcher_get_object_tree(adapter->connection);
+    if (tree != NULL && !binc_object_tree_has_interface(tree, path, INTERFACE_DEVICE)) {
+        log_debug(TAG, "skipping restored device %s, unknown to BlueZ", path);
+        return;
+    }
+
+    Device *device = binc_device_create(path, adapter);
+    adapter_cache_add(adapter, device);
+    const char *property_name;
+    GVariant *property_value;
+    GVariantIter iter;
+    g_variant_iter_init(&iter, properties);
+    while (g_variant_iter_loop(&iter, "{&sv}", &property_name, &property_value)) {
+        binc_internal_device_update_property(device, property_name, property_value);
+    }
+    binc_device_set_bonding_state(device, bonding_state);
+    binc_internal_device_take_changes(device);
+    binc_internal_device_set_restored(device, TRUE);
+
+    // Reconcile right away when the mirror is seeded, otherwise binc_internal_object_tree_seeded does it
+    if (tree != NULL) {
+        binc_internal_load_device_from_tree(adapter, tree, path);
+    }
+}
+
+int binc_adapter_load_device_cache(Adapter *adapter, const char *filename) {
+    g_assert(adapter != NULL);
+    g_assert(filename != NULL);
+
+    GError *error = NULL;
+    GMappedFile *file = g_mapped_file_new(filename, FALSE, &error);
+    if (file == NULL) {
+        log_debug(TAG, "failed to open device cache (error %d: %s)", error->code, error->message);
+        g_clear_error(&error);
+        return -1;
+    }
+
+    int restored = binc_device_snapshot_decode((const guint8 *) g_mapped_file_get_contents(file),
+                                               g_mapped_file_get_length(file), adapter->path,
+                                               binc_internal_restore_device, adapter);
+    g_mapped_file_unref(file);
+    log_debug(TAG, "restored %d devices from %s", restored, filename);
+    return restored;
+}
+
+void binc_adapter_enable_gatt_cache(Adapter *adapter, const char *directory) {
+    g_assert(adapter != NULL);
+
+    if (adapter->gatt_cache != NULL) {
+        binc_gatt_cache_free(adapter->gatt_cache);
+    }
+    adapter->gatt_cache = binc_gatt_cache_create(directory);
+}
+
+GattCache *binc_internal_adapter_get_gatt_cache(const Adapter *adapter) {
+    g_assert(adapter != NULL);
+    return adapter->gatt_cache;
+}
+
+void binc_adapter_set_call_timeout(Adapter *adapter, gint timeout_ms) {
+    g_assert(adapter != NULL);
+    g_assert(timeout_ms > 0 || timeout_ms == -1);
+    adapter->call_timeout_ms = timeout_ms;
+}
+
+gint binc_adapter_get_call_timeout(const Adapter *adapter) {
+    g_assert(adapter != NULL);
+    return adapter->call_timeout_ms;
+}
+
+ConnectionManager *binc_adapter_get_connection_manager(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    if (adapter->connection_manager == NULL) {
+        adapter->connection_manager = binc_internal_connection_manager_create(adapter);
+    }
+    return adapter->connection_manager;
+}
+
+PollScheduler *binc_adapter_get_poll_scheduler(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    if (adapter->poll_scheduler == NULL) {
+        adapter->poll_scheduler = binc_internal_poll_scheduler_create(adapter);
+    }
+    return adapter->poll_scheduler;
+}
+
 void binc_adapter_set_discovery_state_cb(Adapter *adapter, AdapterDiscoveryStateChangeCallback callback) {
     g_assert(adapter != NULL);
     g_assert(callback != NULL);
@@ -956,13 +2131,25 @@ Device *binc_adapter_get_device_by_address(const Adapter *adapter, const char *a
     g_assert(address != NULL);
     g_assert(strlen(address) == MAC_ADDRESS_LENGTH);
 
-    char *path = g_strdup_printf("%s/dev_%s", adapter->path, address);
-    path = replace_char(path, ':', '_');
-    Device *device = g_hash_table_lookup(adapter->devices_cache, path);
-    g_free(path);
+    BincAddress binary_address;
+    if (!binc_address_parse(address, BINC_ADDRESS_PUBLIC, &binary_address)) return NULL;
+
+    Device *device = binc_adapter_get_device_by_binary_address(adapter, &binary_address);
+    if (device == NULL) {
+        binary_address.type = BINC_ADDRESS_RANDOM;
+        device = binc_adapter_get_device_by_binary_address(adapter, &binary_address);
+    }
     return device;
 }
 
+Device *binc_adapter_get_device_by_binary_address(const Adapter *adapter, const BincAddress *address) {
+    g_assert(adapter != NULL);
+    g_assert(address != NULL);
+
+    guint64 key = binc_address_pack(address);
+    return g_hash_table_lookup(adapter->devices_by_address, &key);
+}
+
 GDBusConnection *binc_adapter_get_dbus_connection(const Adapter *adapter) {
     g_assert(adapter != NULL);
     return adapter->connection;
@@ -973,14 +2160,105 @@ const char *binc_adapter_get_discovery_state_name(const Adapter *adapter) {
     return discovery_state_names[adapter->discovery_state];
 }
 
-static void binc_internal_start_advertising_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_register_monitor_cb(GObject *source_object,
+                                             GAsyncResult *res,
+                                             gpointer user_data) {
+    Adapter *adapter = (Adapter *) user_data;
+    g_assert(adapter != NULL);
+
+    GError *error = NULL;
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
+    if (value != NULL) {
+        g_variant_unref(value);
+    }
+
+    if (error != NULL) {
+        log_debug(TAG, "failed to register advertisement monitor (error %d: %s)", error->code, error->message);
+        g_clear_error(&error);
+    } else {
+        log_debug(TAG, "registered advertisement monitor (%s)", adapter->address);
+    }
+}
+
+void binc_adapter_register_advertisement_monitor(Adapter *adapter, AdvertisementMonitor *monitor) {
+    g_assert(adapter != NULL);
+    g_assert(monitor != NULL);
+
+    binc_advertisement_monitor_publish(monitor);
+
+    g_dbus_connection_call(adapter->connection,
+                           BLUEZ_DBUS,
+                           adapter->path,
+                           INTERFACE_ADVERTISEMENT_MONITOR_MANAGER,
+                           "RegisterMonitor",
+                           g_variant_new("(o)", binc_advertisement_monitor_get_root_path(monitor)),
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
+                           (GAsyncReadyCallback) binc_internal_register_monitor_cb, adapter);
+}
+
+static void binc_internal_unregister_monitor_cb(GObject *source_object,
+                                               GAsyncResult *res,
+                                               gpointer user_data) {
+    Adapter *adapter = (Adapter *) user_data;
+    g_assert(adapter != NULL);
+
+    GError *error = NULL;
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
+    if (value != NULL) {
+        g_variant_unref(value);
+    }
+
+    if (error != NULL) {
+        log_debug(TAG, "failed to unregister advertisement monitor (error %d: %s)", error->code, error->message);
+        g_clear_error(&error);
+    } else {
+        log_debug(TAG, "unregistered advertisement monitor");
+    }
+}
+
+void binc_adapter_unregister_advertisement_monitor(Adapter *adapter, AdvertisementMonitor *monitor) {
+    g_assert(adapter != NULL);
+    g_assert(monitor != NULL);
+
+    g_dbus_connection_call(adapter->connection,
+                           BLUEZ_DBUS,
+                           adapter->path,
+                           INTERFACE_ADVERTISEMENT_MONITOR_MANAGER,
+                           "UnregisterMonitor",
+                           g_variant_new("(o)", binc_advertisement_monitor_get_root_path(monitor)),
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
+                           (GAsyncReadyCallback) binc_internal_unregister_monitor_cb, adapter);
+}
+
+static void binc_internal_start_advertising_cb(GObject *source_object,
                                                GAsyncResult *res,
                                                gpointer user_data) {
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -1008,12 +2286,12 @@ void binc_adapter_start_advertising(Adapter *adapter, Advertisement *advertiseme
                            g_variant_new("(oa{sv})", binc_advertisement_get_path(advertisement), NULL),
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
                            (GAsyncReadyCallback) binc_internal_start_advertising_cb, adapter);
 }
 
-static void binc_internal_stop_advertising_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_stop_advertising_cb(GObject *source_object,
                                               GAsyncResult *res,
                                               gpointer user_data) {
 
@@ -1021,7 +2299,12 @@ static void binc_internal_stop_advertising_cb(__attribute__((unused)) GObject *s
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -1048,19 +2331,24 @@ void binc_adapter_stop_advertising(Adapter *adapter, Advertisement *advertisemen
                            g_variant_new("(o)", binc_advertisement_get_path(advertisement)),
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
                            (GAsyncReadyCallback) binc_internal_stop_advertising_cb, adapter);
 }
 
-static void binc_internal_register_appl_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_register_appl_cb(GObject *source_object,
                                            GAsyncResult *res,
                                            gpointer user_data) {
     Adapter *adapter = (Adapter *) user_data;
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -1085,13 +2373,13 @@ void binc_adapter_register_application(Adapter *adapter, Application *applicatio
                            g_variant_new("(oa{sv})", binc_application_get_path(application), NULL),
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
                            (GAsyncReadyCallback) binc_internal_register_appl_cb, adapter);
 
 }
 
-static void binc_internal_unregister_appl_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_unregister_appl_cb(GObject *source_object,
                                              GAsyncResult *res,
                                              gpointer user_data) {
 
@@ -1099,7 +2387,12 @@ static void binc_internal_unregister_appl_cb(__attribute__((unused)) GObject *so
     g_assert(adapter != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(adapter->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The adapter was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -1124,8 +2417,8 @@ void binc_adapter_unregister_application(Adapter *adapter, Application *applicat
                            g_variant_new("(o)", binc_application_get_path(application)),
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           adapter->call_timeout_ms,
+                           adapter->cancellable,
                            (GAsyncReadyCallback) binc_internal_unregister_appl_cb, adapter);
 
 }
@@ -26,6 +26,7 @@
 
 #include <gio/gio.h>
 #include "forward_decl.h"
+#include "address.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,21 +36,83 @@ typedef enum DiscoveryState {
     BINC_DISCOVERY_STOPPED = 0, BINC_DISCOVERY_STARTED = 1, BINC_DISCOVERY_STARTING = 2, BINC_DISCOVERY_STOPPING = 3
 } DiscoveryState;
 
+typedef enum RssiFilterType {
+    BINC_RSSI_FILTER_NONE = 0, BINC_RSSI_FILTER_EMA = 1, BINC_RSSI_FILTER_KALMAN = 2, BINC_RSSI_FILTER_MEDIAN = 3
+} RssiFilterType;
+
+#define BINC_SCAN_STATS_HISTOGRAM_BUCKETS 8
+
+/**
+ * Discovery counters since the adapter was created or the stats were last reset.
+ * Bucket i of the callback histogram counts callbacks that took less than 4^(i+1) microseconds,
+ * the last bucket counts everything slower.
+ */
+typedef struct AdapterScanStats {
+    guint64 signals_received;
+    guint64 signals_decoded;
+    guint64 results_delivered;
+    guint64 results_filtered;
+    guint64 devices_created;
+    guint64 devices_evicted;
+    guint64 callbacks;
+    guint64 callback_time_total_us;
+    guint64 callback_time_max_us;
+    guint64 callback_time_histogram[BINC_SCAN_STATS_HISTOGRAM_BUCKETS];
+    gint64 elapsed_us;
+} AdapterScanStats;
+
+typedef void (*AdapterDeviceForeachFunc)(Device *device, gpointer user_data);
+
+/**
+ * Iterator over the devices of an adapter, allocate it on the stack.
+ * The device set must not change while iterating.
+ */
+typedef struct DeviceIter {
+    GHashTableIter iter;
+} DeviceIter;
+
 typedef void (*AdapterDiscoveryResultCallback)(Adapter *adapter, Device *device);
 
+typedef void (*AdapterDiscoveryBatchCallback)(Adapter *adapter, GPtrArray *devices);
+
 typedef void (*AdapterDiscoveryStateChangeCallback)(Adapter *adapter, DiscoveryState state, const GError *error);
 
 typedef void (*AdapterPoweredStateChangeCallback)(Adapter *adapter, gboolean state);
 
 typedef void (*RemoteCentralConnectionStateCallback)(Adapter *adapter, Device *device);
 
+typedef void (*AdapterDeviceEvictedCallback)(Adapter *adapter, Device *device);
+
+typedef void (*AdapterFindAllCallback)(GPtrArray *adapters, const GError *error, gpointer user_data);
+
+typedef void (*AdapterGetCallback)(Adapter *adapter, const GError *error, gpointer user_data);
+
 
+/**
+ * The lookups below block until BlueZ answers, at most 10 seconds, unless the BlueZ object tree is mirrored already.
+ * Use binc_adapter_find_all_async or binc_adapter_get_async to keep the main loop running or to cancel the lookup.
+ */
 Adapter *binc_adapter_get_default(GDBusConnection *dbusConnection);
 
 Adapter *binc_adapter_get(GDBusConnection *dbusConnection, const char *name);
 
 GPtrArray *binc_adapter_find_all(GDBusConnection *dbusConnection);
 
+/**
+ * Find all adapters without blocking. The callback receives an owned array, which is empty on error.
+ * The callback is always called, with G_IO_ERROR_CANCELLED when cancellable was cancelled first.
+ */
+void binc_adapter_find_all_async(GDBusConnection *dbusConnection, GCancellable *cancellable,
+                                 AdapterFindAllCallback callback, gpointer user_data);
+
+/**
+ * Get an adapter without blocking. Only the devices of the chosen adapter are loaded.
+ *
+ * @param name name of the adapter like 'hci0', or NULL for the default adapter
+ */
+void binc_adapter_get_async(GDBusConnection *dbusConnection, const char *name, GCancellable *cancellable,
+                            AdapterGetCallback callback, gpointer user_data);
+
 void binc_adapter_free(Adapter *adapter);
 
 void binc_adapter_start_discovery(Adapter *adapter);
@@ -64,10 +127,35 @@ GList *binc_adapter_get_devices(const Adapter *adapter);
 
 GList *binc_adapter_get_connected_devices(const Adapter *adapter);
 
+guint binc_adapter_get_connected_device_count(const Adapter *adapter);
+
+/**
+ * Call func for every device without copying the device list
+ */
+void binc_adapter_foreach_device(const Adapter *adapter, AdapterDeviceForeachFunc func, gpointer user_data);
+
+/**
+ * Call func for every connected device without copying the device list
+ */
+void binc_adapter_foreach_connected_device(const Adapter *adapter, AdapterDeviceForeachFunc func, gpointer user_data);
+
+void binc_adapter_device_iter_init(DeviceIter *iter, const Adapter *adapter);
+
+void binc_adapter_connected_device_iter_init(DeviceIter *iter, const Adapter *adapter);
+
+/**
+ * Advance the iterator
+ *
+ * @return FALSE when there are no more devices
+ */
+gboolean binc_device_iter_next(DeviceIter *iter, Device **device);
+
 Device *binc_adapter_get_device_by_path(const Adapter *adapter, const char *path); // make this internal
 
 Device *binc_adapter_get_device_by_address(const Adapter *adapter, const char *address);
 
+Device *binc_adapter_get_device_by_binary_address(const Adapter *adapter, const BincAddress *address);
+
 void binc_adapter_power_on(Adapter *adapter);
 
 void binc_adapter_power_off(Adapter *adapter);
@@ -90,6 +178,127 @@ gboolean binc_adapter_get_powered_state(const Adapter *adapter);
 
 void binc_adapter_set_discovery_cb(Adapter *adapter, AdapterDiscoveryResultCallback callback);
 
+/**
+ * Set the callback for batched discovery results. The array is only valid during the callback.
+ * Without a batch callback, batched results are delivered one by one to the discovery callback.
+ */
+void binc_adapter_set_discovery_batch_cb(Adapter *adapter, AdapterDiscoveryBatchCallback callback);
+
+/**
+ * Coalesce discovery results per device and deliver them once per window, latest state wins.
+ * Devices delivered less than min_interval_ms ago stay queued until they are due.
+ *
+ * @param window_ms batching window, 0 disables batching
+ * @param min_interval_ms minimum time between deliveries of the same device, 0 for no limit
+ */
+void binc_adapter_set_discovery_batching(Adapter *adapter, guint window_ms, guint min_interval_ms);
+
+/**
+ * Bound the device cache. Devices are evicted least recently seen first; connected and bonded devices are never evicted.
+ *
+ * @param max_devices maximum number of cached devices, 0 for no limit
+ * @param idle_ttl_seconds evict devices that have not advertised for this long, 0 to disable
+ * @param remove_from_bluez also call RemoveDevice on BlueZ for evicted devices
+ */
+void binc_adapter_set_device_cache_policy(Adapter *adapter, guint max_devices, guint idle_ttl_seconds,
+                                          gboolean remove_from_bluez);
+
+/**
+ * Set the callback that is called right before a device is evicted from the cache. The device is freed afterwards.
+ */
+void binc_adapter_set_device_evicted_cb(Adapter *adapter, AdapterDeviceEvictedCallback callback);
+
+/**
+ * Smooth the RSSI of every device with an exponential moving average
+ *
+ * @param alpha weight of a new sample, between 0 and 1
+ */
+void binc_adapter_set_rssi_filter_ema(Adapter *adapter, double alpha);
+
+/**
+ * Smooth the RSSI of every device with a one-dimensional Kalman filter
+ *
+ * @param process_noise expected variance of the true RSSI between samples
+ * @param measurement_noise expected variance of a single RSSI sample
+ */
+void binc_adapter_set_rssi_filter_kalman(Adapter *adapter, double process_noise, double measurement_noise);
+
+/**
+ * Smooth the RSSI of every device with the median of the last window samples, at most 15
+ */
+void binc_adapter_set_rssi_filter_median(Adapter *adapter, guint window);
+
+void binc_adapter_disable_rssi_filter(Adapter *adapter);
+
+/**
+ * Only report RSSI-only changes when the smoothed RSSI moved by at least delta_db since the last report.
+ * Changed advertisement data is always reported. 0 reports every change.
+ */
+void binc_adapter_set_rssi_report_delta(Adapter *adapter, guint delta_db);
+
+/**
+ * Divide the smoothed RSSI into proximity zones and report a device whenever it enters another zone.
+ * Zone 0 is at or above thresholds[0], zone i at or above thresholds[i] and the last zone below all of them.
+ *
+ * @param thresholds zone boundaries in dBm in descending order, copied
+ * @param count number of thresholds, 0 to disable zones
+ */
+void binc_adapter_set_proximity_zones(Adapter *adapter, const short *thresholds, guint count);
+
+/**
+ * Copy the discovery counters into stats
+ */
+void binc_adapter_get_scan_stats(const Adapter *adapter, AdapterScanStats *stats);
+
+/**
+ * Reset the discovery counters and the advertisement rates of all devices
+ */
+void binc_adapter_reset_scan_stats(Adapter *adapter);
+
+/**
+ * Save the device cache to a binary snapshot file, written atomically
+ */
+gboolean binc_adapter_save_device_cache(const Adapter *adapter, const char *filename);
+
+/**
+ * Load a snapshot written by binc_adapter_save_device_cache. Devices that are already known are skipped.
+ * Restored devices are usable immediately and are reconciled with BlueZ as soon as it reports on them.
+ * Once the BlueZ object tree has been read, restored devices that BlueZ doesn't know are dropped.
+ *
+ * @return the number of device records in the snapshot, or -1 if the file could not be read
+ */
+int binc_adapter_load_device_cache(Adapter *adapter, const char *filename);
+
+/**
+ * Cache the resolved GATT layout of devices, keyed by identity address and Database Hash.
+ * Reconnects to an unchanged device then build their services from the cache instead of walking the object tree.
+ * A cached layout is dropped when its Database Hash changed or the device indicates Service Changed.
+ * Devices without a Database Hash characteristic are not cached, as a stale layout couldn't be detected.
+ *
+ * @param directory directory to persist the layouts in, or NULL to only cache in memory
+ */
+void binc_adapter_enable_gatt_cache(Adapter *adapter, const char *directory);
+
+/**
+ * Set the D-Bus timeout of the method calls of the adapter and of device connect, pair and disconnect.
+ * The default of -1 uses the D-Bus default of 25 seconds. GATT operations have their own timeout per device.
+ */
+void binc_adapter_set_call_timeout(Adapter *adapter, gint timeout_ms);
+
+gint binc_adapter_get_call_timeout(const Adapter *adapter);
+
+/**
+ * Get the connection manager of the adapter, it is created on first use.
+ * Devices connected through it are queued by priority, limited in how many connect at once and retried on failure.
+ */
+ConnectionManager *binc_adapter_get_connection_manager(Adapter *adapter);
+
+/**
+ * Get the poll scheduler of the adapter, it is created on first use.
+ * It reads characteristics of connected devices periodically from a single timer instead of one timer per poll.
+ */
+PollScheduler *binc_adapter_get_poll_scheduler(Adapter *adapter);
+
 void binc_adapter_set_discovery_state_cb(Adapter *adapter, AdapterDiscoveryStateChangeCallback callback);
 
 void binc_adapter_set_powered_state_cb(Adapter *adapter, AdapterPoweredStateChangeCallback callback);
@@ -102,6 +311,13 @@ void binc_adapter_start_advertising(Adapter *adapter, Advertisement *advertiseme
 
 void binc_adapter_stop_advertising(Adapter *adapter, Advertisement *advertisement);
 
+/**
+ * Let the controller filter advertisements instead of running discovery, see AdvertisementMonitor
+ */
+void binc_adapter_register_advertisement_monitor(Adapter *adapter, AdvertisementMonitor *monitor);
+
+void binc_adapter_unregister_advertisement_monitor(Adapter *adapter, AdvertisementMonitor *monitor);
+
 void binc_adapter_register_application(Adapter *adapter, Application *application);
 
 void binc_adapter_unregister_application(Adapter *adapter, Application *application);
@@ -0,0 +1,59 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_ADAPTER_INTERNAL_H
+#define BINC_ADAPTER_INTERNAL_H
+
+#include "adapter.h"
+#include "rssi_filter.h"
+#include "gatt_cache.h"
+#include "connection_manager_internal.h"
+
+/**
+ * Create an adapter object for path without asking BlueZ about it, adapter lookups use this for every adapter found
+ */
+Adapter *binc_adapter_create(GDBusConnection *connection, const char *path);
+
+void binc_internal_adapter_device_address_changed(Adapter *adapter, Device *device, guint64 old_address_key);
+
+const RssiFilterConfig *binc_internal_adapter_get_rssi_filter(const Adapter *adapter);
+
+/**
+ * Get a device from the cache and mark it as seen, or create it from the mirror or BlueZ if it is not cached yet
+ */
+Device *binc_internal_adapter_find_or_load_device(Adapter *adapter, const char *path);
+
+void binc_internal_adapter_device_connection_changed(Adapter *adapter, Device *device);
+
+void binc_internal_adapter_device_bonding_changed(Adapter *adapter, Device *device);
+
+void binc_internal_adapter_set_scan_aggregator(Adapter *adapter, ScanAggregator *aggregator);
+
+ScanAggregator *binc_internal_adapter_get_scan_aggregator(const Adapter *adapter);
+
+/**
+ * Get the GATT layout cache, or NULL when caching is disabled
+ */
+GattCache *binc_internal_adapter_get_gatt_cache(const Adapter *adapter);
+
+#endif //BINC_ADAPTER_INTERNAL_H
@@ -0,0 +1,107 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "address.h"
+
+#define ADDRESS_TYPE_RANDOM "random"
+#define PATH_ADDRESS_PREFIX "dev_"
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static gboolean parse_with_separator(const char *str, char separator, BincAddressType type, BincAddress *address) {
+    for (int i = 0; i < 6; i++) {
+        const char *octet = str + (i * 3);
+        int high = hex_value(octet[0]);
+        int low = high < 0 ? -1 : hex_value(octet[1]);
+        if (low < 0) return FALSE;
+
+        char next = octet[2];
+        if ((i < 5 && next != separator) || (i == 5 && next != '\0')) return FALSE;
+
+        address->bytes[i] = (guint8) ((high << 4) | low);
+    }
+    address->type = type;
+    return TRUE;
+}
+
+gboolean binc_address_parse(const char *str, BincAddressType type, BincAddress *address) {
+    g_assert(str != NULL);
+    g_assert(address != NULL);
+
+    return parse_with_separator(str, ':', type, address);
+}
+
+gboolean binc_address_parse_path(const char *path, BincAddressType type, BincAddress *address) {
+    g_assert(path != NULL);
+    g_assert(address != NULL);
+
+    const size_t suffix_length = strlen(PATH_ADDRESS_PREFIX) + BINC_ADDRESS_STRING_LENGTH - 1;
+    size_t length = strlen(path);
+    if (length < suffix_length) return FALSE;
+
+    const char *suffix = path + (length - suffix_length);
+    if (!g_str_has_prefix(suffix, PATH_ADDRESS_PREFIX)) return FALSE;
+
+    return parse_with_separator(suffix + strlen(PATH_ADDRESS_PREFIX), '_', type, address);
+}
+
+void binc_address_format(const BincAddress *address, char *buffer) {
+    g_assert(address != NULL);
+    g_assert(buffer != NULL);
+
+    const char hex[] = "0123456789ABCDEF";
+    for (int i = 0; i < 6; i++) {
+        buffer[i * 3] = hex[address->bytes[i] >> 4];
+        buffer[i * 3 + 1] = hex[address->bytes[i] & 0xF];
+        buffer[i * 3 + 2] = i < 5 ? ':' : '\0';
+    }
+}
+
+guint64 binc_address_pack(const BincAddress *address) {
+    g_assert(address != NULL);
+
+    guint64 packed = 0;
+    for (int i = 0; i < 6; i++) {
+        packed = (packed << 8) | address->bytes[i];
+    }
+    return packed | ((guint64) address->type << 48);
+}
+
+gboolean binc_address_equal(const BincAddress *address, const BincAddress *other) {
+    g_assert(address != NULL);
+    g_assert(other != NULL);
+
+    return binc_address_pack(address) == binc_address_pack(other);
+}
+
+BincAddressType binc_address_type_from_string(const char *address_type) {
+    g_assert(address_type != NULL);
+
+    return g_str_equal(address_type, ADDRESS_TYPE_RANDOM) ? BINC_ADDRESS_RANDOM : BINC_ADDRESS_PUBLIC;
+}
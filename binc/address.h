@@ -0,0 +1,79 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_ADDRESS_H
+#define BINC_ADDRESS_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BINC_ADDRESS_STRING_LENGTH 18
+
+typedef enum BincAddressType {
+    BINC_ADDRESS_PUBLIC = 0, BINC_ADDRESS_RANDOM = 1
+} BincAddressType;
+
+/**
+ * Bluetooth device address in binary form. Bytes are stored most significant first, in the same order as printed.
+ */
+typedef struct binc_address {
+    guint8 bytes[6];
+    BincAddressType type;
+} BincAddress;
+
+/**
+ * Parse an address of the form 'XX:XX:XX:XX:XX:XX'. Both upper and lower case hex digits are accepted.
+ *
+ * @return TRUE if the string is a valid address
+ */
+gboolean binc_address_parse(const char *str, BincAddressType type, BincAddress *address);
+
+/**
+ * Parse the address from a BlueZ device path ending in 'dev_XX_XX_XX_XX_XX_XX'
+ *
+ * @return TRUE if the path ends in a valid address
+ */
+gboolean binc_address_parse_path(const char *path, BincAddressType type, BincAddress *address);
+
+/**
+ * Format an address as 'XX:XX:XX:XX:XX:XX' into buffer, which must hold at least BINC_ADDRESS_STRING_LENGTH bytes
+ */
+void binc_address_format(const BincAddress *address, char *buffer);
+
+/**
+ * Pack address and type in a single integer, suitable as a hash key
+ */
+guint64 binc_address_pack(const BincAddress *address);
+
+gboolean binc_address_equal(const BincAddress *address, const BincAddress *other);
+
+BincAddressType binc_address_type_from_string(const char *address_type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BINC_ADDRESS_H
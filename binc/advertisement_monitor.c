@@ -0,0 +1,403 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include "advertisement_monitor.h"
+#include "adapter.h"
+#include "adapter_internal.h"
+#include "device.h"
+#include "logger.h"
+
+static const char *const TAG = "AdvertisementMonitor";
+
+static const char *const INTERFACE_ADVERTISEMENT_MONITOR = "org.bluez.AdvertisementMonitor1";
+static const char *const MONITOR_TYPE_OR_PATTERNS = "or_patterns";
+
+static const gchar monitor_root_xml[] =
+        "<node name='/'>"
+        "  <interface name='org.freedesktop.DBus.ObjectManager'>"
+        "    <method name='GetManagedObjects'>"
+        "        <arg type='a{oa{sa{sv}}}' name='object_paths_interfaces_and_properties' direction='out'/>"
+        "    </method>"
+        "  </interface>"
+        "</node>";
+
+static const gchar monitor_xml[] =
+        "<node name='/'>"
+        "  <interface name='org.bluez.AdvertisementMonitor1'>"
+        "    <method name='Release'/>"
+        "    <method name='Activate'/>"
+        "    <method name='DeviceFound'>"
+        "        <arg type='o' name='device' direction='in'/>"
+        "    </method>"
+        "    <method name='DeviceLost'>"
+        "        <arg type='o' name='device' direction='in'/>"
+        "    </method>"
+        "    <property type='s' name='Type' access='read'/>"
+        "    <property type='n' name='RSSILowThreshold' access='read'/>"
+        "    <property type='n' name='RSSIHighThreshold' access='read'/>"
+        "    <property type='q' name='RSSILowTimeout' access='read'/>"
+        "    <property type='q' name='RSSIHighTimeout' access='read'/>"
+        "    <property type='q' name='RSSISamplingPeriod' access='read'/>"
+        "    <property type='a(yyay)' name='Patterns' access='read'/>"
+        "  </interface>"
+        "</node>";
+
+static const char *const monitor_properties[] = {
+        "Type", "RSSILowThreshold", "RSSIHighThreshold", "RSSILowTimeout", "RSSIHighTimeout", "RSSISamplingPeriod",
+        "Patterns"
+};
+
+static guint monitor_count = 0;
+
+typedef struct monitor_pattern {
+    guint8 start_position;
+    guint8 ad_type;
+    GByteArray *content; // Owned
+} MonitorPattern;
+
+struct binc_advertisement_monitor {
+    char *root_path; // Owned
+    char *path; // Owned
+    Adapter *adapter; // Borrowed
+    GDBusConnection *connection; // Borrowed
+    GPtrArray *patterns; // Owned
+    gboolean has_rssi;
+    short rssi_high_threshold;
+    guint16 rssi_high_timeout;
+    short rssi_low_threshold;
+    guint16 rssi_low_timeout;
+    guint16 rssi_sampling_period;
+    guint root_registration_id;
+    guint registration_id;
+    gboolean active;
+    AdvertisementMonitorDeviceCallback device_found_callback;
+    AdvertisementMonitorDeviceCallback device_lost_callback;
+    AdvertisementMonitorStateCallback state_callback;
+    void *user_data; // Borrowed
+};
+
+static void monitor_pattern_free(MonitorPattern *pattern) {
+    g_byte_array_free(pattern->content, TRUE);
+    g_free(pattern);
+}
+
+static GVariant *monitor_get_patterns(const AdvertisementMonitor *monitor) {
+    GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("a(yyay)"));
+    for (guint i = 0; i < monitor->patterns->len; i++) {
+        MonitorPattern *pattern = g_ptr_array_index(monitor->patterns, i);
+        GVariant *content = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, pattern->content->data,
+                                                      pattern->content->len, sizeof(guint8));
+        g_variant_builder_add(builder, "(yy@ay)", pattern->start_position, pattern->ad_type, content);
+    }
+    GVariant *result = g_variant_builder_end(builder);
+    g_variant_builder_unref(builder);
+    return result;
+}
+
+static GVariant *monitor_get_property(const AdvertisementMonitor *monitor, const char *property_name) {
+    if (g_str_equal(property_name, "Type")) {
+        return g_variant_new_string(MONITOR_TYPE_OR_PATTERNS);
+    } else if (g_str_equal(property_name, "Patterns")) {
+        return monitor_get_patterns(monitor);
+    }
+
+    // Leaving the RSSI properties out makes BlueZ use its defaults
+    if (!monitor->has_rssi) return NULL;
+
+    if (g_str_equal(property_name, "RSSILowThreshold")) {
+        return g_variant_new_int16(monitor->rssi_low_threshold);
+    } else if (g_str_equal(property_name, "RSSIHighThreshold")) {
+        return g_variant_new_int16(monitor->rssi_high_threshold);
+    } else if (g_str_equal(property_name, "RSSILowTimeout")) {
+        return g_variant_new_uint16(monitor->rssi_low_timeout);
+    } else if (g_str_equal(property_name, "RSSIHighTimeout")) {
+        return g_variant_new_uint16(monitor->rssi_high_timeout);
+    } else if (g_str_equal(property_name, "RSSISamplingPeriod")) {
+        return g_variant_new_uint16(monitor->rssi_sampling_period);
+    }
+    return NULL;
+}
+
+static GVariant *binc_internal_monitor_get_property(__attribute__((unused)) GDBusConnection *connection,
+                                                    __attribute__((unused)) const gchar *sender,
+                                                    __attribute__((unused)) const gchar *object_path,
+                                                    __attribute__((unused)) const gchar *interface_name,
+                                                    const gchar *property_name,
+                                                    GError **error,
+                                                    gpointer user_data) {
+
+    AdvertisementMonitor *monitor = (AdvertisementMonitor *) user_data;
+    g_assert(monitor != NULL);
+
+    GVariant *result = monitor_get_property(monitor, property_name);
+    if (result == NULL) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS, "property %s not set", property_name);
+    }
+    return result;
+}
+
+static void binc_internal_monitor_method_call(__attribute__((unused)) GDBusConnection *conn,
+                                              __attribute__((unused)) const gchar *sender,
+                                              __attribute__((unused)) const gchar *path,
+                                              __attribute__((unused)) const gchar *interface,
+                                              const gchar *method,
+                                              GVariant *params,
+                                              GDBusMethodInvocation *invocation,
+                                              void *userdata) {
+
+    AdvertisementMonitor *monitor = (AdvertisementMonitor *) userdata;
+    g_assert(monitor != NULL);
+
+    if (g_str_equal(method, "Activate") || g_str_equal(method, "Release")) {
+        monitor->active = g_str_equal(method, "Activate");
+        log_debug(TAG, "monitor %s %s", monitor->path, monitor->active ? "activated" : "released");
+        g_dbus_method_invocation_return_value(invocation, NULL);
+
+        if (monitor->state_callback != NULL) {
+            monitor->state_callback(monitor, monitor->active);
+        }
+    } else if (g_str_equal(method, "DeviceFound") || g_str_equal(method, "DeviceLost")) {
+        const char *device_path = NULL;
+        g_variant_get(params, "(&o)", &device_path);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+
+        if (g_str_equal(method, "DeviceFound")) {
+            // Monitored devices go into the regular device cache so they behave like discovered ones
+            Device *device = binc_internal_adapter_find_or_load_device(monitor->adapter, device_path);
+            log_debug(TAG, "found %s", device_path);
+            if (monitor->device_found_callback != NULL) {
+                monitor->device_found_callback(monitor, device);
+            }
+        } else {
+            Device *device = binc_adapter_get_device_by_path(monitor->adapter, device_path);
+            log_debug(TAG, "lost %s", device_path);
+            if (device != NULL && monitor->device_lost_callback != NULL) {
+                monitor->device_lost_callback(monitor, device);
+            }
+        }
+    } else {
+        g_dbus_method_invocation_return_dbus_error(invocation, "org.bluez.Error.NotSupported", "Unknown method");
+    }
+}
+
+static void binc_internal_monitor_root_method_call(__attribute__((unused)) GDBusConnection *conn,
+                                                   __attribute__((unused)) const gchar *sender,
+                                                   __attribute__((unused)) const gchar *path,
+                                                   __attribute__((unused)) const gchar *interface,
+                                                   const gchar *method,
+                                                   __attribute__((unused)) GVariant *params,
+                                                   GDBusMethodInvocation *invocation,
+                                                   void *userdata) {
+
+    AdvertisementMonitor *monitor = (AdvertisementMonitor *) userdata;
+    g_assert(monitor != NULL);
+
+    if (g_str_equal(method, "GetManagedObjects")) {
+        GVariantBuilder *properties_builder = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+        for (guint i = 0; i < G_N_ELEMENTS(monitor_properties); i++) {
+            GVariant *value = monitor_get_property(monitor, monitor_properties[i]);
+            if (value != NULL) {
+                g_variant_builder_add(properties_builder, "{sv}", monitor_properties[i], value);
+            }
+        }
+
+        GVariantBuilder *interfaces_builder = g_variant_builder_new(G_VARIANT_TYPE("a{sa{sv}}"));
+        g_variant_builder_add(interfaces_builder, "{sa{sv}}", INTERFACE_ADVERTISEMENT_MONITOR, properties_builder);
+        g_variant_builder_unref(properties_builder);
+
+        GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("a{oa{sa{sv}}}"));
+        g_variant_builder_add(builder, "{oa{sa{sv}}}", monitor->path, interfaces_builder);
+        g_variant_builder_unref(interfaces_builder);
+
+        GVariant *result = g_variant_builder_end(builder);
+        g_variant_builder_unref(builder);
+        g_dbus_method_invocation_return_value(invocation, g_variant_new_tuple(&result, 1));
+    }
+}
+
+static const GDBusInterfaceVTable monitor_method_table = {
+        .method_call = binc_internal_monitor_method_call,
+        .get_property = binc_internal_monitor_get_property
+};
+
+static const GDBusInterfaceVTable monitor_root_method_table = {
+        .method_call = binc_internal_monitor_root_method_call,
+};
+
+static guint register_object(AdvertisementMonitor *monitor, const char *xml, const char *path,
+                             const GDBusInterfaceVTable *vtable) {
+    GError *error = NULL;
+    GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(xml, &error);
+    if (error != NULL) {
+        log_debug(TAG, "Unable to create monitor node: %s", error->message);
+        g_clear_error(&error);
+        return 0;
+    }
+
+    guint registration_id = g_dbus_connection_register_object(monitor->connection, path, info->interfaces[0],
+                                                              vtable, monitor, NULL, &error);
+    g_dbus_node_info_unref(info);
+
+    if (error != NULL) {
+        log_debug(TAG, "registering %s failed: %s", path, error->message);
+        g_clear_error(&error);
+    }
+    return registration_id;
+}
+
+void binc_advertisement_monitor_publish(AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+
+    if (monitor->root_registration_id != 0) return;
+
+    monitor->root_registration_id = register_object(monitor, monitor_root_xml, monitor->root_path,
+                                                    &monitor_root_method_table);
+    monitor->registration_id = register_object(monitor, monitor_xml, monitor->path, &monitor_method_table);
+}
+
+void binc_advertisement_monitor_unpublish(AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+
+    if (monitor->registration_id != 0) {
+        if (!g_dbus_connection_unregister_object(monitor->connection, monitor->registration_id)) {
+            log_debug(TAG, "could not unregister monitor %s", monitor->path);
+        }
+        monitor->registration_id = 0;
+    }
+
+    if (monitor->root_registration_id != 0) {
+        if (!g_dbus_connection_unregister_object(monitor->connection, monitor->root_registration_id)) {
+            log_debug(TAG, "could not unregister monitor root %s", monitor->root_path);
+        }
+        monitor->root_registration_id = 0;
+    }
+    monitor->active = FALSE;
+}
+
+AdvertisementMonitor *binc_advertisement_monitor_create(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    AdvertisementMonitor *monitor = g_new0(AdvertisementMonitor, 1);
+    monitor->adapter = adapter;
+    monitor->connection = binc_adapter_get_dbus_connection(adapter);
+    monitor->root_path = g_strdup_printf("/org/bluez/bincmonitor%u", monitor_count++);
+    monitor->path = g_strdup_printf("%s/monitor0", monitor->root_path);
+    monitor->patterns = g_ptr_array_new_with_free_func((GDestroyNotify) monitor_pattern_free);
+    return monitor;
+}
+
+void binc_advertisement_monitor_free(AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+
+    binc_advertisement_monitor_unpublish(monitor);
+
+    g_ptr_array_free(monitor->patterns, TRUE);
+    monitor->patterns = NULL;
+
+    g_free(monitor->path);
+    monitor->path = NULL;
+
+    g_free(monitor->root_path);
+    monitor->root_path = NULL;
+
+    g_free(monitor);
+}
+
+void binc_advertisement_monitor_add_pattern(AdvertisementMonitor *monitor, guint8 start_position, guint8 ad_type,
+                                            const guint8 *content, guint8 length) {
+    g_assert(monitor != NULL);
+    g_assert(content != NULL);
+    g_assert(length > 0);
+
+    // BlueZ only reads the patterns once, when the monitor is registered
+    if (monitor->registration_id != 0) {
+        log_debug(TAG, "pattern added after publishing, re-register the monitor to apply it");
+    }
+
+    MonitorPattern *pattern = g_new0(MonitorPattern, 1);
+    pattern->start_position = start_position;
+    pattern->ad_type = ad_type;
+    pattern->content = g_byte_array_sized_new(length);
+    g_byte_array_append(pattern->content, content, length);
+    g_ptr_array_add(monitor->patterns, pattern);
+}
+
+void binc_advertisement_monitor_set_rssi(AdvertisementMonitor *monitor, short high_threshold, guint16 high_timeout,
+                                         short low_threshold, guint16 low_timeout, guint16 sampling_period) {
+    g_assert(monitor != NULL);
+    g_assert(low_threshold <= high_threshold);
+
+    monitor->has_rssi = TRUE;
+    monitor->rssi_high_threshold = high_threshold;
+    monitor->rssi_high_timeout = high_timeout;
+    monitor->rssi_low_threshold = low_threshold;
+    monitor->rssi_low_timeout = low_timeout;
+    monitor->rssi_sampling_period = sampling_period;
+}
+
+void binc_advertisement_monitor_set_device_found_cb(AdvertisementMonitor *monitor,
+                                                    AdvertisementMonitorDeviceCallback callback) {
+    g_assert(monitor != NULL);
+    monitor->device_found_callback = callback;
+}
+
+void binc_advertisement_monitor_set_device_lost_cb(AdvertisementMonitor *monitor,
+                                                   AdvertisementMonitorDeviceCallback callback) {
+    g_assert(monitor != NULL);
+    monitor->device_lost_callback = callback;
+}
+
+void binc_advertisement_monitor_set_state_cb(AdvertisementMonitor *monitor, AdvertisementMonitorStateCallback callback) {
+    g_assert(monitor != NULL);
+    monitor->state_callback = callback;
+}
+
+gboolean binc_advertisement_monitor_is_active(const AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+    return monitor->active;
+}
+
+const char *binc_advertisement_monitor_get_path(const AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+    return monitor->path;
+}
+
+const char *binc_advertisement_monitor_get_root_path(const AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+    return monitor->root_path;
+}
+
+Adapter *binc_advertisement_monitor_get_adapter(const AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+    return monitor->adapter;
+}
+
+void binc_advertisement_monitor_set_user_data(AdvertisementMonitor *monitor, void *user_data) {
+    g_assert(monitor != NULL);
+    monitor->user_data = user_data;
+}
+
+void *binc_advertisement_monitor_get_user_data(const AdvertisementMonitor *monitor) {
+    g_assert(monitor != NULL);
+    return monitor->user_data;
+}
@@ -0,0 +1,103 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_ADVERTISEMENT_MONITOR_H
+#define BINC_ADVERTISEMENT_MONITOR_H
+
+#include <gio/gio.h>
+#include "forward_decl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Common AD types for patterns, see the Bluetooth Assigned Numbers
+#define BINC_AD_TYPE_FLAGS 0x01
+#define BINC_AD_TYPE_INCOMPLETE_SERVICE_UUID16 0x02
+#define BINC_AD_TYPE_COMPLETE_SERVICE_UUID16 0x03
+#define BINC_AD_TYPE_SHORTENED_LOCAL_NAME 0x08
+#define BINC_AD_TYPE_COMPLETE_LOCAL_NAME 0x09
+#define BINC_AD_TYPE_SERVICE_DATA_UUID16 0x16
+#define BINC_AD_TYPE_MANUFACTURER_DATA 0xFF
+
+typedef void (*AdvertisementMonitorDeviceCallback)(AdvertisementMonitor *monitor, Device *device);
+
+typedef void (*AdvertisementMonitorStateCallback)(AdvertisementMonitor *monitor, gboolean active);
+
+/**
+ * Create a monitor that lets BlueZ, or the controller when it supports offloading, filter advertisements.
+ * Add patterns and register it with binc_adapter_register_advertisement_monitor.
+ */
+AdvertisementMonitor *binc_advertisement_monitor_create(Adapter *adapter);
+
+void binc_advertisement_monitor_free(AdvertisementMonitor *monitor);
+
+/**
+ * Match advertisements that contain content at start_position within an AD structure of type ad_type.
+ * An advertisement matching any pattern is reported.
+ */
+void binc_advertisement_monitor_add_pattern(AdvertisementMonitor *monitor, guint8 start_position, guint8 ad_type,
+                                            const guint8 *content, guint8 length);
+
+/**
+ * Report a device as found once its RSSI stays above high_threshold for high_timeout seconds,
+ * and as lost once it stays below low_threshold for low_timeout seconds.
+ *
+ * @param sampling_period 0 to report every advertisement, 255 to report only the first,
+ * otherwise the period in units of 100ms
+ */
+void binc_advertisement_monitor_set_rssi(AdvertisementMonitor *monitor, short high_threshold, guint16 high_timeout,
+                                         short low_threshold, guint16 low_timeout, guint16 sampling_period);
+
+void binc_advertisement_monitor_set_device_found_cb(AdvertisementMonitor *monitor,
+                                                    AdvertisementMonitorDeviceCallback callback);
+
+void binc_advertisement_monitor_set_device_lost_cb(AdvertisementMonitor *monitor,
+                                                   AdvertisementMonitorDeviceCallback callback);
+
+/**
+ * Set the callback that is called when BlueZ activates or releases the monitor
+ */
+void binc_advertisement_monitor_set_state_cb(AdvertisementMonitor *monitor, AdvertisementMonitorStateCallback callback);
+
+gboolean binc_advertisement_monitor_is_active(const AdvertisementMonitor *monitor);
+
+const char *binc_advertisement_monitor_get_path(const AdvertisementMonitor *monitor);
+
+const char *binc_advertisement_monitor_get_root_path(const AdvertisementMonitor *monitor);
+
+Adapter *binc_advertisement_monitor_get_adapter(const AdvertisementMonitor *monitor);
+
+void binc_advertisement_monitor_publish(AdvertisementMonitor *monitor);
+
+void binc_advertisement_monitor_unpublish(AdvertisementMonitor *monitor);
+
+void binc_advertisement_monitor_set_user_data(AdvertisementMonitor *monitor, void *user_data);
+
+void *binc_advertisement_monitor_get_user_data(const AdvertisementMonitor *monitor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BINC_ADVERTISEMENT_MONITOR_H
@@ -38,6 +38,7 @@ struct binc_agent {
     GDBusConnection *connection; // Borrowed
     Adapter *adapter; // Borrowed
     guint registration_id;
+    GCancellable *cancellable; // Owned, cancelled when the agent is freed
     AgentRequestAuthorizationCallback request_authorization_callback;
     AgentRequestPasskeyCallback request_passkey_callback;
 };
@@ -49,6 +50,11 @@ void binc_agent_free(Agent *agent) {
         log_debug(TAG, "could not unregister agent");
     }
 
+    // Callbacks of cancelled calls return without touching the agent
+    g_cancellable_cancel(agent->cancellable);
+    g_object_unref(agent->cancellable);
+    agent->cancellable = NULL;
+
     g_free((char *) agent->path);
     agent->path = NULL;
 
@@ -213,36 +219,67 @@ static int bluez_register_agent(Agent *agent) {
     return 0;
 }
 
-static int binc_agentmanager_call_method(GDBusConnection *connection, const gchar *method, GVariant *param) {
-    g_assert(connection != NULL);
+static void binc_agentmanager_call_method(Agent *agent, const gchar *method, GVariant *param,
+                                          GAsyncReadyCallback callback) {
+    g_assert(agent != NULL);
     g_assert(method != NULL);
 
-    GVariant *result;
-    GError *error = NULL;
+    g_dbus_connection_call(agent->connection,
+                           "org.bluez",
+                           "/org/bluez",
+                           "org.bluez.AgentManager1",
+                           method,
+                           param,
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           binc_adapter_get_call_timeout(agent->adapter),
+                           agent->cancellable,
+                           callback,
+                           agent);
+}
 
-    result = g_dbus_connection_call_sync(connection,
-                                         "org.bluez",
-                                         "/org/bluez",
-                                         "org.bluez.AgentManager1",
-                                         method,
-                                         param,
-                                         NULL,
-                                         G_DBUS_CALL_FLAGS_NONE,
-                                         -1,
-                                         NULL,
-                                         &error);
-    g_variant_unref(result);
+/**
+ * Finish an AgentManager call
+ *
+ * @return FALSE if the call failed, or was cancelled because the agent was freed
+ */
+static gboolean binc_agentmanager_call_method_finish(GObject *source_object, GAsyncResult *res,
+                                                     const gchar *method) {
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (result != NULL) {
+        g_variant_unref(result);
+    }
 
     if (error != NULL) {
-        log_error(TAG, "AgentManager call failed '%s': %s\n", method, error->message);
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            log_error(TAG, "AgentManager call failed '%s': %s\n", method, error->message);
+        }
         g_clear_error(&error);
-        return 1;
+        return FALSE;
     }
+    return TRUE;
+}
 
-    return 0;
+static void binc_agentmanager_request_default_agent_cb(GObject *source_object, GAsyncResult *res,
+                                                       __attribute__((unused)) gpointer user_data) {
+    if (!binc_agentmanager_call_method_finish(source_object, res, "RequestDefaultAgent")) {
+        log_debug(TAG, "failed to register agent as default agent");
+    }
 }
 
-int binc_agentmanager_register_agent(Agent *agent) {
+static void binc_agentmanager_register_agent_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    if (!binc_agentmanager_call_method_finish(source_object, res, "RegisterAgent")) {
+        log_debug(TAG, "failed to register agent");
+        return;
+    }
+
+    Agent *agent = (Agent *) user_data;
+    binc_agentmanager_call_method(agent, "RequestDefaultAgent", g_variant_new("(o)", agent->path),
+                                  binc_agentmanager_request_default_agent_cb);
+}
+
+void binc_agentmanager_register_agent(Agent *agent) {
     g_assert(agent != NULL);
     char *capability = NULL;
 
@@ -263,17 +300,10 @@ int binc_agentmanager_register_agent(Agent *agent) {
             capability = "KeyboardDisplay";
             break;
     }
-    int result = binc_agentmanager_call_method(agent->connection, "RegisterAgent",
-                                               g_variant_new("(os)", agent->path, capability));
-    if (result == EXIT_FAILURE) {
-        log_debug(TAG, "failed to register agent");
-    }
 
-    result = binc_agentmanager_call_method(agent->connection, "RequestDefaultAgent", g_variant_new("(o)", agent->path));
-    if (result == EXIT_FAILURE) {
-        log_debug(TAG, "failed to register agent as default agent");
-    }
-    return result;
+    // Asynchronous, so a stuck BlueZ doesn't block the main loop. The agent is made the default once it is registered.
+    binc_agentmanager_call_method(agent, "RegisterAgent", g_variant_new("(os)", agent->path, capability),
+                                  binc_agentmanager_register_agent_cb);
 }
 
 Agent *binc_agent_create(Adapter *adapter, const char *path, IoCapability io_capability) {
@@ -282,6 +312,7 @@ Agent *binc_agent_create(Adapter *adapter, const char *path, IoCapability io_cap
     agent->connection = binc_adapter_get_dbus_connection(adapter);
     agent->adapter = adapter;
     agent->io_capability = io_capability;
+    agent->cancellable = g_cancellable_new();
     bluez_register_agent(agent);
     binc_agentmanager_register_agent(agent);
     return agent;
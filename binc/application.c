@@ -26,7 +26,10 @@
 #include "logger.h"
 #include "characteristic.h"
 #include "utility.h"
+#include "property_dispatch.h"
+#include "runtime.h"
 #include <errno.h>
+#include <string.h>
 
 #define GATT_SERV_INTERFACE "org.bluez.GattService1"
 #define GATT_CHAR_INTERFACE "org.bluez.GattCharacteristic1"
@@ -107,10 +110,20 @@ static const gchar descriptor_xml[] =
         "  </interface>"
         "</node>";
 
+// Identifies a published characteristic in binc_application_notify calls made off the runtime worker
+typedef struct characteristic_key {
+    BincUuid service_uuid;
+    BincUuid char_uuid;
+} CharacteristicKey;
+
 struct binc_application {
     char *path;
     guint registration_id;
     GDBusConnection *connection;
+    Runtime *runtime; // Borrowed, NULL when not created on a runtime worker
+    gint ref_count; // Queued notify commands keep the application alive until they ran
+    GMutex lock; // Guards published_characteristics, which is read from any thread
+    GHashTable *published_characteristics; // Owned, set of CharacteristicKey
     GHashTable *services;
     onLocalCharacteristicWrite on_char_write;
     onLocalCharacteristicRead on_char_read;
@@ -123,16 +136,18 @@ struct binc_application {
 
 typedef struct binc_local_service {
     char *path;
-    char *uuid;
+    const char *uuid; // Interned
+    BincUuid binary_uuid;
     guint registration_id;
     GHashTable *characteristics;
     Application *application;
 } LocalService;
 
 typedef struct local_characteristic {
-    char *service_uuid;
+    const char *service_uuid; // Interned
     char *service_path;
-    char *uuid;
+    const char *uuid; // Interned
+    BincUuid binary_uuid;
     char *path;
     guint registration_id;
     GByteArray *value;
@@ -146,9 +161,10 @@ typedef struct local_characteristic {
 typedef struct local_descriptor {
     char *path;
     char *char_path;
-    char *uuid;
-    char *char_uuid;
-    char *service_uuid;
+    const char *uuid; // Interned
+    BincUuid binary_uuid;
+    const char *char_uuid; // Interned
+    const char *service_uuid; // Interned
     guint registration_id;
     GByteArray *value;
     guint permissions;
@@ -181,13 +197,8 @@ static void binc_local_desc_free(LocalDescriptor *localDescriptor) {
     g_free(localDescriptor->char_path);
     localDescriptor->char_path = NULL;
 
-    g_free(localDescriptor->uuid);
     localDescriptor->uuid = NULL;
-
-    g_free(localDescriptor->char_uuid);
     localDescriptor->char_uuid = NULL;
-
-    g_free(localDescriptor->service_uuid);
     localDescriptor->service_uuid = NULL;
 
     if (localDescriptor->flags != NULL) {
@@ -225,10 +236,7 @@ static void binc_local_char_free(LocalCharacteristic *localCharacteristic) {
     g_free(localCharacteristic->path);
     localCharacteristic->path = NULL;
 
-    g_free(localCharacteristic->uuid);
     localCharacteristic->uuid = NULL;
-
-    g_free(localCharacteristic->service_uuid);
     localCharacteristic->service_uuid = NULL;
 
     g_free(localCharacteristic->service_path);
@@ -264,7 +272,6 @@ void binc_local_service_free(LocalService *localService) {
     g_free(localService->path);
     localService->path = NULL;
 
-    g_free(localService->uuid);
     localService->uuid = NULL;
 
     g_free(localService);
@@ -283,27 +290,42 @@ void read_options_free(ReadOptions *options) {
     g_free(options);
 }
 
+static void read_option_offset(gpointer object, GVariant *value) {
+    ((ReadOptions *) object)->offset = g_variant_get_uint16(value);
+}
+
+static void read_option_mtu(gpointer object, GVariant *value) {
+    ((ReadOptions *) object)->mtu = g_variant_get_uint16(value);
+}
+
+static void read_option_device(gpointer object, GVariant *value) {
+    ReadOptions *options = (ReadOptions *) object;
+    g_free(options->device);
+    options->device = path_to_address(g_variant_get_string(value, NULL));
+}
+
+static void read_option_link(gpointer object, GVariant *value) {
+    ReadOptions *options = (ReadOptions *) object;
+    g_free(options->link_type);
+    options->link_type = g_strdup(g_variant_get_string(value, NULL));
+}
+
+static const PropertyHandlerEntry read_option_handlers[] = {
+        {"offset", "q", read_option_offset},
+        {"mtu",    "q", read_option_mtu},
+        {"device", "o", read_option_device},
+        {"link",   "s", read_option_link},
+};
+
+static PropertyDispatcher read_option_dispatcher = BINC_PROPERTY_DISPATCHER(read_option_handlers);
+
 static ReadOptions *parse_read_options(GVariant *params) {
     g_assert(g_str_equal(g_variant_get_type_string(params), "(a{sv})"));
     ReadOptions *options = g_new0(ReadOptions, 1);
 
-    GVariantIter *optionsVariant;
-    g_variant_get(params, "(a{sv})", &optionsVariant);
-
-    GVariant *property_value;
-    gchar *property_name;
-    while (g_variant_iter_loop(optionsVariant, "{&sv}", &property_name, &property_value)) {
-        if (g_str_equal(property_name, "offset")) {
-            options->offset = g_variant_get_uint16(property_value);
-        } else if (g_str_equal(property_name, "mtu")) {
-            options->mtu = g_variant_get_uint16(property_value);
-        } else if (g_str_equal(property_name, "device")) {
-            options->device = path_to_address(g_variant_get_string(property_value, NULL));
-        } else if (g_str_equal(property_name, "link")) {
-            options->link_type = g_strdup(g_variant_get_string(property_value, NULL));
-        }
-    }
-    g_variant_iter_free(optionsVariant);
+    GVariant *optionsVariant = g_variant_get_child_value(params, 0);
+    binc_property_dispatch_all(&read_option_dispatcher, options, optionsVariant);
+    g_variant_unref(optionsVariant);
 
     log_debug(TAG, "read with offset=%u, mtu=%u, link=%s, device=%s", (unsigned int) options->offset,
               (unsigned int) options->mtu, options->link_type, options->device);
@@ -326,27 +348,47 @@ void write_options_free(WriteOptions *options) {
     g_free(options);
 }
 
+static void write_option_offset(gpointer object, GVariant *value) {
+    ((WriteOptions *) object)->offset = g_variant_get_uint16(value);
+}
+
+static void write_option_type(gpointer object, GVariant *value) {
+    WriteOptions *options = (WriteOptions *) object;
+    g_free(options->write_type);
+    options->write_type = g_strdup(g_variant_get_string(value, NULL));
+}
+
+static void write_option_mtu(gpointer object, GVariant *value) {
+    ((WriteOptions *) object)->mtu = g_variant_get_uint16(value);
+}
+
+static void write_option_device(gpointer object, GVariant *value) {
+    WriteOptions *options = (WriteOptions *) object;
+    g_free(options->device);
+    options->device = path_to_address(g_variant_get_string(value, NULL));
+}
+
+static void write_option_link(gpointer object, GVariant *value) {
+    WriteOptions *options = (WriteOptions *) object;
+    g_free(options->link_type);
+    options->link_type = g_strdup(g_variant_get_string(value, NULL));
+}
+
+static const PropertyHandlerEntry write_option_handlers[] = {
+        {"offset", "q", write_option_offset},
+        {"type",   "s", write_option_type},
+        {"mtu",    "q", write_option_mtu},
+        {"device", "o", write_option_device},
+        {"link",   "s", write_option_link},
+};
+
+static PropertyDispatcher write_option_dispatcher = BINC_PROPERTY_DISPATCHER(write_option_handlers);
+
 static WriteOptions *parse_write_options(GVariant *optionsVariant) {
     g_assert(g_str_equal(g_variant_get_type_string(optionsVariant), "a{sv}"));
     WriteOptions *options = g_new0(WriteOptions, 1);
 
-    GVariantIter iter;
-    g_variant_iter_init(&iter, optionsVariant);
-    GVariant *property_value;
-    gchar *property_name;
-    while (g_variant_iter_loop(&iter, "{&sv}", &property_name, &property_value)) {
-        if (g_str_equal(property_name, "offset")) {
-            options->offset = g_variant_get_uint16(property_value);
-        } else if (g_str_equal(property_name, "type")) {
-            options->write_type = g_strdup(g_variant_get_string(property_value, NULL));
-        } else if (g_str_equal(property_name, "mtu")) {
-            options->mtu = g_variant_get_uint16(property_value);
-        } else if (g_str_equal(property_name, "device")) {
-            options->device = path_to_address(g_variant_get_string(property_value, NULL));
-        } else if (g_str_equal(property_name, "link")) {
-            options->link_type = g_strdup(g_variant_get_string(property_value, NULL));
-        }
-    }
+    binc_property_dispatch_all(&write_option_dispatcher, options, optionsVariant);
 
     log_debug(TAG, "write with offset=%u, mtu=%u, link=%s, device=%s", (unsigned int) options->offset,
               (unsigned int) options->mtu, options->link_type, options->device);
@@ -498,7 +540,7 @@ static void add_services(Application *application, GVariantBuilder *builder) {
         // Build service properties
         GVariantBuilder *service_properties_builder = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
         g_variant_builder_add(service_properties_builder, "{sv}", "UUID",
-                              g_variant_new_string((char *) key));
+                              g_variant_new_string(localService->uuid));
         g_variant_builder_add(service_properties_builder, "{sv}", "Primary",
                               g_variant_new_boolean(TRUE));
         g_variant_builder_add(service_properties_builder, "{sv}", "Characteristics",
@@ -571,15 +613,53 @@ void binc_application_publish(Application *application, const Adapter *adapter)
     log_debug(TAG, "successfully published application");
 }
 
+static guint characteristic_key_hash(gconstpointer key) {
+    const CharacteristicKey *characteristic_key = (const CharacteristicKey *) key;
+    return binc_uuid_hash(&characteristic_key->service_uuid) * 31 + binc_uuid_hash(&characteristic_key->char_uuid);
+}
+
+static gboolean characteristic_key_equal(gconstpointer a, gconstpointer b) {
+    return memcmp(a, b, sizeof(CharacteristicKey)) == 0;
+}
+
+static gboolean application_has_characteristic(const Application *application, const BincUuid *service_uuid,
+                                               const BincUuid *char_uuid) {
+    CharacteristicKey key = {*service_uuid, *char_uuid};
+    Application *mutable_application = (Application *) application;
+    g_mutex_lock(&mutable_application->lock);
+    gboolean result = g_hash_table_contains(application->published_characteristics, &key);
+    g_mutex_unlock(&mutable_application->lock);
+    return result;
+}
+
+static Application *application_ref(const Application *application) {
+    Application *mutable_application = (Application *) application;
+    g_atomic_int_inc(&mutable_application->ref_count);
+    return mutable_application;
+}
+
+static void application_unref(Application *application) {
+    if (!g_atomic_int_dec_and_test(&application->ref_count)) return;
+
+    g_hash_table_destroy(application->published_characteristics);
+    g_mutex_clear(&application->lock);
+    g_free(application);
+}
+
 Application *binc_create_application(const Adapter *adapter) {
     g_assert(adapter != NULL);
 
     Application *application = g_new0(Application, 1);
     application->connection = binc_adapter_get_dbus_connection(adapter);
+    application->runtime = binc_runtime_get_current();
+    application->ref_count = 1;
+    g_mutex_init(&application->lock);
+    application->published_characteristics = g_hash_table_new_full(characteristic_key_hash, characteristic_key_equal,
+                                                                   g_free, NULL);
     application->path = g_strdup("/org/bluez/bincapplication");
-    application->services = g_hash_table_new_full(g_str_hash,
-                                                  g_str_equal,
-                                                  g_free,
+    application->services = g_hash_table_new_full(binc_uuid_hash,
+                                                  binc_uuid_equal,
+                                                  NULL,
                                                   (GDestroyNotify) binc_local_service_free);
 
     binc_application_publish(application, adapter);
@@ -610,14 +690,21 @@ void binc_application_free(Application *application) {
         application->path = NULL;
     }
 
-    g_free(application);
+    g_mutex_lock(&application->lock);
+    g_hash_table_remove_all(application->published_characteristics);
+    g_mutex_unlock(&application->lock);
+
+    // Notify commands still queued on the runtime see the services are gone and do nothing
+    application_unref(application);
 }
 
 static const GDBusInterfaceVTable service_table = {};
 
 int binc_application_add_service(Application *application, const char *service_uuid) {
     g_return_val_if_fail (application != NULL, EINVAL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), EINVAL);
+
+    BincUuid uuid;
+    if (!parse_uuid(service_uuid, &uuid)) return EINVAL;
 
     GError *error = NULL;
     GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(service_xml, &error);
@@ -628,18 +715,19 @@ int binc_application_add_service(Application *application, const char *service_u
     }
 
     LocalService *localService = g_new0(LocalService, 1);
-    localService->uuid = g_strdup(service_uuid);
+    localService->binary_uuid = uuid;
+    localService->uuid = binc_uuid_to_interned_string(&uuid);
     localService->application = application;
     localService->characteristics = g_hash_table_new_full(
-            g_str_hash,
-            g_str_equal,
-            g_free,
+            binc_uuid_hash,
+            binc_uuid_equal,
+            NULL,
             (GDestroyNotify) binc_local_char_free);
     localService->path = g_strdup_printf(
             "%s/service%d",
             application->path,
             g_hash_table_size(application->services));
-    g_hash_table_insert(application->services, g_strdup(service_uuid), localService);
+    g_hash_table_insert(application->services, &localService->binary_uuid, localService);
 
     localService->registration_id = g_dbus_connection_register_object(application->connection,
                                                                       localService->path,
@@ -653,20 +741,19 @@ int binc_application_add_service(Application *application, const char *service_u
     if (localService->registration_id == 0) {
         log_debug(TAG, "failed to publish local service");
         log_debug(TAG, "Error %s", error->message);
-        g_hash_table_remove(application->services, service_uuid);
-        binc_local_service_free(localService);
         g_clear_error(&error);
+        g_hash_table_remove(application->services, &localService->binary_uuid);
         return EINVAL;
     }
 
-    log_debug(TAG, "successfully published local service %s", service_uuid);
+    log_debug(TAG, "successfully published local service %s", localService->uuid);
     return 0;
 }
 
 
-static LocalService *binc_application_get_service(const Application *application, const char *service_uuid) {
+static LocalService *binc_application_get_service(const Application *application, const BincUuid *service_uuid) {
     g_return_val_if_fail (application != NULL, NULL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), NULL);
+    g_return_val_if_fail (service_uuid != NULL, NULL);
 
     return g_hash_table_lookup(application->services, service_uuid);
 }
@@ -782,12 +869,12 @@ static int binc_descriptor_set_value(const Application *application, LocalDescri
     return 0;
 }
 
-static LocalCharacteristic *get_local_characteristic(const Application *application, const char *service_uuid,
-                                                     const char *char_uuid) {
+static LocalCharacteristic *get_local_characteristic_by_uuid(const Application *application,
+                                                             const BincUuid *service_uuid,
+                                                             const BincUuid *char_uuid) {
 
     g_return_val_if_fail (application != NULL, NULL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), NULL);
-    g_return_val_if_fail (is_valid_uuid(char_uuid), NULL);
+    g_return_val_if_fail (char_uuid != NULL, NULL);
 
     LocalService *service = binc_application_get_service(application, service_uuid);
     if (service != NULL) {
@@ -796,17 +883,24 @@ static LocalCharacteristic *get_local_characteristic(const Application *applicat
     return NULL;
 }
 
+static LocalCharacteristic *get_local_characteristic(const Application *application, const char *service_uuid,
+                                                     const char *char_uuid) {
+    BincUuid service, characteristic;
+    if (!parse_uuid(service_uuid, &service) || !parse_uuid(char_uuid, &characteristic)) return NULL;
+    return get_local_characteristic_by_uuid(application, &service, &characteristic);
+}
+
 static LocalDescriptor *get_local_descriptor(const Application *application, const char *service_uuid,
                                              const char *char_uuid, const char *desc_uuid) {
 
     g_return_val_if_fail (application != NULL, NULL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), NULL);
-    g_return_val_if_fail (is_valid_uuid(char_uuid), NULL);
-    g_return_val_if_fail (is_valid_uuid(desc_uuid), NULL);
+
+    BincUuid descriptor;
+    if (!parse_uuid(desc_uuid, &descriptor)) return NULL;
 
     LocalCharacteristic *characteristic = get_local_characteristic(application, service_uuid, char_uuid);
     if (characteristic != NULL) {
-        return g_hash_table_lookup(characteristic->descriptors, desc_uuid);
+        return g_hash_table_lookup(characteristic->descriptors, &descriptor);
     }
     return NULL;
 }
@@ -900,7 +994,9 @@ static const GDBusInterfaceVTable descriptor_table = {
 int binc_application_add_descriptor(Application *application, const char *service_uuid,
                                     const char *char_uuid, const char *desc_uuid, guint permissions) {
     g_return_val_if_fail (application != NULL, EINVAL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), EINVAL);
+
+    BincUuid uuid;
+    if (!parse_uuid(desc_uuid, &uuid)) return EINVAL;
 
     LocalCharacteristic *localCharacteristic = get_local_characteristic(application, service_uuid, char_uuid);
     if (localCharacteristic == NULL) {
@@ -917,16 +1013,17 @@ int binc_application_add_descriptor(Application *application, const char *servic
     }
 
     LocalDescriptor *localDescriptor = g_new0(LocalDescriptor, 1);
-    localDescriptor->uuid = g_strdup(desc_uuid);
+    localDescriptor->binary_uuid = uuid;
+    localDescriptor->uuid = binc_uuid_to_interned_string(&uuid);
     localDescriptor->application = application;
     localDescriptor->char_path = g_strdup(localCharacteristic->path);
-    localDescriptor->char_uuid = g_strdup(char_uuid);
-    localDescriptor->service_uuid = g_strdup(service_uuid);
+    localDescriptor->char_uuid = localCharacteristic->uuid;
+    localDescriptor->service_uuid = localCharacteristic->service_uuid;
     localDescriptor->flags = permissions2Flags(permissions);
     localDescriptor->path = g_strdup_printf("%s/desc%d",
                                             localCharacteristic->path,
                                             g_hash_table_size(localCharacteristic->descriptors));
-    g_hash_table_insert(localCharacteristic->descriptors, g_strdup(desc_uuid), localDescriptor);
+    g_hash_table_insert(localCharacteristic->descriptors, &localDescriptor->binary_uuid, localDescriptor);
 
     // Register characteristic
     localDescriptor->registration_id = g_dbus_connection_register_object(application->connection,
@@ -942,11 +1039,11 @@ int binc_application_add_descriptor(Application *application, const char *servic
         log_debug(TAG, "failed to publish local characteristic");
         log_debug(TAG, "Error %s", error->message);
         g_clear_error(&error);
-        g_hash_table_remove(localCharacteristic->descriptors, desc_uuid);
+        g_hash_table_remove(localCharacteristic->descriptors, &uuid);
         return EINVAL;
     }
 
-    log_debug(TAG, "successfully published local descriptor %s", desc_uuid);
+    log_debug(TAG, "successfully published local descriptor %s", localDescriptor->uuid);
     return 0;
 }
 
@@ -957,14 +1054,25 @@ int binc_application_set_char_value(const Application *application, const char *
     g_return_val_if_fail (service_uuid != NULL, EINVAL);
     g_return_val_if_fail (char_uuid != NULL, EINVAL);
     g_return_val_if_fail (byteArray != NULL, EINVAL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), EINVAL);
-    g_return_val_if_fail (is_valid_uuid(char_uuid), EINVAL);
+
+    BincUuid service, characteristic;
+    if (!parse_uuid(service_uuid, &service) || !parse_uuid(char_uuid, &characteristic)) return EINVAL;
+    return binc_application_set_char_value_by_uuid(application, &service, &characteristic, byteArray);
+}
+
+int binc_application_set_char_value_by_uuid(const Application *application, const BincUuid *service_uuid,
+                                            const BincUuid *char_uuid, GByteArray *byteArray) {
+    g_return_val_if_fail (application != NULL, EINVAL);
+    g_return_val_if_fail (service_uuid != NULL, EINVAL);
+    g_return_val_if_fail (char_uuid != NULL, EINVAL);
+    g_return_val_if_fail (byteArray != NULL, EINVAL);
 
 	log_debug(TAG, "calling get_local_characteristic"); 
-    LocalCharacteristic *characteristic = get_local_characteristic(application, service_uuid, char_uuid);
+    LocalCharacteristic *characteristic = get_local_characteristic_by_uuid(application, service_uuid, char_uuid);
 	log_debug(TAG, "after calling get_local_characteristic, characteristic = %d", characteristic); 
     if (characteristic == NULL) {
-        g_critical("%s: characteristic with uuid %s does not exist", G_STRFUNC, char_uuid);
+        g_critical("%s: characteristic with uuid %s does not exist", G_STRFUNC,
+                   binc_uuid_to_interned_string(char_uuid));
         return EINVAL;
     }
 
@@ -982,8 +1090,6 @@ int binc_application_set_desc_value(const Application *application, const char *
     g_return_val_if_fail (service_uuid != NULL, EINVAL);
     g_return_val_if_fail (char_uuid != NULL, EINVAL);
     g_return_val_if_fail (byteArray != NULL, EINVAL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), EINVAL);
-    g_return_val_if_fail (is_valid_uuid(char_uuid), EINVAL);
 
     LocalDescriptor *descriptor = get_local_descriptor(application, service_uuid, char_uuid, desc_uuid);
     if (descriptor == NULL) {
@@ -1000,8 +1106,6 @@ GByteArray *binc_application_get_char_value(const Application *application, cons
     g_return_val_if_fail (application != NULL, NULL);
     g_return_val_if_fail (service_uuid != NULL, NULL);
     g_return_val_if_fail (char_uuid != NULL, NULL);
-    g_return_val_if_fail (g_uuid_string_is_valid(service_uuid), NULL);
-    g_return_val_if_fail (g_uuid_string_is_valid(char_uuid), NULL);
 
     LocalCharacteristic *characteristic = get_local_characteristic(application, service_uuid, char_uuid);
     if (characteristic != NULL) {
@@ -1155,10 +1259,11 @@ int binc_application_add_characteristic(Application *application, const char *se
                                         const char *char_uuid, guint permissions) {
 
     g_return_val_if_fail (application != NULL, EINVAL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), EINVAL);
-    g_return_val_if_fail (is_valid_uuid(char_uuid), EINVAL);
 
-    LocalService *localService = binc_application_get_service(application, service_uuid);
+    BincUuid service, uuid;
+    if (!parse_uuid(service_uuid, &service) || !parse_uuid(char_uuid, &uuid)) return EINVAL;
+
+    LocalService *localService = binc_application_get_service(application, &service);
     if (localService == NULL) {
         g_critical("service %s does not exist", service_uuid);
         return EINVAL;
@@ -1174,9 +1279,10 @@ int binc_application_add_characteristic(Application *application, const char *se
     }
 
     LocalCharacteristic *characteristic = g_new0(LocalCharacteristic, 1);
-    characteristic->service_uuid = g_strdup(service_uuid);
+    characteristic->service_uuid = localService->uuid;
     characteristic->service_path = g_strdup(localService->path);
-    characteristic->uuid = g_strdup(char_uuid);
+    characteristic->binary_uuid = uuid;
+    characteristic->uuid = binc_uuid_to_interned_string(&uuid);
     characteristic->permissions = permissions;
     characteristic->flags = permissions2Flags(permissions);
     characteristic->value = NULL;
@@ -1185,11 +1291,11 @@ int binc_application_add_characteristic(Application *application, const char *se
                                            localService->path,
                                            g_hash_table_size(localService->characteristics));
     characteristic->descriptors = g_hash_table_new_full(
-            g_str_hash,
-            g_str_equal,
-            g_free,
+            binc_uuid_hash,
+            binc_uuid_equal,
+            NULL,
             (GDestroyNotify) binc_local_desc_free);
-    g_hash_table_insert(localService->characteristics, g_strdup(char_uuid), characteristic);
+    g_hash_table_insert(localService->characteristics, &characteristic->binary_uuid, characteristic);
 
     // Register characteristic
     characteristic->registration_id = g_dbus_connection_register_object(application->connection,
@@ -1205,11 +1311,18 @@ int binc_application_add_characteristic(Application *application, const char *se
         log_debug(TAG, "failed to publish local characteristic");
         log_debug(TAG, "Error %s", error->message);
         g_clear_error(&error);
-        g_hash_table_remove(localService->characteristics, char_uuid);
+        g_hash_table_remove(localService->characteristics, &uuid);
         return EINVAL;
     }
 
-    log_debug(TAG, "successfully published local characteristic %s", char_uuid);
+    CharacteristicKey *key = g_new0(CharacteristicKey, 1);
+    key->service_uuid = service;
+    key->char_uuid = uuid;
+    g_mutex_lock(&application->lock);
+    g_hash_table_add(application->published_characteristics, key);
+    g_mutex_unlock(&application->lock);
+
+    log_debug(TAG, "successfully published local characteristic %s", characteristic->uuid);
     return 0;
 }
 
@@ -1260,17 +1373,76 @@ void binc_application_set_char_stop_notify_cb(Application *application, onLocalC
     application->on_char_stop_notify = callback;
 }
 
+typedef struct application_notify_command {
+    Application *application; // Owned reference
+    BincUuid service_uuid;
+    BincUuid char_uuid;
+    GByteArray *byteArray;
+} ApplicationNotifyCommand;
+
+static int application_notify(const Application *application, const BincUuid *service_uuid,
+                              const BincUuid *char_uuid, const GByteArray *byteArray);
+
+static void binc_internal_notify_command_run(gpointer user_data) {
+    ApplicationNotifyCommand *command = (ApplicationNotifyCommand *) user_data;
+
+    // The application was freed after the command was queued
+    if (command->application->services == NULL) return;
+
+    application_notify(command->application, &command->service_uuid, &command->char_uuid, command->byteArray);
+}
+
+static void binc_internal_notify_command_free(gpointer user_data) {
+    ApplicationNotifyCommand *command = (ApplicationNotifyCommand *) user_data;
+    application_unref(command->application);
+    g_byte_array_free(command->byteArray, TRUE);
+    g_free(command);
+}
+
 int binc_application_notify(const Application *application, const char *service_uuid, const char *char_uuid,
                             const GByteArray *byteArray) {
 
     g_return_val_if_fail (application != NULL, EINVAL);
     g_return_val_if_fail (byteArray != NULL, EINVAL);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), EINVAL);
-    g_return_val_if_fail (is_valid_uuid(char_uuid), EINVAL);
 
-    LocalCharacteristic *characteristic = get_local_characteristic(application, service_uuid, char_uuid);
+    BincUuid service, characteristic;
+    if (!parse_uuid(service_uuid, &service) || !parse_uuid(char_uuid, &characteristic)) return EINVAL;
+    return binc_application_notify_by_uuid(application, &service, &characteristic, byteArray);
+}
+
+int binc_application_notify_by_uuid(const Application *application, const BincUuid *service_uuid,
+                                    const BincUuid *char_uuid, const GByteArray *byteArray) {
+
+    g_return_val_if_fail (application != NULL, EINVAL);
+    g_return_val_if_fail (service_uuid != NULL, EINVAL);
+    g_return_val_if_fail (char_uuid != NULL, EINVAL);
+    g_return_val_if_fail (byteArray != NULL, EINVAL);
+
+    if (application->runtime == NULL || binc_runtime_is_worker_thread(application->runtime)) {
+        return application_notify(application, service_uuid, char_uuid, byteArray);
+    }
+
+    if (!application_has_characteristic(application, service_uuid, char_uuid)) {
+        g_critical("%s: characteristic %s does not exist", G_STRFUNC, binc_uuid_to_interned_string(char_uuid));
+        return EINVAL;
+    }
+
+    ApplicationNotifyCommand *command = g_new0(ApplicationNotifyCommand, 1);
+    command->application = application_ref(application);
+    command->service_uuid = *service_uuid;
+    command->char_uuid = *char_uuid;
+    command->byteArray = g_byte_array_sized_new(byteArray->len);
+    g_byte_array_append(command->byteArray, byteArray->data, byteArray->len);
+    binc_runtime_invoke(application->runtime, binc_internal_notify_command_run, command,
+                        binc_internal_notify_command_free);
+    return 0;
+}
+
+static int application_notify(const Application *application, const BincUuid *service_uuid,
+                              const BincUuid *char_uuid, const GByteArray *byteArray) {
+    LocalCharacteristic *characteristic = get_local_characteristic_by_uuid(application, service_uuid, char_uuid);
     if (characteristic == NULL) {
-        g_critical("%s: characteristic %s does not exist", G_STRFUNC, service_uuid);
+        g_critical("%s: characteristic %s does not exist", G_STRFUNC, binc_uuid_to_interned_string(char_uuid));
         return EINVAL;
     }
 
@@ -1313,8 +1485,6 @@ int binc_application_notify(const Application *application, const char *service_
 gboolean binc_application_char_is_notifying(const Application *application, const char *service_uuid,
                                             const char *char_uuid) {
     g_return_val_if_fail (application != NULL, FALSE);
-    g_return_val_if_fail (is_valid_uuid(service_uuid), FALSE);
-    g_return_val_if_fail (is_valid_uuid(char_uuid), FALSE);
 
     LocalCharacteristic *characteristic = get_local_characteristic(application, service_uuid, char_uuid);
     if (characteristic == NULL) {
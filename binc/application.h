@@ -26,6 +26,7 @@
 
 #include <gio/gio.h>
 #include "forward_decl.h"
+#include "uuid.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -101,6 +102,9 @@ void binc_application_set_char_stop_notify_cb(Application *application, onLocalC
 int binc_application_set_char_value(const Application *application, const char *service_uuid,
                                     const char *char_uuid, GByteArray *byteArray);
 
+int binc_application_set_char_value_by_uuid(const Application *application, const BincUuid *service_uuid,
+                                            const BincUuid *char_uuid, GByteArray *byteArray);
+
 GByteArray *binc_application_get_char_value(const Application *application, const char *service_uuid,
                                             const char *char_uuid);
 
@@ -111,9 +115,18 @@ void binc_application_set_desc_write_cb(Application *application, onLocalDescrip
 int binc_application_set_desc_value(const Application *application, const char *service_uuid,
                                     const char *char_uuid, const char *desc_uuid, GByteArray *byteArray);
 
+/**
+ * Notify subscribers of a new characteristic value.
+ * When the application was created on a Runtime worker, this can be called from any thread: the value is copied
+ * and the notification is sent from the worker. Unknown characteristics are still reported with EINVAL.
+ * Notifications that are queued when the application is freed are dropped.
+ */
 int binc_application_notify(const Application *application, const char *service_uuid, const char *char_uuid,
                             const GByteArray *byteArray);
 
+int binc_application_notify_by_uuid(const Application *application, const BincUuid *service_uuid,
+                                    const BincUuid *char_uuid, const GByteArray *byteArray);
+
 gboolean binc_application_char_is_notifying(const Application *application, const char *service_uuid,
                                             const char *char_uuid);
 
@@ -21,10 +21,12 @@
  *
  */
 
-#include "characteristic.h"
+#include "characteristic_internal.h"
 #include "logger.h"
 #include "utility.h"
 #include "device_internal.h"
+#include "property_dispatch.h"
+#include "signal_dispatcher.h"
 
 static const char *const TAG = "Characteristic";
 static const char *const INTERFACE_CHARACTERISTIC = "org.bluez.GattCharacteristic1";
@@ -34,20 +36,37 @@ static const char *const CHARACTERISTIC_METHOD_READ_VALUE = "ReadValue";
 static const char *const CHARACTERISTIC_METHOD_WRITE_VALUE = "WriteValue";
 static const char *const CHARACTERISTIC_METHOD_STOP_NOTIFY = "StopNotify";
 static const char *const CHARACTERISTIC_METHOD_START_NOTIFY = "StartNotify";
-static const char *const CHARACTERISTIC_PROPERTY_NOTIFYING = "Notifying";
-static const char *const CHARACTERISTIC_PROPERTY_VALUE = "Value";
+// Defines rather than constants so they can be used in the property table
+#define CHARACTERISTIC_PROPERTY_NOTIFYING "Notifying"
+#define CHARACTERISTIC_PROPERTY_VALUE "Value"
+
+typedef struct binc_read_data {
+    Characteristic *characteristic;
+    OnReadCompleteCallback callback;
+    gpointer user_data;
+    GDestroyNotify destroy;
+} ReadData;
 
 typedef struct binc_write_data {
     GVariant *value;
     Characteristic *characteristic;
+    OnWriteCompleteCallback callback;
+    gpointer user_data;
 } WriteData;
 
+typedef struct binc_notify_data {
+    Characteristic *characteristic;
+    OnNotifyingCompleteCallback callback;
+    gpointer user_data;
+} NotifyData;
+
 struct binc_characteristic {
     Device *device; // Borrowed
     Service *service; // Borrowed
     GDBusConnection *connection; // Borrowed
     const char *path; // Owned
-    const char *uuid; // Owned
+    const char *uuid; // Interned
+    BincUuid binary_uuid;
     const char *service_path; // Owned
     gboolean notifying;
     GList *flags; // Owned
@@ -93,7 +112,6 @@ void binc_characteristic_free(Characteristic *characteristic) {
         characteristic->descriptors = NULL;
     }
 
-    g_free((char *) characteristic->uuid);
     characteristic->uuid = NULL;
 
     g_free((char *) characteristic->path);
@@ -132,23 +150,22 @@ char *binc_characteristic_to_string(const Characteristic *characteristic) {
     return result;
 }
 
-static void binc_internal_char_read_cb(__attribute__((unused)) GObject *source_object,
-                                       GAsyncResult *res,
-                                       gpointer user_data) {
-    GError *error = NULL;
+static void binc_internal_char_read_cb(GVariant *value, const GError *error, gpointer user_data) {
     GByteArray *byteArray = NULL;
     GVariant *innerArray = NULL;
-    Characteristic *characteristic = (Characteristic *) user_data;
+    ReadData *readData = (ReadData *) user_data;
+    Characteristic *characteristic = readData->characteristic;
     g_assert(characteristic != NULL);
 
-    GVariant *value = g_dbus_connection_call_finish(characteristic->connection, res, &error);
     if (value != NULL) {
         g_assert(g_str_equal(g_variant_get_type_string(value), "(ay)"));
         innerArray = g_variant_get_child_value(value, 0);
         byteArray = g_variant_get_byte_array(innerArray);
     }
 
-    if (characteristic->on_read_callback != NULL) {
+    if (readData->callback != NULL) {
+        readData->callback(characteristic->device, characteristic, byteArray, error, readData->user_data);
+    } else if (characteristic->on_read_callback != NULL) {
         characteristic->on_read_callback(characteristic->device, characteristic, byteArray, error);
     }
 
@@ -160,80 +177,101 @@ static void binc_internal_char_read_cb(__attribute__((unused)) GObject *source_o
         g_variant_unref(innerArray);
     }
 
-    if (value != NULL) {
-        g_variant_unref(value);
-    }
-
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", CHARACTERISTIC_METHOD_READ_VALUE, error->code,
                   error->message);
-        g_clear_error(&error);
     }
 }
 
 void binc_characteristic_read(Characteristic *characteristic) {
+    binc_characteristic_read_with_cb(characteristic, NULL, NULL, NULL);
+}
+
+static void read_data_free(ReadData *readData) {
+    if (readData->destroy != NULL) {
+        readData->destroy(readData->user_data);
+    }
+    g_free(readData);
+}
+
+void binc_characteristic_read_with_cb(Characteristic *characteristic, GCancellable *cancellable,
+                                      OnReadCompleteCallback callback, gpointer user_data) {
+    binc_internal_characteristic_read_full(characteristic, cancellable, callback, user_data, NULL);
+}
+
+void binc_internal_characteristic_read_full(Characteristic *characteristic, GCancellable *cancellable,
+                                            OnReadCompleteCallback callback, gpointer user_data,
+                                            GDestroyNotify destroy) {
     g_assert(characteristic != NULL);
     g_assert((characteristic->properties & GATT_CHR_PROP_READ) > 0);
 
     log_debug(TAG, "reading <%s>", characteristic->uuid);
 
+    ReadData *readData = g_new0(ReadData, 1);
+    readData->characteristic = characteristic;
+    readData->callback = callback;
+    readData->user_data = user_data;
+    readData->destroy = destroy;
+
     guint16 offset = 0;
     GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
     g_variant_builder_add(builder, "{sv}", "offset", g_variant_new_uint16(offset));
     GVariant *options = g_variant_builder_end(builder);
     g_variant_builder_unref(builder);
 
-    g_dbus_connection_call(characteristic->connection,
-                           BLUEZ_DBUS,
-                           characteristic->path,
-                           INTERFACE_CHARACTERISTIC,
-                           CHARACTERISTIC_METHOD_READ_VALUE,
-                           g_variant_new("(@a{sv})", options),
-                           G_VARIANT_TYPE("(ay)"),
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) binc_internal_char_read_cb,
-                           characteristic);
-}
-
-static void binc_internal_char_write_cb(__attribute__((unused)) GObject *source_object,
-                                        GAsyncResult *res,
+    binc_gatt_queue_call(binc_internal_device_get_gatt_queue(characteristic->device),
+                         characteristic->path,
+                         INTERFACE_CHARACTERISTIC,
+                         CHARACTERISTIC_METHOD_READ_VALUE,
+                         g_variant_new("(@a{sv})", options),
+                         G_VARIANT_TYPE("(ay)"),
+                         FALSE,
+                         cancellable,
+                         binc_internal_char_read_cb,
+                         readData,
+                         (GDestroyNotify) read_data_free);
+}
+
+static void write_data_free(WriteData *writeData) {
+    g_variant_unref(writeData->value);
+    g_free(writeData);
+}
+
+static void binc_internal_char_write_cb(__attribute__((unused)) GVariant *value,
+                                        const GError *error,
                                         gpointer user_data) {
     WriteData *writeData = (WriteData*) user_data;
     Characteristic *characteristic = writeData->characteristic;
     g_assert(characteristic != NULL);
 
     GByteArray *byteArray = NULL;
-    GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(characteristic->connection, res, &error);
-
     if (writeData->value != NULL) {
         byteArray = g_variant_get_byte_array(writeData->value);
     }
 
-    if (characteristic->on_write_callback != NULL) {
+    if (writeData->callback != NULL) {
+        writeData->callback(characteristic->device, characteristic, byteArray, error, writeData->user_data);
+    } else if (characteristic->on_write_callback != NULL) {
         characteristic->on_write_callback(characteristic->device, characteristic, byteArray, error);
     }
 
     if (byteArray != NULL) {
         g_byte_array_free(byteArray, FALSE);
     }
-    g_variant_unref(writeData->value);
-    g_free(writeData);
-
-    if (value != NULL) {
-        g_variant_unref(value);
-    }
 
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", CHARACTERISTIC_METHOD_WRITE_VALUE,
                   error->code, error->message);
-        g_clear_error(&error);
     }
 }
 
 void binc_characteristic_write(Characteristic *characteristic, const GByteArray *byteArray, WriteType writeType) {
+    binc_characteristic_write_with_cb(characteristic, byteArray, writeType, NULL, NULL, NULL);
+}
+
+void binc_characteristic_write_with_cb(Characteristic *characteristic, const GByteArray *byteArray,
+                                       WriteType writeType, GCancellable *cancellable,
+                                       OnWriteCompleteCallback callback, gpointer user_data) {
     g_assert(characteristic != NULL);
     g_assert(byteArray != NULL);
     g_assert(byteArray->len > 0);
@@ -248,6 +286,8 @@ void binc_characteristic_write(Characteristic *characteristic, const GByteArray
     WriteData *writeData = g_new0(WriteData, 1);
     writeData->value = g_variant_ref(value);
     writeData->characteristic = characteristic;
+    writeData->callback = callback;
+    writeData->user_data = user_data;
 
     guint16 offset = 0;
     const char *writeTypeString = writeType == WITH_RESPONSE ? "request" : "command";
@@ -257,20 +297,58 @@ void binc_characteristic_write(Characteristic *characteristic, const GByteArray
     GVariant *options = g_variant_builder_end(optionsBuilder);
     g_variant_builder_unref(optionsBuilder);
 
-    g_dbus_connection_call(characteristic->connection,
-                           BLUEZ_DBUS,
-                           characteristic->path,
-                           INTERFACE_CHARACTERISTIC,
-                           CHARACTERISTIC_METHOD_WRITE_VALUE,
-                           g_variant_new("(@ay@a{sv})", value, options),
-                           NULL,
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) binc_internal_char_write_cb,
-                           writeData);
+    // Writes without response get no ATT reply, so they do not have to wait for other operations
+    binc_gatt_queue_call(binc_internal_device_get_gatt_queue(characteristic->device),
+                         characteristic->path,
+                         INTERFACE_CHARACTERISTIC,
+                         CHARACTERISTIC_METHOD_WRITE_VALUE,
+                         g_variant_new("(@ay@a{sv})", value, options),
+                         NULL,
+                         writeType == WITHOUT_RESPONSE,
+                         cancellable,
+                         binc_internal_char_write_cb,
+                         writeData,
+                         (GDestroyNotify) write_data_free);
+}
+
+static void characteristic_notifying_changed(gpointer object, GVariant *value) {
+    Characteristic *characteristic = (Characteristic *) object;
+    characteristic->notifying = g_variant_get_boolean(value);
+    log_debug(TAG, "notifying %s <%s>", characteristic->notifying ? "true" : "false", characteristic->uuid);
+
+    if (characteristic->notify_state_callback != NULL) {
+        characteristic->notify_state_callback(characteristic->device, characteristic, NULL);
+    }
+
+    if (characteristic->notifying == FALSE) {
+        if (characteristic->characteristic_prop_changed != 0) {
+            g_dbus_connection_signal_unsubscribe(characteristic->connection,
+                                                 characteristic->characteristic_prop_changed);
+            characteristic->characteristic_prop_changed = 0;
+        }
+    }
+}
+
+static void characteristic_value_changed(gpointer object, GVariant *value) {
+    Characteristic *characteristic = (Characteristic *) object;
+    GByteArray *byteArray = g_variant_get_byte_array(value);
+    GString *result = g_byte_array_as_hex(byteArray);
+    log_debug(TAG, "notification <%s> on <%s>", result->str, characteristic->uuid);
+    g_string_free(result, TRUE);
+
+    if (characteristic->on_notify_callback != NULL) {
+        characteristic->on_notify_callback(characteristic->device, characteristic, byteArray);
+    }
+    g_byte_array_free(byteArray, FALSE);
 }
 
+static const PropertyHandlerEntry characteristic_changed_handlers[] = {
+        {CHARACTERISTIC_PROPERTY_NOTIFYING, "b",  characteristic_notifying_changed},
+        {CHARACTERISTIC_PROPERTY_VALUE,     "ay", characteristic_value_changed},
+};
+
+static PropertyDispatcher characteristic_changed_dispatcher = BINC_PROPERTY_DISPATCHER(characteristic_changed_handlers);
+
 static void binc_internal_signal_characteristic_changed(__attribute__((unused)) GDBusConnection *conn,
                                                         __attribute__((unused)) const gchar *sender,
                                                         __attribute__((unused)) const gchar *path,
@@ -291,32 +369,7 @@ static void binc_internal_signal_characteristic_changed(__attribute__((unused))
     g_assert(g_str_equal(g_variant_get_type_string(parameters), "(sa{sv}as)"));
     g_variant_get(parameters, "(&sa{sv}as)", &iface, &properties, &unknown);
     while (g_variant_iter_loop(properties, "{&sv}", &property_name, &property_value)) {
-        if (g_str_equal(property_name, CHARACTERISTIC_PROPERTY_NOTIFYING)) {
-            characteristic->notifying = g_variant_get_boolean(property_value);
-            log_debug(TAG, "notifying %s <%s>", characteristic->notifying ? "true" : "false", characteristic->uuid);
-
-            if (characteristic->notify_state_callback != NULL) {
-                characteristic->notify_state_callback(characteristic->device, characteristic, NULL);
-            }
-
-            if (characteristic->notifying == FALSE) {
-                if (characteristic->characteristic_prop_changed != 0) {
-                    g_dbus_connection_signal_unsubscribe(characteristic->connection,
-                                                         characteristic->characteristic_prop_changed);
-                    characteristic->characteristic_prop_changed = 0;
-                }
-            }
-        } else if (g_str_equal(property_name, CHARACTERISTIC_PROPERTY_VALUE)) {
-            GByteArray *byteArray = g_variant_get_byte_array(property_value);
-            GString *result = g_byte_array_as_hex(byteArray);
-            log_debug(TAG, "notification <%s> on <%s>", result->str, characteristic->uuid);
-            g_string_free(result, TRUE);
-
-            if (characteristic->on_notify_callback != NULL) {
-                characteristic->on_notify_callback(characteristic->device, characteristic, byteArray);
-            }
-            g_byte_array_free(byteArray, FALSE);
-        }
+        binc_property_dispatch(&characteristic_changed_dispatcher, characteristic, property_name, property_value);
     }
 
     if (properties != NULL) {
@@ -327,26 +380,22 @@ static void binc_internal_signal_characteristic_changed(__attribute__((unused))
     }
 }
 
-static void binc_internal_char_start_notify_cb(__attribute__((unused)) GObject *source_object,
-                                               GAsyncResult *res,
+static void binc_internal_char_start_notify_cb(__attribute__((unused)) GVariant *value,
+                                               const GError *error,
                                                gpointer user_data) {
-
-    Characteristic *characteristic = (Characteristic *) user_data;
+    NotifyData *notifyData = (NotifyData *) user_data;
+    Characteristic *characteristic = notifyData->characteristic;
     g_assert(characteristic != NULL);
 
-    GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(characteristic->connection, res, &error);
-    if (value != NULL) {
-        g_variant_unref(value);
-    }
-
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", CHARACTERISTIC_METHOD_START_NOTIFY, error->code,
                   error->message);
-        if (characteristic->notify_state_callback != NULL) {
-            characteristic->notify_state_callback(characteristic->device, characteristic, error);
-        }
-        g_clear_error(&error);
+    }
+
+    if (notifyData->callback != NULL) {
+        notifyData->callback(characteristic->device, characteristic, error, notifyData->user_data);
+    } else if (error != NULL && characteristic->notify_state_callback != NULL) {
+        characteristic->notify_state_callback(characteristic->device, characteristic, error);
     }
 }
 
@@ -365,64 +414,103 @@ static void register_for_properties_changed_signal(Characteristic *characteristi
     }
 }
 
+static NotifyData *notify_data_new(Characteristic *characteristic, OnNotifyingCompleteCallback callback,
+                                   gpointer user_data) {
+    NotifyData *notifyData = g_new0(NotifyData, 1);
+    notifyData->characteristic = characteristic;
+    notifyData->callback = callback;
+    notifyData->user_data = user_data;
+    return notifyData;
+}
+
 void binc_characteristic_start_notify(Characteristic *characteristic) {
+    binc_characteristic_start_notify_with_cb(characteristic, NULL, NULL, NULL);
+}
+
+void binc_characteristic_start_notify_with_cb(Characteristic *characteristic, GCancellable *cancellable,
+                                              OnNotifyingCompleteCallback callback, gpointer user_data) {
     g_assert(characteristic != NULL);
     g_assert(binc_characteristic_supports_notify(characteristic));
 
     log_debug(TAG, "start notify for <%s>", characteristic->uuid);
     register_for_properties_changed_signal(characteristic);
 
-    g_dbus_connection_call(characteristic->connection,
-                           BLUEZ_DBUS,
-                           characteristic->path,
-                           INTERFACE_CHARACTERISTIC,
-                           CHARACTERISTIC_METHOD_START_NOTIFY,
-                           NULL,
-                           NULL,
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) binc_internal_char_start_notify_cb,
-                           characteristic);
-}
-
-static void binc_internal_char_stop_notify_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
-    Characteristic *characteristic = (Characteristic *) user_data;
+    binc_gatt_queue_call(binc_internal_device_get_gatt_queue(characteristic->device),
+                         characteristic->path,
+                         INTERFACE_CHARACTERISTIC,
+                         CHARACTERISTIC_METHOD_START_NOTIFY,
+                         NULL,
+                         NULL,
+                         FALSE,
+                         cancellable,
+                         binc_internal_char_start_notify_cb,
+                         notify_data_new(characteristic, callback, user_data),
+                         g_free);
+}
+
+static void binc_internal_char_stop_notify_cb(__attribute__((unused)) GVariant *value,
+                                              const GError *error,
+                                              gpointer user_data) {
+    NotifyData *notifyData = (NotifyData *) user_data;
+    Characteristic *characteristic = notifyData->characteristic;
     g_assert(characteristic != NULL);
 
-    GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(characteristic->connection, res, &error);
-    if (value != NULL) {
-        g_variant_unref(value);
-    }
-
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", CHARACTERISTIC_METHOD_STOP_NOTIFY, error->code,
                   error->message);
-        if (characteristic->notify_state_callback != NULL) {
-            characteristic->notify_state_callback(characteristic->device, characteristic, error);
-        }
-        g_clear_error(&error);
+    }
+
+    if (notifyData->callback != NULL) {
+        notifyData->callback(characteristic->device, characteristic, error, notifyData->user_data);
+    } else if (error != NULL && characteristic->notify_state_callback != NULL) {
+        characteristic->notify_state_callback(characteristic->device, characteristic, error);
     }
 }
 
 void binc_characteristic_stop_notify(Characteristic *characteristic) {
+    binc_characteristic_stop_notify_with_cb(characteristic, NULL, NULL, NULL);
+}
+
+void binc_characteristic_stop_notify_with_cb(Characteristic *characteristic, GCancellable *cancellable,
+                                             OnNotifyingCompleteCallback callback, gpointer user_data) {
     g_assert(characteristic != NULL);
     g_assert((characteristic->properties & GATT_CHR_PROP_INDICATE) > 0 ||
              (characteristic->properties & GATT_CHR_PROP_NOTIFY) > 0);
 
-    g_dbus_connection_call(characteristic->connection,
-                           BLUEZ_DBUS,
-                           characteristic->path,
-                           INTERFACE_CHARACTERISTIC,
-                           CHARACTERISTIC_METHOD_STOP_NOTIFY,
-                           NULL,
-                           NULL,
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) binc_internal_char_stop_notify_cb,
-                           characteristic);
+    binc_gatt_queue_call(binc_internal_device_get_gatt_queue(characteristic->device),
+                         characteristic->path,
+                         INTERFACE_CHARACTERISTIC,
+                         CHARACTERISTIC_METHOD_STOP_NOTIFY,
+                         NULL,
+                         NULL,
+                         FALSE,
+                         cancellable,
+                         binc_internal_char_stop_notify_cb,
+                         notify_data_new(characteristic, callback, user_data),
+                         g_free);
+}
+
+GByteArray *binc_internal_characteristic_get_cached_value(const Characteristic *characteristic) {
+    g_assert(characteristic != NULL);
+
+    ObjectTree *tree = binc_signal_dispatcher_get_object_tree(characteristic->connection);
+    if (tree == NULL) return NULL;
+
+    GVariant *value = binc_object_tree_get_property(tree, characteristic->path, INTERFACE_CHARACTERISTIC,
+                                                    CHARACTERISTIC_PROPERTY_VALUE);
+    if (value == NULL) return NULL;
+
+    GByteArray *result = NULL;
+    if (g_str_equal(g_variant_get_type_string(value), "ay")) {
+        gsize length = 0;
+        const guint8 *data = g_variant_get_fixed_array(value, &length, sizeof(guint8));
+        if (length > 0) {
+            result = g_byte_array_sized_new((guint) length);
+            g_byte_array_append(result, data, (guint) length);
+        }
+    }
+    g_variant_unref(value);
+    return result;
 }
 
 void binc_characteristic_set_read_cb(Characteristic *characteristic, OnReadCallback callback) {
@@ -465,12 +553,17 @@ const char *binc_characteristic_get_uuid(const Characteristic *characteristic) {
     return characteristic->uuid;
 }
 
+const BincUuid *binc_characteristic_get_binary_uuid(const Characteristic *characteristic) {
+    g_assert(characteristic != NULL);
+    return &characteristic->binary_uuid;
+}
+
 void binc_characteristic_set_uuid(Characteristic *characteristic, const char *uuid) {
     g_assert(characteristic != NULL);
     g_assert(uuid != NULL);
 
-    g_free((char *) characteristic->uuid);
-    characteristic->uuid = g_strdup(uuid);
+    parse_uuid(uuid, &characteristic->binary_uuid);
+    characteristic->uuid = binc_uuid_to_interned_string(&characteristic->binary_uuid);
 }
 
 void binc_characteristic_set_mtu(Characteristic *characteristic, guint mtu) {
@@ -594,14 +687,21 @@ void binc_characteristic_add_descriptor(Characteristic *characteristic, Descript
 
 Descriptor *binc_characteristic_get_descriptor(const Characteristic *characteristic, const char* desc_uuid) {
     g_assert(characteristic != NULL);
-    g_assert(is_valid_uuid(desc_uuid));
 
-    if (characteristic->descriptors != NULL) {
-        for (GList *iterator = characteristic->descriptors; iterator; iterator = iterator->next) {
-            Descriptor *descriptor = (Descriptor *) iterator->data;
-            if (g_str_equal(desc_uuid, binc_descriptor_get_uuid(descriptor))) {
-                return descriptor;
-            }
+    BincUuid uuid;
+    if (!parse_uuid(desc_uuid, &uuid)) return NULL;
+    return binc_characteristic_get_descriptor_by_uuid(characteristic, &uuid);
+}
+
+Descriptor *binc_characteristic_get_descriptor_by_uuid(const Characteristic *characteristic,
+                                                       const BincUuid *desc_uuid) {
+    g_assert(characteristic != NULL);
+    g_assert(desc_uuid != NULL);
+
+    for (GList *iterator = characteristic->descriptors; iterator; iterator = iterator->next) {
+        Descriptor *descriptor = (Descriptor *) iterator->data;
+        if (binc_uuid_equal(desc_uuid, binc_descriptor_get_binary_uuid(descriptor))) {
+            return descriptor;
         }
     }
     return NULL;
@@ -27,6 +27,7 @@
 #include <gio/gio.h>
 #include "service.h"
 #include "forward_decl.h"
+#include "uuid.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,14 @@ typedef void (*OnReadCallback)(Device *device, Characteristic *characteristic, c
 
 typedef void (*OnWriteCallback)(Device *device, Characteristic *characteristic, const GByteArray *byteArray, const GError *error);
 
+typedef void (*OnReadCompleteCallback)(Device *device, Characteristic *characteristic, const GByteArray *byteArray,
+                                       const GError *error, gpointer user_data);
+
+typedef void (*OnWriteCompleteCallback)(Device *device, Characteristic *characteristic, const GByteArray *byteArray,
+                                        const GError *error, gpointer user_data);
+
+typedef void (*OnNotifyingCompleteCallback)(Device *device, Characteristic *characteristic, const GError *error,
+                                            gpointer user_data);
 
 void binc_characteristic_read(Characteristic *characteristic);
 
@@ -82,12 +91,38 @@ void binc_characteristic_start_notify(Characteristic *characteristic);
 
 void binc_characteristic_stop_notify(Characteristic *characteristic);
 
+/**
+ * Read the characteristic and report the result to callback instead of the device-wide read callback.
+ * Cancelling the optional cancellable completes the read with G_IO_ERROR_CANCELLED.
+ */
+void binc_characteristic_read_with_cb(Characteristic *characteristic, GCancellable *cancellable,
+                                      OnReadCompleteCallback callback, gpointer user_data);
+
+/**
+ * Write the characteristic and report the result to callback instead of the device-wide write callback
+ */
+void binc_characteristic_write_with_cb(Characteristic *characteristic, const GByteArray *byteArray,
+                                       WriteType writeType, GCancellable *cancellable,
+                                       OnWriteCompleteCallback callback, gpointer user_data);
+
+/**
+ * Start notifying and call callback when BlueZ answered, with error NULL on success.
+ * Changes of the Notifying state are still reported to the notifying state callback.
+ */
+void binc_characteristic_start_notify_with_cb(Characteristic *characteristic, GCancellable *cancellable,
+                                              OnNotifyingCompleteCallback callback, gpointer user_data);
+
+void binc_characteristic_stop_notify_with_cb(Characteristic *characteristic, GCancellable *cancellable,
+                                             OnNotifyingCompleteCallback callback, gpointer user_data);
+
 Service *binc_characteristic_get_service(const Characteristic *characteristic);
 
 Device *binc_characteristic_get_device(const Characteristic *characteristic);
 
 const char *binc_characteristic_get_uuid(const Characteristic *characteristic);
 
+const BincUuid *binc_characteristic_get_binary_uuid(const Characteristic *characteristic);
+
 GList *binc_characteristic_get_flags(const Characteristic *characteristic);
 
 guint binc_characteristic_get_properties(const Characteristic *characteristic);
@@ -102,6 +137,9 @@ gboolean binc_characteristic_supports_notify(const Characteristic *characteristi
 
 Descriptor *binc_characteristic_get_descriptor(const Characteristic *characteristic, const char *desc_uuid);
 
+Descriptor *binc_characteristic_get_descriptor_by_uuid(const Characteristic *characteristic,
+                                                       const BincUuid *desc_uuid);
+
 GList *binc_characteristic_get_descriptors(const Characteristic *characteristic);
 
 /**
@@ -59,6 +59,19 @@ const char *binc_characteristic_get_service_path(const Characteristic *character
 
 void binc_characteristic_add_descriptor(Characteristic *characteristic, Descriptor *descriptor);
 
+/**
+ * Get a copy of the Value BlueZ cached from the last read or notification, or NULL if it has none
+ */
+GByteArray *binc_internal_characteristic_get_cached_value(const Characteristic *characteristic);
+
+/**
+ * Like binc_characteristic_read_with_cb, destroy is called for user_data once the read is done with it,
+ * also when the read is dropped without calling callback because the device was freed
+ */
+void binc_internal_characteristic_read_full(Characteristic *characteristic, GCancellable *cancellable,
+                                            OnReadCompleteCallback callback, gpointer user_data,
+                                            GDestroyNotify destroy);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,376 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "connection_manager_internal.h"
+#include "device.h"
+#include "device_internal.h"
+#include "logger.h"
+#include "utility.h"
+
+static const char *const TAG = "ConnectionManager";
+
+static const guint DEFAULT_MAX_IN_FLIGHT = 1;
+static const guint DEFAULT_ATTEMPT_TIMEOUT_MS = 10000;
+static const guint DEFAULT_MAX_ATTEMPTS = 5;
+static const guint DEFAULT_INITIAL_BACKOFF_MS = 500;
+static const guint DEFAULT_MAX_BACKOFF_MS = 30000;
+
+// An aborting request keeps its slot until the timed out attempt has ended, so its outcome can't be
+// mistaken for the outcome of the next attempt
+typedef enum ConnectRequestState {
+    REQUEST_WAITING = 0, REQUEST_CONNECTING = 1, REQUEST_BACKING_OFF = 2, REQUEST_ABORTING = 3
+} ConnectRequestState;
+
+typedef struct connect_request {
+    ConnectionManager *manager; // Borrowed
+    Device *device; // Borrowed
+    gint priority;
+    ConnectRequestState state;
+    guint attempts;
+    gint64 queued_at;
+    gint64 attempt_started_at;
+    guint timer_id; // Attempt timeout while connecting or aborting, retry delay while backing off
+} ConnectRequest;
+
+struct binc_connection_manager {
+    Adapter *adapter; // Borrowed
+    GQueue waiting; // Requests waiting for a free slot, highest priority first
+    GHashTable *requests; // Owned, borrowed device -> ConnectRequest
+    guint in_flight;
+    guint max_in_flight;
+    guint attempt_timeout_ms;
+    guint max_attempts;
+    guint initial_backoff_ms;
+    guint max_backoff_ms;
+    ConnectionManagerGaveUpCallback gaveUpCallback;
+    ConnectionManagerStats stats;
+};
+
+static void connect_request_free(ConnectRequest *request) {
+    if (request->timer_id != 0) {
+        binc_source_remove(request->timer_id);
+        request->timer_id = 0;
+    }
+    g_free(request);
+}
+
+ConnectionManager *binc_internal_connection_manager_create(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    ConnectionManager *manager = g_new0(ConnectionManager, 1);
+    manager->adapter = adapter;
+    g_queue_init(&manager->waiting);
+    manager->requests = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, (GDestroyNotify) connect_request_free);
+    manager->max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+    manager->attempt_timeout_ms = DEFAULT_ATTEMPT_TIMEOUT_MS;
+    manager->max_attempts = DEFAULT_MAX_ATTEMPTS;
+    manager->initial_backoff_ms = DEFAULT_INITIAL_BACKOFF_MS;
+    manager->max_backoff_ms = DEFAULT_MAX_BACKOFF_MS;
+    return manager;
+}
+
+void binc_internal_connection_manager_free(ConnectionManager *manager) {
+    g_assert(manager != NULL);
+
+    g_queue_clear(&manager->waiting);
+    g_hash_table_destroy(manager->requests);
+    manager->requests = NULL;
+    g_free(manager);
+}
+
+static gint compare_priority(gconstpointer queued, gconstpointer request, __attribute__((unused)) gpointer user_data) {
+    // Keep requests with the same priority in the order they were queued
+    return ((const ConnectRequest *) queued)->priority >= ((const ConnectRequest *) request)->priority ? -1 : 1;
+}
+
+static void enqueue(ConnectionManager *manager, ConnectRequest *request) {
+    request->state = REQUEST_WAITING;
+    g_queue_insert_sorted(&manager->waiting, request, compare_priority, NULL);
+}
+
+static gboolean holds_slot(const ConnectRequest *request) {
+    return request->state == REQUEST_CONNECTING || request->state == REQUEST_ABORTING;
+}
+
+static void remove_request(ConnectionManager *manager, ConnectRequest *request) {
+    if (request->state == REQUEST_WAITING) {
+        g_queue_remove(&manager->waiting, request);
+    } else if (holds_slot(request)) {
+        manager->in_flight--;
+    }
+
+    // Frees the request
+    g_hash_table_remove(manager->requests, request->device);
+}
+
+guint binc_internal_connection_manager_backoff_delay(const ConnectionManager *manager, guint attempts) {
+    guint delay = manager->initial_backoff_ms;
+    for (guint i = 1; i < attempts && delay < manager->max_backoff_ms; i++) {
+        delay *= 2;
+    }
+    delay = MIN(delay, manager->max_backoff_ms);
+    return delay / 2 + (guint) g_random_int_range(0, (gint32) (delay - delay / 2) + 1);
+}
+
+static void start_next_attempts(ConnectionManager *manager);
+
+static gboolean retry_cb(gpointer user_data) {
+    ConnectRequest *request = (ConnectRequest *) user_data;
+    request->timer_id = 0;
+    enqueue(request->manager, request);
+    start_next_attempts(request->manager);
+    return FALSE;
+}
+
+static void attempt_failed(ConnectionManager *manager, ConnectRequest *request) {
+    if (request->timer_id != 0) {
+        binc_source_remove(request->timer_id);
+        request->timer_id = 0;
+    }
+    // The attempt no longer holds a slot, whether it is retried or given up on
+    manager->in_flight--;
+    request->state = REQUEST_BACKING_OFF;
+    manager->stats.attempt_failures++;
+
+    if (manager->max_attempts > 0 && request->attempts >= manager->max_attempts) {
+        Device *device = request->device;
+        guint attempts = request->attempts;
+        log_debug(TAG, "giving up on '%s' after %u attempts", binc_device_get_address(device), attempts);
+        manager->stats.gave_up++;
+        remove_request(manager, request);
+        if (manager->gaveUpCallback != NULL) {
+            manager->gaveUpCallback(manager, device, attempts);
+        }
+    } else {
+        guint delay = binc_internal_connection_manager_backoff_delay(manager, request->attempts);
+        log_debug(TAG, "retrying '%s' in %u ms", binc_device_get_address(request->device), delay);
+        request->timer_id = binc_timeout_add(delay, retry_cb, request);
+    }
+    start_next_attempts(manager);
+}
+
+static void attempt_succeeded(ConnectionManager *manager, ConnectRequest *request) {
+    guint64 attempt_time = (guint64) (g_get_monotonic_time() - request->attempt_started_at);
+    guint64 connect_time = (guint64) (g_get_monotonic_time() - request->queued_at);
+    ConnectionManagerStats *stats = &manager->stats;
+    stats->connected++;
+    stats->attempt_time_total_us += attempt_time;
+    stats->attempt_time_max_us = MAX(stats->attempt_time_max_us, attempt_time);
+    stats->connect_time_total_us += connect_time;
+    stats->connect_time_max_us = MAX(stats->connect_time_max_us, connect_time);
+
+    remove_request(manager, request);
+    start_next_attempts(manager);
+}
+
+static gboolean abort_timeout_cb(gpointer user_data) {
+    ConnectRequest *request = (ConnectRequest *) user_data;
+    request->timer_id = 0;
+
+    // Don't hold the slot forever when BlueZ never reports the end of the attempt
+    log_debug(TAG, "aborting the attempt for '%s' timed out", binc_device_get_address(request->device));
+    attempt_failed(request->manager, request);
+    return FALSE;
+}
+
+static gboolean attempt_timeout_cb(gpointer user_data) {
+    ConnectRequest *request = (ConnectRequest *) user_data;
+    request->timer_id = 0;
+
+    log_debug(TAG, "connecting to '%s' timed out", binc_device_get_address(request->device));
+    request->manager->stats.timeouts++;
+    if (binc_device_get_connection_state(request->device) == BINC_DISCONNECTED) {
+        attempt_failed(request->manager, request);
+        return FALSE;
+    }
+
+    // The retry is only scheduled once the device is disconnected, see connection_changed
+    request->state = REQUEST_ABORTING;
+    request->timer_id = binc_timeout_add(request->manager->attempt_timeout_ms, abort_timeout_cb, request);
+    binc_internal_device_cancel_connect(request->device);
+    return FALSE;
+}
+
+static void start_attempt(ConnectionManager *manager, ConnectRequest *request) {
+    request->state = REQUEST_CONNECTING;
+    request->attempts++;
+    request->attempt_started_at = g_get_monotonic_time();
+    manager->in_flight++;
+    manager->stats.attempts++;
+
+    ConnectionState state = binc_device_get_connection_state(request->device);
+    if (state == BINC_CONNECTED) {
+        attempt_succeeded(manager, request);
+        return;
+    }
+
+    request->timer_id = binc_timeout_add(manager->attempt_timeout_ms, attempt_timeout_cb, request);
+
+    // A connect or disconnect that is already running decides the outcome of this attempt
+    if (state == BINC_DISCONNECTED) {
+        log_debug(TAG, "attempt %u for '%s'", request->attempts, binc_device_get_address(request->device));
+        binc_device_connect(request->device);
+    }
+}
+
+static void start_next_attempts(ConnectionManager *manager) {
+    while (manager->in_flight < manager->max_in_flight && !g_queue_is_empty(&manager->waiting)) {
+        start_attempt(manager, g_queue_pop_head(&manager->waiting));
+    }
+}
+
+void binc_connection_manager_connect(ConnectionManager *manager, Device *device, gint priority) {
+    g_assert(manager != NULL);
+    g_assert(device != NULL);
+
+    ConnectRequest *request = g_hash_table_lookup(manager->requests, device);
+    if (request != NULL) {
+        if (priority > request->priority) {
+            request->priority = priority;
+            if (request->state == REQUEST_WAITING) {
+                g_queue_remove(&manager->waiting, request);
+                enqueue(manager, request);
+            }
+        }
+        return;
+    }
+
+    if (binc_device_get_connection_state(device) == BINC_CONNECTED) return;
+
+    request = g_new0(ConnectRequest, 1);
+    request->manager = manager;
+    request->device = device;
+    request->priority = priority;
+    request->queued_at = g_get_monotonic_time();
+    g_hash_table_insert(manager->requests, device, request);
+    manager->stats.requests++;
+
+    enqueue(manager, request);
+    start_next_attempts(manager);
+}
+
+void binc_connection_manager_cancel(ConnectionManager *manager, Device *device) {
+    g_assert(manager != NULL);
+    g_assert(device != NULL);
+
+    ConnectRequest *request = g_hash_table_lookup(manager->requests, device);
+    if (request == NULL) return;
+
+    gboolean was_connecting = holds_slot(request);
+    remove_request(manager, request);
+    if (was_connecting) {
+        binc_internal_device_cancel_connect(device);
+        start_next_attempts(manager);
+    }
+}
+
+gboolean binc_connection_manager_is_pending(const ConnectionManager *manager, const Device *device) {
+    g_assert(manager != NULL);
+    g_assert(device != NULL);
+
+    return g_hash_table_contains(manager->requests, device);
+}
+
+void binc_internal_connection_manager_connection_changed(ConnectionManager *manager, Device *device) {
+    g_assert(manager != NULL);
+    g_assert(device != NULL);
+
+    ConnectRequest *request = g_hash_table_lookup(manager->requests, device);
+    if (request == NULL || !holds_slot(request)) return;
+
+    ConnectionState state = binc_device_get_connection_state(device);
+    if (state == BINC_CONNECTED) {
+        attempt_succeeded(manager, request);
+    } else if (state == BINC_DISCONNECTED) {
+        attempt_failed(manager, request);
+    }
+}
+
+void binc_internal_connection_manager_device_removed(ConnectionManager *manager, Device *device) {
+    g_assert(manager != NULL);
+    g_assert(device != NULL);
+
+    ConnectRequest *request = g_hash_table_lookup(manager->requests, device);
+    if (request == NULL) return;
+
+    gboolean was_connecting = holds_slot(request);
+    remove_request(manager, request);
+    if (was_connecting) {
+        start_next_attempts(manager);
+    }
+}
+
+void binc_connection_manager_set_max_in_flight(ConnectionManager *manager, guint max_in_flight) {
+    g_assert(manager != NULL);
+    g_assert(max_in_flight > 0);
+
+    manager->max_in_flight = max_in_flight;
+    start_next_attempts(manager);
+}
+
+void binc_connection_manager_set_attempt_timeout(ConnectionManager *manager, guint timeout_ms) {
+    g_assert(manager != NULL);
+    g_assert(timeout_ms > 0);
+
+    manager->attempt_timeout_ms = timeout_ms;
+}
+
+void binc_connection_manager_set_retry_policy(ConnectionManager *manager, guint max_attempts,
+                                              guint initial_backoff_ms, guint max_backoff_ms) {
+    g_assert(manager != NULL);
+    g_assert(initial_backoff_ms > 0);
+    g_assert(max_backoff_ms >= initial_backoff_ms);
+
+    manager->max_attempts = max_attempts;
+    manager->initial_backoff_ms = initial_backoff_ms;
+    manager->max_backoff_ms = max_backoff_ms;
+}
+
+void binc_connection_manager_set_gave_up_cb(ConnectionManager *manager, ConnectionManagerGaveUpCallback callback) {
+    g_assert(manager != NULL);
+    g_assert(callback != NULL);
+
+    manager->gaveUpCallback = callback;
+}
+
+Adapter *binc_connection_manager_get_adapter(const ConnectionManager *manager) {
+    g_assert(manager != NULL);
+    return manager->adapter;
+}
+
+void binc_connection_manager_get_stats(const ConnectionManager *manager, ConnectionManagerStats *stats) {
+    g_assert(manager != NULL);
+    g_assert(stats != NULL);
+
+    *stats = manager->stats;
+    stats->waiting = g_queue_get_length((GQueue *) &manager->waiting);
+    stats->in_flight = manager->in_flight;
+    stats->backing_off = g_hash_table_size(manager->requests) - stats->waiting - stats->in_flight;
+}
+
+void binc_connection_manager_reset_stats(ConnectionManager *manager) {
+    g_assert(manager != NULL);
+    memset(&manager->stats, 0, sizeof(ConnectionManagerStats));
+}
@@ -0,0 +1,105 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_CONNECTION_MANAGER_H
+#define BINC_CONNECTION_MANAGER_H
+
+#include <gio/gio.h>
+#include "forward_decl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Counters of a connection manager. Latencies are in microseconds:
+ * attempt time runs from sending Connect to the device being connected,
+ * connect time from queueing the request to the device being connected.
+ */
+typedef struct ConnectionManagerStats {
+    guint waiting;
+    guint backing_off;
+    guint in_flight;
+    guint64 requests;
+    guint64 attempts;
+    guint64 connected;
+    guint64 attempt_failures;
+    guint64 timeouts;
+    guint64 gave_up;
+    guint64 attempt_time_total_us;
+    guint64 attempt_time_max_us;
+    guint64 connect_time_total_us;
+    guint64 connect_time_max_us;
+} ConnectionManagerStats;
+
+/**
+ * Called when a device could not be connected within the configured number of attempts
+ */
+typedef void (*ConnectionManagerGaveUpCallback)(ConnectionManager *manager, Device *device, guint attempts);
+
+/**
+ * Queue a connection to the device. Requests with a higher priority are started first, equal priorities in order.
+ * Queueing a device that already has a request raises its priority if the new one is higher.
+ */
+void binc_connection_manager_connect(ConnectionManager *manager, Device *device, gint priority);
+
+/**
+ * Drop the request for the device, aborting the connection attempt if one is running
+ */
+void binc_connection_manager_cancel(ConnectionManager *manager, Device *device);
+
+gboolean binc_connection_manager_is_pending(const ConnectionManager *manager, const Device *device);
+
+/**
+ * Limit the number of connection attempts that run at the same time on the controller
+ */
+void binc_connection_manager_set_max_in_flight(ConnectionManager *manager, guint max_in_flight);
+
+/**
+ * Abort an attempt that did not connect within timeout_ms. The retry is scheduled once the aborted attempt has
+ * ended, which takes at most another timeout_ms.
+ */
+void binc_connection_manager_set_attempt_timeout(ConnectionManager *manager, guint timeout_ms);
+
+/**
+ * Retry failed attempts after an exponential backoff starting at initial_backoff_ms and capped at max_backoff_ms.
+ * Each delay is randomized between half and the full value so devices that failed together do not retry together.
+ *
+ * @param max_attempts number of attempts before giving up, or 0 to keep retrying
+ */
+void binc_connection_manager_set_retry_policy(ConnectionManager *manager, guint max_attempts,
+                                              guint initial_backoff_ms, guint max_backoff_ms);
+
+void binc_connection_manager_set_gave_up_cb(ConnectionManager *manager, ConnectionManagerGaveUpCallback callback);
+
+Adapter *binc_connection_manager_get_adapter(const ConnectionManager *manager);
+
+void binc_connection_manager_get_stats(const ConnectionManager *manager, ConnectionManagerStats *stats);
+
+void binc_connection_manager_reset_stats(ConnectionManager *manager);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BINC_CONNECTION_MANAGER_H
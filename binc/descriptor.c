@@ -34,7 +34,6 @@
 
 static const char *const TAG = "Descriptor";
 
-static const char *const BLUEZ_DBUS = "org.bluez";
 static const char *const INTERFACE_DESCRIPTOR = "org.bluez.GattDescriptor1";
 static const char *const DESCRIPTOR_METHOD_READ_VALUE = "ReadValue";
 static const char *const DESCRIPTOR_METHOD_WRITE_VALUE = "WriteValue";
@@ -45,7 +44,8 @@ struct binc_descriptor {
     GDBusConnection *connection; // Borrowed
     const char *path; // Owned
     const char *char_path; // Owned
-    const char *uuid; // Owned
+    const char *uuid; // Interned
+    BincUuid binary_uuid;
     GList *flags; // Owned
 
     OnDescReadCallback on_read_cb;
@@ -72,7 +72,6 @@ void binc_descriptor_free(Descriptor *descriptor) {
         descriptor->flags = NULL;
     }
 
-    g_free((char *) descriptor->uuid);
     descriptor->uuid = NULL;
     g_free((char *) descriptor->path);
     descriptor->path = NULL;
@@ -110,10 +109,9 @@ const char *binc_descriptor_to_string(const Descriptor *descriptor) {
 
 void binc_descriptor_set_uuid(Descriptor *descriptor, const char *uuid) {
     g_assert(descriptor != NULL);
-    g_assert(is_valid_uuid(uuid));
 
-    g_free((char *) descriptor->uuid);
-    descriptor->uuid = g_strdup(uuid);
+    parse_uuid(uuid, &descriptor->binary_uuid);
+    descriptor->uuid = binc_uuid_to_interned_string(&descriptor->binary_uuid);
 }
 
 void binc_descriptor_set_char_path(Descriptor *descriptor, const char *path) {
@@ -134,6 +132,11 @@ const char *binc_descriptor_get_uuid(const Descriptor *descriptor) {
     return descriptor->uuid;
 }
 
+const BincUuid *binc_descriptor_get_binary_uuid(const Descriptor *descriptor) {
+    g_assert(descriptor != NULL);
+    return &descriptor->binary_uuid;
+}
+
 void binc_descriptor_set_char(Descriptor *descriptor, Characteristic *characteristic) {
     g_assert(descriptor != NULL);
     g_assert(characteristic != NULL);
@@ -151,21 +154,28 @@ void binc_descriptor_set_flags(Descriptor *descriptor, GList *flags) {
     descriptor->flags = flags;
 }
 
-static void binc_internal_descriptor_read_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
-    GError *error = NULL;
+typedef struct binc_desc_read_data {
+    Descriptor *descriptor;
+    OnDescReadCompleteCallback callback;
+    gpointer user_data;
+} ReadDescData;
+
+static void binc_internal_descriptor_read_cb(GVariant *value, const GError *error, gpointer user_data) {
     GByteArray *byteArray = NULL;
     GVariant *innerArray = NULL;
-    Descriptor *descriptor = (Descriptor *) user_data;
+    ReadDescData *readData = (ReadDescData *) user_data;
+    Descriptor *descriptor = readData->descriptor;
     g_assert(descriptor != NULL);
 
-    GVariant *value = g_dbus_connection_call_finish(descriptor->connection, res, &error);
     if (value != NULL) {
         g_assert(g_str_equal(g_variant_get_type_string(value), "(ay)"));
         innerArray = g_variant_get_child_value(value, 0);
         byteArray = g_variant_get_byte_array(innerArray);
     }
 
-    if (descriptor->on_read_cb != NULL) {
+    if (readData->callback != NULL) {
+        readData->callback(descriptor->device, descriptor, byteArray, error, readData->user_data);
+    } else if (descriptor->on_read_cb != NULL) {
         descriptor->on_read_cb(descriptor->device, descriptor, byteArray, error);
     }
 
@@ -177,82 +187,92 @@ static void binc_internal_descriptor_read_cb(GObject *source_object, GAsyncResul
         g_variant_unref(innerArray);
     }
 
-    if (value != NULL) {
-        g_variant_unref(value);
-    }
-
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", DESCRIPTOR_METHOD_READ_VALUE, error->code,
                   error->message);
-        g_clear_error(&error);
     }
 }
 
 void binc_descriptor_read(Descriptor *descriptor) {
+    binc_descriptor_read_with_cb(descriptor, NULL, NULL, NULL);
+}
+
+void binc_descriptor_read_with_cb(Descriptor *descriptor, GCancellable *cancellable,
+                                  OnDescReadCompleteCallback callback, gpointer user_data) {
     g_assert(descriptor != NULL);
 
     log_debug(TAG, "reading <%s>", descriptor->uuid);
 
+    ReadDescData *readData = g_new0(ReadDescData, 1);
+    readData->descriptor = descriptor;
+    readData->callback = callback;
+    readData->user_data = user_data;
+
     guint16 offset = 0;
     GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
     g_variant_builder_add(builder, "{sv}", "offset", g_variant_new_uint16(offset));
     GVariant *options = g_variant_builder_end(builder);
     g_variant_builder_unref(builder);
 
-    g_dbus_connection_call(descriptor->connection,
-                           BLUEZ_DBUS,
-                           descriptor->path,
-                           INTERFACE_DESCRIPTOR,
-                           DESCRIPTOR_METHOD_READ_VALUE,
-                           g_variant_new("(@a{sv})", options),
-                           G_VARIANT_TYPE("(ay)"),
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) binc_internal_descriptor_read_cb,
-                           descriptor);
+    binc_gatt_queue_call(binc_internal_device_get_gatt_queue(descriptor->device),
+                         descriptor->path,
+                         INTERFACE_DESCRIPTOR,
+                         DESCRIPTOR_METHOD_READ_VALUE,
+                         g_variant_new("(@a{sv})", options),
+                         G_VARIANT_TYPE("(ay)"),
+                         FALSE,
+                         cancellable,
+                         binc_internal_descriptor_read_cb,
+                         readData,
+                         g_free);
 }
 
 typedef struct binc_desc_write_data {
     GVariant *value;
     Descriptor *descriptor;
+    OnDescWriteCompleteCallback callback;
+    gpointer user_data;
 } WriteDescData;
 
-static void binc_internal_descriptor_write_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+static void write_desc_data_free(WriteDescData *writeData) {
+    g_variant_unref(writeData->value);
+    g_free(writeData);
+}
+
+static void binc_internal_descriptor_write_cb(__attribute__((unused)) GVariant *value,
+                                              const GError *error,
+                                              gpointer user_data) {
     WriteDescData *writeData = (WriteDescData *) user_data;
     Descriptor *descriptor = writeData->descriptor;
     g_assert(descriptor != NULL);
 
     GByteArray *byteArray = NULL;
-    GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(descriptor->connection, res, &error);
-
     if (writeData->value != NULL) {
         byteArray = g_variant_get_byte_array(writeData->value);
     }
 
-    if (descriptor->on_write_cb != NULL) {
+    if (writeData->callback != NULL) {
+        writeData->callback(descriptor->device, descriptor, byteArray, error, writeData->user_data);
+    } else if (descriptor->on_write_cb != NULL) {
         descriptor->on_write_cb(descriptor->device, descriptor, byteArray, error);
     }
 
     if (byteArray != NULL) {
         g_byte_array_free(byteArray, FALSE);
     }
-    g_variant_unref(writeData->value);
-    g_free(writeData);
-
-    if (value != NULL) {
-        g_variant_unref(value);
-    }
 
     if (error != NULL) {
         log_debug(TAG, "failed to call '%s' (error %d: %s)", DESCRIPTOR_METHOD_WRITE_VALUE,
                   error->code, error->message);
-        g_clear_error(&error);
     }
 }
 
 void binc_descriptor_write(Descriptor *descriptor, const GByteArray *byteArray) {
+    binc_descriptor_write_with_cb(descriptor, byteArray, NULL, NULL, NULL);
+}
+
+void binc_descriptor_write_with_cb(Descriptor *descriptor, const GByteArray *byteArray, GCancellable *cancellable,
+                                   OnDescWriteCompleteCallback callback, gpointer user_data) {
     g_assert(descriptor != NULL);
     g_assert(byteArray != NULL);
     g_assert(byteArray->len > 0);
@@ -266,6 +286,8 @@ void binc_descriptor_write(Descriptor *descriptor, const GByteArray *byteArray)
     WriteDescData *writeData = g_new0(WriteDescData, 1);
     writeData->value = g_variant_ref(value);
     writeData->descriptor = descriptor;
+    writeData->callback = callback;
+    writeData->user_data = user_data;
 
     guint16 offset = 0;
     GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
@@ -273,18 +295,17 @@ void binc_descriptor_write(Descriptor *descriptor, const GByteArray *byteArray)
     GVariant *options = g_variant_builder_end(builder);
     g_variant_builder_unref(builder);
 
-    g_dbus_connection_call(descriptor->connection,
-                           BLUEZ_DBUS,
-                           descriptor->path,
-                           INTERFACE_DESCRIPTOR,
-                           DESCRIPTOR_METHOD_WRITE_VALUE,
-                           g_variant_new("(@ay@a{sv})", value, options),
-                           NULL,
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) binc_internal_descriptor_write_cb,
-                           writeData);
+    binc_gatt_queue_call(binc_internal_device_get_gatt_queue(descriptor->device),
+                         descriptor->path,
+                         INTERFACE_DESCRIPTOR,
+                         DESCRIPTOR_METHOD_WRITE_VALUE,
+                         g_variant_new("(@ay@a{sv})", value, options),
+                         NULL,
+                         FALSE,
+                         cancellable,
+                         binc_internal_descriptor_write_cb,
+                         writeData,
+                         (GDestroyNotify) write_desc_data_free);
 }
 
 void binc_descriptor_set_read_cb(Descriptor *descriptor, OnDescReadCallback callback) {
@@ -26,6 +26,7 @@
 
 #include <gio/gio.h>
 #include "forward_decl.h"
+#include "uuid.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,12 +36,33 @@ typedef void (*OnDescReadCallback)(Device *device, Descriptor *descriptor, const
 
 typedef void (*OnDescWriteCallback)(Device *device, Descriptor *descriptor, const GByteArray *byteArray, const GError *error);
 
+typedef void (*OnDescReadCompleteCallback)(Device *device, Descriptor *descriptor, const GByteArray *byteArray,
+                                           const GError *error, gpointer user_data);
+
+typedef void (*OnDescWriteCompleteCallback)(Device *device, Descriptor *descriptor, const GByteArray *byteArray,
+                                            const GError *error, gpointer user_data);
+
 void binc_descriptor_read(Descriptor *descriptor);
 
 void binc_descriptor_write(Descriptor *descriptor, const GByteArray *byteArray);
 
+/**
+ * Read the descriptor and report the result to callback instead of the device-wide descriptor read callback.
+ * Cancelling the optional cancellable completes the read with G_IO_ERROR_CANCELLED.
+ */
+void binc_descriptor_read_with_cb(Descriptor *descriptor, GCancellable *cancellable,
+                                  OnDescReadCompleteCallback callback, gpointer user_data);
+
+/**
+ * Write the descriptor and report the result to callback instead of the device-wide descriptor write callback
+ */
+void binc_descriptor_write_with_cb(Descriptor *descriptor, const GByteArray *byteArray, GCancellable *cancellable,
+                                   OnDescWriteCompleteCallback callback, gpointer user_data);
+
 const char *binc_descriptor_get_uuid(const Descriptor *descriptor);
 
+const BincUuid *binc_descriptor_get_binary_uuid(const Descriptor *descriptor);
+
 const char *binc_descriptor_to_string(const Descriptor *descriptor);
 
 Characteristic *binc_descriptor_get_char(const Descriptor *descriptor);
@@ -22,13 +22,17 @@
  */
 
 #include <gio/gio.h>
+#include <string.h>
 #include "logger.h"
-#include "device.h"
+#include "device_internal.h"
 #include "utility.h"
 #include "service_internal.h"
 #include "characteristic_internal.h"
-#include "adapter.h"
+#include "adapter_internal.h"
 #include "descriptor_internal.h"
+#include "signal_dispatcher.h"
+#include "property_dispatch.h"
+#include "gatt_cache.h"
 
 static const char *const TAG = "Device";
 static const char *const BLUEZ_DBUS = "org.bluez";
@@ -38,23 +42,28 @@ static const char *const DEVICE_METHOD_CONNECT = "Connect";
 static const char *const DEVICE_METHOD_PAIR = "Pair";
 static const char *const DEVICE_METHOD_DISCONNECT = "Disconnect";
 
-static const char *const DEVICE_PROPERTY_ADDRESS = "Address";
-static const char *const DEVICE_PROPERTY_ADDRESS_TYPE = "AddressType";
-static const char *const DEVICE_PROPERTY_ALIAS = "Alias";
-static const char *const DEVICE_PROPERTY_NAME = "Name";
-static const char *const DEVICE_PROPERTY_PAIRED = "Paired";
-static const char *const DEVICE_PROPERTY_RSSI = "RSSI";
-static const char *const DEVICE_PROPERTY_UUIDS = "UUIDs";
-static const char *const DEVICE_PROPERTY_MANUFACTURER_DATA = "ManufacturerData";
-static const char *const DEVICE_PROPERTY_SERVICE_DATA = "ServiceData";
-static const char *const DEVICE_PROPERTY_TRUSTED = "Trusted";
-static const char *const DEVICE_PROPERTY_TXPOWER = "TxPower";
-static const char *const DEVICE_PROPERTY_CONNECTED = "Connected";
-static const char *const DEVICE_PROPERTY_SERVICES_RESOLVED = "ServicesResolved";
+// Defines rather than constants so they can be used in the property tables
+#define DEVICE_PROPERTY_ADDRESS "Address"
+#define DEVICE_PROPERTY_ADDRESS_TYPE "AddressType"
+#define DEVICE_PROPERTY_ALIAS "Alias"
+#define DEVICE_PROPERTY_NAME "Name"
+#define DEVICE_PROPERTY_PAIRED "Paired"
+#define DEVICE_PROPERTY_RSSI "RSSI"
+#define DEVICE_PROPERTY_UUIDS "UUIDs"
+#define DEVICE_PROPERTY_MANUFACTURER_DATA "ManufacturerData"
+#define DEVICE_PROPERTY_SERVICE_DATA "ServiceData"
+#define DEVICE_PROPERTY_TRUSTED "Trusted"
+#define DEVICE_PROPERTY_TXPOWER "TxPower"
+#define DEVICE_PROPERTY_CONNECTED "Connected"
+#define DEVICE_PROPERTY_SERVICES_RESOLVED "ServicesResolved"
 
 static const char *const INTERFACE_SERVICE = "org.bluez.GattService1";
 static const char *const INTERFACE_CHARACTERISTIC = "org.bluez.GattCharacteristic1";
 static const char *const INTERFACE_DESCRIPTOR = "org.bluez.GattDescriptor1";
+static const char *const CHARACTERISTIC_METHOD_READ_VALUE = "ReadValue";
+static const guint16 DATABASE_HASH_UUID16 = 0x2B2A;
+static const guint16 SERVICE_CHANGED_UUID16 = 0x2A05;
+static const guint GATT_CHANGED_SETTLE_MS = 500;
 
 static const char *connection_state_names[] = {
         [BINC_DISCONNECTED] = "DISCONNECTED",
@@ -63,11 +72,28 @@ static const char *connection_state_names[] = {
         [BINC_DISCONNECTING]  = "DISCONNECTING"
 };
 
+#define ADVERTISEMENT_DATA_INLINE_SIZE 27
+
+/**
+ * Manufacturer or service data payload. Payloads that fit a legacy advertisement are stored inline,
+ * longer ones in a heap buffer that is kept for later updates.
+ */
+typedef struct advertisement_data {
+    BincUuid service_uuid; // Service data only
+    guint16 company_id; // Manufacturer data only
+    guint16 length;
+    guint16 heap_capacity;
+    gboolean seen; // Whether the entry is part of the update being applied
+    guint8 *heap_data; // Owned, only used for payloads longer than ADVERTISEMENT_DATA_INLINE_SIZE
+    guint8 inline_data[ADVERTISEMENT_DATA_INLINE_SIZE];
+} AdvertisementData;
+
 struct binc_device {
     GDBusConnection *connection; // Borrowed
     Adapter *adapter; // Borrowed
     const char *address; // Owned
     const char *address_type; // Owned
+    BincAddress binary_address;
     const char *alias; // Owned
     ConnectionState connection_state;
     gboolean services_resolved;
@@ -77,11 +103,22 @@ struct binc_device {
     const char *path; // Owned
     const char *name; // Owned
     short rssi;
+    short smoothed_rssi;
+    RssiFilterState rssi_filter;
+    short reported_rssi;
+    guint proximity_zone;
+    gboolean restored;
+    guint advertisement_count;
+    gint64 advertisement_since;
     gboolean trusted;
     short txpower;
-    GHashTable *manufacturer_data; // Owned
-    GHashTable *service_data; // Owned
-    GList *uuids; // Owned
+    GArray *manufacturer_data; // Owned, AdvertisementData per company id
+    GArray *service_data; // Owned, AdvertisementData per service uuid
+    GArray *binary_uuids; // Owned, BincUuid values of the advertised service uuids
+    GHashTable *manufacturer_data_view; // Owned, built when asked for, NULL when out of date
+    GHashTable *service_data_view; // Owned, built when asked for, NULL when out of date
+    GList *uuids_view; // Owned, built when asked for, NULL when out of date
+    guint changes; // DeviceChanges bits set since the last binc_internal_device_take_changes
     guint mtu;
 
     guint device_prop_changed;
@@ -90,8 +127,14 @@ struct binc_device {
     BondingStateChangedCallback bonding_state_callback;
     GHashTable *services; // Owned
     GList *services_list; // Owned
+    GHashTable *services_by_uuid; // Owned, borrowed BincUuid of the service -> first Service with that uuid
+    GHashTable *characteristics_by_uuid; // Owned, CharacteristicKey -> first Characteristic with that pair
     GHashTable *characteristics; // Owned
     GHashTable *descriptors; // Owned
+    GattQueue *gatt_queue; // Owned
+    GList *batch_reads; // Borrowed BatchRead, batch reads whose callback didn't run yet
+    guint gatt_changed_id; // Timer that walks the GATT tree again once BlueZ settled after a Service Changed
+    GCancellable *cancellable; // Owned, cancelled when the device is freed
     gboolean is_central;
 
     OnReadCallback on_read_callback;
@@ -104,6 +147,21 @@ struct binc_device {
 };
 
 
+typedef struct characteristic_key {
+    BincUuid service_uuid;
+    BincUuid characteristic_uuid;
+} CharacteristicKey;
+
+static guint characteristic_key_hash(gconstpointer key) {
+    const CharacteristicKey *characteristic_key = (const CharacteristicKey *) key;
+    return binc_uuid_hash(&characteristic_key->service_uuid) * 31 +
+           binc_uuid_hash(&characteristic_key->characteristic_uuid);
+}
+
+static gboolean characteristic_key_equal(gconstpointer key, gconstpointer other) {
+    return memcmp(key, other, sizeof(CharacteristicKey)) == 0;
+}
+
 Device *binc_device_create(const char *path, Adapter *adapter) {
     g_assert(path != NULL);
     g_assert(strlen(path) > 0);
@@ -116,49 +174,285 @@ Device *binc_device_create(const char *path, Adapter *adapter) {
     device->bondingState = BINC_BOND_NONE;
     device->connection_state = BINC_DISCONNECTED;
     device->rssi = -255;
+    device->smoothed_rssi = -255;
+    device->reported_rssi = -255;
     device->txpower = -255;
     device->mtu = 23;
     device->user_data = NULL;
+    device->services_by_uuid = g_hash_table_new(binc_uuid_hash, binc_uuid_equal);
+    device->characteristics_by_uuid = g_hash_table_new_full(characteristic_key_hash, characteristic_key_equal,
+                                                            g_free, NULL);
+    device->gatt_queue = binc_gatt_queue_create(device->connection);
+    device->cancellable = g_cancellable_new();
+    binc_address_parse_path(path, BINC_ADDRESS_PUBLIC, &device->binary_address);
     return device;
 }
 
-static void binc_device_free_uuids(Device *device) {
-    if (device->uuids != NULL) {
-        g_list_free_full(device->uuids, g_free);
-        device->uuids = NULL;
+static void byte_array_free(GByteArray *byteArray) { g_byte_array_free(byteArray, TRUE); }
+
+static void binc_device_drop_view(GHashTable **view) {
+    if (*view != NULL) {
+        g_hash_table_destroy(*view);
+        *view = NULL;
     }
 }
 
-static void byte_array_free(GByteArray *byteArray) { g_byte_array_free(byteArray, TRUE); }
+static void binc_device_drop_uuids_view(Device *device) {
+    if (device->uuids_view != NULL) {
+        g_list_free_full(device->uuids_view, g_free);
+        device->uuids_view = NULL;
+    }
+}
 
-static void binc_device_free_manufacturer_data(Device *device) {
+static void binc_device_free_advertisement_data(Device *device) {
     g_assert(device != NULL);
 
     if (device->manufacturer_data != NULL) {
-        g_hash_table_destroy(device->manufacturer_data);
+        g_array_free(device->manufacturer_data, TRUE);
         device->manufacturer_data = NULL;
     }
+    if (device->service_data != NULL) {
+        g_array_free(device->service_data, TRUE);
+        device->service_data = NULL;
+    }
+    if (device->binary_uuids != NULL) {
+        g_array_free(device->binary_uuids, TRUE);
+        device->binary_uuids = NULL;
+    }
+    binc_device_drop_view(&device->manufacturer_data_view);
+    binc_device_drop_view(&device->service_data_view);
+    binc_device_drop_uuids_view(device);
 }
 
-static void binc_device_free_service_data(Device *device) {
-    g_assert(device != NULL);
+static const guint8 *advertisement_data_get_bytes(const AdvertisementData *entry) {
+    return entry->length > ADVERTISEMENT_DATA_INLINE_SIZE ? entry->heap_data : entry->inline_data;
+}
 
-    if (device->service_data != NULL) {
-        g_hash_table_destroy(device->service_data);
-        device->service_data = NULL;
+static void advertisement_data_clear(gpointer data) {
+    AdvertisementData *entry = (AdvertisementData *) data;
+    g_free(entry->heap_data);
+    entry->heap_data = NULL;
+}
+
+static GArray *advertisement_data_store_new(void) {
+    GArray *store = g_array_new(FALSE, TRUE, sizeof(AdvertisementData));
+    g_array_set_clear_func(store, advertisement_data_clear);
+    return store;
+}
+
+/**
+ * Copy payload into an entry, reusing its buffer
+ *
+ * @return TRUE if the content changed
+ */
+static gboolean advertisement_data_update(AdvertisementData *entry, GVariant *payload) {
+    gsize data_length = 0;
+    const guint8 *data = (const guint8 *) g_variant_get_fixed_array(payload, &data_length, sizeof(guint8));
+    data_length = MIN(data_length, G_MAXUINT16);
+    if (entry->length == data_length && memcmp(advertisement_data_get_bytes(entry), data, data_length) == 0) {
+        return FALSE;
     }
+
+    if (data_length > ADVERTISEMENT_DATA_INLINE_SIZE && data_length > entry->heap_capacity) {
+        entry->heap_data = g_realloc(entry->heap_data, data_length);
+        entry->heap_capacity = (guint16) data_length;
+    }
+    entry->length = (guint16) data_length;
+    memcpy((guint8 *) advertisement_data_get_bytes(entry), data, data_length);
+    return TRUE;
+}
+
+static AdvertisementData *advertisement_data_append(GArray *store) {
+    g_array_set_size(store, store->len + 1);
+    return &g_array_index(store, AdvertisementData, store->len - 1);
 }
 
+static void advertisement_data_begin_update(GArray *store) {
+    for (guint i = 0; i < store->len; i++) {
+        g_array_index(store, AdvertisementData, i).seen = FALSE;
+    }
+}
+
+/**
+ * Drop the entries that were not part of the last update
+ *
+ * @return TRUE if any entry was dropped
+ */
+static gboolean advertisement_data_end_update(GArray *store) {
+    gboolean changed = FALSE;
+    for (guint i = store->len; i > 0; i--) {
+        if (!g_array_index(store, AdvertisementData, i - 1).seen) {
+            g_array_remove_index(store, i - 1);
+            changed = TRUE;
+        }
+    }
+    return changed;
+}
+
+static GByteArray *advertisement_data_to_byte_array(const AdvertisementData *entry) {
+    GByteArray *byteArray = g_byte_array_sized_new(entry->length);
+    g_byte_array_append(byteArray, advertisement_data_get_bytes(entry), entry->length);
+    return byteArray;
+}
+
+/**
+ * Update the manufacturer data in place. Only company ids with payloads too long to be stored inline allocate memory.
+ */
+static void binc_internal_device_update_manufacturer_data(Device *device, GVariant *property_value) {
+    if (device->manufacturer_data == NULL) {
+        device->manufacturer_data = advertisement_data_store_new();
+    }
+    GArray *store = device->manufacturer_data;
+    advertisement_data_begin_update(store);
+
+    gboolean changed = FALSE;
+    GVariantIter iter;
+    GVariant *array;
+    guint16 key;
+    g_variant_iter_init(&iter, property_value);
+    while (g_variant_iter_loop(&iter, "{qv}", &key, &array)) {
+        AdvertisementData *entry = NULL;
+        for (guint i = 0; i < store->len && entry == NULL; i++) {
+            AdvertisementData *candidate = &g_array_index(store, AdvertisementData, i);
+            if (candidate->company_id == key) entry = candidate;
+        }
+        if (entry == NULL) {
+            entry = advertisement_data_append(store);
+            entry->company_id = key;
+        }
+        entry->seen = TRUE;
+        changed |= advertisement_data_update(entry, array);
+    }
+
+    // Drop company ids that are no longer advertised
+    changed |= advertisement_data_end_update(store);
+
+    if (changed) {
+        device->changes |= BINC_DEVICE_CHANGED_MANUFACTURER_DATA;
+        binc_device_drop_view(&device->manufacturer_data_view);
+    }
+}
+
+/**
+ * Update the service data in place. Only service uuids with payloads too long to be stored inline allocate memory.
+ */
+static void binc_internal_device_update_service_data(Device *device, GVariant *property_value) {
+    if (device->service_data == NULL) {
+        device->service_data = advertisement_data_store_new();
+    }
+    GArray *store = device->service_data;
+    advertisement_data_begin_update(store);
+
+    gboolean changed = FALSE;
+    GVariantIter iter;
+    GVariant *array;
+    const char *key;
+    g_variant_iter_init(&iter, property_value);
+    while (g_variant_iter_loop(&iter, "{&sv}", &key, &array)) {
+        BincUuid uuid;
+        if (!binc_uuid_parse(key, &uuid)) continue;
+
+        AdvertisementData *entry = NULL;
+        for (guint i = 0; i < store->len && entry == NULL; i++) {
+            AdvertisementData *candidate = &g_array_index(store, AdvertisementData, i);
+            if (binc_uuid_equal(&candidate->service_uuid, &uuid)) entry = candidate;
+        }
+        if (entry == NULL) {
+            entry = advertisement_data_append(store);
+            entry->service_uuid = uuid;
+        }
+        entry->seen = TRUE;
+        changed |= advertisement_data_update(entry, array);
+    }
+
+    // Drop service uuids that are no longer advertised
+    changed |= advertisement_data_end_update(store);
+
+    if (changed) {
+        device->changes |= BINC_DEVICE_CHANGED_SERVICE_DATA;
+        binc_device_drop_view(&device->service_data_view);
+    }
+}
+
+/**
+ * Store uuid at index of the binary uuids, which may be one past the end
+ *
+ * @return TRUE if the stored value changed
+ */
+static gboolean binc_device_store_uuid(Device *device, guint index, const BincUuid *uuid) {
+    GArray *binary_uuids = device->binary_uuids;
+    if (index < binary_uuids->len) {
+        BincUuid *stored = &g_array_index(binary_uuids, BincUuid, index);
+        if (binc_uuid_equal(stored, uuid)) return FALSE;
+        *stored = *uuid;
+    } else {
+        g_array_append_val(binary_uuids, *uuid);
+    }
+    return TRUE;
+}
+
+/**
+ * Finish a uuid update that stored count uuids, reporting a change if anything differs from before
+ */
+static void binc_device_end_uuids_update(Device *device, guint count, gboolean changed) {
+    if (device->binary_uuids->len != count) {
+        g_array_set_size(device->binary_uuids, count);
+        changed = TRUE;
+    }
+    if (changed) {
+        device->changes |= BINC_DEVICE_CHANGED_UUIDS;
+        binc_device_drop_uuids_view(device);
+    }
+}
+
+static void binc_internal_device_update_uuids(Device *device, GVariant *property_value) {
+    if (device->binary_uuids == NULL) {
+        device->binary_uuids = g_array_new(FALSE, FALSE, sizeof(BincUuid));
+    }
+
+    // Decode once here so service filtering doesn't need string compares
+    gboolean changed = FALSE;
+    guint count = 0;
+    GVariantIter iter;
+    const char *uuid_string;
+    g_variant_iter_init(&iter, property_value);
+    while (g_variant_iter_next(&iter, "&s", &uuid_string)) {
+        BincUuid uuid;
+        if (binc_uuid_parse(uuid_string, &uuid)) {
+            changed |= binc_device_store_uuid(device, count++, &uuid);
+        }
+    }
+    binc_device_end_uuids_update(device, count, changed);
+}
+
+static void binc_internal_fail_batch_reads(Device *device);
+
 void binc_device_free(Device *device) {
     g_assert(device != NULL);
 
     log_debug(TAG, "freeing %s", device->path);
 
+    // Before the queue drops the reads, the callbacks still get a valid device
+    binc_internal_fail_batch_reads(device);
+
     if (device->device_prop_changed != 0) {
         g_dbus_connection_signal_unsubscribe(device->connection, device->device_prop_changed);
         device->device_prop_changed = 0;
     }
 
+    // Callbacks of cancelled calls return without touching the device
+    g_cancellable_cancel(device->cancellable);
+    g_object_unref(device->cancellable);
+    device->cancellable = NULL;
+
+    if (device->gatt_changed_id != 0) {
+        binc_source_remove(device->gatt_changed_id);
+        device->gatt_changed_id = 0;
+    }
+
+    binc_gatt_queue_free(device->gatt_queue);
+    device->gatt_queue = NULL;
+
     g_free((char *) device->path);
     device->path = NULL;
     g_free((char *) device->address_type);
@@ -170,6 +464,11 @@ void binc_device_free(Device *device) {
     g_free((char *) device->name);
     device->name = NULL;
 
+    g_hash_table_destroy(device->characteristics_by_uuid);
+    device->characteristics_by_uuid = NULL;
+    g_hash_table_destroy(device->services_by_uuid);
+    device->services_by_uuid = NULL;
+
     if (device->descriptors != NULL) {
         g_hash_table_destroy(device->descriptors);
         device->descriptors = NULL;
@@ -185,9 +484,7 @@ void binc_device_free(Device *device) {
         device->services = NULL;
     }
 
-    binc_device_free_manufacturer_data(device);
-    binc_device_free_service_data(device);
-    binc_device_free_uuids(device);
+    binc_device_free_advertisement_data(device);
 
     if (device->services_list != NULL) {
         g_list_free(device->services_list);
@@ -204,8 +501,9 @@ char *binc_device_to_string(const Device *device) {
 
     // First build up uuids string
     GString *uuids = g_string_new("[");
-    if (g_list_length(device->uuids) > 0) {
-        for (GList *iterator = device->uuids; iterator; iterator = iterator->next) {
+    GList *uuid_list = binc_device_get_uuids(device);
+    if (g_list_length(uuid_list) > 0) {
+        for (GList *iterator = uuid_list; iterator; iterator = iterator->next) {
             g_string_append_printf(uuids, "%s, ", (char *) iterator->data);
         }
         g_string_truncate(uuids, uuids->len - 2);
@@ -214,11 +512,12 @@ char *binc_device_to_string(const Device *device) {
 
     // Build up manufacturer data string
     GString *manufacturer_data = g_string_new("[");
-    if (device->manufacturer_data != NULL && g_hash_table_size(device->manufacturer_data) > 0) {
+    GHashTable *manufacturer_table = binc_device_get_manufacturer_data(device);
+    if (manufacturer_table != NULL && g_hash_table_size(manufacturer_table) > 0) {
         GHashTableIter iter;
         int *key;
         gpointer value;
-        g_hash_table_iter_init(&iter, device->manufacturer_data);
+        g_hash_table_iter_init(&iter, manufacturer_table);
         while (g_hash_table_iter_next(&iter, (gpointer) &key, &value)) {
             GByteArray *byteArray = (GByteArray *) value;
             GString *byteArrayString = g_byte_array_as_hex(byteArray);
@@ -232,10 +531,11 @@ char *binc_device_to_string(const Device *device) {
 
     // Build up service data string
     GString *service_data = g_string_new("[");
-    if (device->service_data != NULL && g_hash_table_size(device->service_data) > 0) {
+    GHashTable *service_table = binc_device_get_service_data(device);
+    if (service_table != NULL && g_hash_table_size(service_table) > 0) {
         GHashTableIter iter;
         gpointer key, value;
-        g_hash_table_iter_init(&iter, device->service_data);
+        g_hash_table_iter_init(&iter, service_table);
         while (g_hash_table_iter_next(&iter, &key, &value)) {
             GByteArray *byteArray = (GByteArray *) value;
             GString *byteArrayString = g_byte_array_as_hex(byteArray);
@@ -281,6 +581,11 @@ binc_on_characteristic_write(Device *device, Characteristic *characteristic, con
 }
 
 static void binc_on_characteristic_notify(Device *device, Characteristic *characteristic, const GByteArray *byteArray) {
+    BincUuid service_changed_uuid;
+    binc_uuid_from_uuid16(SERVICE_CHANGED_UUID16, &service_changed_uuid);
+    if (binc_uuid_equal(binc_characteristic_get_binary_uuid(characteristic), &service_changed_uuid)) {
+        binc_internal_device_gatt_changed(device);
+    }
     if (device->on_notify_callback != NULL) {
         device->on_notify_callback(device, characteristic, byteArray);
     }
@@ -307,6 +612,12 @@ static void binc_on_descriptor_write(Device *device, Descriptor *descriptor, con
 static void binc_device_internal_set_conn_state(Device *device, ConnectionState state, GError *error) {
     ConnectionState old_state = device->connection_state;
     device->connection_state = state;
+    if (state != old_state && state == BINC_DISCONNECTED) {
+        binc_gatt_queue_flush(device->gatt_queue);
+    }
+    if (state != old_state && device->adapter != NULL) {
+        binc_internal_adapter_device_connection_changed(device->adapter, device);
+    }
     if (device->connection_state_callback != NULL) {
         if (device->connection_state != old_state) {
             device->connection_state_callback(device, state, error);
@@ -314,6 +625,64 @@ static void binc_device_internal_set_conn_state(Device *device, ConnectionState
     }
 }
 
+static void binc_internal_add_service(Device *device, const char *path, const char *uuid) {
+    Service *service = binc_service_create(device, path, uuid);
+    g_hash_table_insert(device->services, g_strdup(path), service);
+}
+
+static Characteristic *binc_internal_create_characteristic(Device *device, const char *path) {
+    Characteristic *characteristic = binc_characteristic_create(device, path);
+    binc_characteristic_set_read_cb(characteristic, &binc_on_characteristic_read);
+    binc_characteristic_set_write_cb(characteristic, &binc_on_characteristic_write);
+    binc_characteristic_set_notify_cb(characteristic, &binc_on_characteristic_notify);
+    binc_characteristic_set_notifying_state_change_cb(characteristic,
+                                                      &binc_on_characteristic_notification_state_changed);
+    return characteristic;
+}
+
+static void binc_internal_add_characteristic(Device *device, const char *path, Characteristic *characteristic) {
+    // Get service and link the characteristic to the service
+    Service *service = g_hash_table_lookup(device->services,
+                                           binc_characteristic_get_service_path(characteristic));
+    if (service != NULL) {
+        binc_service_add_characteristic(service, characteristic);
+        binc_characteristic_set_service(characteristic, service);
+        g_hash_table_insert(device->characteristics, g_strdup(path), characteristic);
+
+        char *charString = binc_characteristic_to_string(characteristic);
+        log_debug(TAG, charString);
+        g_free(charString);
+    } else {
+        log_error(TAG, "could not find service %s",
+                  binc_characteristic_get_service_path(characteristic));
+    }
+}
+
+static Descriptor *binc_internal_create_descriptor(Device *device, const char *path) {
+    Descriptor *descriptor = binc_descriptor_create(device, path);
+    binc_descriptor_set_read_cb(descriptor, &binc_on_descriptor_read);
+    binc_descriptor_set_write_cb(descriptor, &binc_on_descriptor_write);
+    return descriptor;
+}
+
+static void binc_internal_add_descriptor(Device *device, const char *path, Descriptor *descriptor) {
+    // Look up characteristic
+    Characteristic *characteristic = g_hash_table_lookup(device->characteristics,
+                                                         binc_descriptor_get_char_path(descriptor));
+    if (characteristic != NULL) {
+        binc_characteristic_add_descriptor(characteristic, descriptor);
+        binc_descriptor_set_char(descriptor, characteristic);
+        g_hash_table_insert(device->descriptors, g_strdup(path), descriptor);
+
+        const char *descString = binc_descriptor_to_string(descriptor);
+        log_debug(TAG, descString);
+        g_free((char *) descString);
+    } else {
+        log_error(TAG, "could not find characteristic %s",
+                  binc_descriptor_get_char_path(descriptor));
+    }
+}
+
 static void binc_internal_extract_service(Device *device, const char *object_path, GVariant *properties) {
     g_assert(device != NULL);
     g_assert(object_path != NULL);
@@ -331,8 +700,7 @@ static void binc_internal_extract_service(Device *device, const char *object_pat
         }
     }
 
-    Service *service = binc_service_create(device, object_path, uuid);
-    g_hash_table_insert(device->services, g_strdup(object_path), service);
+    binc_internal_add_service(device, object_path, uuid);
     g_free(uuid);
 }
 
@@ -341,12 +709,7 @@ static void binc_internal_extract_characteristic(Device *device, const char *obj
     g_assert(object_path != NULL);
     g_assert(properties != NULL);
 
-    Characteristic *characteristic = binc_characteristic_create(device, object_path);
-    binc_characteristic_set_read_cb(characteristic, &binc_on_characteristic_read);
-    binc_characteristic_set_write_cb(characteristic, &binc_on_characteristic_write);
-    binc_characteristic_set_notify_cb(characteristic, &binc_on_characteristic_notify);
-    binc_characteristic_set_notifying_state_change_cb(characteristic,
-                                                      &binc_on_characteristic_notification_state_changed);
+    Characteristic *characteristic = binc_internal_create_characteristic(device, object_path);
 
     const char *property_name;
     GVariantIter iter;
@@ -372,21 +735,7 @@ static void binc_internal_extract_characteristic(Device *device, const char *obj
         }
     }
 
-    // Get service and link the characteristic to the service
-    Service *service = g_hash_table_lookup(device->services,
-                                           binc_characteristic_get_service_path(characteristic));
-    if (service != NULL) {
-        binc_service_add_characteristic(service, characteristic);
-        binc_characteristic_set_service(characteristic, service);
-        g_hash_table_insert(device->characteristics, g_strdup(object_path), characteristic);
-
-        char *charString = binc_characteristic_to_string(characteristic);
-        log_debug(TAG, charString);
-        g_free(charString);
-    } else {
-        log_error(TAG, "could not find service %s",
-                  binc_characteristic_get_service_path(characteristic));
-    }
+    binc_internal_add_characteristic(device, object_path, characteristic);
 }
 
 static void binc_internal_extract_descriptor(Device *device, const char *object_path, GVariant *properties) {
@@ -394,9 +743,7 @@ static void binc_internal_extract_descriptor(Device *device, const char *object_
     g_assert(object_path != NULL);
     g_assert(properties != NULL);
 
-    Descriptor *descriptor = binc_descriptor_create(device, object_path);
-    binc_descriptor_set_read_cb(descriptor, &binc_on_descriptor_read);
-    binc_descriptor_set_write_cb(descriptor, &binc_on_descriptor_write);
+    Descriptor *descriptor = binc_internal_create_descriptor(device, object_path);
 
     const char *property_name;
     GVariantIter iter;
@@ -413,24 +760,100 @@ static void binc_internal_extract_descriptor(Device *device, const char *object_
         }
     }
 
-    // Look up characteristic
-    Characteristic *characteristic = g_hash_table_lookup(device->characteristics,
-                                                         binc_descriptor_get_char_path(descriptor));
-    if (characteristic != NULL) {
-        binc_characteristic_add_descriptor(characteristic, descriptor);
-        binc_descriptor_set_char(descriptor, characteristic);
-        g_hash_table_insert(device->descriptors, g_strdup(object_path), descriptor);
+    binc_internal_add_descriptor(device, object_path, descriptor);
+}
 
-        const char *descString = binc_descriptor_to_string(descriptor);
-        log_debug(TAG, descString);
-        g_free((char *) descString);
-    } else {
-        log_error(TAG, "could not find characteristic %s",
-                  binc_descriptor_get_char_path(descriptor));
+static void binc_internal_reset_gatt_tree(Device *device) {
+    // Queued and running operations borrow the characteristics and descriptors, complete them while those still exist
+    if (device->services != NULL) {
+        binc_gatt_queue_cancel_all(device->gatt_queue);
+        binc_internal_fail_batch_reads(device);
+    }
+
+    // The indexes borrow from the objects that are freed below
+    g_hash_table_remove_all(device->services_by_uuid);
+    g_hash_table_remove_all(device->characteristics_by_uuid);
+
+    if (device->services != NULL) {
+        g_hash_table_destroy(device->services);
+    }
+    device->services = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             g_free, (GDestroyNotify) binc_service_free);
+
+    if (device->characteristics != NULL) {
+        g_hash_table_destroy(device->characteristics);
+    }
+    device->characteristics = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                    g_free, (GDestroyNotify) binc_characteristic_free);
+
+    if (device->descriptors != NULL) {
+        g_hash_table_destroy(device->descriptors);
+    }
+    device->descriptors = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, (GDestroyNotify) binc_descriptor_free);
+}
+
+/**
+ * Database Hash read before walking the GATT tree, so a change during the walk can't be cached under the new hash
+ */
+typedef struct database_hash {
+    Device *device; // Borrowed
+    char *path; // Owned, path of the Database Hash characteristic relative to the device path
+    GByteArray *value; // Owned, NULL until read or when reading failed
+} DatabaseHash;
+
+static void database_hash_free(DatabaseHash *hash) {
+    if (hash->value != NULL) {
+        g_byte_array_free(hash->value, TRUE);
+    }
+    g_free(hash->path);
+    g_free(hash);
+}
+
+static GattLayout *binc_internal_build_gatt_layout(const Device *device);
+
+static void binc_internal_store_gatt_layout(Device *device, const DatabaseHash *hash);
+
+static void binc_internal_index_gatt_tree(Device *device) {
+    for (GList *iterator = device->services_list; iterator; iterator = iterator->next) {
+        Service *service = (Service *) iterator->data;
+        const BincUuid *service_uuid = binc_service_get_binary_uuid(service);
+        if (!g_hash_table_contains(device->services_by_uuid, service_uuid)) {
+            g_hash_table_insert(device->services_by_uuid, (gpointer) service_uuid, service);
+        }
+
+        for (GList *chars = binc_service_get_characteristics(service); chars; chars = chars->next) {
+            Characteristic *characteristic = (Characteristic *) chars->data;
+            CharacteristicKey *key = g_new(CharacteristicKey, 1);
+            key->service_uuid = *service_uuid;
+            key->characteristic_uuid = *binc_characteristic_get_binary_uuid(characteristic);
+            if (!g_hash_table_contains(device->characteristics_by_uuid, key)) {
+                g_hash_table_insert(device->characteristics_by_uuid, key, characteristic);
+            } else {
+                g_free(key);
+            }
+        }
+    }
+}
+
+static void binc_internal_gatt_tree_collected(Device *device, const DatabaseHash *hash) {
+    if (hash != NULL && hash->value != NULL) {
+        binc_internal_store_gatt_layout(device, hash);
+    }
+
+    if (device->services_list != NULL) {
+        g_list_free(device->services_list);
+    }
+    device->services_list = g_hash_table_get_values(device->services);
+    binc_internal_index_gatt_tree(device);
+
+    log_debug(TAG, "found %d services", g_list_length(device->services_list));
+    if (device->services_resolved_callback != NULL) {
+        device->services_resolved_callback(device);
     }
 }
 
-static void binc_internal_collect_gatt_tree_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_collect_gatt_tree_cb(GObject *source_object,
                                                GAsyncResult *res,
                                                gpointer user_data) {
 
@@ -438,7 +861,12 @@ static void binc_internal_collect_gatt_tree_cb(__attribute__((unused)) GObject *
     Device *device = (Device *) user_data;
     g_assert(device != NULL);
 
-    GVariant *result = g_dbus_connection_call_finish(device->connection, res, &error);
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The device was freed
+        g_clear_error(&error);
+        return;
+    }
 
     if (result == NULL) {
         log_error(TAG, "Unable to get result for GetManagedObjects");
@@ -453,23 +881,7 @@ static void binc_internal_collect_gatt_tree_cb(__attribute__((unused)) GObject *
     const char *object_path;
     GVariant *ifaces_and_properties;
     if (result) {
-        if (device->services != NULL) {
-            g_hash_table_destroy(device->services);
-        }
-        device->services = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                                 g_free, (GDestroyNotify) binc_service_free);
-
-        if (device->characteristics != NULL) {
-            g_hash_table_destroy(device->characteristics);
-        }
-        device->characteristics = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                                        g_free, (GDestroyNotify) binc_characteristic_free);
-
-        if (device->descriptors != NULL) {
-            g_hash_table_destroy(device->descriptors);
-        }
-        device->descriptors = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                                    g_free, (GDestroyNotify) binc_descriptor_free);
+        binc_internal_reset_gatt_tree(device);
 
         g_assert(g_str_equal(g_variant_get_type_string(result), "(a{oa{sa{sv}}})"));
         g_variant_get(result, "(a{oa{sa{sv}}})", &iter);
@@ -498,21 +910,37 @@ static void binc_internal_collect_gatt_tree_cb(__attribute__((unused)) GObject *
         g_variant_unref(result);
     }
 
-    if (device->services_list != NULL) {
-        g_list_free(device->services_list);
-    }
-    device->services_list = g_hash_table_get_values(device->services);
+    // The Database Hash is only looked up in the mirror, without it the layout isn't cached
+    binc_internal_gatt_tree_collected(device, NULL);
+}
 
-    log_debug(TAG, "found %d services", g_list_length(device->services_list));
-    if (device->services_resolved_callback != NULL) {
-        device->services_resolved_callback(device);
+static void binc_internal_collect_gatt_object(const char *path, gpointer user_data) {
+    Device *device = (Device *) user_data;
+    ObjectTree *tree = binc_signal_dispatcher_get_object_tree(device->connection);
+
+    GVariant *properties = NULL;
+    if ((properties = binc_object_tree_get_properties(tree, path, INTERFACE_SERVICE)) != NULL) {
+        binc_internal_extract_service(device, path, properties);
+    } else if ((properties = binc_object_tree_get_properties(tree, path, INTERFACE_CHARACTERISTIC)) != NULL) {
+        binc_internal_extract_characteristic(device, path, properties);
+    } else if ((properties = binc_object_tree_get_properties(tree, path, INTERFACE_DESCRIPTOR)) != NULL) {
+        binc_internal_extract_descriptor(device, path, properties);
     }
+
+    // Parents are visited before their children, so services exist before their characteristics
+    binc_object_tree_foreach_child(tree, path, binc_internal_collect_gatt_object, device);
 }
 
-static void binc_collect_gatt_tree(Device *device) {
-    g_assert(device != NULL);
+static void binc_internal_walk_gatt_tree(Device *device, const DatabaseHash *hash) {
+    // Only walk this device's part of the mirror once it is seeded, instead of fetching the whole tree
+    ObjectTree *tree = binc_signal_dispatcher_get_object_tree(device->connection);
+    if (tree != NULL) {
+        binc_internal_reset_gatt_tree(device);
+        binc_object_tree_foreach_child(tree, device->path, binc_internal_collect_gatt_object, device);
+        binc_internal_gatt_tree_collected(device, hash);
+        return;
+    }
 
-    device->service_discovery_started = TRUE;
     g_dbus_connection_call(device->connection,
                            BLUEZ_DBUS,
                            "/",
@@ -521,12 +949,291 @@ static void binc_collect_gatt_tree(Device *device) {
                            NULL,
                            G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           binc_adapter_get_call_timeout(device->adapter),
+                           device->cancellable,
                            (GAsyncReadyCallback) binc_internal_collect_gatt_tree_cb,
                            device);
 }
 
+static gboolean gatt_layout_add(GattLayout *layout, const Device *device, GattCacheAttributeType type,
+                                const char *path, const BincUuid *uuid, const GList *flags) {
+    if (!g_str_has_prefix(path, device->path)) {
+        return FALSE;
+    }
+    binc_gatt_layout_add(layout, type, path + strlen(device->path), uuid, flags);
+    return TRUE;
+}
+
+static GattLayout *binc_internal_build_gatt_layout(const Device *device) {
+    GattLayout *layout = binc_gatt_layout_create(device->mtu);
+    gboolean valid = TRUE;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, device->services);
+    while (valid && g_hash_table_iter_next(&iter, &key, &value)) {
+        valid = gatt_layout_add(layout, device, GATT_CACHE_SERVICE, (const char *) key,
+                                binc_service_get_binary_uuid((Service *) value), NULL);
+    }
+
+    g_hash_table_iter_init(&iter, device->characteristics);
+    while (valid && g_hash_table_iter_next(&iter, &key, &value)) {
+        Characteristic *characteristic = (Characteristic *) value;
+        valid = gatt_layout_add(layout, device, GATT_CACHE_CHARACTERISTIC, (const char *) key,
+                                binc_characteristic_get_binary_uuid(characteristic),
+                                binc_characteristic_get_flags(characteristic));
+    }
+
+    g_hash_table_iter_init(&iter, device->descriptors);
+    while (valid && g_hash_table_iter_next(&iter, &key, &value)) {
+        valid = gatt_layout_add(layout, device, GATT_CACHE_DESCRIPTOR, (const char *) key,
+                                binc_descriptor_get_binary_uuid((Descriptor *) value), NULL);
+    }
+
+    if (!valid) {
+        binc_gatt_layout_free(layout);
+        return NULL;
+    }
+    return layout;
+}
+
+static gpointer copy_string(gconstpointer string, __attribute__((unused)) gpointer user_data) {
+    return g_strdup((const char *) string);
+}
+
+static void binc_internal_materialize_gatt_tree(Device *device, const GattLayout *layout) {
+    binc_internal_reset_gatt_tree(device);
+    device->mtu = layout->mtu;
+
+    for (guint i = 0; i < layout->attributes->len; i++) {
+        const GattCacheAttribute *attribute = &g_array_index(layout->attributes, GattCacheAttribute, i);
+        char *path = g_strconcat(device->path, attribute->path, NULL);
+        char *parent_path = g_path_get_dirname(path);
+        char uuid[BINC_UUID_STRING_LENGTH];
+        binc_uuid_format(&attribute->uuid, uuid);
+
+        if (attribute->type == GATT_CACHE_SERVICE) {
+            binc_internal_add_service(device, path, uuid);
+        } else if (attribute->type == GATT_CACHE_CHARACTERISTIC) {
+            Characteristic *characteristic = binc_internal_create_characteristic(device, path);
+            binc_characteristic_set_uuid(characteristic, uuid);
+            binc_characteristic_set_service_path(characteristic, parent_path);
+            if (attribute->flags != NULL) {
+                binc_characteristic_set_flags(characteristic,
+                                              g_list_copy_deep(attribute->flags, copy_string, NULL));
+            }
+            binc_characteristic_set_mtu(characteristic, layout->mtu);
+            binc_internal_add_characteristic(device, path, characteristic);
+        } else {
+            Descriptor *descriptor = binc_internal_create_descriptor(device, path);
+            binc_descriptor_set_uuid(descriptor, uuid);
+            binc_descriptor_set_char_path(descriptor, parent_path);
+            binc_internal_add_descriptor(device, path, descriptor);
+        }
+
+        g_free(parent_path);
+        g_free(path);
+    }
+
+    log_debug(TAG, "restored %u GATT attributes from cache", layout->attributes->len);
+    binc_internal_gatt_tree_collected(device, NULL);
+}
+
+static void binc_internal_read_database_hash(Device *device, const char *relative_path, GattQueueCallback callback) {
+    DatabaseHash *hash = g_new0(DatabaseHash, 1);
+    hash->device = device;
+    hash->path = g_strdup(relative_path);
+
+    char *path = g_strconcat(device->path, relative_path, NULL);
+    binc_gatt_queue_call(device->gatt_queue,
+                         path,
+                         INTERFACE_CHARACTERISTIC,
+                         CHARACTERISTIC_METHOD_READ_VALUE,
+                         g_variant_new("(a{sv})", NULL),
+                         G_VARIANT_TYPE("(ay)"),
+                         FALSE,
+                         NULL,
+                         callback,
+                         hash,
+                         (GDestroyNotify) database_hash_free);
+    g_free(path);
+}
+
+/**
+ * Keep the value of a Database Hash read
+ *
+ * @return FALSE if the read was cancelled because the tree was reset meanwhile or the device disconnected
+ */
+static gboolean binc_internal_read_database_hash_finish(DatabaseHash *hash, GVariant *result, const GError *error) {
+    if (result == NULL) {
+        log_debug(TAG, "failed to read database hash (error %d: %s)", error->code, error->message);
+        return !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) && hash->device->services_resolved;
+    }
+
+    gsize length = 0;
+    GVariant *value = g_variant_get_child_value(result, 0);
+    const guint8 *data = g_variant_get_fixed_array(value, &length, sizeof(guint8));
+    hash->value = g_byte_array_sized_new((guint) length);
+    g_byte_array_append(hash->value, data, (guint) length);
+    g_variant_unref(value);
+    return hash->device->services_resolved;
+}
+
+static void binc_internal_store_gatt_layout(Device *device, const DatabaseHash *hash) {
+    GattCache *cache = binc_internal_adapter_get_gatt_cache(device->adapter);
+    if (cache == NULL) return;
+
+    GattLayout *layout = binc_internal_build_gatt_layout(device);
+    if (layout == NULL) return;
+
+    // Only cache the layout together with the hash it belongs to, the characteristic may have moved meanwhile
+    BincUuid hash_uuid;
+    binc_uuid_from_uuid16(DATABASE_HASH_UUID16, &hash_uuid);
+    if (g_strcmp0(binc_gatt_layout_find_path(layout, &hash_uuid), hash->path) != 0) {
+        binc_gatt_layout_free(layout);
+        return;
+    }
+
+    binc_gatt_layout_set_database_hash(layout, hash->value->data, hash->value->len);
+    binc_gatt_cache_store(cache, &device->binary_address, layout);
+}
+
+static void binc_internal_database_hash_read_cb(GVariant *result, const GError *error, gpointer user_data) {
+    DatabaseHash *hash = (DatabaseHash *) user_data;
+    if (binc_internal_read_database_hash_finish(hash, result, error)) {
+        binc_internal_walk_gatt_tree(hash->device, hash);
+    }
+}
+
+typedef struct database_hash_search {
+    const ObjectTree *tree; // Borrowed
+    BincUuid uuid;
+    char *path; // Owned, NULL until found
+} DatabaseHashSearch;
+
+static void binc_internal_find_database_hash(const char *path, gpointer user_data) {
+    DatabaseHashSearch *search = (DatabaseHashSearch *) user_data;
+    if (search->path != NULL) return;
+
+    GVariant *properties = binc_object_tree_get_properties(search->tree, path, INTERFACE_CHARACTERISTIC);
+    if (properties != NULL) {
+        const char *uuid_string = NULL;
+        BincUuid uuid;
+        if (g_variant_lookup(properties, "UUID", "&s", &uuid_string) && binc_uuid_parse(uuid_string, &uuid) &&
+            binc_uuid_equal(&uuid, &search->uuid)) {
+            search->path = g_strdup(path);
+        }
+
+        // Only descriptors are below a characteristic
+        return;
+    }
+    binc_object_tree_foreach_child(search->tree, path, binc_internal_find_database_hash, search);
+}
+
+static void binc_internal_discover_gatt_tree(Device *device) {
+    GattCache *cache = binc_internal_adapter_get_gatt_cache(device->adapter);
+    ObjectTree *tree = binc_signal_dispatcher_get_object_tree(device->connection);
+    if (cache == NULL || tree == NULL) {
+        binc_internal_walk_gatt_tree(device, NULL);
+        return;
+    }
+
+    // Read the Database Hash before walking, a change during the walk then leaves a layout that fails validation
+    DatabaseHashSearch search = {.tree = tree};
+    binc_uuid_from_uuid16(DATABASE_HASH_UUID16, &search.uuid);
+    binc_object_tree_foreach_child(tree, device->path, binc_internal_find_database_hash, &search);
+    if (search.path == NULL) {
+        binc_internal_walk_gatt_tree(device, NULL);
+        return;
+    }
+
+    binc_internal_read_database_hash(device, search.path + strlen(device->path), binc_internal_database_hash_read_cb);
+    g_free(search.path);
+}
+
+static void binc_internal_validate_gatt_layout_cb(GVariant *result, const GError *error, gpointer user_data) {
+    DatabaseHash *hash = (DatabaseHash *) user_data;
+    Device *device = hash->device;
+    if (!binc_internal_read_database_hash_finish(hash, result, error)) return;
+
+    GattCache *cache = binc_internal_adapter_get_gatt_cache(device->adapter);
+    const GattLayout *layout = cache != NULL ? binc_gatt_cache_lookup(cache, &device->binary_address) : NULL;
+    if (layout != NULL && hash->value != NULL && layout->database_hash != NULL &&
+        hash->value->len == layout->database_hash->len &&
+        memcmp(hash->value->data, layout->database_hash->data, hash->value->len) == 0) {
+        binc_internal_materialize_gatt_tree(device, layout);
+        return;
+    }
+
+    if (layout != NULL && hash->value != NULL) {
+        log_debug(TAG, "database hash of '%s' changed", device->address);
+        binc_gatt_cache_invalidate(cache, &device->binary_address);
+    }
+
+    // The hash was read before walking, so it is stored with the new layout without reading it again
+    binc_internal_walk_gatt_tree(device, hash);
+}
+
+static void binc_collect_gatt_tree(Device *device) {
+    g_assert(device != NULL);
+
+    device->service_discovery_started = TRUE;
+    if (device->gatt_changed_id != 0) {
+        binc_source_remove(device->gatt_changed_id);
+        device->gatt_changed_id = 0;
+    }
+
+    GattCache *cache = binc_internal_adapter_get_gatt_cache(device->adapter);
+    const GattLayout *layout = cache != NULL ? binc_gatt_cache_lookup(cache, &device->binary_address) : NULL;
+    if (layout == NULL) {
+        binc_internal_discover_gatt_tree(device);
+        return;
+    }
+
+    // A layout is only reused when the hash on the device is still the same. Layouts without a hash can't be
+    // validated, they may come from a cache directory written by an older version.
+    BincUuid hash_uuid;
+    binc_uuid_from_uuid16(DATABASE_HASH_UUID16, &hash_uuid);
+    const char *hash_path = binc_gatt_layout_find_path(layout, &hash_uuid);
+    if (layout->database_hash != NULL && hash_path != NULL) {
+        binc_internal_read_database_hash(device, hash_path, binc_internal_validate_gatt_layout_cb);
+    } else {
+        binc_gatt_cache_invalidate(cache, &device->binary_address);
+        binc_internal_discover_gatt_tree(device);
+    }
+}
+
+static gboolean binc_internal_gatt_changed_settled(gpointer user_data) {
+    Device *device = (Device *) user_data;
+    device->gatt_changed_id = 0;
+
+    if (device->services_resolved) {
+        log_debug(TAG, "collecting the changed GATT database of '%s'", device->address);
+        binc_internal_discover_gatt_tree(device);
+    }
+    return FALSE;
+}
+
+void binc_internal_device_gatt_changed(Device *device) {
+    g_assert(device != NULL);
+
+    // Services also appear while BlueZ resolves them and disappear after a disconnect, only changes in between count
+    if (!device->services_resolved) return;
+
+    GattCache *cache = binc_internal_adapter_get_gatt_cache(device->adapter);
+    if (cache != NULL) {
+        log_debug(TAG, "GATT database of '%s' changed", device->address);
+        binc_gatt_cache_invalidate(cache, &device->binary_address);
+    }
+
+    // BlueZ rediscovers the changed range and adds and removes its objects one by one, walk again once that settled.
+    // Waiting also keeps the tree alive while the Service Changed indication is still being delivered.
+    if (device->gatt_changed_id != 0) {
+        binc_source_remove(device->gatt_changed_id);
+    }
+    device->gatt_changed_id = binc_timeout_add(GATT_CHANGED_SETTLE_MS, binc_internal_gatt_changed_settled, device);
+}
+
 void binc_device_set_bonding_state_changed_cb(Device *device, BondingStateChangedCallback callback) {
     g_assert(device != NULL);
     g_assert(callback != NULL);
@@ -539,6 +1246,9 @@ void binc_device_set_bonding_state(Device *device, BondingState bonding_state) {
 
     BondingState old_state = device->bondingState;
     device->bondingState = bonding_state;
+    if (bonding_state != old_state && device->adapter != NULL) {
+        binc_internal_adapter_device_bonding_changed(device->adapter, device);
+    }
     if (device->bonding_state_callback != NULL) {
         if (device->bondingState != old_state) {
             device->bonding_state_callback(device, device->bondingState, old_state, NULL);
@@ -546,6 +1256,48 @@ void binc_device_set_bonding_state(Device *device, BondingState bonding_state) {
     }
 }
 
+static void device_connected_changed(gpointer object, GVariant *value) {
+    Device *device = (Device *) object;
+    binc_device_internal_set_conn_state(device, g_variant_get_boolean(value), NULL);
+    if (device->connection_state == BINC_DISCONNECTED) {
+        g_dbus_connection_signal_unsubscribe(device->connection, device->device_prop_changed);
+        device->device_prop_changed = 0;
+    }
+}
+
+static void device_services_resolved_changed(gpointer object, GVariant *value) {
+    Device *device = (Device *) object;
+    device->services_resolved = g_variant_get_boolean(value);
+    log_debug(TAG, "ServicesResolved %s", device->services_resolved ? "true" : "false");
+    if (device->services_resolved == TRUE && device->bondingState != BINC_BONDING) {
+        binc_collect_gatt_tree(device);
+    }
+
+    if (device->services_resolved == FALSE && device->connection_state == BINC_CONNECTED) {
+        binc_device_internal_set_conn_state(device, BINC_DISCONNECTING, NULL);
+    }
+}
+
+static void device_paired_changed(gpointer object, GVariant *value) {
+    Device *device = (Device *) object;
+    device->paired = g_variant_get_boolean(value);
+    log_debug(TAG, "Paired %s", device->paired ? "true" : "false");
+    binc_device_set_bonding_state(device, device->paired ? BINC_BONDED : BINC_BOND_NONE);
+
+    // If gatt-tree has not been built yet, start building it
+    if (device->services == NULL && device->services_resolved && !device->service_discovery_started) {
+        binc_collect_gatt_tree(device);
+    }
+}
+
+static const PropertyHandlerEntry device_changed_handlers[] = {
+        {DEVICE_PROPERTY_CONNECTED,         "b", device_connected_changed},
+        {DEVICE_PROPERTY_SERVICES_RESOLVED, "b", device_services_resolved_changed},
+        {DEVICE_PROPERTY_PAIRED,            "b", device_paired_changed},
+};
+
+static PropertyDispatcher device_changed_dispatcher = BINC_PROPERTY_DISPATCHER(device_changed_handlers);
+
 static void binc_device_changed(__attribute__((unused)) GDBusConnection *conn,
                                 __attribute__((unused)) const gchar *sender,
                                 __attribute__((unused)) const gchar *path,
@@ -566,32 +1318,7 @@ static void binc_device_changed(__attribute__((unused)) GDBusConnection *conn,
     g_assert(g_str_equal(g_variant_get_type_string(params), "(sa{sv}as)"));
     g_variant_get(params, "(&sa{sv}as)", &iface, &properties_changed, &properties_invalidated);
     while (g_variant_iter_loop(properties_changed, "{&sv}", &property_name, &property_value)) {
-        if (g_str_equal(property_name, DEVICE_PROPERTY_CONNECTED)) {
-            binc_device_internal_set_conn_state(device, g_variant_get_boolean(property_value), NULL);
-            if (device->connection_state == BINC_DISCONNECTED) {
-                g_dbus_connection_signal_unsubscribe(device->connection, device->device_prop_changed);
-                device->device_prop_changed = 0;
-            }
-        } else if (g_str_equal(property_name, DEVICE_PROPERTY_SERVICES_RESOLVED)) {
-            device->services_resolved = g_variant_get_boolean(property_value);
-            log_debug(TAG, "ServicesResolved %s", device->services_resolved ? "true" : "false");
-            if (device->services_resolved == TRUE && device->bondingState != BINC_BONDING) {
-                binc_collect_gatt_tree(device);
-            }
-
-            if (device->services_resolved == FALSE && device->connection_state == BINC_CONNECTED) {
-                binc_device_internal_set_conn_state(device, BINC_DISCONNECTING, NULL);
-            }
-        } else if (g_str_equal(property_name, DEVICE_PROPERTY_PAIRED)) {
-            device->paired = g_variant_get_boolean(property_value);
-            log_debug(TAG, "Paired %s", device->paired ? "true" : "false");
-            binc_device_set_bonding_state(device, device->paired ? BINC_BONDED : BINC_BOND_NONE);
-
-            // If gatt-tree has not been built yet, start building it
-            if (device->services == NULL && device->services_resolved && !device->service_discovery_started) {
-                binc_collect_gatt_tree(device);
-            }
-        }
+        binc_property_dispatch(&device_changed_dispatcher, device, property_name, property_value);
     }
 
     if (properties_changed != NULL)
@@ -601,7 +1328,7 @@ static void binc_device_changed(__attribute__((unused)) GDBusConnection *conn,
         g_variant_iter_free(properties_invalidated);
 }
 
-static void binc_internal_device_connect_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_device_connect_cb(GObject *source_object,
                                             GAsyncResult *res,
                                             gpointer user_data) {
 
@@ -609,7 +1336,12 @@ static void binc_internal_device_connect_cb(__attribute__((unused)) GObject *sou
     Device *device = (Device *) user_data;
     g_assert(device != NULL);
 
-    GVariant *value = g_dbus_connection_call_finish(device->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The device was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -660,13 +1392,13 @@ void binc_device_connect(Device *device) {
                            NULL,
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           binc_adapter_get_call_timeout(device->adapter),
+                           device->cancellable,
                            (GAsyncReadyCallback) binc_internal_device_connect_cb,
                            device);
 }
 
-static void binc_internal_device_pair_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_device_pair_cb(GObject *source_object,
                                          GAsyncResult *res,
                                          gpointer user_data) {
 
@@ -674,7 +1406,12 @@ static void binc_internal_device_pair_cb(__attribute__((unused)) GObject *source
     g_assert(device != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(device->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The device was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -709,13 +1446,13 @@ void binc_device_pair(Device *device) {
                            NULL,
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           binc_adapter_get_call_timeout(device->adapter),
+                           device->cancellable,
                            (GAsyncReadyCallback) binc_internal_device_pair_cb,
                            device);
 }
 
-static void binc_internal_device_disconnect_cb(__attribute__((unused)) GObject *source_object,
+static void binc_internal_device_disconnect_cb(GObject *source_object,
                                                GAsyncResult *res,
                                                gpointer user_data) {
 
@@ -723,7 +1460,12 @@ static void binc_internal_device_disconnect_cb(__attribute__((unused)) GObject *
     g_assert(device != NULL);
 
     GError *error = NULL;
-    GVariant *value = g_dbus_connection_call_finish(device->connection, res, &error);
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The device was freed
+        g_clear_error(&error);
+        return;
+    }
     if (value != NULL) {
         g_variant_unref(value);
     }
@@ -753,12 +1495,57 @@ void binc_device_disconnect(Device *device) {
                            NULL,
                            NULL,
                            G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
+                           binc_adapter_get_call_timeout(device->adapter),
+                           device->cancellable,
                            (GAsyncReadyCallback) binc_internal_device_disconnect_cb,
                            device);
 }
 
+static void binc_internal_device_cancel_connect_cb(GObject *source_object,
+                                                   GAsyncResult *res,
+                                                   gpointer user_data) {
+
+    Device *device = (Device *) user_data;
+    g_assert(device != NULL);
+
+    GError *error = NULL;
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The device was freed
+        g_clear_error(&error);
+        return;
+    }
+    if (value != NULL) {
+        g_variant_unref(value);
+    }
+
+    // The pending Connect call fails with an error and moves the device to disconnected
+    if (error != NULL) {
+        log_error(TAG, "failed to cancel connect (error %d: %s)", error->code, error->message);
+        g_clear_error(&error);
+    }
+}
+
+void binc_internal_device_cancel_connect(Device *device) {
+    g_assert(device != NULL);
+    g_assert(device->path != NULL);
+
+    if (device->connection_state != BINC_CONNECTING) return;
+
+    log_debug(TAG, "Cancelling connect to '%s' (%s)", device->name, device->address);
+    g_dbus_connection_call(device->connection,
+                           BLUEZ_DBUS,
+                           device->path,
+                           INTERFACE_DEVICE,
+                           DEVICE_METHOD_DISCONNECT,
+                           NULL,
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           binc_adapter_get_call_timeout(device->adapter),
+                           device->cancellable,
+                           (GAsyncReadyCallback) binc_internal_device_cancel_connect_cb,
+                           device);
+}
 
 void binc_device_set_connection_state_change_cb(Device *device, ConnectionStateChangedCallback callback) {
     g_assert(device != NULL);
@@ -781,35 +1568,38 @@ void binc_device_set_services_resolved_cb(Device *device, ServicesResolvedCallba
 
 Service *binc_device_get_service(const Device *device, const char *service_uuid) {
     g_assert(device != NULL);
-    g_assert(service_uuid != NULL);
-    g_assert(g_uuid_string_is_valid(service_uuid));
 
-    if (device->services_list != NULL) {
-        for (GList *iterator = device->services_list; iterator; iterator = iterator->next) {
-            Service *service = (Service *) iterator->data;
-            if (g_str_equal(service_uuid, binc_service_get_uuid(service))) {
-                return service;
-            }
-        }
-    }
+    BincUuid uuid;
+    if (!parse_uuid(service_uuid, &uuid)) return NULL;
+    return binc_device_get_service_by_uuid(device, &uuid);
+}
+
+Service *binc_device_get_service_by_uuid(const Device *device, const BincUuid *service_uuid) {
+    g_assert(device != NULL);
+    g_assert(service_uuid != NULL);
 
-    return NULL;
+    return g_hash_table_lookup(device->services_by_uuid, service_uuid);
 }
 
 Characteristic *
 binc_device_get_characteristic(const Device *device, const char *service_uuid, const char *characteristic_uuid) {
     g_assert(device != NULL);
-    g_assert(service_uuid != NULL);
-    g_assert(characteristic_uuid != NULL);
-    g_assert(g_uuid_string_is_valid(service_uuid));
-    g_assert(g_uuid_string_is_valid(characteristic_uuid));
 
-    Service *service = binc_device_get_service(device, service_uuid);
-    if (service != NULL) {
-        return binc_service_get_characteristic(service, characteristic_uuid);
+    CharacteristicKey key;
+    if (!parse_uuid(service_uuid, &key.service_uuid) || !parse_uuid(characteristic_uuid, &key.characteristic_uuid)) {
+        return NULL;
     }
+    return g_hash_table_lookup(device->characteristics_by_uuid, &key);
+}
+
+Characteristic *binc_device_get_characteristic_by_uuid(const Device *device, const BincUuid *service_uuid,
+                                                       const BincUuid *characteristic_uuid) {
+    g_assert(device != NULL);
+    g_assert(service_uuid != NULL);
+    g_assert(characteristic_uuid != NULL);
 
-    return NULL;
+    CharacteristicKey key = {.service_uuid = *service_uuid, .characteristic_uuid = *characteristic_uuid};
+    return g_hash_table_lookup(device->characteristics_by_uuid, &key);
 }
 
 void binc_device_set_read_char_cb(Device *device, OnReadCallback callback) {
@@ -819,8 +1609,7 @@ void binc_device_set_read_char_cb(Device *device, OnReadCallback callback) {
 }
 
 gboolean binc_device_read_char(const Device *device, const char *service_uuid, const char *characteristic_uuid) {
-    g_assert(is_valid_uuid(service_uuid));
-    g_assert(is_valid_uuid(characteristic_uuid));
+    g_assert(device != NULL);
 
     Characteristic *characteristic = binc_device_get_characteristic(device, service_uuid, characteristic_uuid);
     if (characteristic != NULL && binc_characteristic_supports_read(characteristic)) {
@@ -832,9 +1621,7 @@ gboolean binc_device_read_char(const Device *device, const char *service_uuid, c
 
 gboolean binc_device_read_desc(const Device *device, const char *service_uuid,
                                const char *characteristic_uuid, const char *desc_uuid) {
-    g_assert(is_valid_uuid(service_uuid));
-    g_assert(is_valid_uuid(characteristic_uuid));
-    g_assert(is_valid_uuid(desc_uuid));
+    g_assert(device != NULL);
 
     Characteristic *characteristic = binc_device_get_characteristic(device, service_uuid, characteristic_uuid);
     if (characteristic == NULL) {
@@ -852,9 +1639,7 @@ gboolean binc_device_read_desc(const Device *device, const char *service_uuid,
 
 gboolean binc_device_write_desc(const Device *device, const char *service_uuid,
                                 const char *characteristic_uuid, const char *desc_uuid, const GByteArray *byteArray) {
-    g_assert(is_valid_uuid(service_uuid));
-    g_assert(is_valid_uuid(characteristic_uuid));
-    g_assert(is_valid_uuid(desc_uuid));
+    g_assert(device != NULL);
 
     Characteristic *characteristic = binc_device_get_characteristic(device, service_uuid, characteristic_uuid);
     if (characteristic == NULL) {
@@ -879,8 +1664,6 @@ void binc_device_set_write_char_cb(Device *device, OnWriteCallback callback) {
 gboolean binc_device_write_char(const Device *device, const char *service_uuid, const char *characteristic_uuid,
                                 const GByteArray *byteArray, WriteType writeType) {
     g_assert(device != NULL);
-    g_assert(is_valid_uuid(service_uuid));
-    g_assert(is_valid_uuid(characteristic_uuid));
 
     Characteristic *characteristic = binc_device_get_characteristic(device, service_uuid, characteristic_uuid);
     if (characteristic != NULL && binc_characteristic_supports_write(characteristic, writeType)) {
@@ -904,8 +1687,6 @@ void binc_device_set_notify_state_cb(Device *device, OnNotifyingStateChangedCall
 
 gboolean binc_device_start_notify(const Device *device, const char *service_uuid, const char *characteristic_uuid) {
     g_assert(device != NULL);
-    g_assert(is_valid_uuid(service_uuid));
-    g_assert(is_valid_uuid(characteristic_uuid));
 
     Characteristic *characteristic = binc_device_get_characteristic(device, service_uuid, characteristic_uuid);
     if (characteristic != NULL && binc_characteristic_supports_notify(characteristic)) {
@@ -917,8 +1698,6 @@ gboolean binc_device_start_notify(const Device *device, const char *service_uuid
 
 gboolean binc_device_stop_notify(const Device *device, const char *service_uuid, const char *characteristic_uuid) {
     g_assert(device != NULL);
-    g_assert(is_valid_uuid(service_uuid));
-    g_assert(is_valid_uuid(characteristic_uuid));
 
     Characteristic *characteristic = binc_device_get_characteristic(device, service_uuid, characteristic_uuid);
     if (characteristic != NULL && binc_characteristic_supports_notify(characteristic) && binc_characteristic_is_notifying(characteristic)) {
@@ -962,6 +1741,17 @@ void binc_device_set_address(Device *device, const char *address) {
 
     g_free((char *) device->address);
     device->address = g_strdup(address);
+
+    guint64 old_key = binc_address_pack(&device->binary_address);
+    if (binc_address_parse(address, device->binary_address.type, &device->binary_address) &&
+        binc_address_pack(&device->binary_address) != old_key) {
+        binc_internal_adapter_device_address_changed(device->adapter, device, old_key);
+    }
+}
+
+const BincAddress *binc_device_get_binary_address(const Device *device) {
+    g_assert(device != NULL);
+    return &device->binary_address;
 }
 
 const char *binc_device_get_address_type(const Device *device) {
@@ -975,6 +1765,13 @@ void binc_device_set_address_type(Device *device, const char *address_type) {
 
     g_free((char *) device->address_type);
     device->address_type = g_strdup(address_type);
+
+    BincAddressType type = binc_address_type_from_string(address_type);
+    if (type != device->binary_address.type) {
+        guint64 old_key = binc_address_pack(&device->binary_address);
+        device->binary_address.type = type;
+        binc_internal_adapter_device_address_changed(device->adapter, device, old_key);
+    }
 }
 
 const char *binc_device_get_alias(const Device *device) {
@@ -1000,6 +1797,9 @@ void binc_device_set_name(Device *device, const char *name) {
     g_assert(name != NULL);
     g_assert(strlen(name) > 0);
 
+    if (device->name == NULL || !g_str_equal(device->name, name)) {
+        device->changes |= BINC_DEVICE_CHANGED_NAME;
+    }
     g_free((char *) device->name);
     device->name = g_strdup(name);
 }
@@ -1035,7 +1835,81 @@ short binc_device_get_rssi(const Device *device) {
 
 void binc_device_set_rssi(Device *device, short rssi) {
     g_assert(device != NULL);
+    if (device->rssi != rssi) {
+        device->changes |= BINC_DEVICE_CHANGED_RSSI;
+    }
     device->rssi = rssi;
+
+    // BlueZ uses -255 for 'no RSSI', keep that out of the filter
+    if (rssi == -255) {
+        device->smoothed_rssi = rssi;
+        binc_rssi_filter_reset(&device->rssi_filter);
+    } else if (device->adapter != NULL) {
+        device->smoothed_rssi = binc_rssi_filter_apply(binc_internal_adapter_get_rssi_filter(device->adapter),
+                                                       &device->rssi_filter, rssi);
+    } else {
+        device->smoothed_rssi = rssi;
+    }
+}
+
+short binc_device_get_smoothed_rssi(const Device *device) {
+    g_assert(device != NULL);
+    return device->smoothed_rssi;
+}
+
+guint binc_device_get_proximity_zone(const Device *device) {
+    g_assert(device != NULL);
+    return device->proximity_zone;
+}
+
+short binc_internal_device_get_reported_rssi(const Device *device) {
+    g_assert(device != NULL);
+    return device->reported_rssi;
+}
+
+void binc_internal_device_set_reported_rssi(Device *device, short rssi, guint proximity_zone) {
+    g_assert(device != NULL);
+    device->reported_rssi = rssi;
+    device->proximity_zone = proximity_zone;
+}
+
+gboolean binc_device_is_restored(const Device *device) {
+    g_assert(device != NULL);
+    return device->restored;
+}
+
+void binc_internal_device_set_restored(Device *device, gboolean restored) {
+    g_assert(device != NULL);
+    device->restored = restored;
+}
+
+void binc_internal_device_count_advertisement(Device *device) {
+    g_assert(device != NULL);
+    if (device->advertisement_count == 0) {
+        device->advertisement_since = g_get_monotonic_time();
+    }
+    device->advertisement_count++;
+}
+
+void binc_internal_device_reset_advertisement_rate(Device *device) {
+    g_assert(device != NULL);
+    device->advertisement_count = 0;
+}
+
+double binc_device_get_advertisement_rate(const Device *device) {
+    g_assert(device != NULL);
+
+    // The first advertisement only starts the clock
+    if (device->advertisement_count < 2) return 0;
+    gint64 elapsed = g_get_monotonic_time() - device->advertisement_since;
+    if (elapsed <= 0) return 0;
+    return (device->advertisement_count - 1) * (double) G_USEC_PER_SEC / (double) elapsed;
+}
+
+void binc_internal_device_reset_rssi_filter(Device *device) {
+    g_assert(device != NULL);
+    binc_rssi_filter_reset(&device->rssi_filter);
+    device->smoothed_rssi = device->rssi;
 }
 
 gboolean binc_device_get_trusted(const Device *device) {
@@ -1055,43 +1929,129 @@ short binc_device_get_txpower(const Device *device) {
 
 void binc_device_set_txpower(Device *device, short txpower) {
     g_assert(device != NULL);
+    if (device->txpower != txpower) {
+        device->changes |= BINC_DEVICE_CHANGED_TXPOWER;
+    }
     device->txpower = txpower;
 }
 
 GList *binc_device_get_uuids(const Device *device) {
     g_assert(device != NULL);
-    return device->uuids;
+
+    if (device->binary_uuids == NULL || device->binary_uuids->len == 0) return NULL;
+
+    // The list is a view on the binary uuids, built on the first call after a change
+    Device *mutable_device = (Device *) device;
+    if (mutable_device->uuids_view == NULL) {
+        for (guint i = device->binary_uuids->len; i > 0; i--) {
+            char buffer[BINC_UUID_STRING_LENGTH];
+            binc_uuid_format(&g_array_index(device->binary_uuids, BincUuid, i - 1), buffer);
+            mutable_device->uuids_view = g_list_prepend(mutable_device->uuids_view, g_strdup(buffer));
+        }
+    }
+    return mutable_device->uuids_view;
 }
 
 void binc_device_set_uuids(Device *device, GList *uuids) {
     g_assert(device != NULL);
 
-    binc_device_free_uuids(device);
-    device->uuids = uuids;
+    if (device->binary_uuids == NULL) {
+        device->binary_uuids = g_array_new(FALSE, FALSE, sizeof(BincUuid));
+    }
+
+    gboolean changed = FALSE;
+    guint count = 0;
+    for (GList *iterator = uuids; iterator; iterator = iterator->next) {
+        BincUuid uuid;
+        if (binc_uuid_parse((const char *) iterator->data, &uuid)) {
+            changed |= binc_device_store_uuid(device, count++, &uuid);
+        }
+    }
+    binc_device_end_uuids_update(device, count, changed);
+    g_list_free_full(uuids, g_free);
 }
 
 GHashTable *binc_device_get_manufacturer_data(const Device *device) {
     g_assert(device != NULL);
-    return device->manufacturer_data;
+
+    if (device->manufacturer_data == NULL) return NULL;
+
+    // The table is a view on the inline store, built on the first call after a change
+    Device *mutable_device = (Device *) device;
+    if (mutable_device->manufacturer_data_view == NULL) {
+        GHashTable *view = g_hash_table_new_full(g_int_hash, g_int_equal, g_free, (GDestroyNotify) byte_array_free);
+        for (guint i = 0; i < device->manufacturer_data->len; i++) {
+            const AdvertisementData *entry = &g_array_index(device->manufacturer_data, AdvertisementData, i);
+            int *key = g_new0(int, 1);
+            *key = entry->company_id;
+            g_hash_table_insert(view, key, advertisement_data_to_byte_array(entry));
+        }
+        mutable_device->manufacturer_data_view = view;
+    }
+    return mutable_device->manufacturer_data_view;
+}
+
+/**
+ * Convert a table of the form returned by the getters back into a GetAll style dictionary entry value
+ */
+static GVariant *byte_array_table_to_variant(GHashTable *table, gboolean int_keys) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, int_keys ? G_VARIANT_TYPE("a{qv}") : G_VARIANT_TYPE("a{sv}"));
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GByteArray *byteArray = (GByteArray *) value;
+        GVariant *payload = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, byteArray->data, byteArray->len,
+                                                      sizeof(guint8));
+        if (int_keys) {
+            g_variant_builder_add(&builder, "{qv}", (guint16) *(int *) key, payload);
+        } else {
+            g_variant_builder_add(&builder, "{sv}", (const char *) key, payload);
+        }
+    }
+    return g_variant_ref_sink(g_variant_builder_end(&builder));
 }
 
 void binc_device_set_manufacturer_data(Device *device, GHashTable *manufacturer_data) {
     g_assert(device != NULL);
+    g_assert(manufacturer_data != NULL);
 
-    binc_device_free_manufacturer_data(device);
-    device->manufacturer_data = manufacturer_data;
+    GVariant *value = byte_array_table_to_variant(manufacturer_data, TRUE);
+    binc_internal_device_update_manufacturer_data(device, value);
+    g_variant_unref(value);
+    g_hash_table_destroy(manufacturer_data);
 }
 
 GHashTable *binc_device_get_service_data(const Device *device) {
     g_assert(device != NULL);
-    return device->service_data;
+
+    if (device->service_data == NULL) return NULL;
+
+    // The table is a view on the inline store, built on the first call after a change
+    Device *mutable_device = (Device *) device;
+    if (mutable_device->service_data_view == NULL) {
+        GHashTable *view = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) byte_array_free);
+        for (guint i = 0; i < device->service_data->len; i++) {
+            const AdvertisementData *entry = &g_array_index(device->service_data, AdvertisementData, i);
+            char buffer[BINC_UUID_STRING_LENGTH];
+            binc_uuid_format(&entry->service_uuid, buffer);
+            g_hash_table_insert(view, g_strdup(buffer), advertisement_data_to_byte_array(entry));
+        }
+        mutable_device->service_data_view = view;
+    }
+    return mutable_device->service_data_view;
 }
 
 void binc_device_set_service_data(Device *device, GHashTable *service_data) {
     g_assert(device != NULL);
+    g_assert(service_data != NULL);
 
-    binc_device_free_service_data(device);
-    device->service_data = service_data;
+    GVariant *value = byte_array_table_to_variant(service_data, FALSE);
+    binc_internal_device_update_service_data(device, value);
+    g_variant_unref(value);
+    g_hash_table_destroy(service_data);
 }
 
 void binc_device_set_is_central(Device *device, gboolean is_central) {
@@ -1109,6 +2069,171 @@ GDBusConnection *binc_device_get_dbus_connection(const Device *device) {
     return device->connection;
 }
 
+GattQueue *binc_internal_device_get_gatt_queue(const Device *device) {
+    g_assert(device != NULL);
+    return device->gatt_queue;
+}
+
+typedef struct batch_read BatchRead;
+
+typedef struct batch_read_slot {
+    BatchRead *batch; // Borrowed
+    guint index;
+} BatchReadSlot;
+
+/**
+ * Each read still running holds one count of remaining, released by its destroy notify. The batch is freed when
+ * the last one is released, which can be after the callback ran when the device was freed.
+ */
+struct batch_read {
+    Device *device; // Borrowed
+    GattReadResult *results; // Owned
+    BatchReadSlot *slots; // Owned
+    guint count;
+    guint remaining;
+    gboolean finished;
+    DeviceBatchReadCallback callback;
+    gpointer user_data;
+};
+
+static void batch_read_finish(BatchRead *batch) {
+    batch->finished = TRUE;
+    batch->device->batch_reads = g_list_remove(batch->device->batch_reads, batch);
+    batch->callback(batch->device, batch->results, batch->count, batch->user_data);
+
+    for (guint i = 0; i < batch->count; i++) {
+        if (batch->results[i].value != NULL) {
+            g_byte_array_free(batch->results[i].value, TRUE);
+            batch->results[i].value = NULL;
+        }
+        if (batch->results[i].error != NULL) {
+            g_error_free(batch->results[i].error);
+            batch->results[i].error = NULL;
+        }
+    }
+}
+
+static void batch_read_complete_item(BatchRead *batch) {
+    if (--batch->remaining > 0) return;
+
+    if (!batch->finished) {
+        batch_read_finish(batch);
+    }
+    g_free(batch->results);
+    g_free(batch->slots);
+    g_free(batch);
+}
+
+static void batch_read_slot_released(gpointer user_data) {
+    batch_read_complete_item(((BatchReadSlot *) user_data)->batch);
+}
+
+static void binc_internal_fail_batch_reads(Device *device) {
+    while (device->batch_reads != NULL) {
+        BatchRead *batch = (BatchRead *) device->batch_reads->data;
+        for (guint i = 0; i < batch->count; i++) {
+            GattReadResult *result = &batch->results[i];
+            if (result->value == NULL && result->error == NULL) {
+                result->error = g_error_new(G_IO_ERROR, G_IO_ERROR_CANCELLED, "device was freed");
+            }
+        }
+        batch_read_finish(batch);
+    }
+}
+
+static void binc_internal_batch_read_cb(__attribute__((unused)) Device *device,
+                                        __attribute__((unused)) Characteristic *characteristic,
+                                        const GByteArray *byteArray,
+                                        const GError *error,
+                                        gpointer user_data) {
+    BatchReadSlot *slot = (BatchReadSlot *) user_data;
+    if (slot->batch->finished) return;
+
+    GattReadResult *result = &slot->batch->results[slot->index];
+    if (error != NULL) {
+        result->error = g_error_copy(error);
+    } else {
+        result->value = g_byte_array_sized_new(byteArray != NULL ? byteArray->len : 0);
+        if (byteArray != NULL) {
+            g_byte_array_append(result->value, byteArray->data, byteArray->len);
+        }
+    }
+}
+
+void binc_device_read_chars(Device *device, const GattReadItem *items, guint count, gboolean use_cached,
+                            GCancellable *cancellable, DeviceBatchReadCallback callback, gpointer user_data) {
+    g_assert(device != NULL);
+    g_assert(items != NULL || count == 0);
+    g_assert(callback != NULL);
+
+    BatchRead *batch = g_new0(BatchRead, 1);
+    batch->device = device;
+    batch->results = g_new0(GattReadResult, count);
+    batch->slots = g_new0(BatchReadSlot, count);
+    batch->count = count;
+    batch->callback = callback;
+    batch->user_data = user_data;
+
+    // Hold one completion back so the batch can't complete while reads are still being queued
+    batch->remaining = count + 1;
+    device->batch_reads = g_list_prepend(device->batch_reads, batch);
+
+    for (guint i = 0; i < count; i++) {
+        GattReadResult *result = &batch->results[i];
+        result->characteristic = binc_device_get_characteristic_by_uuid(device, &items[i].service_uuid,
+                                                                         &items[i].characteristic_uuid);
+        if (result->characteristic == NULL) {
+            result->error = g_error_new(G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "characteristic %s not found",
+                                        binc_uuid_to_interned_string(&items[i].characteristic_uuid));
+            batch->remaining--;
+            continue;
+        }
+
+        if (use_cached) {
+            result->value = binc_internal_characteristic_get_cached_value(result->characteristic);
+            if (result->value != NULL) {
+                result->cached = TRUE;
+                batch->remaining--;
+                continue;
+            }
+        }
+
+        if (!binc_characteristic_supports_read(result->characteristic)) {
+            result->error = g_error_new(G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "characteristic %s is not readable",
+                                        binc_characteristic_get_uuid(result->characteristic));
+            batch->remaining--;
+            continue;
+        }
+
+        batch->slots[i].batch = batch;
+        batch->slots[i].index = i;
+        binc_internal_characteristic_read_full(result->characteristic, cancellable, binc_internal_batch_read_cb,
+                                               &batch->slots[i], batch_read_slot_released);
+    }
+
+    batch_read_complete_item(batch);
+}
+
+void binc_device_set_gatt_timeout(Device *device, gint timeout_ms) {
+    g_assert(device != NULL);
+    binc_gatt_queue_set_timeout(device->gatt_queue, timeout_ms);
+}
+
+gint binc_device_get_gatt_timeout(const Device *device) {
+    g_assert(device != NULL);
+    return binc_gatt_queue_get_timeout(device->gatt_queue);
+}
+
+void binc_device_get_gatt_queue_stats(const Device *device, GattQueueStats *stats) {
+    g_assert(device != NULL);
+    binc_gatt_queue_get_stats(device->gatt_queue, stats);
+}
+
+void binc_device_reset_gatt_queue_stats(Device *device) {
+    g_assert(device != NULL);
+    binc_gatt_queue_reset_stats(device->gatt_queue);
+}
+
 BondingState binc_device_get_bonding_state(const Device *device) {
     g_assert(device != NULL);
     return device->bondingState;
@@ -1126,83 +2251,107 @@ guint binc_device_get_mtu(const Device *device) {
 
 gboolean binc_device_has_service(const Device *device, const char *service_uuid) {
     g_assert(device != NULL);
-    g_assert(g_uuid_string_is_valid(service_uuid));
 
-    if (device->uuids != NULL && g_list_length(device->uuids) > 0) {
-        for (GList *iterator = device->uuids; iterator; iterator = iterator->next) {
-            if (g_str_equal(service_uuid, (char *) iterator->data)) {
-                return TRUE;
-            }
+    BincUuid uuid;
+    if (!parse_uuid(service_uuid, &uuid)) return FALSE;
+    return binc_device_has_service_uuid(device, &uuid);
+}
+
+gboolean binc_device_has_service_uuid(const Device *device, const BincUuid *service_uuid) {
+    g_assert(device != NULL);
+    g_assert(service_uuid != NULL);
+
+    if (device->binary_uuids == NULL) return FALSE;
+
+    for (guint i = 0; i < device->binary_uuids->len; i++) {
+        if (binc_uuid_equal(&g_array_index(device->binary_uuids, BincUuid, i), service_uuid)) {
+            return TRUE;
         }
     }
     return FALSE;
 }
 
+const GArray *binc_internal_device_get_binary_uuids(const Device *device) {
+    g_assert(device != NULL);
+    return device->binary_uuids;
+}
+
+guint binc_internal_device_take_changes(Device *device) {
+    g_assert(device != NULL);
+
+    guint changes = device->changes;
+    device->changes = 0;
+    return changes;
+}
+
+static void device_update_address(gpointer object, GVariant *value) {
+    binc_device_set_address((Device *) object, g_variant_get_string(value, NULL));
+}
+
+static void device_update_address_type(gpointer object, GVariant *value) {
+    binc_device_set_address_type((Device *) object, g_variant_get_string(value, NULL));
+}
+
+static void device_update_alias(gpointer object, GVariant *value) {
+    binc_device_set_alias((Device *) object, g_variant_get_string(value, NULL));
+}
+
+static void device_update_connected(gpointer object, GVariant *value) {
+    binc_device_internal_set_conn_state((Device *) object,
+                                        g_variant_get_boolean(value) ? BINC_CONNECTED : BINC_DISCONNECTED, NULL);
+}
+
+static void device_update_name(gpointer object, GVariant *value) {
+    binc_device_set_name((Device *) object, g_variant_get_string(value, NULL));
+}
+
+static void device_update_paired(gpointer object, GVariant *value) {
+    binc_device_set_paired((Device *) object, g_variant_get_boolean(value));
+}
+
+static void device_update_rssi(gpointer object, GVariant *value) {
+    binc_device_set_rssi((Device *) object, g_variant_get_int16(value));
+}
+
+static void device_update_trusted(gpointer object, GVariant *value) {
+    binc_device_set_trusted((Device *) object, g_variant_get_boolean(value));
+}
+
+static void device_update_txpower(gpointer object, GVariant *value) {
+    binc_device_set_txpower((Device *) object, g_variant_get_int16(value));
+}
+
+static void device_update_uuids(gpointer object, GVariant *value) {
+    binc_internal_device_update_uuids((Device *) object, value);
+}
+
+static void device_update_manufacturer_data(gpointer object, GVariant *value) {
+    binc_internal_device_update_manufacturer_data((Device *) object, value);
+}
+
+static void device_update_service_data(gpointer object, GVariant *value) {
+    binc_internal_device_update_service_data((Device *) object, value);
+}
+
+static const PropertyHandlerEntry device_property_handlers[] = {
+        {DEVICE_PROPERTY_ADDRESS,           "s",     device_update_address},
+        {DEVICE_PROPERTY_ADDRESS_TYPE,      "s",     device_update_address_type},
+        {DEVICE_PROPERTY_ALIAS,             "s",     device_update_alias},
+        {DEVICE_PROPERTY_CONNECTED,         "b",     device_update_connected},
+        {DEVICE_PROPERTY_NAME,              "s",     device_update_name},
+        {DEVICE_PROPERTY_PAIRED,            "b",     device_update_paired},
+        {DEVICE_PROPERTY_RSSI,              "n",     device_update_rssi},
+        {DEVICE_PROPERTY_TRUSTED,           "b",     device_update_trusted},
+        {DEVICE_PROPERTY_TXPOWER,           "n",     device_update_txpower},
+        {DEVICE_PROPERTY_UUIDS,             "as",    device_update_uuids},
+        {DEVICE_PROPERTY_MANUFACTURER_DATA, "a{qv}", device_update_manufacturer_data},
+        {DEVICE_PROPERTY_SERVICE_DATA,      "a{sv}", device_update_service_data},
+};
+
+static PropertyDispatcher device_property_dispatcher = BINC_PROPERTY_DISPATCHER(device_property_handlers);
+
 void binc_internal_device_update_property(Device *device, const char *property_name, GVariant *property_value) {
-    if (g_str_equal(property_name, DEVICE_PROPERTY_ADDRESS)) {
-        binc_device_set_address(device, g_variant_get_string(property_value, NULL));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_ADDRESS_TYPE)) {
-        binc_device_set_address_type(device, g_variant_get_string(property_value, NULL));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_ALIAS)) {
-        binc_device_set_alias(device, g_variant_get_string(property_value, NULL));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_CONNECTED)) {
-        binc_device_internal_set_conn_state(device, g_variant_get_boolean(property_value) ? BINC_CONNECTED : BINC_DISCONNECTED,
-                                            NULL);
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_NAME)) {
-        binc_device_set_name(device, g_variant_get_string(property_value, NULL));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_PAIRED)) {
-        binc_device_set_paired(device, g_variant_get_boolean(property_value));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_RSSI)) {
-        binc_device_set_rssi(device, g_variant_get_int16(property_value));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_TRUSTED)) {
-        binc_device_set_trusted(device, g_variant_get_boolean(property_value));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_TXPOWER)) {
-        binc_device_set_txpower(device, g_variant_get_int16(property_value));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_UUIDS)) {
-        binc_device_set_uuids(device, g_variant_string_array_to_list(property_value));
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_MANUFACTURER_DATA)) {
-        GVariantIter *iter;
-        g_variant_get(property_value, "a{qv}", &iter);
-
-        GVariant *array;
-        guint16 key;
-        GHashTable *manufacturer_data = g_hash_table_new_full(g_int_hash, g_int_equal,
-                                                              g_free, (GDestroyNotify) byte_array_free);
-        while (g_variant_iter_loop(iter, "{qv}", &key, &array)) {
-            size_t data_length = 0;
-            guint8 *data = (guint8 *) g_variant_get_fixed_array(array, &data_length, sizeof(guint8));
-            GByteArray *byteArray = g_byte_array_sized_new(data_length);
-            g_byte_array_append(byteArray, data, data_length);
-
-            int *keyCopy = g_new0 (gint, 1);
-            *keyCopy = key;
-
-            g_hash_table_insert(manufacturer_data, keyCopy, byteArray);
-        }
-        binc_device_set_manufacturer_data(device, manufacturer_data);
-        g_variant_iter_free(iter);
-    } else if (g_str_equal(property_name, DEVICE_PROPERTY_SERVICE_DATA)) {
-        GVariantIter *iter;
-        g_variant_get(property_value, "a{sv}", &iter);
-
-        GVariant *array;
-        char *key;
-
-        GHashTable *service_data = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                                         g_free, (GDestroyNotify) byte_array_free);
-        while (g_variant_iter_loop(iter, "{sv}", &key, &array)) {
-            size_t data_length = 0;
-            guint8 *data = (guint8 *) g_variant_get_fixed_array(array, &data_length, sizeof(guint8));
-            GByteArray *byteArray = g_byte_array_sized_new(data_length);
-            g_byte_array_append(byteArray, data, data_length);
-
-            char *keyCopy = g_strdup(key);
-
-            g_hash_table_insert(service_data, keyCopy, byteArray);
-        }
-        binc_device_set_service_data(device, service_data);
-        g_variant_iter_free(iter);
-    }
+    binc_property_dispatch(&device_property_dispatcher, device, property_name, property_value);
 }
 
 void binc_device_set_user_data(Device *device, void *user_data) {
@@ -25,6 +25,8 @@
 
 #include <glib.h>
 #include "forward_decl.h"
+#include "address.h"
+#include "uuid.h"
 #include "characteristic.h"
 #include "descriptor.h"
 
@@ -47,6 +49,50 @@ typedef void (*ServicesResolvedCallback)(Device *device);
 typedef void (*BondingStateChangedCallback)(Device *device, BondingState new_state, BondingState old_state,
                                             const GError *error);
 
+/**
+ * A characteristic to read in a batch, identified by the uuids of its service and itself
+ */
+typedef struct GattReadItem {
+    BincUuid service_uuid;
+    BincUuid characteristic_uuid;
+} GattReadItem;
+
+/**
+ * Result of one item of a batch read. Exactly one of value and error is set.
+ * cached is TRUE when the value was taken from BlueZ's cache instead of read from the device.
+ */
+typedef struct GattReadResult {
+    Characteristic *characteristic; // NULL when the device has no such characteristic
+    GByteArray *value;
+    GError *error;
+    gboolean cached;
+} GattReadResult;
+
+/**
+ * Called once when every item of a batch read completed. The results are in the order of the items and are only
+ * valid during the callback.
+ */
+typedef void (*DeviceBatchReadCallback)(Device *device, const GattReadResult *results, guint count,
+                                        gpointer user_data);
+
+/**
+ * Counters of the GATT operation queue of a device. Wait time runs from queueing an operation to sending it,
+ * latency from queueing it to its completion, both in microseconds.
+ */
+typedef struct GattQueueStats {
+    guint depth;
+    guint in_flight;
+    guint64 operations;
+    guint64 failures;
+    guint64 retries;
+    guint64 timeouts;
+    guint64 cancelled;
+    guint64 wait_time_total_us;
+    guint64 wait_time_max_us;
+    guint64 latency_total_us;
+    guint64 latency_max_us;
+} GattQueueStats;
+
 
 /**
  * Connect to a device asynchronously
@@ -90,12 +136,18 @@ void binc_device_set_write_desc_cb(Device *device, OnDescWriteCallback callback)
 
 void binc_device_set_connection_state_change_cb(Device *device, ConnectionStateChangedCallback callback);
 
+/**
+ * Called once the services of a connected device were collected, and again when the device indicated Service Changed.
+ * The characteristics and descriptors from before are freed then, calls on them complete with G_IO_ERROR_CANCELLED.
+ */
 void binc_device_set_services_resolved_cb(Device *device, ServicesResolvedCallback callback);
 
 void binc_device_set_bonding_state_changed_cb(Device *device, BondingStateChangedCallback callback);
 
 gboolean binc_device_has_service(const Device *device, const char *service_uuid);
 
+gboolean binc_device_has_service_uuid(const Device *device, const BincUuid *service_uuid);
+
 GList *binc_device_get_services(const Device *device);
 
 Service *binc_device_get_service(const Device *device, const char *service_uuid);
@@ -103,6 +155,28 @@ Service *binc_device_get_service(const Device *device, const char *service_uuid)
 Characteristic *binc_device_get_characteristic(const Device *device,
                                                const char *service_uuid, const char *characteristic_uuid);
 
+/**
+ * Look up a service by binary uuid without string compares
+ */
+Service *binc_device_get_service_by_uuid(const Device *device, const BincUuid *service_uuid);
+
+/**
+ * Look up a characteristic by binary uuids in a single hash lookup. The result stays valid until services are
+ * resolved again, so hot loops can resolve it once and call the characteristic functions directly.
+ */
+Characteristic *binc_device_get_characteristic_by_uuid(const Device *device, const BincUuid *service_uuid,
+                                                       const BincUuid *characteristic_uuid);
+
+/**
+ * Read several characteristics and complete once with all results.
+ * The reads go through the GATT operation queue. With use_cached, characteristics that have a non-empty cached Value
+ * in BlueZ are answered from it without an ATT round trip. The callback runs before this returns when no item
+ * needs a read. Cancelling the optional cancellable fails the reads that did not complete yet.
+ * When the device is freed first, the callback runs from binc_device_free with those reads failed as cancelled.
+ */
+void binc_device_read_chars(Device *device, const GattReadItem *items, guint count, gboolean use_cached,
+                            GCancellable *cancellable, DeviceBatchReadCallback callback, gpointer user_data);
+
 ConnectionState binc_device_get_connection_state(const Device *device);
 
 const char *binc_device_get_connection_state_name(const Device *device);
@@ -111,6 +185,8 @@ const char *binc_device_get_address(const Device *device);
 
 const char *binc_device_get_address_type(const Device *device);
 
+const BincAddress *binc_device_get_binary_address(const Device *device);
+
 const char *binc_device_get_alias(const Device *device);
 
 const char *binc_device_get_name(const Device *device);
@@ -121,12 +197,35 @@ gboolean binc_device_get_paired(const Device *device);
 
 short binc_device_get_rssi(const Device *device);
 
+/**
+ * Get the RSSI after the filter configured on the adapter, or the raw RSSI if no filter is set
+ */
+short binc_device_get_smoothed_rssi(const Device *device);
+
+/**
+ * Get the proximity zone the device was last reported in, see binc_adapter_set_proximity_zones
+ */
+guint binc_device_get_proximity_zone(const Device *device);
+
+/**
+ * Get the number of advertisements per second received since the device was first seen or the scan stats were reset
+ */
+double binc_device_get_advertisement_rate(const Device *device);
+
 gboolean binc_device_get_trusted(const Device *device);
 
 short binc_device_get_txpower(const Device *device);
 
+/**
+ * Get the advertised service uuids as a list of strings, or NULL if there are none.
+ * The list is owned by the device and stays valid until the uuids change.
+ */
 GList *binc_device_get_uuids(const Device *device);
 
+/**
+ * Get the manufacturer data as a table of int company id -> GByteArray, or service data as a table of
+ * uuid string -> GByteArray. The table is owned by the device and stays valid until the data changes.
+ */
 GHashTable *binc_device_get_manufacturer_data(const Device *device);
 
 GHashTable *binc_device_get_service_data(const Device *device);
@@ -139,6 +238,28 @@ guint binc_device_get_mtu(const Device *device);
 
 gboolean binc_device_is_central(const Device *device);
 
+/**
+ * Restored devices come from a device cache snapshot and have not been confirmed by BlueZ yet.
+ * Their properties may be stale. Restored devices that BlueZ no longer knows are dropped once the adapter has
+ * read the BlueZ object tree.
+ */
+gboolean binc_device_is_restored(const Device *device);
+
+/**
+ * Set the timeout of each GATT operation of the device, -1 for the D-Bus default of 25 seconds. Defaults to 10 seconds.
+ * An operation that times out fails with G_IO_ERROR_TIMED_OUT and frees its place in the queue.
+ */
+void binc_device_set_gatt_timeout(Device *device, gint timeout_ms);
+
+gint binc_device_get_gatt_timeout(const Device *device);
+
+/**
+ * Copy the counters of the GATT operation queue into stats
+ */
+void binc_device_get_gatt_queue_stats(const Device *device, GattQueueStats *stats);
+
+void binc_device_reset_gatt_queue_stats(Device *device);
+
 char *binc_device_to_string(const Device *device);
 
 void binc_device_set_user_data(Device *device, void *user_data);
@@ -25,6 +25,19 @@
 #define BINC_DEVICE_INTERNAL_H
 
 #include "device.h"
+#include "gatt_queue.h"
+
+typedef enum DeviceChanges {
+    BINC_DEVICE_CHANGED_RSSI = 1 << 0,
+    BINC_DEVICE_CHANGED_MANUFACTURER_DATA = 1 << 1,
+    BINC_DEVICE_CHANGED_SERVICE_DATA = 1 << 2,
+    BINC_DEVICE_CHANGED_NAME = 1 << 3,
+    BINC_DEVICE_CHANGED_UUIDS = 1 << 4,
+    BINC_DEVICE_CHANGED_TXPOWER = 1 << 5
+} DeviceChanges;
+
+#define BINC_DEVICE_CHANGED_ADVERTISEMENT \
+    (BINC_DEVICE_CHANGED_RSSI | BINC_DEVICE_CHANGED_MANUFACTURER_DATA | BINC_DEVICE_CHANGED_SERVICE_DATA)
 
 Device *binc_device_create(const char *path, Adapter *adapter);
 
@@ -32,6 +45,11 @@ void binc_device_free(Device *device);
 
 GDBusConnection *binc_device_get_dbus_connection(const Device *device);
 
+/**
+ * Get the queue that all GATT reads, writes and notify calls on the device go through
+ */
+GattQueue *binc_internal_device_get_gatt_queue(const Device *device);
+
 void binc_device_set_address(Device *device, const char *address);
 
 void binc_device_set_address_type(Device *device, const char *address_type);
@@ -52,6 +70,10 @@ void binc_device_set_trusted(Device *device, gboolean trusted);
 
 void binc_device_set_txpower(Device *device, short txpower);
 
+/**
+ * Replace the advertised uuids, manufacturer data or service data. The device takes ownership of the argument
+ * and only reports a change when the content differs.
+ */
 void binc_device_set_uuids(Device *device, GList *uuids);
 
 void binc_device_set_manufacturer_data(Device *device, GHashTable *manufacturer_data);
@@ -62,6 +84,36 @@ void binc_device_set_bonding_state(Device *device, BondingState bonding_state);
 
 void binc_device_set_is_central(Device *device, gboolean is_central);
 
+const GArray *binc_internal_device_get_binary_uuids(const Device *device);
+
+/**
+ * Called when BlueZ reports that the GATT database of a resolved device changed, drops its cached layout and
+ * collects the services again once BlueZ stopped changing them
+ */
+void binc_internal_device_gatt_changed(Device *device);
+
+/**
+ * Get the DeviceChanges bits for properties that changed value since the last call, and clear them
+ */
+guint binc_internal_device_take_changes(Device *device);
+
+short binc_internal_device_get_reported_rssi(const Device *device);
+
+void binc_internal_device_set_reported_rssi(Device *device, short rssi, guint proximity_zone);
+
+void binc_internal_device_reset_rssi_filter(Device *device);
+
+void binc_internal_device_set_restored(Device *device, gboolean restored);
+
+void binc_internal_device_count_advertisement(Device *device);
+
+void binc_internal_device_reset_advertisement_rate(Device *device);
+
+/**
+ * Abort a running connection attempt, BlueZ then fails the pending Connect call
+ */
+void binc_internal_device_cancel_connect(Device *device);
+
 void binc_internal_device_update_property(Device *device, const char *property_name, GVariant *property_value);
 
 #endif //BINC_DEVICE_INTERNAL_H
@@ -0,0 +1,350 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "device_snapshot.h"
+#include "adapter.h"
+#include "device_internal.h"
+#include "logger.h"
+#include "utility.h"
+
+static const char *const TAG = "DeviceSnapshot";
+
+/*
+ * Layout, all integers little endian:
+ *
+ * header:  magic "BINCDEVS", u16 version, u16 reserved, u32 device count
+ * record:  u32 length of the rest of the record, so newer minor fields can be skipped
+ *          u8[6] address, u8 address type, u8 flags (paired, trusted), u8 bonding state,
+ *          i16 rssi, i16 txpower, str name, str alias,
+ *          u16 uuid count, u8[16] uuid...,
+ *          u16 manufacturer count, (u16 id, u16 length, data)...,
+ *          u16 service data count, (u8[16] uuid, u16 length, data)...
+ * str:     u16 length, bytes without terminator, length 0xFFFF for NULL
+ */
+static const char SNAPSHOT_MAGIC[8] = {'B', 'I', 'N', 'C', 'D', 'E', 'V', 'S'};
+static const guint16 SNAPSHOT_VERSION = 1;
+static const gsize SNAPSHOT_HEADER_LENGTH = 16;
+static const guint16 STRING_NULL = 0xFFFF;
+
+static const guint8 FLAG_PAIRED = 1 << 0;
+static const guint8 FLAG_TRUSTED = 1 << 1;
+
+static void put_u8(GByteArray *out, guint8 value) {
+    g_byte_array_append(out, &value, 1);
+}
+
+static void put_u16(GByteArray *out, guint16 value) {
+    guint16 le = GUINT16_TO_LE(value);
+    g_byte_array_append(out, (const guint8 *) &le, sizeof(le));
+}
+
+static void put_u32(GByteArray *out, guint32 value) {
+    guint32 le = GUINT32_TO_LE(value);
+    g_byte_array_append(out, (const guint8 *) &le, sizeof(le));
+}
+
+static void put_string(GByteArray *out, const char *value) {
+    if (value == NULL) {
+        put_u16(out, STRING_NULL);
+        return;
+    }
+    gsize length = MIN(strlen(value), (gsize) STRING_NULL - 1);
+    put_u16(out, (guint16) length);
+    g_byte_array_append(out, (const guint8 *) value, (guint) length);
+}
+
+static void put_blob(GByteArray *out, const GByteArray *value) {
+    guint16 length = (guint16) MIN(value->len, G_MAXUINT16);
+    put_u16(out, length);
+    g_byte_array_append(out, value->data, length);
+}
+
+static void encode_device(GByteArray *out, const Device *device) {
+    guint record_start = out->len;
+    put_u32(out, 0);
+
+    const BincAddress *address = binc_device_get_binary_address(device);
+    g_byte_array_append(out, address->bytes, sizeof(address->bytes));
+    put_u8(out, (guint8) address->type);
+    put_u8(out, (binc_device_get_paired(device) ? FLAG_PAIRED : 0) |
+                (binc_device_get_trusted(device) ? FLAG_TRUSTED : 0));
+    put_u8(out, (guint8) binc_device_get_bonding_state(device));
+    put_u16(out, (guint16) binc_device_get_rssi(device));
+    put_u16(out, (guint16) binc_device_get_txpower(device));
+    put_string(out, binc_device_get_name(device));
+    put_string(out, binc_device_get_alias(device));
+
+    const GArray *uuids = binc_internal_device_get_binary_uuids(device);
+    guint16 uuid_count = uuids != NULL ? (guint16) MIN(uuids->len, G_MAXUINT16) : 0;
+    put_u16(out, uuid_count);
+    for (guint i = 0; i < uuid_count; i++) {
+        g_byte_array_append(out, g_array_index(uuids, BincUuid, i).bytes, sizeof(BincUuid));
+    }
+
+    GHashTable *manufacturer_data = binc_device_get_manufacturer_data(device);
+    put_u16(out, manufacturer_data != NULL ? (guint16) g_hash_table_size(manufacturer_data) : 0);
+    if (manufacturer_data != NULL) {
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, manufacturer_data);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            put_u16(out, (guint16) *(int *) key);
+            put_blob(out, (GByteArray *) value);
+        }
+    }
+
+    // Service data with a key that is not a valid uuid can't be encoded, count only the ones that can
+    GHashTable *service_data = binc_device_get_service_data(device);
+    guint count_offset = out->len;
+    guint16 service_count = 0;
+    put_u16(out, 0);
+    if (service_data != NULL) {
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, service_data);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            BincUuid uuid;
+            if (!binc_uuid_parse((const char *) key, &uuid)) continue;
+            g_byte_array_append(out, uuid.bytes, sizeof(uuid.bytes));
+            put_blob(out, (GByteArray *) value);
+            service_count++;
+        }
+    }
+    guint16 service_count_le = GUINT16_TO_LE(service_count);
+    memcpy(out->data + count_offset, &service_count_le, sizeof(service_count_le));
+
+    guint32 record_length = GUINT32_TO_LE(out->len - record_start - (guint) sizeof(guint32));
+    memcpy(out->data + record_start, &record_length, sizeof(record_length));
+}
+
+GByteArray *binc_device_snapshot_encode(const Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    GByteArray *out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8 *) SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put_u16(out, SNAPSHOT_VERSION);
+    put_u16(out, 0);
+    put_u32(out, 0);
+
+    guint32 count = 0;
+    DeviceIter iter;
+    Device *device;
+    binc_adapter_device_iter_init(&iter, adapter);
+    while (binc_device_iter_next(&iter, &device)) {
+        encode_device(out, device);
+        count++;
+    }
+
+    guint32 count_le = GUINT32_TO_LE(count);
+    memcpy(out->data + 12, &count_le, sizeof(count_le));
+    return out;
+}
+
+typedef struct snapshot_reader {
+    const guint8 *data;
+    gsize length;
+    gsize position;
+    gboolean valid;
+} SnapshotReader;
+
+static const guint8 *take(SnapshotReader *reader, gsize length) {
+    if (!reader->valid || reader->length - reader->position < length) {
+        reader->valid = FALSE;
+        return NULL;
+    }
+    const guint8 *result = reader->data + reader->position;
+    reader->position += length;
+    return result;
+}
+
+static guint8 get_u8(SnapshotReader *reader) {
+    const guint8 *bytes = take(reader, 1);
+    return bytes != NULL ? bytes[0] : 0;
+}
+
+static guint16 get_u16(SnapshotReader *reader) {
+    guint16 value = 0;
+    const guint8 *bytes = take(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return GUINT16_FROM_LE(value);
+}
+
+static guint32 get_u32(SnapshotReader *reader) {
+    guint32 value = 0;
+    const guint8 *bytes = take(reader, sizeof(value));
+    if (bytes != NULL) memcpy(&value, bytes, sizeof(value));
+    return GUINT32_FROM_LE(value);
+}
+
+static GVariant *get_bytes_variant(SnapshotReader *reader) {
+    guint16 length = get_u16(reader);
+    const guint8 *bytes = take(reader, length);
+    if (bytes == NULL) return NULL;
+    return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, bytes, length, sizeof(guint8));
+}
+
+static void add_string_property(GVariantBuilder *builder, SnapshotReader *reader, const char *name) {
+    guint16 length = get_u16(reader);
+    if (length == STRING_NULL) return;
+
+    const guint8 *bytes = take(reader, length);
+    if (bytes == NULL) return;
+    char *value = g_strndup((const char *) bytes, length);
+    if (g_utf8_validate(value, -1, NULL)) {
+        g_variant_builder_add(builder, "{sv}", name, g_variant_new_string(value));
+    }
+    g_free(value);
+}
+
+static GVariant *decode_device(SnapshotReader *reader, const char *adapter_path, char **path,
+                               BondingState *bonding_state) {
+    BincAddress address;
+    const guint8 *address_bytes = take(reader, sizeof(address.bytes));
+    if (address_bytes == NULL) return NULL;
+    memcpy(address.bytes, address_bytes, sizeof(address.bytes));
+    address.type = get_u8(reader) == BINC_ADDRESS_RANDOM ? BINC_ADDRESS_RANDOM : BINC_ADDRESS_PUBLIC;
+    guint8 flags = get_u8(reader);
+    guint8 bonding = get_u8(reader);
+    *bonding_state = bonding <= BINC_BONDED ? (BondingState) bonding : BINC_BOND_NONE;
+
+    char address_string[BINC_ADDRESS_STRING_LENGTH];
+    binc_address_format(&address, address_string);
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&builder, "{sv}", "Address", g_variant_new_string(address_string));
+    g_variant_builder_add(&builder, "{sv}", "AddressType",
+                          g_variant_new_string(address.type == BINC_ADDRESS_RANDOM ? "random" : "public"));
+    g_variant_builder_add(&builder, "{sv}", "Paired", g_variant_new_boolean((flags & FLAG_PAIRED) != 0));
+    g_variant_builder_add(&builder, "{sv}", "Trusted", g_variant_new_boolean((flags & FLAG_TRUSTED) != 0));
+    g_variant_builder_add(&builder, "{sv}", "RSSI", g_variant_new_int16((gint16) get_u16(reader)));
+    g_variant_builder_add(&builder, "{sv}", "TxPower", g_variant_new_int16((gint16) get_u16(reader)));
+    add_string_property(&builder, reader, "Name");
+    add_string_property(&builder, reader, "Alias");
+
+    guint16 uuid_count = get_u16(reader);
+    if (uuid_count > 0) {
+        GVariantBuilder uuids;
+        g_variant_builder_init(&uuids, G_VARIANT_TYPE("as"));
+        for (guint i = 0; i < uuid_count && reader->valid; i++) {
+            BincUuid uuid;
+            const guint8 *bytes = take(reader, sizeof(uuid.bytes));
+            if (bytes == NULL) break;
+            memcpy(uuid.bytes, bytes, sizeof(uuid.bytes));
+            char uuid_string[BINC_UUID_STRING_LENGTH];
+            binc_uuid_format(&uuid, uuid_string);
+            g_variant_builder_add(&uuids, "s", uuid_string);
+        }
+        g_variant_builder_add(&builder, "{sv}", "UUIDs", g_variant_builder_end(&uuids));
+    }
+
+    guint16 manufacturer_count = get_u16(reader);
+    if (manufacturer_count > 0) {
+        GVariantBuilder manufacturer_data;
+        g_variant_builder_init(&manufacturer_data, G_VARIANT_TYPE("a{qv}"));
+        for (guint i = 0; i < manufacturer_count && reader->valid; i++) {
+            guint16 id = get_u16(reader);
+            GVariant *payload = get_bytes_variant(reader);
+            if (payload == NULL) break;
+            g_variant_builder_add(&manufacturer_data, "{qv}", id, payload);
+        }
+        g_variant_builder_add(&builder, "{sv}", "ManufacturerData", g_variant_builder_end(&manufacturer_data));
+    }
+
+    guint16 service_count = get_u16(reader);
+    if (service_count > 0) {
+        GVariantBuilder service_data;
+        g_variant_builder_init(&service_data, G_VARIANT_TYPE("a{sv}"));
+        for (guint i = 0; i < service_count && reader->valid; i++) {
+            BincUuid uuid;
+            const guint8 *bytes = take(reader, sizeof(uuid.bytes));
+            GVariant *payload = bytes != NULL ? get_bytes_variant(reader) : NULL;
+            if (payload == NULL) break;
+            memcpy(uuid.bytes, bytes, sizeof(uuid.bytes));
+            char uuid_string[BINC_UUID_STRING_LENGTH];
+            binc_uuid_format(&uuid, uuid_string);
+            g_variant_builder_add(&service_data, "{sv}", uuid_string, payload);
+        }
+        g_variant_builder_add(&builder, "{sv}", "ServiceData", g_variant_builder_end(&service_data));
+    }
+
+    GVariant *properties = g_variant_ref_sink(g_variant_builder_end(&builder));
+    if (!reader->valid) {
+        g_variant_unref(properties);
+        return NULL;
+    }
+
+    // BlueZ names device objects after their address
+    char *object_name = g_strdup_printf("dev_%s", address_string);
+    replace_char(object_name, ':', '_');
+    *path = g_strdup_printf("%s/%s", adapter_path, object_name);
+    g_free(object_name);
+    return properties;
+}
+
+int binc_device_snapshot_decode(const guint8 *data, gsize length, const char *adapter_path,
+                                DeviceSnapshotRecordFunc func, gpointer user_data) {
+    g_assert(adapter_path != NULL);
+    g_assert(func != NULL);
+
+    if (data == NULL || length < SNAPSHOT_HEADER_LENGTH || memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        log_debug(TAG, "not a device snapshot");
+        return -1;
+    }
+
+    SnapshotReader reader = {.data = data, .length = length, .position = sizeof(SNAPSHOT_MAGIC), .valid = TRUE};
+    guint16 version = get_u16(&reader);
+    get_u16(&reader);
+    guint32 count = get_u32(&reader);
+    if (version != SNAPSHOT_VERSION) {
+        log_debug(TAG, "unsupported device snapshot version %u", version);
+        return -1;
+    }
+
+    int decoded = 0;
+    for (guint32 i = 0; i < count; i++) {
+        guint32 record_length = get_u32(&reader);
+        const guint8 *record = take(&reader, record_length);
+        if (record == NULL) break;
+
+        SnapshotReader record_reader = {.data = record, .length = record_length, .position = 0, .valid = TRUE};
+        char *path = NULL;
+        BondingState bonding_state = BINC_BOND_NONE;
+        GVariant *properties = decode_device(&record_reader, adapter_path, &path, &bonding_state);
+        if (properties == NULL) {
+            log_debug(TAG, "skipping corrupt device record %u", i);
+            continue;
+        }
+
+        func(path, properties, bonding_state, user_data);
+        g_variant_unref(properties);
+        g_free(path);
+        decoded++;
+    }
+
+    if (!reader.valid) {
+        log_debug(TAG, "device snapshot is truncated");
+    }
+    return decoded;
+}
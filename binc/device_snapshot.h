@@ -0,0 +1,53 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_DEVICE_SNAPSHOT_H
+#define BINC_DEVICE_SNAPSHOT_H
+
+#include <glib.h>
+#include "forward_decl.h"
+#include "device.h"
+
+/**
+ * Called for every device in a snapshot.
+ *
+ * @param path object path of the device below the adapter the snapshot is loaded into
+ * @param properties Device1 style a{sv} properties, borrowed
+ */
+typedef void (*DeviceSnapshotRecordFunc)(const char *path, GVariant *properties, BondingState bonding_state,
+                                         gpointer user_data);
+
+/**
+ * Encode the devices of an adapter into the snapshot format
+ */
+GByteArray *binc_device_snapshot_encode(const Adapter *adapter);
+
+/**
+ * Decode a snapshot, calling func for every device in it
+ *
+ * @return the number of devices decoded, or -1 if the data is not a valid snapshot
+ */
+int binc_device_snapshot_decode(const guint8 *data, gsize length, const char *adapter_path,
+                                DeviceSnapshotRecordFunc func, gpointer user_data);
+
+#endif //BINC_DEVICE_SNAPSHOT_H
@@ -35,7 +35,12 @@ typedef struct binc_characteristic Characteristic;
 typedef struct binc_descriptor Descriptor;
 typedef struct binc_service_handler_manager ServiceHandlerManager;
 typedef struct binc_advertisement Advertisement;
+typedef struct binc_advertisement_monitor AdvertisementMonitor;
 typedef struct binc_application Application;
+typedef struct binc_scan_aggregator ScanAggregator;
+typedef struct binc_runtime Runtime;
+typedef struct binc_connection_manager ConnectionManager;
+typedef struct binc_poll_scheduler PollScheduler;
 
 #ifdef __cplusplus
 }
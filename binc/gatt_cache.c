@@ -0,0 +1,297 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include "gatt_cache.h"
+#include "logger.h"
+#include "utility.h"
+
+static const char *const TAG = "GattCache";
+
+/*
+ * Layouts are persisted as serialized GVariants, one file per device:
+ * version, address bytes, address type, database hash (empty if none), mtu, (type, path, uuid bytes, flags)...
+ */
+#define GATT_CACHE_FORMAT "(yayyayqa(ysayas))"
+static const guint8 GATT_CACHE_VERSION = 1;
+
+struct binc_gatt_cache {
+    char *directory; // Owned, NULL for a memory only cache
+    GHashTable *layouts; // Owned, packed identity address -> GattLayout
+    GHashTable *absent; // Owned, packed identity addresses without a layout on disk
+};
+
+static void gatt_cache_attribute_clear(gpointer data) {
+    GattCacheAttribute *attribute = (GattCacheAttribute *) data;
+    g_free(attribute->path);
+    g_list_free_full(attribute->flags, g_free);
+}
+
+GattLayout *binc_gatt_layout_create(guint mtu) {
+    GattLayout *layout = g_new0(GattLayout, 1);
+    layout->attributes = g_array_new(FALSE, FALSE, sizeof(GattCacheAttribute));
+    g_array_set_clear_func(layout->attributes, gatt_cache_attribute_clear);
+    layout->mtu = mtu;
+    return layout;
+}
+
+void binc_gatt_layout_free(GattLayout *layout) {
+    g_assert(layout != NULL);
+
+    g_array_free(layout->attributes, TRUE);
+    if (layout->database_hash != NULL) {
+        g_byte_array_free(layout->database_hash, TRUE);
+    }
+    g_free(layout);
+}
+
+void binc_gatt_layout_add(GattLayout *layout, GattCacheAttributeType type, const char *path, const BincUuid *uuid,
+                          const GList *flags) {
+    g_assert(layout != NULL);
+    g_assert(path != NULL);
+    g_assert(uuid != NULL);
+
+    GattCacheAttribute attribute = {.type = type, .path = g_strdup(path), .uuid = *uuid, .flags = NULL};
+    for (const GList *iterator = flags; iterator; iterator = iterator->next) {
+        attribute.flags = g_list_prepend(attribute.flags, g_strdup((const char *) iterator->data));
+    }
+    attribute.flags = g_list_reverse(attribute.flags);
+    g_array_append_val(layout->attributes, attribute);
+}
+
+void binc_gatt_layout_set_database_hash(GattLayout *layout, const guint8 *hash, gsize length) {
+    g_assert(layout != NULL);
+
+    if (layout->database_hash != NULL) {
+        g_byte_array_free(layout->database_hash, TRUE);
+    }
+    layout->database_hash = g_byte_array_sized_new((guint) length);
+    g_byte_array_append(layout->database_hash, hash, (guint) length);
+}
+
+const char *binc_gatt_layout_find_path(const GattLayout *layout, const BincUuid *uuid) {
+    g_assert(layout != NULL);
+    g_assert(uuid != NULL);
+
+    for (guint i = 0; i < layout->attributes->len; i++) {
+        const GattCacheAttribute *attribute = &g_array_index(layout->attributes, GattCacheAttribute, i);
+        if (binc_uuid_equal(&attribute->uuid, uuid)) {
+            return attribute->path;
+        }
+    }
+    return NULL;
+}
+
+static GVariant *gatt_layout_to_variant(const BincAddress *address, const GattLayout *layout) {
+    GVariantBuilder attributes;
+    g_variant_builder_init(&attributes, G_VARIANT_TYPE("a(ysayas)"));
+    for (guint i = 0; i < layout->attributes->len; i++) {
+        const GattCacheAttribute *attribute = &g_array_index(layout->attributes, GattCacheAttribute, i);
+        GVariantBuilder flags;
+        g_variant_builder_init(&flags, G_VARIANT_TYPE("as"));
+        for (GList *iterator = attribute->flags; iterator; iterator = iterator->next) {
+            g_variant_builder_add(&flags, "s", (const char *) iterator->data);
+        }
+        g_variant_builder_add(&attributes, "(ys@ay@as)", (guint8) attribute->type, attribute->path,
+                              g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, attribute->uuid.bytes,
+                                                        sizeof(attribute->uuid.bytes), sizeof(guint8)),
+                              g_variant_builder_end(&flags));
+    }
+
+    const GByteArray *hash = layout->database_hash;
+    return g_variant_new(GATT_CACHE_FORMAT,
+                         GATT_CACHE_VERSION,
+                         g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, address->bytes, sizeof(address->bytes),
+                                                   sizeof(guint8)),
+                         (guint8) address->type,
+                         g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, hash != NULL ? hash->data : NULL,
+                                                   hash != NULL ? hash->len : 0, sizeof(guint8)),
+                         (guint16) layout->mtu,
+                         &attributes);
+}
+
+static GattLayout *gatt_layout_from_variant(GVariant *variant, const BincAddress *address) {
+    guint8 version = 0;
+    guint8 address_type = 0;
+    guint16 mtu = 0;
+    GVariant *address_bytes = NULL;
+    GVariant *hash = NULL;
+    GVariantIter *attributes = NULL;
+    g_variant_get(variant, "(y@ayy@ayqa(ysayas))", &version, &address_bytes, &address_type, &hash, &mtu,
+                  &attributes);
+    gsize length = 0;
+    const guint8 *bytes = g_variant_get_fixed_array(address_bytes, &length, sizeof(guint8));
+    gboolean matches = version == GATT_CACHE_VERSION && length == sizeof(address->bytes) &&
+                       memcmp(bytes, address->bytes, length) == 0 && address_type == (guint8) address->type;
+
+    GattLayout *layout = NULL;
+    if (matches) {
+        layout = binc_gatt_layout_create(mtu);
+        bytes = g_variant_get_fixed_array(hash, &length, sizeof(guint8));
+        if (length > 0) {
+            binc_gatt_layout_set_database_hash(layout, bytes, length);
+        }
+
+        guint8 type;
+        const char *path;
+        GVariant *uuid_bytes;
+        GVariant *flags;
+        while (g_variant_iter_loop(attributes, "(y&s@ay@as)", &type, &path, &uuid_bytes, &flags)) {
+            BincUuid uuid;
+            bytes = g_variant_get_fixed_array(uuid_bytes, &length, sizeof(guint8));
+            if (length != sizeof(uuid.bytes) || type > GATT_CACHE_DESCRIPTOR) {
+                binc_gatt_layout_free(layout);
+                layout = NULL;
+                break;
+            }
+            memcpy(uuid.bytes, bytes, sizeof(uuid.bytes));
+
+            GList *flag_list = g_variant_string_array_to_list(flags);
+            binc_gatt_layout_add(layout, (GattCacheAttributeType) type, path, &uuid, flag_list);
+            g_list_free_full(flag_list, g_free);
+        }
+    }
+
+    g_variant_iter_free(attributes);
+    g_variant_unref(hash);
+    g_variant_unref(address_bytes);
+    return layout;
+}
+
+static char *gatt_cache_filename(const GattCache *cache, const BincAddress *address) {
+    char address_string[BINC_ADDRESS_STRING_LENGTH];
+    binc_address_format(address, address_string);
+    replace_char(address_string, ':', '_');
+
+    char *name = g_strdup_printf("%s.gatt", address_string);
+    char *filename = g_build_filename(cache->directory, name, NULL);
+    g_free(name);
+    return filename;
+}
+
+static GattLayout *gatt_cache_load(const GattCache *cache, const BincAddress *address) {
+    char *filename = gatt_cache_filename(cache, address);
+    gchar *contents = NULL;
+    gsize length = 0;
+    gboolean result = g_file_get_contents(filename, &contents, &length, NULL);
+    g_free(filename);
+    if (!result) {
+        return NULL;
+    }
+
+    GVariant *variant = g_variant_ref_sink(
+            g_variant_new_from_data(G_VARIANT_TYPE(GATT_CACHE_FORMAT), contents, length, FALSE, g_free, contents));
+    GattLayout *layout = gatt_layout_from_variant(variant, address);
+    g_variant_unref(variant);
+    return layout;
+}
+
+static void gatt_cache_save(const GattCache *cache, const BincAddress *address, const GattLayout *layout) {
+    GVariant *variant = g_variant_ref_sink(gatt_layout_to_variant(address, layout));
+    char *filename = gatt_cache_filename(cache, address);
+
+    GError *error = NULL;
+    if (!g_file_set_contents(filename, g_variant_get_data(variant), (gssize) g_variant_get_size(variant), &error)) {
+        log_debug(TAG, "could not write '%s': %s", filename, error->message);
+        g_clear_error(&error);
+    }
+
+    g_free(filename);
+    g_variant_unref(variant);
+}
+
+GattCache *binc_gatt_cache_create(const char *directory) {
+    GattCache *cache = g_new0(GattCache, 1);
+    cache->layouts = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                           (GDestroyNotify) binc_gatt_layout_free);
+    cache->absent = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    if (directory != NULL) {
+        cache->directory = g_strdup(directory);
+        if (g_mkdir_with_parents(directory, 0700) != 0) {
+            log_debug(TAG, "could not create '%s'", directory);
+        }
+    }
+    return cache;
+}
+
+void binc_gatt_cache_free(GattCache *cache) {
+    g_assert(cache != NULL);
+
+    g_hash_table_destroy(cache->layouts);
+    g_hash_table_destroy(cache->absent);
+    g_free(cache->directory);
+    g_free(cache);
+}
+
+static guint64 *gatt_cache_key(const BincAddress *address) {
+    guint64 *key = g_new(guint64, 1);
+    *key = binc_address_pack(address);
+    return key;
+}
+
+const GattLayout *binc_gatt_cache_lookup(GattCache *cache, const BincAddress *address) {
+    g_assert(cache != NULL);
+    g_assert(address != NULL);
+
+    guint64 key = binc_address_pack(address);
+    GattLayout *layout = g_hash_table_lookup(cache->layouts, &key);
+    if (layout != NULL || cache->directory == NULL || g_hash_table_contains(cache->absent, &key)) {
+        return layout;
+    }
+
+    layout = gatt_cache_load(cache, address);
+    if (layout != NULL) {
+        g_hash_table_insert(cache->layouts, gatt_cache_key(address), layout);
+    } else {
+        g_hash_table_add(cache->absent, gatt_cache_key(address));
+    }
+    return layout;
+}
+
+void binc_gatt_cache_store(GattCache *cache, const BincAddress *address, GattLayout *layout) {
+    g_assert(cache != NULL);
+    g_assert(address != NULL);
+    g_assert(layout != NULL);
+
+    guint64 key = binc_address_pack(address);
+    g_hash_table_remove(cache->absent, &key);
+    g_hash_table_insert(cache->layouts, gatt_cache_key(address), layout);
+    if (cache->directory != NULL) {
+        gatt_cache_save(cache, address, layout);
+    }
+}
+
+void binc_gatt_cache_invalidate(GattCache *cache, const BincAddress *address) {
+    g_assert(cache != NULL);
+    g_assert(address != NULL);
+
+    guint64 key = binc_address_pack(address);
+    g_hash_table_remove(cache->layouts, &key);
+    if (cache->directory != NULL) {
+        char *filename = gatt_cache_filename(cache, address);
+        g_remove(filename);
+        g_free(filename);
+        g_hash_table_add(cache->absent, gatt_cache_key(address));
+    }
+}
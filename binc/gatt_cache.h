@@ -0,0 +1,94 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_GATT_CACHE_H
+#define BINC_GATT_CACHE_H
+
+#include <glib.h>
+#include "address.h"
+#include "uuid.h"
+
+typedef struct binc_gatt_cache GattCache;
+
+typedef enum GattCacheAttributeType {
+    GATT_CACHE_SERVICE = 0, GATT_CACHE_CHARACTERISTIC = 1, GATT_CACHE_DESCRIPTOR = 2
+} GattCacheAttributeType;
+
+typedef struct gatt_cache_attribute {
+    GattCacheAttributeType type;
+    char *path; // Owned, relative to the device path like '/service000a/char000b'
+    BincUuid uuid;
+    GList *flags; // Owned
+} GattCacheAttribute;
+
+/**
+ * Resolved GATT layout of a device. Attributes are ordered services first, then characteristics, then descriptors,
+ * so parents always come before their children.
+ */
+typedef struct gatt_layout {
+    GArray *attributes; // Owned, GattCacheAttribute
+    guint mtu;
+    GByteArray *database_hash; // Owned, NULL when the device has no Database Hash characteristic
+} GattLayout;
+
+GattLayout *binc_gatt_layout_create(guint mtu);
+
+void binc_gatt_layout_free(GattLayout *layout);
+
+/**
+ * Add an attribute, the flags are copied
+ */
+void binc_gatt_layout_add(GattLayout *layout, GattCacheAttributeType type, const char *path, const BincUuid *uuid,
+                          const GList *flags);
+
+void binc_gatt_layout_set_database_hash(GattLayout *layout, const guint8 *hash, gsize length);
+
+/**
+ * Get the relative path of the first attribute with the given uuid, or NULL
+ */
+const char *binc_gatt_layout_find_path(const GattLayout *layout, const BincUuid *uuid);
+
+/**
+ * Create a cache of GATT layouts keyed by identity address
+ *
+ * @param directory directory to persist layouts in, one file per device, or NULL to only cache in memory
+ */
+GattCache *binc_gatt_cache_create(const char *directory);
+
+void binc_gatt_cache_free(GattCache *cache);
+
+/**
+ * Get the cached layout of a device, loading it from disk if it is not in memory yet
+ *
+ * @return the layout, owned by the cache, or NULL
+ */
+const GattLayout *binc_gatt_cache_lookup(GattCache *cache, const BincAddress *address);
+
+/**
+ * Store the layout of a device, replacing a previous one. Takes ownership of layout.
+ */
+void binc_gatt_cache_store(GattCache *cache, const BincAddress *address, GattLayout *layout);
+
+void binc_gatt_cache_invalidate(GattCache *cache, const BincAddress *address);
+
+#endif //BINC_GATT_CACHE_H
@@ -0,0 +1,414 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "gatt_queue.h"
+#include "logger.h"
+#include "utility.h"
+
+static const char *const TAG = "GattQueue";
+static const char *const BLUEZ_DBUS = "org.bluez";
+static const char *const BLUEZ_ERROR_IN_PROGRESS = "org.bluez.Error.InProgress";
+
+static const guint MAX_PIPELINED_IN_FLIGHT = 8;
+static const guint MAX_IN_PROGRESS_RETRIES = 5;
+static const guint INITIAL_RETRY_DELAY_MS = 20;
+static const gint DEFAULT_TIMEOUT_MS = 10000;
+
+typedef struct gatt_operation {
+    GattQueue *queue; // Borrowed, NULL once the queue is freed while the call is running
+    char *path; // Owned
+    const char *interface; // Borrowed
+    const char *method; // Borrowed
+    GVariant *parameters; // Owned
+    const GVariantType *reply_type; // Borrowed
+    gboolean pipelined;
+    GCancellable *cancellable; // Owned, cancelled by flush, free or the caller's cancellable
+    guint caller_cancelled_id; // Source that runs once the caller's cancellable is cancelled
+    gboolean flushed;
+    guint retries;
+    guint retry_id;
+    gint64 queued_at;
+    GattQueueCallback callback;
+    gpointer user_data;
+    GDestroyNotify destroy;
+} GattOperation;
+
+struct binc_gatt_queue {
+    GDBusConnection *connection; // Borrowed
+    GQueue pending; // Owned, operations that were not sent yet in order
+    GHashTable *in_flight; // Owned, set of borrowed operations that were sent
+    guint serial_in_flight;
+    guint pipelined_in_flight;
+    gint timeout_ms;
+    GattQueueStats stats;
+};
+
+static void gatt_operation_free(GattOperation *operation) {
+    if (operation->retry_id != 0) {
+        binc_source_remove(operation->retry_id);
+        operation->retry_id = 0;
+    }
+    if (operation->caller_cancelled_id != 0) {
+        binc_source_remove(operation->caller_cancelled_id);
+        operation->caller_cancelled_id = 0;
+    }
+    g_object_unref(operation->cancellable);
+    if (operation->destroy != NULL) {
+        operation->destroy(operation->user_data);
+    }
+    if (operation->parameters != NULL) {
+        g_variant_unref(operation->parameters);
+    }
+    g_free(operation->path);
+    g_free(operation);
+}
+
+GattQueue *binc_gatt_queue_create(GDBusConnection *connection) {
+    g_assert(connection != NULL);
+
+    GattQueue *queue = g_new0(GattQueue, 1);
+    queue->connection = connection;
+    g_queue_init(&queue->pending);
+    queue->in_flight = g_hash_table_new(g_direct_hash, g_direct_equal);
+    queue->timeout_ms = DEFAULT_TIMEOUT_MS;
+    return queue;
+}
+
+void binc_gatt_queue_set_timeout(GattQueue *queue, gint timeout_ms) {
+    g_assert(queue != NULL);
+    g_assert(timeout_ms > 0 || timeout_ms == -1);
+    queue->timeout_ms = timeout_ms;
+}
+
+gint binc_gatt_queue_get_timeout(const GattQueue *queue) {
+    g_assert(queue != NULL);
+    return queue->timeout_ms;
+}
+
+void binc_gatt_queue_free(GattQueue *queue) {
+    g_assert(queue != NULL);
+
+    g_queue_clear_full(&queue->pending, (GDestroyNotify) gatt_operation_free);
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, queue->in_flight);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        GattOperation *operation = (GattOperation *) key;
+        if (operation->retry_id != 0) {
+            gatt_operation_free(operation);
+        } else {
+            // Freed when the running call completes, which cancelling makes happen soon
+            operation->queue = NULL;
+            g_cancellable_cancel(operation->cancellable);
+        }
+    }
+    g_hash_table_destroy(queue->in_flight);
+    queue->in_flight = NULL;
+
+    queue->connection = NULL;
+    g_free(queue);
+}
+
+static gboolean is_in_progress_error(const GError *error) {
+    gchar *name = g_dbus_error_get_remote_error(error);
+    gboolean result = g_strcmp0(name, BLUEZ_ERROR_IN_PROGRESS) == 0;
+    g_free(name);
+    return result;
+}
+
+static void binc_internal_gatt_operation_cb(GObject *source_object, GAsyncResult *res, gpointer user_data);
+
+static void send_operation(GattQueue *queue, GattOperation *operation) {
+    g_dbus_connection_call(queue->connection,
+                           BLUEZ_DBUS,
+                           operation->path,
+                           operation->interface,
+                           operation->method,
+                           operation->parameters,
+                           operation->reply_type,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           queue->timeout_ms,
+                           operation->cancellable,
+                           (GAsyncReadyCallback) binc_internal_gatt_operation_cb,
+                           operation);
+}
+
+static void dispatch(GattQueue *queue) {
+    while (!g_queue_is_empty(&queue->pending)) {
+        GattOperation *operation = g_queue_peek_head(&queue->pending);
+        if (operation->pipelined) {
+            if (queue->pipelined_in_flight >= MAX_PIPELINED_IN_FLIGHT) break;
+            queue->pipelined_in_flight++;
+        } else {
+            if (queue->serial_in_flight > 0) break;
+            queue->serial_in_flight++;
+        }
+
+        g_queue_pop_head(&queue->pending);
+        g_hash_table_add(queue->in_flight, operation);
+
+        guint64 wait_time = (guint64) (g_get_monotonic_time() - operation->queued_at);
+        queue->stats.wait_time_total_us += wait_time;
+        queue->stats.wait_time_max_us = MAX(queue->stats.wait_time_max_us, wait_time);
+        send_operation(queue, operation);
+    }
+}
+
+static void remove_in_flight(GattQueue *queue, GattOperation *operation) {
+    g_hash_table_remove(queue->in_flight, operation);
+    if (operation->pipelined) {
+        queue->pipelined_in_flight--;
+    } else {
+        queue->serial_in_flight--;
+    }
+}
+
+static void record_completion(GattQueue *queue, const GattOperation *operation, const GError *error) {
+    guint64 latency = (guint64) (g_get_monotonic_time() - operation->queued_at);
+    queue->stats.operations++;
+    queue->stats.latency_total_us += latency;
+    queue->stats.latency_max_us = MAX(queue->stats.latency_max_us, latency);
+    if (error != NULL) {
+        queue->stats.failures++;
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT)) {
+            queue->stats.timeouts++;
+        } else if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            queue->stats.cancelled++;
+        }
+    }
+}
+
+static gboolean retry_operation(gpointer user_data) {
+    GattOperation *operation = (GattOperation *) user_data;
+    operation->retry_id = 0;
+    send_operation(operation->queue, operation);
+    return FALSE;
+}
+
+static void binc_internal_gatt_operation_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GattOperation *operation = (GattOperation *) user_data;
+    GattQueue *queue = operation->queue;
+
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+
+    if (operation->flushed && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // Report calls cancelled by a disconnect like the ones that were never sent
+        g_clear_error(&error);
+        error = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED, "Device disconnected");
+    }
+
+    if (queue != NULL && error != NULL && is_in_progress_error(error) &&
+        operation->retries < MAX_IN_PROGRESS_RETRIES && !g_cancellable_is_cancelled(operation->cancellable)) {
+        // Keep the slot so later calls cannot overtake this one
+        guint delay = INITIAL_RETRY_DELAY_MS << operation->retries;
+        operation->retries++;
+        queue->stats.retries++;
+        log_debug(TAG, "'%s' on %s is in progress, retrying in %u ms", operation->method, operation->path, delay);
+        operation->retry_id = binc_timeout_add(delay, retry_operation, operation);
+        g_clear_error(&error);
+        return;
+    }
+
+    if (queue != NULL) {
+        remove_in_flight(queue, operation);
+        record_completion(queue, operation, error);
+        dispatch(queue);
+
+        // The callback may free the queue
+        if (operation->callback != NULL) {
+            operation->callback(result, error, operation->user_data);
+        }
+    }
+
+    if (result != NULL) {
+        g_variant_unref(result);
+    }
+    if (error != NULL) {
+        g_clear_error(&error);
+    }
+    gatt_operation_free(operation);
+}
+
+static gboolean binc_internal_gatt_operation_cancelled_cb(__attribute__((unused)) GCancellable *caller_cancellable,
+                                                          gpointer user_data) {
+    GattOperation *operation = (GattOperation *) user_data;
+    GattQueue *queue = operation->queue;
+    operation->caller_cancelled_id = 0;
+
+    // A running call completes with G_IO_ERROR_CANCELLED once D-Bus gave up on it
+    GList *link = queue != NULL ? g_queue_find(&queue->pending, operation) : NULL;
+    if (link == NULL && operation->retry_id == 0) {
+        g_cancellable_cancel(operation->cancellable);
+        return G_SOURCE_REMOVE;
+    }
+
+    // Don't let a queued or retrying call wait for the calls in front of it, or for its next retry
+    if (link != NULL) {
+        g_queue_delete_link(&queue->pending, link);
+    } else {
+        binc_source_remove(operation->retry_id);
+        operation->retry_id = 0;
+        remove_in_flight(queue, operation);
+        dispatch(queue);
+    }
+
+    GError *error = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Operation was cancelled");
+    record_completion(queue, operation, error);
+    if (operation->callback != NULL) {
+        operation->callback(NULL, error, operation->user_data);
+    }
+    g_error_free(error);
+    gatt_operation_free(operation);
+    return G_SOURCE_REMOVE;
+}
+
+void binc_gatt_queue_call(GattQueue *queue, const char *path, const char *interface, const char *method,
+                          GVariant *parameters, const GVariantType *reply_type, gboolean pipelined,
+                          GCancellable *cancellable, GattQueueCallback callback, gpointer user_data,
+                          GDestroyNotify destroy) {
+    g_assert(queue != NULL);
+    g_assert(path != NULL);
+    g_assert(interface != NULL);
+    g_assert(method != NULL);
+
+    GattOperation *operation = g_new0(GattOperation, 1);
+    operation->queue = queue;
+    operation->path = g_strdup(path);
+    operation->interface = interface;
+    operation->method = method;
+    operation->parameters = parameters != NULL ? g_variant_ref_sink(parameters) : NULL;
+    operation->reply_type = reply_type;
+    operation->pipelined = pipelined;
+    // A cancellable of our own, so flush and free never cancel the caller's other calls
+    operation->cancellable = g_cancellable_new();
+    if (cancellable != NULL) {
+        operation->caller_cancelled_id = binc_cancelled_add(cancellable, binc_internal_gatt_operation_cancelled_cb,
+                                                            operation);
+    }
+    operation->queued_at = g_get_monotonic_time();
+    operation->callback = callback;
+    operation->user_data = user_data;
+    operation->destroy = destroy;
+
+    g_queue_push_tail(&queue->pending, operation);
+    dispatch(queue);
+}
+
+static void fail_all(GattQueue *queue, const GError *error, gboolean complete_running) {
+    // Operations waiting for a retry will not get a different answer now
+    GQueue failed = G_QUEUE_INIT;
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, queue->in_flight);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        GattOperation *operation = (GattOperation *) key;
+        if (operation->retry_id != 0) {
+            binc_source_remove(operation->retry_id);
+            operation->retry_id = 0;
+            g_queue_push_tail(&failed, operation);
+        }
+    }
+    for (GList *iterator = failed.head; iterator != NULL; iterator = iterator->next) {
+        remove_in_flight(queue, iterator->data);
+    }
+
+    // The running calls complete with an error soon instead of waiting for their timeout
+    GQueue running = G_QUEUE_INIT;
+    g_hash_table_iter_init(&iter, queue->in_flight);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        GattOperation *operation = (GattOperation *) key;
+        operation->flushed = !complete_running;
+        g_cancellable_cancel(operation->cancellable);
+        if (complete_running) {
+            g_queue_push_tail(&running, operation);
+        }
+    }
+
+    // Take over the pending operations so callbacks can queue new calls
+    while (!g_queue_is_empty(&queue->pending)) {
+        g_queue_push_tail(&failed, g_queue_pop_head(&queue->pending));
+    }
+
+    if (failed.length > 0) {
+        log_debug(TAG, "failing %u queued GATT operations", failed.length);
+    }
+
+    for (GList *iterator = failed.head; iterator != NULL; iterator = iterator->next) {
+        record_completion(queue, iterator->data, error);
+    }
+
+    // Running calls keep their slot until BlueZ answers, only their callback runs now
+    while (!g_queue_is_empty(&running)) {
+        GattOperation *operation = g_queue_pop_head(&running);
+        if (operation->callback != NULL) {
+            operation->callback(NULL, error, operation->user_data);
+            operation->callback = NULL;
+        }
+        if (operation->destroy != NULL) {
+            operation->destroy(operation->user_data);
+            operation->destroy = NULL;
+        }
+    }
+
+    // The callbacks may free the queue
+    while (!g_queue_is_empty(&failed)) {
+        GattOperation *operation = g_queue_pop_head(&failed);
+        if (operation->callback != NULL) {
+            operation->callback(NULL, error, operation->user_data);
+        }
+        gatt_operation_free(operation);
+    }
+}
+
+void binc_gatt_queue_flush(GattQueue *queue) {
+    g_assert(queue != NULL);
+
+    GError *error = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED, "Device disconnected");
+    fail_all(queue, error, FALSE);
+    g_error_free(error);
+}
+
+void binc_gatt_queue_cancel_all(GattQueue *queue) {
+    g_assert(queue != NULL);
+
+    GError *error = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED, "GATT database changed");
+    fail_all(queue, error, TRUE);
+    g_error_free(error);
+}
+
+void binc_gatt_queue_get_stats(const GattQueue *queue, GattQueueStats *stats) {
+    g_assert(queue != NULL);
+    g_assert(stats != NULL);
+
+    *stats = queue->stats;
+    stats->depth = queue->pending.length;
+    stats->in_flight = queue->serial_in_flight + queue->pipelined_in_flight;
+}
+
+void binc_gatt_queue_reset_stats(GattQueue *queue) {
+    g_assert(queue != NULL);
+    memset(&queue->stats, 0, sizeof(GattQueueStats));
+}
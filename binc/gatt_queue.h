@@ -0,0 +1,82 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_GATT_QUEUE_H
+#define BINC_GATT_QUEUE_H
+
+#include <gio/gio.h>
+#include "device.h"
+
+typedef struct binc_gatt_queue GattQueue;
+
+/**
+ * Called once with the reply or the error of a queued call. The result and error are owned by the queue.
+ */
+typedef void (*GattQueueCallback)(GVariant *result, const GError *error, gpointer user_data);
+
+GattQueue *binc_gatt_queue_create(GDBusConnection *connection);
+
+/**
+ * Set the D-Bus timeout of every call sent from now on, -1 for the D-Bus default
+ */
+void binc_gatt_queue_set_timeout(GattQueue *queue, gint timeout_ms);
+
+gint binc_gatt_queue_get_timeout(const GattQueue *queue);
+
+/**
+ * Free the queue. Running calls are cancelled and callbacks of calls that did not complete yet are not called,
+ * their user_data is destroyed.
+ */
+void binc_gatt_queue_free(GattQueue *queue);
+
+/**
+ * Queue a BlueZ method call on a GATT object of the device.
+ * Calls run one at a time in the order they were queued, except pipelined calls like write-without-response that
+ * run next to the other calls. Calls failing with InProgress are retried after a backoff.
+ *
+ * @param parameters floating references are consumed
+ * @param reply_type expected reply type, must be a static type string
+ * @param cancellable optional, cancelling it completes the call with G_IO_ERROR_CANCELLED, right away when it is still
+ *                    queued or waiting for a retry
+ */
+void binc_gatt_queue_call(GattQueue *queue, const char *path, const char *interface, const char *method,
+                          GVariant *parameters, const GVariantType *reply_type, gboolean pipelined,
+                          GCancellable *cancellable, GattQueueCallback callback, gpointer user_data,
+                          GDestroyNotify destroy);
+
+/**
+ * Fail all calls with G_IO_ERROR_NOT_CONNECTED and cancel the running ones, used when the device disconnects
+ */
+void binc_gatt_queue_flush(GattQueue *queue);
+
+/**
+ * Complete all calls with G_IO_ERROR_CANCELLED right away, the running ones too. Used before the objects the
+ * callbacks refer to are freed, running calls keep their slot until BlueZ answers them.
+ */
+void binc_gatt_queue_cancel_all(GattQueue *queue);
+
+void binc_gatt_queue_get_stats(const GattQueue *queue, GattQueueStats *stats);
+
+void binc_gatt_queue_reset_stats(GattQueue *queue);
+
+#endif //BINC_GATT_QUEUE_H
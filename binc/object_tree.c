@@ -0,0 +1,290 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "object_tree.h"
+
+typedef struct object_node ObjectNode;
+
+typedef struct interface_properties {
+    GHashTable *values; // Owned, interned property name -> GVariant
+    GVariant *dict; // Owned, a{sv} built when asked for, NULL when out of date
+} InterfaceProperties;
+
+struct object_node {
+    char *path; // Owned
+    GHashTable *interfaces; // Owned, interface name -> InterfaceProperties
+    GPtrArray *children; // Owned, nodes borrowed
+    ObjectNode *parent; // Borrowed
+};
+
+struct binc_object_tree {
+    GHashTable *nodes; // Owned, path -> ObjectNode
+    gboolean seeded;
+};
+
+static void interface_properties_free(InterfaceProperties *properties) {
+    g_hash_table_destroy(properties->values);
+    if (properties->dict != NULL) {
+        g_variant_unref(properties->dict);
+    }
+    g_free(properties);
+}
+
+static InterfaceProperties *interface_properties_create(GVariant *dict) {
+    InterfaceProperties *properties = g_new0(InterfaceProperties, 1);
+    properties->values = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_variant_unref);
+
+    const char *property_name;
+    GVariant *property_value;
+    GVariantIter iter;
+    g_variant_iter_init(&iter, dict);
+    while (g_variant_iter_next(&iter, "{&sv}", &property_name, &property_value)) {
+        g_hash_table_insert(properties->values, (gpointer) g_intern_string(property_name), property_value);
+    }
+    return properties;
+}
+
+static void object_node_free(ObjectNode *node) {
+    g_hash_table_destroy(node->interfaces);
+    g_ptr_array_free(node->children, TRUE);
+    g_free(node->path);
+    g_free(node);
+}
+
+ObjectTree *binc_object_tree_create(void) {
+    ObjectTree *tree = g_new0(ObjectTree, 1);
+    tree->nodes = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) object_node_free);
+    return tree;
+}
+
+void binc_object_tree_free(ObjectTree *tree) {
+    g_assert(tree != NULL);
+
+    g_hash_table_destroy(tree->nodes);
+    g_free(tree);
+}
+
+gboolean binc_object_tree_is_seeded(const ObjectTree *tree) {
+    g_assert(tree != NULL);
+    return tree->seeded;
+}
+
+static ObjectNode *get_or_create_node(ObjectTree *tree, const char *path) {
+    ObjectNode *node = g_hash_table_lookup(tree->nodes, path);
+    if (node != NULL) return node;
+
+    node = g_new0(ObjectNode, 1);
+    node->path = g_strdup(path);
+    node->interfaces = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                             (GDestroyNotify) interface_properties_free);
+    node->children = g_ptr_array_new();
+    g_hash_table_insert(tree->nodes, node->path, node);
+
+    // Create the parents up to the root so children can be enumerated per object
+    if (!g_str_equal(path, "/")) {
+        const char *separator = strrchr(path, '/');
+        char *parent_path = separator == path ? g_strdup("/") : g_strndup(path, (gsize) (separator - path));
+        node->parent = get_or_create_node(tree, parent_path);
+        g_ptr_array_add(node->parent->children, node);
+        g_free(parent_path);
+    }
+    return node;
+}
+
+static void prune_node(ObjectTree *tree, ObjectNode *node) {
+    while (node != NULL && node->parent != NULL &&
+           g_hash_table_size(node->interfaces) == 0 && node->children->len == 0) {
+        ObjectNode *parent = node->parent;
+        g_ptr_array_remove(parent->children, node);
+        g_hash_table_remove(tree->nodes, node->path);
+        node = parent;
+    }
+}
+
+static void add_interfaces(ObjectTree *tree, const char *path, GVariant *interfaces) {
+    ObjectNode *node = get_or_create_node(tree, path);
+
+    const char *interface_name;
+    GVariant *properties;
+    GVariantIter iter;
+    g_variant_iter_init(&iter, interfaces);
+    while (g_variant_iter_next(&iter, "{&s@a{sv}}", &interface_name, &properties)) {
+        g_hash_table_insert(node->interfaces, g_strdup(interface_name), interface_properties_create(properties));
+        g_variant_unref(properties);
+    }
+}
+
+void binc_object_tree_seed(ObjectTree *tree, GVariant *managed_objects) {
+    g_assert(tree != NULL);
+    g_assert(managed_objects != NULL);
+    g_assert(g_str_equal(g_variant_get_type_string(managed_objects), "(a{oa{sa{sv}}})"));
+
+    // The reply is newer than anything applied from signals before it arrived
+    g_hash_table_remove_all(tree->nodes);
+
+    GVariantIter *iter;
+    const char *object_path;
+    GVariant *interfaces;
+    g_variant_get(managed_objects, "(a{oa{sa{sv}}})", &iter);
+    while (g_variant_iter_loop(iter, "{&o@a{sa{sv}}}", &object_path, &interfaces)) {
+        add_interfaces(tree, object_path, interfaces);
+    }
+
+    if (iter != NULL) {
+        g_variant_iter_free(iter);
+    }
+    tree->seeded = TRUE;
+}
+
+void binc_object_tree_interfaces_added(ObjectTree *tree, GVariant *parameters) {
+    g_assert(tree != NULL);
+    g_assert(parameters != NULL);
+
+    const char *object_path;
+    GVariant *interfaces;
+    g_variant_get(parameters, "(&o@a{sa{sv}})", &object_path, &interfaces);
+    add_interfaces(tree, object_path, interfaces);
+    g_variant_unref(interfaces);
+}
+
+void binc_object_tree_interfaces_removed(ObjectTree *tree, GVariant *parameters) {
+    g_assert(tree != NULL);
+    g_assert(parameters != NULL);
+
+    const char *object_path;
+    GVariantIter *interfaces;
+    const char *interface_name;
+    g_variant_get(parameters, "(&oas)", &object_path, &interfaces);
+
+    ObjectNode *node = g_hash_table_lookup(tree->nodes, object_path);
+    if (node != NULL) {
+        while (g_variant_iter_loop(interfaces, "&s", &interface_name)) {
+            g_hash_table_remove(node->interfaces, interface_name);
+        }
+        prune_node(tree, node);
+    }
+    g_variant_iter_free(interfaces);
+}
+
+void binc_object_tree_properties_changed(ObjectTree *tree, const char *path, GVariant *parameters) {
+    g_assert(tree != NULL);
+    g_assert(path != NULL);
+    g_assert(parameters != NULL);
+
+    const char *interface_name;
+    GVariant *changed;
+    const char **invalidated;
+    g_variant_get(parameters, "(&s@a{sv}^a&s)", &interface_name, &changed, &invalidated);
+
+    ObjectNode *node = g_hash_table_lookup(tree->nodes, path);
+    InterfaceProperties *properties = node != NULL ? g_hash_table_lookup(node->interfaces, interface_name) : NULL;
+    if (properties != NULL) {
+        // Only touch the changed keys, the dictionary is rebuilt when someone asks for it
+        const char *property_name;
+        GVariant *property_value;
+        GVariantIter iter;
+        g_variant_iter_init(&iter, changed);
+        while (g_variant_iter_next(&iter, "{&sv}", &property_name, &property_value)) {
+            g_hash_table_insert(properties->values, (gpointer) g_intern_string(property_name), property_value);
+        }
+        for (const char **name = invalidated; *name != NULL; name++) {
+            g_hash_table_remove(properties->values, *name);
+        }
+
+        if (properties->dict != NULL) {
+            g_variant_unref(properties->dict);
+            properties->dict = NULL;
+        }
+    }
+
+    g_variant_unref(changed);
+    g_free(invalidated);
+}
+
+GVariant *binc_object_tree_get_properties(const ObjectTree *tree, const char *path, const char *interface) {
+    g_assert(tree != NULL);
+    g_assert(path != NULL);
+    g_assert(interface != NULL);
+
+    ObjectNode *node = g_hash_table_lookup(tree->nodes, path);
+    if (node == NULL) return NULL;
+
+    InterfaceProperties *properties = g_hash_table_lookup(node->interfaces, interface);
+    if (properties == NULL) return NULL;
+
+    if (properties->dict == NULL) {
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, properties->values);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            g_variant_builder_add(&builder, "{sv}", (const char *) key, (GVariant *) value);
+        }
+        properties->dict = g_variant_ref_sink(g_variant_builder_end(&builder));
+    }
+    return properties->dict;
+}
+
+gboolean binc_object_tree_has_interface(const ObjectTree *tree, const char *path, const char *interface) {
+    g_assert(tree != NULL);
+    g_assert(path != NULL);
+    g_assert(interface != NULL);
+
+    ObjectNode *node = g_hash_table_lookup(tree->nodes, path);
+    return node != NULL && g_hash_table_contains(node->interfaces, interface);
+}
+
+GVariant *binc_object_tree_get_property(const ObjectTree *tree, const char *path, const char *interface,
+                                        const char *property) {
+    g_assert(tree != NULL);
+    g_assert(path != NULL);
+    g_assert(interface != NULL);
+    g_assert(property != NULL);
+
+    ObjectNode *node = g_hash_table_lookup(tree->nodes, path);
+    if (node == NULL) return NULL;
+
+    InterfaceProperties *properties = g_hash_table_lookup(node->interfaces, interface);
+    if (properties == NULL) return NULL;
+
+    GVariant *value = g_hash_table_lookup(properties->values, property);
+    return value != NULL ? g_variant_ref(value) : NULL;
+}
+
+void binc_object_tree_foreach_child(const ObjectTree *tree, const char *path, ObjectTreeForeachFunc func,
+                                    gpointer user_data) {
+    g_assert(tree != NULL);
+    g_assert(path != NULL);
+    g_assert(func != NULL);
+
+    ObjectNode *node = g_hash_table_lookup(tree->nodes, path);
+    if (node == NULL) return;
+
+    for (guint i = 0; i < node->children->len; i++) {
+        ObjectNode *child = g_ptr_array_index(node->children, i);
+        func(child->path, user_data);
+    }
+}
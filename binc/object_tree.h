@@ -0,0 +1,73 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_OBJECT_TREE_H
+#define BINC_OBJECT_TREE_H
+
+#include <gio/gio.h>
+
+/**
+ * Local mirror of the BlueZ object tree, seeded from GetManagedObjects and kept up to date from signals
+ */
+typedef struct binc_object_tree ObjectTree;
+
+typedef void (*ObjectTreeForeachFunc)(const char *path, gpointer user_data);
+
+ObjectTree *binc_object_tree_create(void);
+
+void binc_object_tree_free(ObjectTree *tree);
+
+/**
+ * Replace the contents of the tree by a GetManagedObjects reply
+ */
+void binc_object_tree_seed(ObjectTree *tree, GVariant *managed_objects);
+
+gboolean binc_object_tree_is_seeded(const ObjectTree *tree);
+
+void binc_object_tree_interfaces_added(ObjectTree *tree, GVariant *parameters);
+
+void binc_object_tree_interfaces_removed(ObjectTree *tree, GVariant *parameters);
+
+void binc_object_tree_properties_changed(ObjectTree *tree, const char *path, GVariant *parameters);
+
+/**
+ * Get the properties of an interface as a borrowed a{sv} dictionary, or NULL if the object doesn't implement it.
+ * The dictionary is built on the first call after a change and stays valid until the next change of the interface.
+ */
+GVariant *binc_object_tree_get_properties(const ObjectTree *tree, const char *path, const char *interface);
+
+gboolean binc_object_tree_has_interface(const ObjectTree *tree, const char *path, const char *interface);
+
+/**
+ * Get a single property value, or NULL if not present. The returned value must be unref-ed.
+ */
+GVariant *binc_object_tree_get_property(const ObjectTree *tree, const char *path, const char *interface,
+                                        const char *property);
+
+/**
+ * Call func for every direct child of path, in the order they were added
+ */
+void binc_object_tree_foreach_child(const ObjectTree *tree, const char *path, ObjectTreeForeachFunc func,
+                                    gpointer user_data);
+
+#endif //BINC_OBJECT_TREE_H
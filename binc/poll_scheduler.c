@@ -0,0 +1,396 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "poll_scheduler_internal.h"
+#include "device.h"
+#include "logger.h"
+#include "utility.h"
+
+static const char *const TAG = "PollScheduler";
+
+static const guint DEFAULT_TICK_MS = 100;
+static const guint DEFAULT_MAX_READS_PER_TICK = 16;
+static const guint DEFAULT_MAX_BACKOFF_MS = 60000;
+static const guint MAX_BACKOFF_SHIFT = 16;
+
+typedef struct poll {
+    PollScheduler *scheduler; // Borrowed
+    guint id;
+    Device *device; // Borrowed
+    BincUuid service_uuid;
+    BincUuid characteristic_uuid;
+    gint64 period_us;
+    gint64 jitter_us;
+    gint64 next_base; // Due time without jitter, keeps the phase of the poll
+    gint64 due;
+    guint failures;
+    gboolean in_flight;
+    gboolean removed; // Freed when the running read completes
+    gint64 read_started_at;
+    GCancellable *cancellable; // Owned
+    OnReadCompleteCallback callback;
+    gpointer user_data;
+} Poll;
+
+struct binc_poll_scheduler {
+    Adapter *adapter; // Borrowed
+    GHashTable *polls; // Owned, id -> Poll
+    guint next_id;
+    guint tick_ms;
+    guint tick_id;
+    guint max_reads_per_tick;
+    guint max_backoff_ms;
+    guint in_flight;
+    PollSchedulerStats stats;
+};
+
+static void poll_free(Poll *poll) {
+    g_object_unref(poll->cancellable);
+    g_free(poll);
+}
+
+PollScheduler *binc_internal_poll_scheduler_create(Adapter *adapter) {
+    g_assert(adapter != NULL);
+
+    PollScheduler *scheduler = g_new0(PollScheduler, 1);
+    scheduler->adapter = adapter;
+    scheduler->polls = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) poll_free);
+    scheduler->next_id = 1;
+    scheduler->tick_ms = DEFAULT_TICK_MS;
+    scheduler->max_reads_per_tick = DEFAULT_MAX_READS_PER_TICK;
+    scheduler->max_backoff_ms = DEFAULT_MAX_BACKOFF_MS;
+    return scheduler;
+}
+
+void binc_internal_poll_scheduler_free(PollScheduler *scheduler) {
+    g_assert(scheduler != NULL);
+
+    if (scheduler->tick_id != 0) {
+        binc_source_remove(scheduler->tick_id);
+        scheduler->tick_id = 0;
+    }
+    g_hash_table_destroy(scheduler->polls);
+    scheduler->polls = NULL;
+    g_free(scheduler);
+}
+
+static gint64 random_delay(gint64 max_us) {
+    if (max_us <= 0) return 0;
+    return (gint64) (g_random_double() * (double) max_us);
+}
+
+static void schedule_next(Poll *poll, gint64 now) {
+    poll->next_base += poll->period_us;
+    if (poll->next_base <= now) {
+        poll->next_base = now + poll->period_us;
+    }
+    poll->due = poll->next_base + random_delay(poll->jitter_us);
+}
+
+static void schedule_backoff(const PollScheduler *scheduler, Poll *poll, gint64 now) {
+    gint64 backoff = poll->period_us << MIN(poll->failures, MAX_BACKOFF_SHIFT);
+    backoff = MAX(poll->period_us, MIN(backoff, (gint64) scheduler->max_backoff_ms * 1000));
+    poll->next_base = MAX(poll->next_base, now + backoff);
+    poll->due = poll->next_base + random_delay(poll->jitter_us);
+}
+
+static gboolean is_device_error(const GError *error) {
+    // Failures caused by a disconnect or by cancelling say nothing about the characteristic
+    return !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED) &&
+           !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+}
+
+static void binc_internal_poll_read_cb(Device *device, Characteristic *characteristic, const GByteArray *byteArray,
+                                       const GError *error, gpointer user_data) {
+    Poll *poll = (Poll *) user_data;
+    PollScheduler *scheduler = poll->scheduler;
+    gint64 now = g_get_monotonic_time();
+
+    poll->in_flight = FALSE;
+    scheduler->in_flight--;
+    guint64 latency = (guint64) (now - poll->read_started_at);
+    scheduler->stats.read_latency_total_us += latency;
+    scheduler->stats.read_latency_max_us = MAX(scheduler->stats.read_latency_max_us, latency);
+
+    if (poll->removed) {
+        g_hash_table_remove(scheduler->polls, GUINT_TO_POINTER(poll->id));
+        return;
+    }
+
+    if (error != NULL) {
+        scheduler->stats.failures++;
+        if (is_device_error(error)) {
+            poll->failures++;
+            schedule_backoff(scheduler, poll, now);
+            log_debug(TAG, "poll %u failed %u times, next read in %ld ms", poll->id, poll->failures,
+                      (long) ((poll->due - now) / 1000));
+        }
+    } else {
+        poll->failures = 0;
+    }
+
+    // The callback may remove the poll or free the scheduler
+    poll->callback(device, characteristic, byteArray, error, poll->user_data);
+}
+
+static void start_read(PollScheduler *scheduler, Poll *poll, Characteristic *characteristic, gint64 now) {
+    schedule_next(poll, now);
+    poll->in_flight = TRUE;
+    poll->read_started_at = now;
+    scheduler->in_flight++;
+    scheduler->stats.reads++;
+    binc_characteristic_read_with_cb(characteristic, poll->cancellable, binc_internal_poll_read_cb, poll);
+}
+
+typedef struct due_read {
+    Poll *poll; // Borrowed
+    Characteristic *characteristic; // Borrowed
+} DueRead;
+
+static gint compare_due(gconstpointer a, gconstpointer b) {
+    const Poll *poll = ((const DueRead *) a)->poll;
+    const Poll *other = ((const DueRead *) b)->poll;
+    return poll->due < other->due ? -1 : (poll->due > other->due ? 1 : 0);
+}
+
+static gint compare_device_then_due(gconstpointer a, gconstpointer b) {
+    const Poll *poll = ((const DueRead *) a)->poll;
+    const Poll *other = ((const DueRead *) b)->poll;
+    if (poll->device != other->device) {
+        return (guintptr) poll->device < (guintptr) other->device ? -1 : 1;
+    }
+    return compare_due(a, b);
+}
+
+static Characteristic *get_readable_characteristic(PollScheduler *scheduler, Poll *poll, gint64 now) {
+    if (binc_device_get_connection_state(poll->device) != BINC_CONNECTED) return NULL;
+
+    // Not found while the services are not resolved yet
+    Characteristic *characteristic = binc_device_get_characteristic_by_uuid(poll->device, &poll->service_uuid,
+                                                                            &poll->characteristic_uuid);
+    if (characteristic == NULL) return NULL;
+
+    if (!binc_characteristic_supports_read(characteristic)) {
+        log_error(TAG, "poll %u: characteristic <%s> is not readable", poll->id,
+                  binc_characteristic_get_uuid(characteristic));
+        scheduler->stats.failures++;
+        poll->failures++;
+        schedule_backoff(scheduler, poll, now);
+        return NULL;
+    }
+    return characteristic;
+}
+
+static gboolean binc_internal_poll_tick_cb(gpointer user_data) {
+    PollScheduler *scheduler = (PollScheduler *) user_data;
+    gint64 now = g_get_monotonic_time();
+    scheduler->stats.ticks++;
+
+    GArray *due = g_array_new(FALSE, FALSE, sizeof(DueRead));
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, scheduler->polls);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Poll *poll = (Poll *) value;
+        if (poll->removed || poll->due > now) continue;
+
+        if (poll->in_flight) {
+            scheduler->stats.skipped_in_flight++;
+            schedule_next(poll, now);
+            continue;
+        }
+
+        // Not readable yet, the poll stays due and is checked again on the next tick
+        DueRead read = {poll, get_readable_characteristic(scheduler, poll, now)};
+        if (read.characteristic != NULL) {
+            g_array_append_val(due, read);
+        }
+    }
+
+    // Spread the load by only starting the reads that are due the longest
+    g_array_sort(due, compare_due);
+    if (scheduler->max_reads_per_tick > 0 && due->len > scheduler->max_reads_per_tick) {
+        scheduler->stats.deferred += due->len - scheduler->max_reads_per_tick;
+        g_array_set_size(due, scheduler->max_reads_per_tick);
+    }
+
+    // Queue the reads of a device together so they run back to back on its GATT queue
+    g_array_sort(due, compare_device_then_due);
+    const Device *batch_device = NULL;
+    for (guint i = 0; i < due->len; i++) {
+        DueRead *read = &g_array_index(due, DueRead, i);
+        if (read->poll->device != batch_device) {
+            batch_device = read->poll->device;
+            scheduler->stats.batches++;
+        }
+        start_read(scheduler, read->poll, read->characteristic, now);
+    }
+    g_array_free(due, TRUE);
+
+    if (g_hash_table_size(scheduler->polls) == 0) {
+        scheduler->tick_id = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void start_ticking(PollScheduler *scheduler) {
+    if (scheduler->tick_id == 0) {
+        scheduler->tick_id = binc_timeout_add(scheduler->tick_ms, binc_internal_poll_tick_cb, scheduler);
+    }
+}
+
+guint binc_poll_scheduler_add(PollScheduler *scheduler, Device *device, const BincUuid *service_uuid,
+                              const BincUuid *characteristic_uuid, guint period_ms, guint jitter_ms,
+                              OnReadCompleteCallback callback, gpointer user_data) {
+    g_assert(scheduler != NULL);
+    g_assert(device != NULL);
+    g_assert(binc_device_get_adapter(device) == scheduler->adapter);
+    g_assert(service_uuid != NULL);
+    g_assert(characteristic_uuid != NULL);
+    g_assert(period_ms > 0);
+    g_assert(callback != NULL);
+
+    Poll *poll = g_new0(Poll, 1);
+    poll->scheduler = scheduler;
+    poll->id = scheduler->next_id++;
+    poll->device = device;
+    poll->service_uuid = *service_uuid;
+    poll->characteristic_uuid = *characteristic_uuid;
+    poll->period_us = (gint64) period_ms * 1000;
+    poll->jitter_us = (gint64) jitter_ms * 1000;
+    poll->next_base = g_get_monotonic_time() + random_delay(poll->period_us);
+    poll->due = poll->next_base;
+    poll->cancellable = g_cancellable_new();
+    poll->callback = callback;
+    poll->user_data = user_data;
+    g_hash_table_insert(scheduler->polls, GUINT_TO_POINTER(poll->id), poll);
+
+    log_debug(TAG, "polling <%s> of %s every %u ms", binc_uuid_to_interned_string(characteristic_uuid),
+              binc_device_get_address(device), period_ms);
+    start_ticking(scheduler);
+    return poll->id;
+}
+
+void binc_poll_scheduler_remove(PollScheduler *scheduler, guint poll_id) {
+    g_assert(scheduler != NULL);
+
+    Poll *poll = g_hash_table_lookup(scheduler->polls, GUINT_TO_POINTER(poll_id));
+    if (poll == NULL || poll->removed) return;
+
+    if (poll->in_flight) {
+        poll->removed = TRUE;
+        g_cancellable_cancel(poll->cancellable);
+    } else {
+        g_hash_table_remove(scheduler->polls, GUINT_TO_POINTER(poll_id));
+    }
+}
+
+void binc_poll_scheduler_remove_device(PollScheduler *scheduler, const Device *device) {
+    g_assert(scheduler != NULL);
+    g_assert(device != NULL);
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, scheduler->polls);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Poll *poll = (Poll *) value;
+        if (poll->device != device || poll->removed) continue;
+
+        if (poll->in_flight) {
+            poll->removed = TRUE;
+            g_cancellable_cancel(poll->cancellable);
+        } else {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+void binc_internal_poll_scheduler_device_removed(PollScheduler *scheduler, Device *device) {
+    g_assert(scheduler != NULL);
+    g_assert(device != NULL);
+
+    // The device is freed next and its GATT queue drops running reads without calling back
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, scheduler->polls);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Poll *poll = (Poll *) value;
+        if (poll->device == device) {
+            if (poll->in_flight) {
+                scheduler->in_flight--;
+            }
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+void binc_poll_scheduler_set_tick(PollScheduler *scheduler, guint tick_ms) {
+    g_assert(scheduler != NULL);
+    g_assert(tick_ms > 0);
+
+    scheduler->tick_ms = tick_ms;
+    if (scheduler->tick_id != 0) {
+        binc_source_remove(scheduler->tick_id);
+        scheduler->tick_id = 0;
+        start_ticking(scheduler);
+    }
+}
+
+void binc_poll_scheduler_set_max_reads_per_tick(PollScheduler *scheduler, guint max_reads) {
+    g_assert(scheduler != NULL);
+    scheduler->max_reads_per_tick = max_reads;
+}
+
+void binc_poll_scheduler_set_max_backoff(PollScheduler *scheduler, guint max_backoff_ms) {
+    g_assert(scheduler != NULL);
+    scheduler->max_backoff_ms = max_backoff_ms;
+}
+
+Adapter *binc_poll_scheduler_get_adapter(const PollScheduler *scheduler) {
+    g_assert(scheduler != NULL);
+    return scheduler->adapter;
+}
+
+void binc_poll_scheduler_get_stats(const PollScheduler *scheduler, PollSchedulerStats *stats) {
+    g_assert(scheduler != NULL);
+    g_assert(stats != NULL);
+
+    *stats = scheduler->stats;
+    stats->in_flight = scheduler->in_flight;
+    stats->polls = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, scheduler->polls);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        if (!((const Poll *) value)->removed) {
+            stats->polls++;
+        }
+    }
+}
+
+void binc_poll_scheduler_reset_stats(PollScheduler *scheduler) {
+    g_assert(scheduler != NULL);
+    memset(&scheduler->stats, 0, sizeof(PollSchedulerStats));
+}
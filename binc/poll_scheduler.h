@@ -0,0 +1,97 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_POLL_SCHEDULER_H
+#define BINC_POLL_SCHEDULER_H
+
+#include <gio/gio.h>
+#include "forward_decl.h"
+#include "characteristic.h"
+#include "uuid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Counters of a poll scheduler. Read latency runs from starting a read to its completion, in microseconds.
+ */
+typedef struct PollSchedulerStats {
+    guint polls;
+    guint in_flight;
+    guint64 ticks;
+    guint64 reads;
+    guint64 batches;
+    guint64 failures;
+    guint64 skipped_in_flight;
+    guint64 deferred;
+    guint64 read_latency_total_us;
+    guint64 read_latency_max_us;
+} PollSchedulerStats;
+
+/**
+ * Read a characteristic of the device every period_ms while the device is connected and its services are resolved,
+ * and pass every result to callback. The first read falls at a random moment within the first period and every read
+ * is delayed by a random 0 to jitter_ms, so polls registered together do not all land on the same tick.
+ * A poll that is due while its previous read is still running skips that period.
+ *
+ * @return id of the poll, used to remove it
+ */
+guint binc_poll_scheduler_add(PollScheduler *scheduler, Device *device, const BincUuid *service_uuid,
+                              const BincUuid *characteristic_uuid, guint period_ms, guint jitter_ms,
+                              OnReadCompleteCallback callback, gpointer user_data);
+
+/**
+ * Remove a poll, a read that is still running is cancelled and its callback is not called
+ */
+void binc_poll_scheduler_remove(PollScheduler *scheduler, guint poll_id);
+
+void binc_poll_scheduler_remove_device(PollScheduler *scheduler, const Device *device);
+
+/**
+ * Check for due polls every tick_ms. The due reads of a device are queued on its GATT queue together.
+ */
+void binc_poll_scheduler_set_tick(PollScheduler *scheduler, guint tick_ms);
+
+/**
+ * Limit the number of reads started on one tick, or 0 for no limit.
+ * The reads that are due the longest go first, the others move to the next tick.
+ */
+void binc_poll_scheduler_set_max_reads_per_tick(PollScheduler *scheduler, guint max_reads);
+
+/**
+ * After failed reads a poll waits its period doubled for every consecutive failure, up to max_backoff_ms
+ */
+void binc_poll_scheduler_set_max_backoff(PollScheduler *scheduler, guint max_backoff_ms);
+
+Adapter *binc_poll_scheduler_get_adapter(const PollScheduler *scheduler);
+
+void binc_poll_scheduler_get_stats(const PollScheduler *scheduler, PollSchedulerStats *stats);
+
+void binc_poll_scheduler_reset_stats(PollScheduler *scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BINC_POLL_SCHEDULER_H
@@ -0,0 +1,63 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include "property_dispatch.h"
+
+static const PropertyHandlerEntry *lookup(PropertyDispatcher *dispatcher, const char *name) {
+    if (g_once_init_enter(&dispatcher->initialized)) {
+        GHashTable *index = g_hash_table_new(g_str_hash, g_str_equal);
+        for (guint i = 0; i < dispatcher->count; i++) {
+            g_hash_table_insert(index, (gpointer) dispatcher->entries[i].name, (gpointer) &dispatcher->entries[i]);
+        }
+        dispatcher->index = index;
+        g_once_init_leave(&dispatcher->initialized, 1);
+    }
+    return g_hash_table_lookup(dispatcher->index, name);
+}
+
+gboolean binc_property_dispatch(PropertyDispatcher *dispatcher, gpointer object, const char *name, GVariant *value) {
+    g_assert(dispatcher != NULL);
+    g_assert(name != NULL);
+    g_assert(value != NULL);
+
+    const PropertyHandlerEntry *entry = lookup(dispatcher, name);
+    if (entry == NULL) return FALSE;
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE(entry->type))) return FALSE;
+
+    entry->handler(object, value);
+    return TRUE;
+}
+
+void binc_property_dispatch_all(PropertyDispatcher *dispatcher, gpointer object, GVariant *properties) {
+    g_assert(dispatcher != NULL);
+    g_assert(properties != NULL);
+    g_assert(g_variant_is_of_type(properties, G_VARIANT_TYPE("a{sv}")));
+
+    const char *property_name;
+    GVariant *property_value;
+    GVariantIter iter;
+    g_variant_iter_init(&iter, properties);
+    while (g_variant_iter_loop(&iter, "{&sv}", &property_name, &property_value)) {
+        binc_property_dispatch(dispatcher, object, property_name, property_value);
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_PROPERTY_DISPATCH_H
+#define BINC_PROPERTY_DISPATCH_H
+
+#include <glib.h>
+
+typedef void (*PropertyHandler)(gpointer object, GVariant *value);
+
+typedef struct binc_property_handler_entry {
+    const char *name;
+    const char *type; // GVariant type string, values of another type are ignored
+    PropertyHandler handler;
+} PropertyHandlerEntry;
+
+/**
+ * Maps property names to handlers. Declare one statically per table with BINC_PROPERTY_DISPATCHER,
+ * the name index is built on first use.
+ */
+typedef struct binc_property_dispatcher {
+    const PropertyHandlerEntry *entries;
+    guint count;
+    gsize initialized;
+    GHashTable *index; // Owned, never freed
+} PropertyDispatcher;
+
+#define BINC_PROPERTY_DISPATCHER(entries) { (entries), G_N_ELEMENTS(entries), 0, NULL }
+
+/**
+ * Call the handler for a property
+ *
+ * @return TRUE if a handler was called
+ */
+gboolean binc_property_dispatch(PropertyDispatcher *dispatcher, gpointer object, const char *name, GVariant *value);
+
+/**
+ * Call the handlers for all properties in an a{sv} dictionary
+ */
+void binc_property_dispatch_all(PropertyDispatcher *dispatcher, gpointer object, GVariant *properties);
+
+#endif //BINC_PROPERTY_DISPATCH_H
@@ -0,0 +1,98 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include "rssi_filter.h"
+
+void binc_rssi_filter_reset(RssiFilterState *state) {
+    g_assert(state != NULL);
+    memset(state, 0, sizeof(RssiFilterState));
+}
+
+static double apply_ema(const RssiFilterConfig *config, RssiFilterState *state, short rssi) {
+    state->estimate = state->estimate + config->ema_alpha * (rssi - state->estimate);
+    return state->estimate;
+}
+
+static double apply_kalman(const RssiFilterConfig *config, RssiFilterState *state, short rssi) {
+    // Constant signal model, so the prediction step only grows the uncertainty
+    double predicted_covariance = state->error_covariance + config->kalman_process_noise;
+    double gain = predicted_covariance / (predicted_covariance + config->kalman_measurement_noise);
+    state->estimate = state->estimate + gain * (rssi - state->estimate);
+    state->error_covariance = (1.0 - gain) * predicted_covariance;
+    return state->estimate;
+}
+
+static double apply_median(const RssiFilterConfig *config, RssiFilterState *state, short rssi) {
+    guint window = CLAMP(config->median_window, 1, BINC_RSSI_MEDIAN_MAX_WINDOW);
+    state->window[state->window_next] = rssi;
+    state->window_next = (state->window_next + 1) % window;
+    if (state->window_count < window) state->window_count++;
+
+    // Insertion sort on a copy, the window is tiny
+    short sorted[BINC_RSSI_MEDIAN_MAX_WINDOW];
+    for (guint i = 0; i < state->window_count; i++) {
+        short value = state->window[i];
+        guint j = i;
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+
+    guint middle = state->window_count / 2;
+    if (state->window_count % 2 == 1) return sorted[middle];
+    return (sorted[middle - 1] + sorted[middle]) / 2.0;
+}
+
+short binc_rssi_filter_apply(const RssiFilterConfig *config, RssiFilterState *state, short rssi) {
+    g_assert(config != NULL);
+    g_assert(state != NULL);
+
+    if (config->type == BINC_RSSI_FILTER_NONE) return rssi;
+
+    if (!state->initialized) {
+        state->initialized = TRUE;
+        state->estimate = rssi;
+        state->error_covariance = config->kalman_measurement_noise;
+        if (config->type != BINC_RSSI_FILTER_MEDIAN) return rssi;
+    }
+
+    double estimate = rssi;
+    switch (config->type) {
+        case BINC_RSSI_FILTER_EMA:
+            estimate = apply_ema(config, state, rssi);
+            break;
+        case BINC_RSSI_FILTER_KALMAN:
+            estimate = apply_kalman(config, state, rssi);
+            break;
+        case BINC_RSSI_FILTER_MEDIAN:
+            estimate = apply_median(config, state, rssi);
+            break;
+        default:
+            break;
+    }
+    return (short) lround(estimate);
+}
@@ -0,0 +1,56 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_RSSI_FILTER_H
+#define BINC_RSSI_FILTER_H
+
+#include <glib.h>
+#include "adapter.h"
+
+#define BINC_RSSI_MEDIAN_MAX_WINDOW 15
+
+typedef struct rssi_filter_config {
+    RssiFilterType type;
+    double ema_alpha;
+    double kalman_process_noise;
+    double kalman_measurement_noise;
+    guint median_window;
+} RssiFilterConfig;
+
+typedef struct rssi_filter_state {
+    gboolean initialized;
+    double estimate;
+    double error_covariance;
+    short window[BINC_RSSI_MEDIAN_MAX_WINDOW];
+    guint window_count;
+    guint window_next;
+} RssiFilterState;
+
+void binc_rssi_filter_reset(RssiFilterState *state);
+
+/**
+ * Feed a new sample into the filter and return the smoothed value
+ */
+short binc_rssi_filter_apply(const RssiFilterConfig *config, RssiFilterState *state, short rssi);
+
+#endif //BINC_RSSI_FILTER_H
@@ -0,0 +1,297 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include "runtime.h"
+#include "logger.h"
+
+static const char *const TAG = "Runtime";
+
+typedef struct runtime_command {
+    RuntimeFunc func;
+    gpointer user_data;
+    GDestroyNotify destroy;
+    struct runtime_command *next;
+} RuntimeCommand;
+
+typedef struct runtime_source {
+    GSource source;
+    Runtime *runtime; // Borrowed
+} RuntimeSource;
+
+typedef struct runtime_sync_call {
+    RuntimeFunc func;
+    gpointer user_data;
+    GMutex mutex;
+    GCond cond;
+    gboolean done;
+} RuntimeSyncCall;
+
+typedef struct runtime_delivery {
+    RuntimeFunc func;
+    gpointer user_data;
+    GDestroyNotify destroy;
+} RuntimeDelivery;
+
+struct binc_runtime {
+    GMainContext *context; // Owned
+    GMainLoop *loop; // Owned
+    GSource *source; // Owned
+    GThread *thread; // Owned
+
+    // Lock-free stack of pending commands, newest first. Pushed by any thread, only popped by the worker.
+    RuntimeCommand *pending;
+
+    GMutex callback_mutex;
+    GMainContext *callback_context; // Owned
+};
+
+static GPrivate current_runtime = G_PRIVATE_INIT(NULL);
+
+static void runtime_command_free(RuntimeCommand *command) {
+    if (command->destroy != NULL) {
+        command->destroy(command->user_data);
+    }
+    g_free(command);
+}
+
+/**
+ * Take all pending commands at once and return them in the order they were posted
+ */
+static RuntimeCommand *runtime_take_pending(Runtime *runtime) {
+    RuntimeCommand *head;
+    do {
+        head = g_atomic_pointer_get(&runtime->pending);
+    } while (head != NULL && !g_atomic_pointer_compare_and_exchange(&runtime->pending, head, NULL));
+
+    RuntimeCommand *ordered = NULL;
+    while (head != NULL) {
+        RuntimeCommand *next = head->next;
+        head->next = ordered;
+        ordered = head;
+        head = next;
+    }
+    return ordered;
+}
+
+static gboolean runtime_source_prepare(GSource *source, gint *timeout) {
+    Runtime *runtime = ((RuntimeSource *) source)->runtime;
+    *timeout = -1;
+    return g_atomic_pointer_get(&runtime->pending) != NULL;
+}
+
+static gboolean runtime_source_check(GSource *source) {
+    Runtime *runtime = ((RuntimeSource *) source)->runtime;
+    return g_atomic_pointer_get(&runtime->pending) != NULL;
+}
+
+static gboolean runtime_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    Runtime *runtime = ((RuntimeSource *) source)->runtime;
+    RuntimeCommand *command = runtime_take_pending(runtime);
+    while (command != NULL) {
+        RuntimeCommand *next = command->next;
+        command->func(command->user_data);
+        runtime_command_free(command);
+        command = next;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs runtime_source_funcs = {
+        runtime_source_prepare,
+        runtime_source_check,
+        runtime_source_dispatch,
+        NULL,
+        NULL,
+        NULL
+};
+
+static gpointer runtime_thread(gpointer data) {
+    Runtime *runtime = (Runtime *) data;
+    g_private_set(&current_runtime, runtime);
+    g_main_context_push_thread_default(runtime->context);
+
+    log_debug(TAG, "worker thread started");
+    g_main_loop_run(runtime->loop);
+    log_debug(TAG, "worker thread stopped");
+
+    g_main_context_pop_thread_default(runtime->context);
+    g_private_set(&current_runtime, NULL);
+    return NULL;
+}
+
+Runtime *binc_runtime_create() {
+    Runtime *runtime = g_new0(Runtime, 1);
+    runtime->context = g_main_context_new();
+    runtime->loop = g_main_loop_new(runtime->context, FALSE);
+    g_mutex_init(&runtime->callback_mutex);
+    runtime->callback_context = g_main_context_ref(g_main_context_default());
+
+    runtime->source = g_source_new(&runtime_source_funcs, sizeof(RuntimeSource));
+    ((RuntimeSource *) runtime->source)->runtime = runtime;
+    g_source_set_name(runtime->source, "binc runtime commands");
+    g_source_attach(runtime->source, runtime->context);
+
+    runtime->thread = g_thread_new("binc-runtime", runtime_thread, runtime);
+    return runtime;
+}
+
+static void runtime_quit(gpointer user_data) {
+    Runtime *runtime = (Runtime *) user_data;
+    g_main_loop_quit(runtime->loop);
+}
+
+void binc_runtime_free(Runtime *runtime) {
+    g_assert(runtime != NULL);
+    g_assert(!binc_runtime_is_worker_thread(runtime));
+
+    binc_runtime_invoke(runtime, runtime_quit, runtime, NULL);
+    g_thread_join(runtime->thread);
+    runtime->thread = NULL;
+
+    RuntimeCommand *command = runtime_take_pending(runtime);
+    while (command != NULL) {
+        RuntimeCommand *next = command->next;
+        runtime_command_free(command);
+        command = next;
+    }
+
+    g_source_destroy(runtime->source);
+    g_source_unref(runtime->source);
+    g_main_loop_unref(runtime->loop);
+    g_main_context_unref(runtime->context);
+    g_main_context_unref(runtime->callback_context);
+    g_mutex_clear(&runtime->callback_mutex);
+    g_free(runtime);
+}
+
+GMainContext *binc_runtime_get_context(const Runtime *runtime) {
+    g_assert(runtime != NULL);
+    return runtime->context;
+}
+
+Runtime *binc_runtime_get_current() {
+    return (Runtime *) g_private_get(&current_runtime);
+}
+
+gboolean binc_runtime_is_worker_thread(const Runtime *runtime) {
+    g_assert(runtime != NULL);
+    return g_private_get(&current_runtime) == runtime;
+}
+
+void binc_runtime_invoke(Runtime *runtime, RuntimeFunc func, gpointer user_data, GDestroyNotify destroy) {
+    g_assert(runtime != NULL);
+    g_assert(func != NULL);
+
+    RuntimeCommand *command = g_new0(RuntimeCommand, 1);
+    command->func = func;
+    command->user_data = user_data;
+    command->destroy = destroy;
+
+    RuntimeCommand *head;
+    do {
+        head = g_atomic_pointer_get(&runtime->pending);
+        command->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange(&runtime->pending, head, command));
+
+    // Only the first command after the worker drained the queue has to wake it up
+    if (head == NULL) {
+        g_main_context_wakeup(runtime->context);
+    }
+}
+
+static void runtime_sync_call_run(gpointer user_data) {
+    RuntimeSyncCall *call = (RuntimeSyncCall *) user_data;
+    call->func(call->user_data);
+
+    g_mutex_lock(&call->mutex);
+    call->done = TRUE;
+    g_cond_signal(&call->cond);
+    g_mutex_unlock(&call->mutex);
+}
+
+void binc_runtime_invoke_sync(Runtime *runtime, RuntimeFunc func, gpointer user_data) {
+    g_assert(runtime != NULL);
+    g_assert(func != NULL);
+
+    if (binc_runtime_is_worker_thread(runtime)) {
+        func(user_data);
+        return;
+    }
+
+    RuntimeSyncCall call = {.func = func, .user_data = user_data, .done = FALSE};
+    g_mutex_init(&call.mutex);
+    g_cond_init(&call.cond);
+
+    binc_runtime_invoke(runtime, runtime_sync_call_run, &call, NULL);
+
+    g_mutex_lock(&call.mutex);
+    while (!call.done) {
+        g_cond_wait(&call.cond, &call.mutex);
+    }
+    g_mutex_unlock(&call.mutex);
+
+    g_cond_clear(&call.cond);
+    g_mutex_clear(&call.mutex);
+}
+
+void binc_runtime_set_callback_context(Runtime *runtime, GMainContext *context) {
+    g_assert(runtime != NULL);
+
+    GMainContext *new_context = g_main_context_ref(context != NULL ? context : g_main_context_default());
+    g_mutex_lock(&runtime->callback_mutex);
+    GMainContext *old_context = runtime->callback_context;
+    runtime->callback_context = new_context;
+    g_mutex_unlock(&runtime->callback_mutex);
+    g_main_context_unref(old_context);
+}
+
+static gboolean runtime_delivery_run(gpointer user_data) {
+    RuntimeDelivery *delivery = (RuntimeDelivery *) user_data;
+    delivery->func(delivery->user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void runtime_delivery_free(gpointer user_data) {
+    RuntimeDelivery *delivery = (RuntimeDelivery *) user_data;
+    if (delivery->destroy != NULL) {
+        delivery->destroy(delivery->user_data);
+    }
+    g_free(delivery);
+}
+
+void binc_runtime_deliver(Runtime *runtime, RuntimeFunc func, gpointer user_data, GDestroyNotify destroy) {
+    g_assert(runtime != NULL);
+    g_assert(func != NULL);
+
+    RuntimeDelivery *delivery = g_new0(RuntimeDelivery, 1);
+    delivery->func = func;
+    delivery->user_data = user_data;
+    delivery->destroy = destroy;
+
+    g_mutex_lock(&runtime->callback_mutex);
+    GMainContext *context = g_main_context_ref(runtime->callback_context);
+    g_mutex_unlock(&runtime->callback_mutex);
+
+    g_main_context_invoke_full(context, G_PRIORITY_DEFAULT, runtime_delivery_run, delivery, runtime_delivery_free);
+    g_main_context_unref(context);
+}
@@ -0,0 +1,91 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_RUNTIME_H
+#define BINC_RUNTIME_H
+
+#include <gio/gio.h>
+#include "forward_decl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*RuntimeFunc)(gpointer user_data);
+
+/**
+ * Start a worker thread that runs its own GMainContext for all D-Bus traffic.
+ *
+ * Objects created on the worker (for example inside binc_runtime_invoke_sync) receive their signals, replies and
+ * timers there. They must only be used and freed on the worker, with binc_application_notify as the one exception.
+ * Commands posted from other threads go through a lock-free queue and never wait for the worker.
+ *
+ * The library calls all callbacks on the worker and does not hand them over to another thread by itself.
+ * Callbacks that need to reach another thread should pass their results on with binc_runtime_deliver.
+ */
+Runtime *binc_runtime_create();
+
+/**
+ * Stop the worker thread and wait for it. Commands that did not run yet are dropped.
+ * Must not be called from the worker thread.
+ */
+void binc_runtime_free(Runtime *runtime);
+
+GMainContext *binc_runtime_get_context(const Runtime *runtime);
+
+/**
+ * Get the runtime whose worker thread is the calling thread, or NULL
+ */
+Runtime *binc_runtime_get_current();
+
+gboolean binc_runtime_is_worker_thread(const Runtime *runtime);
+
+/**
+ * Run func on the worker thread. Can be called from any thread, commands run in the order they were posted.
+ *
+ * @param destroy called for user_data after func ran or when the command is dropped, may be NULL
+ */
+void binc_runtime_invoke(Runtime *runtime, RuntimeFunc func, gpointer user_data, GDestroyNotify destroy);
+
+/**
+ * Run func on the worker thread and wait until it returned. Runs func directly when called on the worker thread.
+ */
+void binc_runtime_invoke_sync(Runtime *runtime, RuntimeFunc func, gpointer user_data);
+
+/**
+ * Set the context on which binc_runtime_deliver runs callbacks, NULL for the global default context
+ */
+void binc_runtime_set_callback_context(Runtime *runtime, GMainContext *context);
+
+/**
+ * Run func on the callback context. Use it from library callbacks, which run on the worker thread,
+ * to hand results over to the thread that owns the callback context. Objects of the library must not be
+ * used by func, copy what it needs.
+ */
+void binc_runtime_deliver(Runtime *runtime, RuntimeFunc func, gpointer user_data, GDestroyNotify destroy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BINC_RUNTIME_H
@@ -0,0 +1,277 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include "scan_aggregator_internal.h"
+#include "adapter.h"
+#include "adapter_internal.h"
+#include "device.h"
+#include "logger.h"
+
+static const char *const TAG = "ScanAggregator";
+
+static const guint DEFAULT_HYSTERESIS_DB = 3;
+static const guint DEFAULT_STALE_MS = 5000;
+
+typedef struct aggregated_device AggregatedDevice;
+
+typedef struct sighting {
+    Device *device; // Borrowed
+    AggregatedDevice *owner; // Borrowed
+    gint64 last_seen;
+} Sighting;
+
+struct aggregated_device {
+    guint64 key; // Packed identity address, also the key in the devices table
+    GPtrArray *sightings; // Owned, one per controller
+    Sighting *best; // Borrowed
+};
+
+struct binc_scan_aggregator {
+    GPtrArray *adapters; // Owned, adapters borrowed
+    GHashTable *devices; // Owned, packed identity address -> AggregatedDevice
+    GHashTable *sightings_by_device; // Owned, borrowed device -> Sighting
+    ScanAggregatorResultCallback resultCallback;
+    guint hysteresis_db;
+    gint64 stale_us;
+    void *user_data; // Borrowed
+};
+
+static void aggregated_device_free(AggregatedDevice *entry) {
+    g_ptr_array_free(entry->sightings, TRUE);
+    g_free(entry);
+}
+
+ScanAggregator *binc_scan_aggregator_create() {
+    ScanAggregator *aggregator = g_new0(ScanAggregator, 1);
+    aggregator->adapters = g_ptr_array_new();
+    aggregator->devices = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                                NULL, (GDestroyNotify) aggregated_device_free);
+    aggregator->sightings_by_device = g_hash_table_new(g_direct_hash, g_direct_equal);
+    aggregator->hysteresis_db = DEFAULT_HYSTERESIS_DB;
+    aggregator->stale_us = (gint64) DEFAULT_STALE_MS * G_TIME_SPAN_MILLISECOND;
+    return aggregator;
+}
+
+void binc_scan_aggregator_free(ScanAggregator *aggregator) {
+    g_assert(aggregator != NULL);
+
+    for (guint i = 0; i < aggregator->adapters->len; i++) {
+        binc_internal_adapter_set_scan_aggregator(g_ptr_array_index(aggregator->adapters, i), NULL);
+    }
+    g_ptr_array_free(aggregator->adapters, TRUE);
+    aggregator->adapters = NULL;
+
+    g_hash_table_destroy(aggregator->sightings_by_device);
+    aggregator->sightings_by_device = NULL;
+
+    g_hash_table_destroy(aggregator->devices);
+    aggregator->devices = NULL;
+
+    g_free(aggregator);
+}
+
+static Sighting *pick_best(const AggregatedDevice *entry) {
+    Sighting *best = NULL;
+    for (guint i = 0; i < entry->sightings->len; i++) {
+        Sighting *sighting = g_ptr_array_index(entry->sightings, i);
+        if (best == NULL ||
+            binc_device_get_smoothed_rssi(sighting->device) > binc_device_get_smoothed_rssi(best->device)) {
+            best = sighting;
+        }
+    }
+    return best;
+}
+
+static void remove_sighting(ScanAggregator *aggregator, Sighting *sighting) {
+    AggregatedDevice *entry = sighting->owner;
+    gboolean was_best = entry->best == sighting;
+
+    g_hash_table_remove(aggregator->sightings_by_device, sighting->device);
+    g_ptr_array_remove_fast(entry->sightings, sighting);
+
+    if (entry->sightings->len == 0) {
+        g_hash_table_remove(aggregator->devices, &entry->key);
+    } else if (was_best) {
+        entry->best = pick_best(entry);
+    }
+}
+
+static Sighting *add_sighting(ScanAggregator *aggregator, Device *device, guint64 key) {
+    AggregatedDevice *entry = g_hash_table_lookup(aggregator->devices, &key);
+    if (entry == NULL) {
+        entry = g_new0(AggregatedDevice, 1);
+        entry->key = key;
+        entry->sightings = g_ptr_array_new_with_free_func(g_free);
+        g_hash_table_insert(aggregator->devices, &entry->key, entry);
+    }
+
+    Sighting *sighting = g_new0(Sighting, 1);
+    sighting->device = device;
+    sighting->owner = entry;
+    g_ptr_array_add(entry->sightings, sighting);
+    g_hash_table_insert(aggregator->sightings_by_device, device, sighting);
+    return sighting;
+}
+
+void binc_internal_scan_aggregator_result(ScanAggregator *aggregator, Device *device) {
+    g_assert(aggregator != NULL);
+    g_assert(device != NULL);
+
+    guint64 key = binc_address_pack(binc_device_get_binary_address(device));
+    Sighting *sighting = g_hash_table_lookup(aggregator->sightings_by_device, device);
+
+    // The identity address can change once BlueZ resolves a random address
+    if (sighting != NULL && sighting->owner->key != key) {
+        remove_sighting(aggregator, sighting);
+        sighting = NULL;
+    }
+    if (sighting == NULL) {
+        sighting = add_sighting(aggregator, device, key);
+    }
+
+    gint64 now = g_get_monotonic_time();
+    sighting->last_seen = now;
+
+    AggregatedDevice *entry = sighting->owner;
+    if (entry->best != NULL && entry->best != sighting) {
+        gboolean is_stale = now - entry->best->last_seen > aggregator->stale_us;
+        int improvement = binc_device_get_smoothed_rssi(device) - binc_device_get_smoothed_rssi(entry->best->device);
+        if (!is_stale && improvement <= (int) aggregator->hysteresis_db) return;
+
+        log_debug(TAG, "switching '%s' to %s", binc_device_get_address(device),
+                  binc_adapter_get_name(binc_device_get_adapter(device)));
+    }
+    entry->best = sighting;
+
+    if (aggregator->resultCallback != NULL) {
+        aggregator->resultCallback(aggregator, device);
+    }
+}
+
+void binc_internal_scan_aggregator_device_removed(ScanAggregator *aggregator, Device *device) {
+    g_assert(aggregator != NULL);
+    g_assert(device != NULL);
+
+    Sighting *sighting = g_hash_table_lookup(aggregator->sightings_by_device, device);
+    if (sighting != NULL) {
+        remove_sighting(aggregator, sighting);
+    }
+}
+
+void binc_scan_aggregator_add_adapter(ScanAggregator *aggregator, Adapter *adapter) {
+    g_assert(aggregator != NULL);
+    g_assert(adapter != NULL);
+    g_assert(binc_internal_adapter_get_scan_aggregator(adapter) == NULL);
+
+    g_ptr_array_add(aggregator->adapters, adapter);
+    binc_internal_adapter_set_scan_aggregator(adapter, aggregator);
+}
+
+void binc_scan_aggregator_remove_adapter(ScanAggregator *aggregator, Adapter *adapter) {
+    g_assert(aggregator != NULL);
+    g_assert(adapter != NULL);
+
+    if (!g_ptr_array_remove(aggregator->adapters, adapter)) return;
+    binc_internal_adapter_set_scan_aggregator(adapter, NULL);
+
+    // Forget everything this controller has seen, other controllers take over
+    GPtrArray *stale = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, aggregator->sightings_by_device);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (binc_device_get_adapter((Device *) key) == adapter) {
+            g_ptr_array_add(stale, key);
+        }
+    }
+    for (guint i = 0; i < stale->len; i++) {
+        binc_internal_scan_aggregator_device_removed(aggregator, g_ptr_array_index(stale, i));
+    }
+    g_ptr_array_free(stale, TRUE);
+}
+
+void binc_scan_aggregator_start_discovery(ScanAggregator *aggregator) {
+    g_assert(aggregator != NULL);
+
+    for (guint i = 0; i < aggregator->adapters->len; i++) {
+        binc_adapter_start_discovery(g_ptr_array_index(aggregator->adapters, i));
+    }
+}
+
+void binc_scan_aggregator_stop_discovery(ScanAggregator *aggregator) {
+    g_assert(aggregator != NULL);
+
+    for (guint i = 0; i < aggregator->adapters->len; i++) {
+        binc_adapter_stop_discovery(g_ptr_array_index(aggregator->adapters, i));
+    }
+}
+
+void binc_scan_aggregator_set_result_cb(ScanAggregator *aggregator, ScanAggregatorResultCallback callback) {
+    g_assert(aggregator != NULL);
+    g_assert(callback != NULL);
+
+    aggregator->resultCallback = callback;
+}
+
+void binc_scan_aggregator_set_switch_policy(ScanAggregator *aggregator, guint hysteresis_db, guint stale_ms) {
+    g_assert(aggregator != NULL);
+
+    aggregator->hysteresis_db = hysteresis_db;
+    aggregator->stale_us = (gint64) stale_ms * G_TIME_SPAN_MILLISECOND;
+}
+
+Device *binc_scan_aggregator_get_device(const ScanAggregator *aggregator, const BincAddress *address) {
+    g_assert(aggregator != NULL);
+    g_assert(address != NULL);
+
+    guint64 key = binc_address_pack(address);
+    AggregatedDevice *entry = g_hash_table_lookup(aggregator->devices, &key);
+    if (entry == NULL || entry->best == NULL) return NULL;
+    return entry->best->device;
+}
+
+GList *binc_scan_aggregator_get_devices(const ScanAggregator *aggregator) {
+    g_assert(aggregator != NULL);
+
+    GList *result = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, aggregator->devices);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        AggregatedDevice *entry = (AggregatedDevice *) value;
+        if (entry->best != NULL) {
+            result = g_list_prepend(result, entry->best->device);
+        }
+    }
+    return result;
+}
+
+void binc_scan_aggregator_set_user_data(ScanAggregator *aggregator, void *user_data) {
+    g_assert(aggregator != NULL);
+    aggregator->user_data = user_data;
+}
+
+void *binc_scan_aggregator_get_user_data(const ScanAggregator *aggregator) {
+    g_assert(aggregator != NULL);
+    return aggregator->user_data;
+}
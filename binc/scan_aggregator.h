@@ -0,0 +1,85 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_SCAN_AGGREGATOR_H
+#define BINC_SCAN_AGGREGATOR_H
+
+#include <gio/gio.h>
+#include "forward_decl.h"
+#include "address.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Called with the Device of the controller that currently hears the peripheral best
+ */
+typedef void (*ScanAggregatorResultCallback)(ScanAggregator *aggregator, Device *device);
+
+/**
+ * Create an aggregator that merges the discovery results of several adapters into one stream.
+ * A peripheral seen by more than one controller is reported once, through the controller with the best RSSI.
+ */
+ScanAggregator *binc_scan_aggregator_create();
+
+void binc_scan_aggregator_free(ScanAggregator *aggregator);
+
+/**
+ * Add an adapter to the aggregator. An adapter can only be part of one aggregator at a time.
+ */
+void binc_scan_aggregator_add_adapter(ScanAggregator *aggregator, Adapter *adapter);
+
+void binc_scan_aggregator_remove_adapter(ScanAggregator *aggregator, Adapter *adapter);
+
+void binc_scan_aggregator_start_discovery(ScanAggregator *aggregator);
+
+void binc_scan_aggregator_stop_discovery(ScanAggregator *aggregator);
+
+void binc_scan_aggregator_set_result_cb(ScanAggregator *aggregator, ScanAggregatorResultCallback callback);
+
+/**
+ * Only switch to another controller when it hears the peripheral more than hysteresis_db better,
+ * or when the current controller has not reported it for stale_ms
+ */
+void binc_scan_aggregator_set_switch_policy(ScanAggregator *aggregator, guint hysteresis_db, guint stale_ms);
+
+/**
+ * Get the Device of the controller that currently hears the peripheral best, or NULL if it is not known
+ */
+Device *binc_scan_aggregator_get_device(const ScanAggregator *aggregator, const BincAddress *address);
+
+/**
+ * Get the best Device for every known peripheral. The list must be freed, the devices are borrowed.
+ */
+GList *binc_scan_aggregator_get_devices(const ScanAggregator *aggregator);
+
+void binc_scan_aggregator_set_user_data(ScanAggregator *aggregator, void *user_data);
+
+void *binc_scan_aggregator_get_user_data(const ScanAggregator *aggregator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BINC_SCAN_AGGREGATOR_H
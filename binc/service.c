@@ -28,20 +28,23 @@
 struct binc_service {
     Device *device; // Borrowed
     const char *path; // Owned
-    const char* uuid; // Owned
+    const char* uuid; // Interned
+    BincUuid binary_uuid;
     GList *characteristics; // Owned
+    GHashTable *characteristics_by_uuid; // Owned, borrowed BincUuid of the characteristic -> first Characteristic
 };
 
 Service* binc_service_create(Device *device, const char* path, const char* uuid) {
     g_assert(device != NULL);
     g_assert(path != NULL);
-    g_assert(is_valid_uuid(uuid));
 
     Service *service = g_new0(Service, 1);
     service->device = device;
     service->path = g_strdup(path);
-    service->uuid = g_strdup(uuid);
+    parse_uuid(uuid, &service->binary_uuid);
+    service->uuid = binc_uuid_to_interned_string(&service->binary_uuid);
     service->characteristics = NULL;
+    service->characteristics_by_uuid = g_hash_table_new(binc_uuid_hash, binc_uuid_equal);
     return service;
 }
 
@@ -51,9 +54,11 @@ void binc_service_free(Service *service) {
     g_free((char*) service->path);
     service->path = NULL;
 
-    g_free((char*) service->uuid);
     service->uuid = NULL;
 
+    g_hash_table_destroy(service->characteristics_by_uuid);
+    service->characteristics_by_uuid = NULL;
+
     g_list_free(service->characteristics);
     service->characteristics = NULL;
 
@@ -66,6 +71,11 @@ const char* binc_service_get_uuid(const Service *service) {
     return service->uuid;
 }
 
+const BincUuid *binc_service_get_binary_uuid(const Service *service) {
+    g_assert(service != NULL);
+    return &service->binary_uuid;
+}
+
 Device *binc_service_get_device(const Service *service) {
     g_assert(service != NULL);
     return service->device;
@@ -76,6 +86,11 @@ void binc_service_add_characteristic(Service *service, Characteristic *character
     g_assert(characteristic != NULL);
 
     service->characteristics = g_list_append(service->characteristics, characteristic);
+
+    const BincUuid *uuid = binc_characteristic_get_binary_uuid(characteristic);
+    if (!g_hash_table_contains(service->characteristics_by_uuid, uuid)) {
+        g_hash_table_insert(service->characteristics_by_uuid, (gpointer) uuid, characteristic);
+    }
 }
 
 GList *binc_service_get_characteristics(const Service *service) {
@@ -86,15 +101,15 @@ GList *binc_service_get_characteristics(const Service *service) {
 Characteristic *binc_service_get_characteristic(const Service *service, const char* char_uuid) {
     g_assert(service != NULL);
     g_assert(char_uuid != NULL);
-    g_assert(is_valid_uuid(char_uuid));
-
-    if (service->characteristics != NULL) {
-        for (GList *iterator = service->characteristics; iterator; iterator = iterator->next) {
-            Characteristic *characteristic = (Characteristic *) iterator->data;
-            if (g_str_equal(char_uuid, binc_characteristic_get_uuid(characteristic))) {
-                return characteristic;
-            }
-        }
-    }
-    return NULL;
+
+    BincUuid uuid;
+    if (!parse_uuid(char_uuid, &uuid)) return NULL;
+    return binc_service_get_characteristic_by_uuid(service, &uuid);
+}
+
+Characteristic *binc_service_get_characteristic_by_uuid(const Service *service, const BincUuid *char_uuid) {
+    g_assert(service != NULL);
+    g_assert(char_uuid != NULL);
+
+    return g_hash_table_lookup(service->characteristics_by_uuid, char_uuid);
 }
@@ -26,6 +26,7 @@
 
 #include <gio/gio.h>
 #include "forward_decl.h"
+#include "uuid.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,12 +34,20 @@ extern "C" {
 
 const char *binc_service_get_uuid(const Service *service);
 
+const BincUuid *binc_service_get_binary_uuid(const Service *service);
+
 Device *binc_service_get_device(const Service *service);
 
 GList *binc_service_get_characteristics(const Service *service);
 
 Characteristic *binc_service_get_characteristic(const Service *service, const char *char_uuid);
 
+/**
+ * Look up a characteristic by binary uuid without string compares. The result stays valid until services are
+ * resolved again, so it can be kept and reused.
+ */
+Characteristic *binc_service_get_characteristic_by_uuid(const Service *service, const BincUuid *char_uuid);
+
 #ifdef __cplusplus
 }
 #endif
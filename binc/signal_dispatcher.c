@@ -0,0 +1,376 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "signal_dispatcher.h"
+#include "logger.h"
+
+static const char *const TAG = "SignalDispatcher";
+static const char *const BLUEZ_DBUS = "org.bluez";
+static const char *const BLUEZ_PATH_NAMESPACE = "/org/bluez";
+static const char *const BLUEZ_OBJECT_PREFIX = "/org/bluez/";
+static const char *const INTERFACE_DEVICE = "org.bluez.Device1";
+static const char *const INTERFACE_OBJECT_MANAGER = "org.freedesktop.DBus.ObjectManager";
+static const char *const INTERFACE_PROPERTIES = "org.freedesktop.DBus.Properties";
+static const char *const SIGNAL_PROPERTIES_CHANGED = "PropertiesChanged";
+static const char *const SIGNAL_INTERFACES_ADDED = "InterfacesAdded";
+static const char *const SIGNAL_INTERFACES_REMOVED = "InterfacesRemoved";
+
+static const char *const DBUS_NAME = "org.freedesktop.DBus";
+static const char *const DBUS_PATH = "/org/freedesktop/DBus";
+static const char *const DBUS_INTERFACE = "org.freedesktop.DBus";
+
+#define MAX_STACK_PATH_LENGTH 128
+
+// The bus daemon answers match rule calls itself, BlueZ answers GetManagedObjects from memory
+#define DISPATCHER_CALL_TIMEOUT_MS 10000
+
+typedef struct binc_signal_route {
+    ObjectSignalHandlers handlers;
+    gpointer user_data; // Borrowed
+} SignalRoute;
+
+typedef struct binc_signal_dispatcher {
+    GDBusConnection *connection; // Borrowed
+    GHashTable *routes; // Owned, path -> GPtrArray of SignalRoute
+    char *match_rule; // Owned
+    ObjectTree *object_tree; // Owned
+    GCancellable *cancellable; // Owned, cancels the pending match rule and seeding calls
+    guint properties_changed;
+    guint interfaces_added;
+    guint interfaces_removed;
+} SignalDispatcher;
+
+// One dispatcher per connection, shared by all adapters on it. Connections may be used from different threads,
+// e.g. a Runtime worker and the main thread, so the table is locked. A dispatcher itself is only used on the
+// thread of its connection's objects.
+static GHashTable *dispatchers = NULL;
+static GMutex dispatchers_lock;
+
+static SignalDispatcher *lookup_dispatcher(GDBusConnection *connection) {
+    g_mutex_lock(&dispatchers_lock);
+    SignalDispatcher *dispatcher = dispatchers != NULL ? g_hash_table_lookup(dispatchers, connection) : NULL;
+    g_mutex_unlock(&dispatchers_lock);
+    return dispatcher;
+}
+
+/**
+ * Find the route registered for the longest path prefix of object_path, only matching at '/' boundaries.
+ */
+static GPtrArray *find_routes(SignalDispatcher *dispatcher, const char *object_path) {
+    size_t length = strlen(object_path);
+    char stack_buffer[MAX_STACK_PATH_LENGTH];
+    char *buffer = length < MAX_STACK_PATH_LENGTH ? stack_buffer : g_malloc(length + 1);
+    memcpy(buffer, object_path, length + 1);
+
+    GPtrArray *routes = NULL;
+    for (;;) {
+        routes = g_hash_table_lookup(dispatcher->routes, buffer);
+        if (routes != NULL) break;
+
+        char *separator = strrchr(buffer, '/');
+        if (separator == NULL || separator == buffer) break;
+        *separator = '\0';
+    }
+
+    if (buffer != stack_buffer) g_free(buffer);
+    return routes;
+}
+
+static void on_properties_changed(GDBusConnection *connection,
+                                  const gchar *sender_name,
+                                  const gchar *object_path,
+                                  const gchar *interface_name,
+                                  const gchar *signal_name,
+                                  GVariant *parameters,
+                                  gpointer user_data) {
+    SignalDispatcher *dispatcher = (SignalDispatcher *) user_data;
+    g_assert(dispatcher != NULL);
+
+    binc_object_tree_properties_changed(dispatcher->object_tree, object_path, parameters);
+
+    // Only Device1 changes are routed, the mirror takes all of them
+    GVariant *changed_interface = g_variant_get_child_value(parameters, 0);
+    gboolean is_device = g_str_equal(g_variant_get_string(changed_interface, NULL), INTERFACE_DEVICE);
+    g_variant_unref(changed_interface);
+    if (!is_device) return;
+
+    GPtrArray *routes = find_routes(dispatcher, object_path);
+    if (routes == NULL) return;
+
+    for (guint i = 0; i < routes->len; i++) {
+        SignalRoute *route = g_ptr_array_index(routes, i);
+        if (route->handlers.properties_changed != NULL) {
+            route->handlers.properties_changed(connection, sender_name, object_path, interface_name, signal_name,
+                                               parameters, route->user_data);
+        }
+    }
+}
+
+static void on_interfaces_changed(GDBusConnection *connection,
+                                  const gchar *sender_name,
+                                  const gchar *object_path,
+                                  const gchar *interface_name,
+                                  const gchar *signal_name,
+                                  GVariant *parameters,
+                                  gpointer user_data) {
+    SignalDispatcher *dispatcher = (SignalDispatcher *) user_data;
+    g_assert(dispatcher != NULL);
+
+    gboolean is_added = g_str_equal(signal_name, SIGNAL_INTERFACES_ADDED);
+    if (is_added) {
+        binc_object_tree_interfaces_added(dispatcher->object_tree, parameters);
+    } else {
+        binc_object_tree_interfaces_removed(dispatcher->object_tree, parameters);
+    }
+
+    // Both signals carry the object path as first argument, route on that without decoding the rest
+    GVariant *object = g_variant_get_child_value(parameters, 0);
+    GPtrArray *routes = find_routes(dispatcher, g_variant_get_string(object, NULL));
+    g_variant_unref(object);
+    if (routes == NULL) return;
+
+    for (guint i = 0; i < routes->len; i++) {
+        SignalRoute *route = g_ptr_array_index(routes, i);
+        GDBusSignalCallback handler = is_added ? route->handlers.interfaces_added : route->handlers.interfaces_removed;
+        if (handler != NULL) {
+            handler(connection, sender_name, object_path, interface_name, signal_name, parameters, route->user_data);
+        }
+    }
+}
+
+static void binc_internal_seed_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+
+    // The dispatcher is gone when the call was cancelled
+    if (error != NULL) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            log_debug(TAG, "failed to seed object tree (error %d: %s)", error->code, error->message);
+        }
+        g_clear_error(&error);
+        return;
+    }
+
+    SignalDispatcher *dispatcher = (SignalDispatcher *) user_data;
+    binc_object_tree_seed(dispatcher->object_tree, result);
+    g_variant_unref(result);
+    log_debug(TAG, "object tree seeded");
+
+    GHashTableIter iter;
+    GPtrArray *routes = NULL;
+    g_hash_table_iter_init(&iter, dispatcher->routes);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &routes)) {
+        for (guint i = 0; i < routes->len; i++) {
+            SignalRoute *route = g_ptr_array_index(routes, i);
+            if (route->handlers.seeded != NULL) {
+                route->handlers.seeded(dispatcher->object_tree, route->user_data);
+            }
+        }
+    }
+}
+
+static void binc_internal_match_rule_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GError *error = NULL;
+    GVariant *value = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    if (value != NULL) {
+        g_variant_unref(value);
+    }
+
+    if (error != NULL) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            log_debug(TAG, "failed to update match rule (error %d: %s)", error->code, error->message);
+        }
+        g_clear_error(&error);
+        return;
+    }
+
+    // The bus handles our messages in order, so all subscriptions are active once AddMatch is acknowledged
+    SignalDispatcher *dispatcher = (SignalDispatcher *) user_data;
+    if (dispatcher == NULL) return;
+
+    g_dbus_connection_call(dispatcher->connection,
+                           BLUEZ_DBUS,
+                           "/",
+                           INTERFACE_OBJECT_MANAGER,
+                           "GetManagedObjects",
+                           NULL,
+                           G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           DISPATCHER_CALL_TIMEOUT_MS,
+                           dispatcher->cancellable,
+                           (GAsyncReadyCallback) binc_internal_seed_cb,
+                           dispatcher);
+}
+
+/**
+ * Add or remove a match rule. When dispatcher is not NULL, the mirror is seeded once the rule is active.
+ */
+static void call_match_rule_method(GDBusConnection *connection, const char *method, const char *rule,
+                                   SignalDispatcher *dispatcher) {
+    g_dbus_connection_call(connection,
+                           DBUS_NAME,
+                           DBUS_PATH,
+                           DBUS_INTERFACE,
+                           method,
+                           g_variant_new("(s)", rule),
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           DISPATCHER_CALL_TIMEOUT_MS,
+                           dispatcher != NULL ? dispatcher->cancellable : NULL,
+                           (GAsyncReadyCallback) binc_internal_match_rule_cb,
+                           dispatcher);
+}
+
+static SignalDispatcher *dispatcher_create(GDBusConnection *connection) {
+    SignalDispatcher *dispatcher = g_new0(SignalDispatcher, 1);
+    dispatcher->connection = connection;
+    dispatcher->routes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
+    dispatcher->object_tree = binc_object_tree_create();
+    dispatcher->cancellable = g_cancellable_new();
+
+    dispatcher->properties_changed = g_dbus_connection_signal_subscribe(connection,
+                                                                        BLUEZ_DBUS,
+                                                                        INTERFACE_PROPERTIES,
+                                                                        SIGNAL_PROPERTIES_CHANGED,
+                                                                        NULL,
+                                                                        NULL,
+                                                                        G_DBUS_SIGNAL_FLAGS_NO_MATCH_RULE,
+                                                                        on_properties_changed,
+                                                                        dispatcher,
+                                                                        NULL);
+
+    dispatcher->interfaces_added = g_dbus_connection_signal_subscribe(connection,
+                                                                      BLUEZ_DBUS,
+                                                                      INTERFACE_OBJECT_MANAGER,
+                                                                      SIGNAL_INTERFACES_ADDED,
+                                                                      NULL,
+                                                                      BLUEZ_OBJECT_PREFIX,
+                                                                      G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_PATH,
+                                                                      on_interfaces_changed,
+                                                                      dispatcher,
+                                                                      NULL);
+
+    dispatcher->interfaces_removed = g_dbus_connection_signal_subscribe(connection,
+                                                                        BLUEZ_DBUS,
+                                                                        INTERFACE_OBJECT_MANAGER,
+                                                                        SIGNAL_INTERFACES_REMOVED,
+                                                                        NULL,
+                                                                        BLUEZ_OBJECT_PREFIX,
+                                                                        G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_PATH,
+                                                                        on_interfaces_changed,
+                                                                        dispatcher,
+                                                                        NULL);
+
+    // GDBus can't express path_namespace, so the match rule for PropertiesChanged is added by hand.
+    // It is added last so that its reply also confirms the match rules of the subscriptions above.
+    dispatcher->match_rule = g_strdup_printf(
+            "type='signal',sender='%s',interface='%s',member='%s',path_namespace='%s'",
+            BLUEZ_DBUS, INTERFACE_PROPERTIES, SIGNAL_PROPERTIES_CHANGED, BLUEZ_PATH_NAMESPACE);
+    call_match_rule_method(connection, "AddMatch", dispatcher->match_rule, dispatcher);
+    return dispatcher;
+}
+
+static void dispatcher_free(SignalDispatcher *dispatcher) {
+    g_cancellable_cancel(dispatcher->cancellable);
+    g_object_unref(dispatcher->cancellable);
+    g_dbus_connection_signal_unsubscribe(dispatcher->connection, dispatcher->properties_changed);
+    g_dbus_connection_signal_unsubscribe(dispatcher->connection, dispatcher->interfaces_added);
+    g_dbus_connection_signal_unsubscribe(dispatcher->connection, dispatcher->interfaces_removed);
+    call_match_rule_method(dispatcher->connection, "RemoveMatch", dispatcher->match_rule, NULL);
+
+    g_free(dispatcher->match_rule);
+    g_hash_table_destroy(dispatcher->routes);
+    binc_object_tree_free(dispatcher->object_tree);
+    g_free(dispatcher);
+}
+
+void binc_signal_dispatcher_register(GDBusConnection *connection, const char *path,
+                                     const ObjectSignalHandlers *handlers, gpointer user_data) {
+    g_assert(connection != NULL);
+    g_assert(path != NULL);
+    g_assert(handlers != NULL);
+
+    g_mutex_lock(&dispatchers_lock);
+    if (dispatchers == NULL) {
+        dispatchers = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
+    SignalDispatcher *dispatcher = g_hash_table_lookup(dispatchers, connection);
+    if (dispatcher == NULL) {
+        log_debug(TAG, "creating signal dispatcher");
+        dispatcher = dispatcher_create(connection);
+        g_hash_table_insert(dispatchers, connection, dispatcher);
+    }
+    g_mutex_unlock(&dispatchers_lock);
+
+    // Several objects may be registered for the same path, e.g. when an adapter is retrieved twice
+    GPtrArray *routes = g_hash_table_lookup(dispatcher->routes, path);
+    if (routes == NULL) {
+        routes = g_ptr_array_new_with_free_func(g_free);
+        g_hash_table_insert(dispatcher->routes, g_strdup(path), routes);
+    }
+
+    SignalRoute *route = g_new0(SignalRoute, 1);
+    route->handlers = *handlers;
+    route->user_data = user_data;
+    g_ptr_array_add(routes, route);
+}
+
+void binc_signal_dispatcher_unregister(GDBusConnection *connection, const char *path, gpointer user_data) {
+    g_assert(connection != NULL);
+    g_assert(path != NULL);
+
+    SignalDispatcher *dispatcher = lookup_dispatcher(connection);
+    if (dispatcher == NULL) return;
+
+    GPtrArray *routes = g_hash_table_lookup(dispatcher->routes, path);
+    if (routes == NULL) return;
+
+    for (guint i = 0; i < routes->len; i++) {
+        SignalRoute *route = g_ptr_array_index(routes, i);
+        if (route->user_data == user_data) {
+            g_ptr_array_remove_index(routes, i);
+            break;
+        }
+    }
+
+    if (routes->len == 0) {
+        g_hash_table_remove(dispatcher->routes, path);
+    }
+    if (g_hash_table_size(dispatcher->routes) == 0) {
+        log_debug(TAG, "freeing signal dispatcher");
+        g_mutex_lock(&dispatchers_lock);
+        g_hash_table_remove(dispatchers, connection);
+        g_mutex_unlock(&dispatchers_lock);
+        dispatcher_free(dispatcher);
+    }
+}
+
+ObjectTree *binc_signal_dispatcher_get_object_tree(GDBusConnection *connection) {
+    g_assert(connection != NULL);
+
+    SignalDispatcher *dispatcher = lookup_dispatcher(connection);
+    if (dispatcher == NULL || !binc_object_tree_is_seeded(dispatcher->object_tree)) return NULL;
+    return dispatcher->object_tree;
+}
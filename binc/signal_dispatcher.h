@@ -0,0 +1,60 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_SIGNAL_DISPATCHER_H
+#define BINC_SIGNAL_DISPATCHER_H
+
+#include <gio/gio.h>
+#include "object_tree.h"
+
+typedef void (*ObjectTreeSeededCallback)(ObjectTree *tree, gpointer user_data);
+
+/**
+ * Handlers for the BlueZ object signals below a registered path.
+ *
+ * properties_changed receives Device1 PropertiesChanged signals, the interfaces handlers receive
+ * ObjectManager InterfacesAdded/InterfacesRemoved signals for objects under the path.
+ * The object tree mirror of the connection is updated before any handler is called.
+ * seeded is called once when the mirror has been seeded, it is not called for registrations made afterwards.
+ */
+typedef struct binc_object_signal_handlers {
+    GDBusSignalCallback properties_changed;
+    GDBusSignalCallback interfaces_added;
+    GDBusSignalCallback interfaces_removed;
+    ObjectTreeSeededCallback seeded;
+} ObjectSignalHandlers;
+
+void binc_signal_dispatcher_register(GDBusConnection *connection, const char *path,
+                                     const ObjectSignalHandlers *handlers, gpointer user_data);
+
+void binc_signal_dispatcher_unregister(GDBusConnection *connection, const char *path, gpointer user_data);
+
+/**
+ * Get the object tree mirror of a connection, or NULL if nothing is registered on it or the mirror isn't seeded yet.
+ *
+ * The mirror is seeded from a GetManagedObjects call made once the signal subscriptions are active,
+ * so no change can be missed between the reply and the first signal.
+ */
+ObjectTree *binc_signal_dispatcher_get_object_tree(GDBusConnection *connection);
+
+#endif //BINC_SIGNAL_DISPATCHER_H
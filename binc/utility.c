@@ -23,6 +23,7 @@
 
 #include "utility.h"
 #include "math.h"
+#include <string.h>
 
 void bytes_to_hex(char *dest, const guint8 *src, int n) {
     const char xx[] = "0123456789abcdef";
@@ -111,6 +112,15 @@ gboolean is_valid_uuid(const char *uuid) {
     return TRUE;
 }
 
+gboolean parse_uuid(const char *uuid, BincUuid *binary_uuid) {
+    if (uuid == NULL || !binc_uuid_parse(uuid, binary_uuid)) {
+        g_critical("%s is not a valid UUID", uuid != NULL ? uuid : "NULL");
+        memset(binary_uuid, 0, sizeof(BincUuid));
+        return FALSE;
+    }
+    return TRUE;
+}
+
 char* replace_char(char* str, char find, char replace){
     char *current_pos = strchr(str,find);
     while (current_pos) {
@@ -141,4 +151,40 @@ GByteArray *g_variant_get_byte_array(GVariant *variant) {
     size_t data_length = 0;
     guint8 *data = (guint8 *) g_variant_get_fixed_array(variant, &data_length, sizeof(guint8));
     return g_byte_array_new_take(data, data_length);
-}
\ No newline at end of file
+}
+
+static guint attach_to_thread_default(GSource *source, GSourceFunc function, gpointer data) {
+    g_source_set_callback(source, function, data, NULL);
+    GMainContext *context = g_main_context_ref_thread_default();
+    guint source_id = g_source_attach(source, context);
+    g_main_context_unref(context);
+    g_source_unref(source);
+    return source_id;
+}
+
+guint binc_timeout_add(guint interval_ms, GSourceFunc function, gpointer data) {
+    return attach_to_thread_default(g_timeout_source_new(interval_ms), function, data);
+}
+
+guint binc_timeout_add_seconds(guint interval, GSourceFunc function, gpointer data) {
+    return attach_to_thread_default(g_timeout_source_new_seconds(interval), function, data);
+}
+
+guint binc_idle_add(GSourceFunc function, gpointer data) {
+    return attach_to_thread_default(g_idle_source_new(), function, data);
+}
+
+guint binc_cancelled_add(GCancellable *cancellable, GCancellableSourceFunc function, gpointer data) {
+    return attach_to_thread_default(g_cancellable_source_new(cancellable), G_SOURCE_FUNC(function), data);
+}
+
+void binc_source_remove(guint source_id) {
+    g_assert(source_id != 0);
+
+    GMainContext *context = g_main_context_ref_thread_default();
+    GSource *source = g_main_context_find_source_by_id(context, source_id);
+    if (source != NULL) {
+        g_source_destroy(source);
+    }
+    g_main_context_unref(context);
+}
@@ -24,7 +24,8 @@
 #ifndef BINC_UTILITY_H
 #define BINC_UTILITY_H
 
-#include <glib.h>
+#include <gio/gio.h>
+#include "uuid.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,12 +43,37 @@ gboolean is_lowercase(const char *str);
 
 gboolean is_valid_uuid(const char *uuid);
 
+/**
+ * Parse a UUID in any form binc_uuid_parse accepts, logging a critical warning and clearing binary_uuid if invalid
+ */
+gboolean parse_uuid(const char *uuid, BincUuid *binary_uuid);
+
 char *path_to_address(const char *path);
 
 GByteArray *g_variant_get_byte_array(GVariant *variant);
 
 char* replace_char(char* str, char find, char replace);
 
+/**
+ * Like g_timeout_add, g_timeout_add_seconds and g_idle_add, but attached to the thread-default main context,
+ * so timers follow the context the library is used on, e.g. the worker of a Runtime
+ */
+guint binc_timeout_add(guint interval_ms, GSourceFunc function, gpointer data);
+
+guint binc_timeout_add_seconds(guint interval, GSourceFunc function, gpointer data);
+
+guint binc_idle_add(GSourceFunc function, gpointer data);
+
+/**
+ * Call function on the thread-default main context once cancellable is cancelled, from whichever thread cancels it
+ */
+guint binc_cancelled_add(GCancellable *cancellable, GCancellableSourceFunc function, gpointer data);
+
+/**
+ * Remove a source added by the functions above. Must be called on the thread-default context it was added to.
+ */
+void binc_source_remove(guint source_id);
+
 #ifdef __cplusplus
 }
 #endif
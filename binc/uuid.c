@@ -0,0 +1,141 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <string.h>
+#include "uuid.h"
+
+// 00000000-0000-1000-8000-00805f9b34fb
+static const guint8 base_uuid[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                     0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb};
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static gboolean parse_hex(const char *str, size_t length, guint32 *value) {
+    guint32 result = 0;
+    for (size_t i = 0; i < length; i++) {
+        int nibble = hex_value(str[i]);
+        if (nibble < 0) return FALSE;
+        result = (result << 4) | (guint32) nibble;
+    }
+    *value = result;
+    return TRUE;
+}
+
+void binc_uuid_from_uuid32(guint32 short_uuid, BincUuid *uuid) {
+    g_assert(uuid != NULL);
+
+    memcpy(uuid->bytes, base_uuid, sizeof(base_uuid));
+    uuid->bytes[0] = (guint8) (short_uuid >> 24);
+    uuid->bytes[1] = (guint8) (short_uuid >> 16);
+    uuid->bytes[2] = (guint8) (short_uuid >> 8);
+    uuid->bytes[3] = (guint8) short_uuid;
+}
+
+void binc_uuid_from_uuid16(guint16 short_uuid, BincUuid *uuid) {
+    binc_uuid_from_uuid32(short_uuid, uuid);
+}
+
+gboolean binc_uuid_parse(const char *str, BincUuid *uuid) {
+    g_assert(str != NULL);
+    g_assert(uuid != NULL);
+
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        str += 2;
+    }
+
+    size_t length = strlen(str);
+    if (length == 4 || length == 8) {
+        guint32 short_uuid = 0;
+        if (!parse_hex(str, length, &short_uuid)) return FALSE;
+        binc_uuid_from_uuid32(short_uuid, uuid);
+        return TRUE;
+    }
+
+    if (length != BINC_UUID_STRING_LENGTH - 1) return FALSE;
+
+    int byte_index = 0;
+    for (size_t i = 0; i < length;) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (str[i] != '-') return FALSE;
+            i++;
+            continue;
+        }
+
+        int high = hex_value(str[i]);
+        int low = hex_value(str[i + 1]);
+        if (high < 0 || low < 0) return FALSE;
+        uuid->bytes[byte_index++] = (guint8) ((high << 4) | low);
+        i += 2;
+    }
+    return TRUE;
+}
+
+void binc_uuid_format(const BincUuid *uuid, char *buffer) {
+    g_assert(uuid != NULL);
+    g_assert(buffer != NULL);
+
+    const char hex[] = "0123456789abcdef";
+    char *out = buffer;
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *out++ = '-';
+        }
+        *out++ = hex[uuid->bytes[i] >> 4];
+        *out++ = hex[uuid->bytes[i] & 0xF];
+    }
+    *out = '\0';
+}
+
+const char *binc_uuid_to_interned_string(const BincUuid *uuid) {
+    g_assert(uuid != NULL);
+
+    char buffer[BINC_UUID_STRING_LENGTH];
+    binc_uuid_format(uuid, buffer);
+    return g_intern_string(buffer);
+}
+
+gboolean binc_uuid_equal(gconstpointer uuid, gconstpointer other) {
+    g_assert(uuid != NULL);
+    g_assert(other != NULL);
+
+    return memcmp(((const BincUuid *) uuid)->bytes, ((const BincUuid *) other)->bytes, 16) == 0;
+}
+
+guint binc_uuid_hash(gconstpointer uuid) {
+    g_assert(uuid != NULL);
+
+    // SIG UUIDs only differ in the first 4 bytes, so mix all words to keep them apart
+    const guint8 *bytes = ((const BincUuid *) uuid)->bytes;
+    guint32 hash = 2166136261u;
+    for (int i = 0; i < 16; i += 4) {
+        guint32 word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 16777619u;
+    }
+    return hash;
+}
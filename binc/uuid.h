@@ -0,0 +1,72 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_UUID_H
+#define BINC_UUID_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BINC_UUID_STRING_LENGTH 37
+
+/**
+ * 128-bit UUID in binary form. Bytes are stored most significant first, in the same order as printed.
+ */
+typedef struct binc_uuid {
+    guint8 bytes[16];
+} BincUuid;
+
+/**
+ * Parse a UUID. Besides the full 128-bit form, 16-bit and 32-bit SIG short forms like '180d' or '0x180D' are
+ * accepted and expanded using the Bluetooth base UUID.
+ *
+ * @return TRUE if the string is a valid UUID
+ */
+gboolean binc_uuid_parse(const char *str, BincUuid *uuid);
+
+void binc_uuid_from_uuid16(guint16 short_uuid, BincUuid *uuid);
+
+void binc_uuid_from_uuid32(guint32 short_uuid, BincUuid *uuid);
+
+/**
+ * Format a UUID in lowercase 128-bit form into buffer, which must hold at least BINC_UUID_STRING_LENGTH bytes
+ */
+void binc_uuid_format(const BincUuid *uuid, char *buffer);
+
+/**
+ * Get the lowercase 128-bit form of a UUID as an interned string, shared by all users and never freed
+ */
+const char *binc_uuid_to_interned_string(const BincUuid *uuid);
+
+gboolean binc_uuid_equal(gconstpointer uuid, gconstpointer other);
+
+guint binc_uuid_hash(gconstpointer uuid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BINC_UUID_H
@@ -18,6 +18,7 @@
 #include "advertisement.h"
 #include "utility.h"
 #include "parser.h"
+#include "runtime.h"
 #include <termios.h>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -66,11 +67,12 @@
 char imei[IMEI_LENGTH + 1] = {0};
 int tty_fd = -1;
 GMainLoop *loop = NULL;
+Runtime *runtime = NULL;
 Adapter *default_adapter = NULL;
 Advertisement *advertisement = NULL;
 Application *app = NULL;
-static gboolean is_authenticated = FALSE;
-Device *connected_device = NULL;
+static gint is_authenticated = FALSE; // Shared with the CAN threads, use g_atomic_int_*
+Device *connected_device = NULL; // Only used on the runtime worker
 const canid_t monitored_can_ids[NUM_CAN_IDS] = {
     0x407, 0x520, 0x201, 0x306, 0x303, 0x305, 0x302, 0x322, 0x307, 0x100, 0x500
 };
@@ -162,7 +164,7 @@ void on_powered_state_changed(Adapter *adapter, gboolean state) {
 }
 
 void publish_is_authenticated() {
-    const char *value = is_authenticated ? "true" : "false";
+    const char *value = g_atomic_int_get(&is_authenticated) ? "true" : "false";
     GByteArray *byteArray = g_byte_array_new();
     g_byte_array_append(byteArray, (const guint8 *)value, strlen(value));
     //binc_application_set_char_value(app, AUTH_SERVICE_UUID, IS_AUTHENTICATED_CHAR_UUID, byteArray);
@@ -179,7 +181,9 @@ gboolean publish_is_authenticated_periodically(gpointer user_data) {
 void publish_tcu_info() {
     // Format the TCU info as IMEI,DeviceID
     char tcu_info[IMEI_LENGTH + 2 + strlen(device_id_global)]; // IMEI + comma + DeviceID
+    pthread_mutex_lock(&can_data_mutex);
     snprintf(tcu_info, sizeof(tcu_info), "%s,%s", imei, device_id_global);
+    pthread_mutex_unlock(&can_data_mutex);
 
     // Convert the tcu_info to a byte array for publication
     GByteArray *byteArray = g_byte_array_new();
@@ -210,7 +214,7 @@ void on_central_state_changed(Adapter *adapter, Device *device) {
     ConnectionState state = binc_device_get_connection_state(device);
     if (state == BINC_CONNECTED) {
         binc_adapter_stop_advertising(adapter, advertisement);
-		is_authenticated = FALSE;
+		g_atomic_int_set(&is_authenticated, FALSE);
     } else if (state == BINC_DISCONNECTED){
         binc_adapter_start_advertising(adapter, advertisement);
     }
@@ -222,7 +226,7 @@ const char *on_local_char_read(const Application *application, const char *addre
     log_debug(TAG, "on char read");
 
     if (g_str_equal(service_uuid, AUTH_SERVICE_UUID) && g_str_equal(char_uuid, IS_AUTHENTICATED_CHAR_UUID)) {
-        const char *value = is_authenticated ? "true" : "false";
+        const char *value = g_atomic_int_get(&is_authenticated) ? "true" : "false";
         GByteArray *byteArray = g_byte_array_new();
         log_debug(TAG, "calling g_byte_array_append");
         g_byte_array_append(byteArray, (const guint8 *)value, strlen(value));
@@ -231,7 +235,7 @@ const char *on_local_char_read(const Application *application, const char *addre
         return NULL;
     }
 
-    if (!is_authenticated) {
+    if (!g_atomic_int_get(&is_authenticated)) {
         log_info(TAG, "Read request rejected: Authentication required");
         return BLUEZ_ERROR_AUTHORIZATION_FAILED;
     }
@@ -292,7 +296,7 @@ const char *on_local_char_write(const Application *application, const char *addr
         log_debug(TAG, "Received password: 0x%06x", received_password);
 
         if (received_password == DEFAULT_PASSWORD) {
-            is_authenticated = TRUE;
+            g_atomic_int_set(&is_authenticated, TRUE);
 
             // Write "true" to IS_AUTHENTICATED_CHAR_UUID
             //const uint8_t yes_value[] = {'t', 'r', 'u', 'e'};
@@ -308,13 +312,13 @@ const char *on_local_char_write(const Application *application, const char *addr
         } else {
             log_error(TAG, "Authentication failed, received password: 0x%06x", received_password);
             // Disconnect the device
-            is_authenticated = FALSE;
+            g_atomic_int_set(&is_authenticated, FALSE);
             binc_device_disconnect(connected_device);
             return BLUEZ_ERROR_AUTHORIZATION_FAILED;
         }
     }
 
-    if (!is_authenticated) {
+    if (!g_atomic_int_get(&is_authenticated)) {
         log_info(TAG, "Write request rejected: Authentication required");
         return BLUEZ_ERROR_AUTHORIZATION_FAILED;
     }
@@ -348,7 +352,8 @@ void on_local_char_stop_notify(const Application *application, const char *servi
     log_debug(TAG, "on stop notify");
 }
 
-gboolean callback(gpointer data) {
+// Runs on the runtime worker, which owns all library objects
+static void teardown_bluetooth(gpointer user_data) {
     if (app != NULL) {
         binc_adapter_unregister_application(default_adapter, app);
         binc_application_free(app);
@@ -358,12 +363,17 @@ gboolean callback(gpointer data) {
     if (advertisement != NULL) {
         binc_adapter_stop_advertising(default_adapter, advertisement);
         binc_advertisement_free(advertisement);
+        advertisement = NULL;
     }
 
     if (default_adapter != NULL) {
         binc_adapter_free(default_adapter);
         default_adapter = NULL;
     }
+}
+
+gboolean callback(gpointer data) {
+    binc_runtime_invoke_sync(runtime, teardown_bluetooth, NULL);
 
     g_main_loop_quit((GMainLoop *) data);
     return FALSE;
@@ -373,21 +383,7 @@ static void cleanup_handler(int signo) {
     if (signo == SIGINT) {
         log_error(TAG, "received SIGINT, performing graceful shutdown");
 
-        if (app != NULL) {
-            binc_adapter_unregister_application(default_adapter, app);
-            binc_application_free(app);
-            app = NULL;
-        }
-
-        if (advertisement != NULL) {
-            binc_adapter_stop_advertising(default_adapter, advertisement);
-            binc_advertisement_free(advertisement);
-        }
-
-        if (default_adapter != NULL) {
-            binc_adapter_free(default_adapter);
-            default_adapter = NULL;
-        }
+        binc_runtime_invoke_sync(runtime, teardown_bluetooth, NULL);
 
         if (tty_fd != -1) {
             close(tty_fd);
@@ -476,7 +472,7 @@ void *can_read_thread(void *arg) {
     			}
 			}
 
-            if (is_authenticated) {
+            if (g_atomic_int_get(&is_authenticated)) {
                 // Update the global can_data buffer
                 memset(can_data, 0, CAN_DATA_LEN);  // Clear buffer
                 for (int i = 0; i < NUM_CAN_IDS; i++) {
@@ -515,7 +511,7 @@ void *can_write_thread(void *arg) {
     while (1) {
         sleep(write_interval);
         
-        if (is_authenticated) {
+        if (g_atomic_int_get(&is_authenticated)) {
             pthread_mutex_lock(&can_data_mutex);
             GByteArray *byteArray = g_byte_array_new();
             g_byte_array_append(byteArray, can_data, CAN_DATA_LEN);
@@ -569,6 +565,52 @@ void *read_imei_thread(void *arg) {
     return NULL;
 }
 
+// Runs on the runtime worker so that all D-Bus signals and method calls of the library are handled there
+static void setup_bluetooth(gpointer user_data) {
+    GDBusConnection *dbusConnection = (GDBusConnection *) user_data;
+
+    // Get the default adapter
+    default_adapter = binc_adapter_get_default(dbusConnection);
+    if (default_adapter == NULL) {
+        return;
+    }
+
+    log_debug(TAG, "using adapter '%s'", binc_adapter_get_path(default_adapter));
+
+    // Make sure the adapter is on
+    binc_adapter_set_powered_state_cb(default_adapter, &on_powered_state_changed);
+    if (!binc_adapter_get_powered_state(default_adapter)) {
+        binc_adapter_power_on(default_adapter);
+    }
+
+    // Setup remote central connection state callback
+    binc_adapter_set_remote_central_cb(default_adapter, &on_central_state_changed);
+
+    // Setup advertisement
+    GPtrArray *adv_service_uuids = g_ptr_array_new();
+    g_ptr_array_add(adv_service_uuids, VEHICLE_SERVICE_UUID);
+    g_ptr_array_add(adv_service_uuids, AUTH_SERVICE_UUID);
+
+    advertisement = binc_advertisement_create();
+    binc_advertisement_set_local_name(advertisement, "LxG_iWave_1");
+    binc_advertisement_set_services(advertisement, adv_service_uuids);
+    g_ptr_array_free(adv_service_uuids, TRUE);
+    binc_adapter_start_advertising(default_adapter, advertisement);
+
+    // Start application
+    app = binc_create_application(default_adapter);
+
+    // Install services
+    ble_install_auth_service();
+    ble_install_vehicle_service();
+
+    binc_application_set_char_read_cb(app, &on_local_char_read);
+    binc_application_set_char_write_cb(app, &on_local_char_write);
+    binc_application_set_char_start_notify_cb(app, &on_local_char_start_notify);
+    binc_application_set_char_stop_notify_cb(app, &on_local_char_stop_notify);
+    binc_adapter_register_application(default_adapter, app);
+}
+
 int main(void) {
 
     log_set_level(LOG_DEBUG);
@@ -586,45 +628,11 @@ int main(void) {
     // Setup mainloop
     loop = g_main_loop_new(NULL, FALSE);
 
-    // Get the default adapter
-    default_adapter = binc_adapter_get_default(dbusConnection);
+    // Let the library run on its own thread, binc_application_notify can then be called from any thread
+    runtime = binc_runtime_create();
+    binc_runtime_invoke_sync(runtime, setup_bluetooth, dbusConnection);
 
     if (default_adapter != NULL) {
-        log_debug(TAG, "using adapter '%s'", binc_adapter_get_path(default_adapter));
-
-        // Make sure the adapter is on
-        binc_adapter_set_powered_state_cb(default_adapter, &on_powered_state_changed);
-        if (!binc_adapter_get_powered_state(default_adapter)) {
-            binc_adapter_power_on(default_adapter);
-        }
-
-        // Setup remote central connection state callback
-        binc_adapter_set_remote_central_cb(default_adapter, &on_central_state_changed);
-
-        // Setup advertisement
-        GPtrArray *adv_service_uuids = g_ptr_array_new();
-        g_ptr_array_add(adv_service_uuids, VEHICLE_SERVICE_UUID);
-        g_ptr_array_add(adv_service_uuids, AUTH_SERVICE_UUID);
-
-        advertisement = binc_advertisement_create();
-        binc_advertisement_set_local_name(advertisement, "LxG_iWave_1");
-        binc_advertisement_set_services(advertisement, adv_service_uuids);
-        g_ptr_array_free(adv_service_uuids, TRUE);
-        binc_adapter_start_advertising(default_adapter, advertisement);
-
-        // Start application
-        app = binc_create_application(default_adapter);
-
-        // Install services
-        ble_install_auth_service();
-        ble_install_vehicle_service();
-
-        binc_application_set_char_read_cb(app, &on_local_char_read);
-        binc_application_set_char_write_cb(app, &on_local_char_write);
-        binc_application_set_char_start_notify_cb(app, &on_local_char_start_notify);
-        binc_application_set_char_stop_notify_cb(app, &on_local_char_stop_notify);
-        binc_adapter_register_application(default_adapter, app);
-
         // Create CAN read thread
         pthread_t can_read_tid;
         pthread_create(&can_read_tid, NULL, can_read_thread, NULL);
@@ -653,8 +661,9 @@ int main(void) {
     // Start the mainloop
     g_main_loop_run(loop);
 
-    // Clean up mainloop
+    // Clean up mainloop and runtime
     g_main_loop_unref(loop);
+    binc_runtime_free(runtime);
 
     // Disconnect from DBus
     g_dbus_connection_close_sync(dbusConnection, NULL, NULL);
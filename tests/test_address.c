@@ -0,0 +1,86 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <glib.h>
+#include "address.h"
+
+static void test_parse(void) {
+    BincAddress address;
+    g_assert_true(binc_address_parse("C4:0a:1B:2c:3D:7E", BINC_ADDRESS_RANDOM, &address));
+    g_assert_cmpuint(address.bytes[0], ==, 0xC4);
+    g_assert_cmpuint(address.bytes[1], ==, 0x0A);
+    g_assert_cmpuint(address.bytes[5], ==, 0x7E);
+    g_assert_cmpint(address.type, ==, BINC_ADDRESS_RANDOM);
+
+    char buffer[BINC_ADDRESS_STRING_LENGTH];
+    binc_address_format(&address, buffer);
+    g_assert_cmpstr(buffer, ==, "C4:0A:1B:2C:3D:7E");
+}
+
+static void test_parse_invalid(void) {
+    BincAddress address;
+    g_assert_false(binc_address_parse("", BINC_ADDRESS_PUBLIC, &address));
+    g_assert_false(binc_address_parse("C4:0A:1B:2C:3D", BINC_ADDRESS_PUBLIC, &address));
+    g_assert_false(binc_address_parse("C4:0A:1B:2C:3D:7E:00", BINC_ADDRESS_PUBLIC, &address));
+    g_assert_false(binc_address_parse("C4-0A-1B-2C-3D-7E", BINC_ADDRESS_PUBLIC, &address));
+    g_assert_false(binc_address_parse("C4:0A:1B:2C:3D:7G", BINC_ADDRESS_PUBLIC, &address));
+}
+
+static void test_parse_path(void) {
+    BincAddress address, expected;
+    g_assert_true(binc_address_parse_path("/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E", BINC_ADDRESS_PUBLIC, &address));
+    g_assert_true(binc_address_parse("C4:0A:1B:2C:3D:7E", BINC_ADDRESS_PUBLIC, &expected));
+    g_assert_true(binc_address_equal(&address, &expected));
+
+    g_assert_false(binc_address_parse_path("/org/bluez/hci0", BINC_ADDRESS_PUBLIC, &address));
+    g_assert_false(binc_address_parse_path("/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E/service0001",
+                                           BINC_ADDRESS_PUBLIC, &address));
+    g_assert_false(binc_address_parse_path("/org/bluez/hci0/xyz_C4_0A_1B_2C_3D_7E", BINC_ADDRESS_PUBLIC, &address));
+}
+
+static void test_pack_and_equal(void) {
+    BincAddress public_address, random_address, other;
+    g_assert_true(binc_address_parse("C4:0A:1B:2C:3D:7E", BINC_ADDRESS_PUBLIC, &public_address));
+    g_assert_true(binc_address_parse("C4:0A:1B:2C:3D:7E", BINC_ADDRESS_RANDOM, &random_address));
+    g_assert_true(binc_address_parse("C4:0A:1B:2C:3D:7F", BINC_ADDRESS_PUBLIC, &other));
+
+    g_assert_cmpuint(binc_address_pack(&public_address), ==, G_GUINT64_CONSTANT(0xC40A1B2C3D7E));
+    g_assert_false(binc_address_equal(&public_address, &random_address));
+    g_assert_false(binc_address_equal(&public_address, &other));
+}
+
+static void test_type_from_string(void) {
+    g_assert_cmpint(binc_address_type_from_string("random"), ==, BINC_ADDRESS_RANDOM);
+    g_assert_cmpint(binc_address_type_from_string("public"), ==, BINC_ADDRESS_PUBLIC);
+    g_assert_cmpint(binc_address_type_from_string(""), ==, BINC_ADDRESS_PUBLIC);
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/address/parse", test_parse);
+    g_test_add_func("/address/parse-invalid", test_parse_invalid);
+    g_test_add_func("/address/parse-path", test_parse_path);
+    g_test_add_func("/address/pack-and-equal", test_pack_and_equal);
+    g_test_add_func("/address/type-from-string", test_type_from_string);
+    return g_test_run();
+}
@@ -0,0 +1,336 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <gio/gio.h>
+#include "adapter.h"
+#include "adapter_internal.h"
+#include "advertisement_monitor.h"
+#include "device.h"
+#include "test_bus.h"
+
+static const char *const ADAPTER_PATH = "/org/bluez/hci0";
+static const char *const DEVICE_PATH = "/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E";
+static const char *const INTERFACE_ADVERTISEMENT_MONITOR = "org.bluez.AdvertisementMonitor1";
+static const char *const INTERFACE_OBJECT_MANAGER = "org.freedesktop.DBus.ObjectManager";
+static const guint WAIT_TIMEOUT_MS = 5000;
+
+static const guint8 PATTERN_CONTENT[] = {0x4C, 0x00, 0x02};
+
+static const char *const bluez_xml =
+        "<node>"
+        "   <interface name='org.bluez.AdvertisementMonitorManager1'>"
+        "       <method name='RegisterMonitor'>"
+        "           <arg name='application' type='o' direction='in'/>"
+        "       </method>"
+        "       <method name='UnregisterMonitor'>"
+        "           <arg name='application' type='o' direction='in'/>"
+        "       </method>"
+        "   </interface>"
+        "   <interface name='org.bluez.Device1'>"
+        "       <property name='Address' type='s' access='read'/>"
+        "       <property name='Name' type='s' access='read'/>"
+        "   </interface>"
+        "</node>";
+
+/**
+ * Stub of the BlueZ side: reads the registered monitor like BlueZ does, then activates it and reports a device
+ */
+typedef struct fixture {
+    GDBusConnection *bluez;
+    GDBusConnection *client;
+    GDBusNodeInfo *info;
+    guint registrations[2];
+    Adapter *adapter;
+    AdvertisementMonitor *monitor;
+    char *application; // Unique name of the registering client
+    char *root_path;
+    GVariant *monitor_properties;
+    guint events;
+    guint activated;
+    guint released;
+    guint found;
+    guint lost;
+    char *found_path;
+    char *lost_path;
+} Fixture;
+
+static void call_monitor(Fixture *fixture, const char *method, GVariant *parameters, GAsyncReadyCallback callback);
+
+static void device_lost_reply_cb(GObject *source_object, GAsyncResult *res, __attribute__((unused)) gpointer user_data) {
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    g_assert_no_error(error);
+    g_variant_unref(result);
+}
+
+static void device_found_reply_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    g_assert_no_error(error);
+    g_variant_unref(result);
+
+    call_monitor((Fixture *) user_data, "DeviceLost", g_variant_new("(o)", DEVICE_PATH), device_lost_reply_cb);
+}
+
+static void activate_reply_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    g_assert_no_error(error);
+    g_variant_unref(result);
+
+    call_monitor((Fixture *) user_data, "DeviceFound", g_variant_new("(o)", DEVICE_PATH), device_found_reply_cb);
+}
+
+static void get_managed_objects_reply_cb(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+    Fixture *fixture = (Fixture *) user_data;
+
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish((GDBusConnection *) source_object, res, &error);
+    g_assert_no_error(error);
+
+    GVariant *objects = g_variant_get_child_value(result, 0);
+    g_assert_cmpuint(g_variant_n_children(objects), ==, 1);
+    GVariant *interfaces = g_variant_lookup_value(objects, binc_advertisement_monitor_get_path(fixture->monitor),
+                                                  G_VARIANT_TYPE("a{sa{sv}}"));
+    g_assert_nonnull(interfaces);
+    fixture->monitor_properties = g_variant_lookup_value(interfaces, INTERFACE_ADVERTISEMENT_MONITOR,
+                                                         G_VARIANT_TYPE("a{sv}"));
+    g_assert_nonnull(fixture->monitor_properties);
+    g_variant_unref(interfaces);
+    g_variant_unref(objects);
+    g_variant_unref(result);
+
+    call_monitor(fixture, "Activate", NULL, activate_reply_cb);
+}
+
+static void call_monitor(Fixture *fixture, const char *method, GVariant *parameters, GAsyncReadyCallback callback) {
+    g_dbus_connection_call(fixture->bluez,
+                           fixture->application,
+                           binc_advertisement_monitor_get_path(fixture->monitor),
+                           INTERFACE_ADVERTISEMENT_MONITOR,
+                           method,
+                           parameters,
+                           NULL,
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           NULL,
+                           callback,
+                           fixture);
+}
+
+static void stub_method_call(__attribute__((unused)) GDBusConnection *connection,
+                             const gchar *sender,
+                             __attribute__((unused)) const gchar *object_path,
+                             __attribute__((unused)) const gchar *interface_name,
+                             const gchar *method_name,
+                             GVariant *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer user_data) {
+    Fixture *fixture = (Fixture *) user_data;
+
+    if (g_str_equal(method_name, "RegisterMonitor")) {
+        g_free(fixture->application);
+        g_free(fixture->root_path);
+        fixture->application = g_strdup(sender);
+        g_variant_get(parameters, "(o)", &fixture->root_path);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+
+        g_dbus_connection_call(fixture->bluez,
+                               fixture->application,
+                               fixture->root_path,
+                               INTERFACE_OBJECT_MANAGER,
+                               "GetManagedObjects",
+                               NULL,
+                               G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                               G_DBUS_CALL_FLAGS_NONE,
+                               -1,
+                               NULL,
+                               get_managed_objects_reply_cb,
+                               fixture);
+    } else if (g_str_equal(method_name, "UnregisterMonitor")) {
+        g_dbus_method_invocation_return_value(invocation, NULL);
+        call_monitor(fixture, "Release", NULL, device_lost_reply_cb);
+    }
+}
+
+static GVariant *stub_get_property(__attribute__((unused)) GDBusConnection *connection,
+                                   __attribute__((unused)) const gchar *sender,
+                                   __attribute__((unused)) const gchar *object_path,
+                                   __attribute__((unused)) const gchar *interface_name,
+                                   const gchar *property_name,
+                                   __attribute__((unused)) GError **error,
+                                   __attribute__((unused)) gpointer user_data) {
+    if (g_str_equal(property_name, "Address")) {
+        return g_variant_new_string("C4:0A:1B:2C:3D:7E");
+    }
+    return g_variant_new_string("Stub");
+}
+
+static const GDBusInterfaceVTable stub_vtable = {
+        .method_call = stub_method_call,
+        .get_property = stub_get_property
+};
+
+static void on_state_changed(AdvertisementMonitor *monitor, gboolean active) {
+    Fixture *fixture = (Fixture *) binc_advertisement_monitor_get_user_data(monitor);
+    if (active) {
+        fixture->activated++;
+    } else {
+        fixture->released++;
+    }
+    fixture->events++;
+}
+
+static void on_device_found(AdvertisementMonitor *monitor, Device *device) {
+    Fixture *fixture = (Fixture *) binc_advertisement_monitor_get_user_data(monitor);
+    fixture->found++;
+    fixture->found_path = g_strdup(binc_device_get_path(device));
+    fixture->events++;
+}
+
+static void on_device_lost(AdvertisementMonitor *monitor, Device *device) {
+    Fixture *fixture = (Fixture *) binc_advertisement_monitor_get_user_data(monitor);
+    fixture->lost++;
+    fixture->lost_path = g_strdup(binc_device_get_path(device));
+    fixture->events++;
+}
+
+static void fixture_set_up(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->bluez = test_bus_connect();
+    test_bus_own_bluez(fixture->bluez);
+
+    GError *error = NULL;
+    fixture->info = g_dbus_node_info_new_for_xml(bluez_xml, &error);
+    g_assert_no_error(error);
+    fixture->registrations[0] = g_dbus_connection_register_object(fixture->bluez, ADAPTER_PATH,
+                                                                  fixture->info->interfaces[0], &stub_vtable,
+                                                                  fixture, NULL, &error);
+    g_assert_no_error(error);
+    fixture->registrations[1] = g_dbus_connection_register_object(fixture->bluez, DEVICE_PATH,
+                                                                  fixture->info->interfaces[1], &stub_vtable,
+                                                                  fixture, NULL, &error);
+    g_assert_no_error(error);
+
+    fixture->client = test_bus_connect();
+    fixture->adapter = binc_adapter_create(fixture->client, ADAPTER_PATH);
+    fixture->monitor = binc_advertisement_monitor_create(fixture->adapter);
+    binc_advertisement_monitor_set_user_data(fixture->monitor, fixture);
+    binc_advertisement_monitor_set_state_cb(fixture->monitor, on_state_changed);
+    binc_advertisement_monitor_set_device_found_cb(fixture->monitor, on_device_found);
+    binc_advertisement_monitor_set_device_lost_cb(fixture->monitor, on_device_lost);
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    binc_advertisement_monitor_free(fixture->monitor);
+    binc_adapter_free(fixture->adapter);
+    g_object_unref(fixture->client);
+
+    g_dbus_connection_unregister_object(fixture->bluez, fixture->registrations[0]);
+    g_dbus_connection_unregister_object(fixture->bluez, fixture->registrations[1]);
+    g_dbus_node_info_unref(fixture->info);
+    g_object_unref(fixture->bluez);
+
+    if (fixture->monitor_properties != NULL) {
+        g_variant_unref(fixture->monitor_properties);
+    }
+    g_free(fixture->application);
+    g_free(fixture->root_path);
+    g_free(fixture->found_path);
+    g_free(fixture->lost_path);
+}
+
+static void test_monitor_lifecycle(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    binc_advertisement_monitor_add_pattern(fixture->monitor, 0, BINC_AD_TYPE_MANUFACTURER_DATA,
+                                           PATTERN_CONTENT, sizeof(PATTERN_CONTENT));
+    binc_adapter_register_advertisement_monitor(fixture->adapter, fixture->monitor);
+
+    // Activate, DeviceFound and DeviceLost
+    g_assert_true(test_bus_wait_for_count(&fixture->events, 3, WAIT_TIMEOUT_MS));
+    g_assert_cmpstr(fixture->root_path, ==, binc_advertisement_monitor_get_root_path(fixture->monitor));
+    g_assert_cmpuint(fixture->activated, ==, 1);
+    g_assert_true(binc_advertisement_monitor_is_active(fixture->monitor));
+    g_assert_cmpuint(fixture->found, ==, 1);
+    g_assert_cmpstr(fixture->found_path, ==, DEVICE_PATH);
+    g_assert_cmpuint(fixture->lost, ==, 1);
+    g_assert_cmpstr(fixture->lost_path, ==, DEVICE_PATH);
+
+    // The found device went into the adapter's cache like a discovered one
+    g_assert_nonnull(binc_adapter_get_device_by_path(fixture->adapter, DEVICE_PATH));
+
+    binc_adapter_unregister_advertisement_monitor(fixture->adapter, fixture->monitor);
+    g_assert_true(test_bus_wait_for_count(&fixture->released, 1, WAIT_TIMEOUT_MS));
+    g_assert_false(binc_advertisement_monitor_is_active(fixture->monitor));
+}
+
+static void test_monitor_properties(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    binc_advertisement_monitor_add_pattern(fixture->monitor, 0, BINC_AD_TYPE_MANUFACTURER_DATA,
+                                           PATTERN_CONTENT, sizeof(PATTERN_CONTENT));
+    binc_advertisement_monitor_set_rssi(fixture->monitor, -60, 5, -80, 10, 0);
+    binc_adapter_register_advertisement_monitor(fixture->adapter, fixture->monitor);
+
+    // Let the stub finish its calls so none is left in flight at tear down
+    g_assert_true(test_bus_wait_for_count(&fixture->events, 3, WAIT_TIMEOUT_MS));
+
+    GVariant *properties = fixture->monitor_properties;
+    const char *type = NULL;
+    g_assert_true(g_variant_lookup(properties, "Type", "&s", &type));
+    g_assert_cmpstr(type, ==, "or_patterns");
+
+    gint16 high_threshold = 0;
+    gint16 low_threshold = 0;
+    g_assert_true(g_variant_lookup(properties, "RSSIHighThreshold", "n", &high_threshold));
+    g_assert_true(g_variant_lookup(properties, "RSSILowThreshold", "n", &low_threshold));
+    g_assert_cmpint(high_threshold, ==, -60);
+    g_assert_cmpint(low_threshold, ==, -80);
+
+    GVariant *patterns = g_variant_lookup_value(properties, "Patterns", G_VARIANT_TYPE("a(yyay)"));
+    g_assert_nonnull(patterns);
+    g_assert_cmpuint(g_variant_n_children(patterns), ==, 1);
+
+    guint8 start_position = 0xFF;
+    guint8 ad_type = 0;
+    GVariant *content = NULL;
+    g_variant_get_child(patterns, 0, "(yy@ay)", &start_position, &ad_type, &content);
+    g_assert_cmpuint(start_position, ==, 0);
+    g_assert_cmpuint(ad_type, ==, BINC_AD_TYPE_MANUFACTURER_DATA);
+
+    gsize length = 0;
+    const guint8 *bytes = g_variant_get_fixed_array(content, &length, sizeof(guint8));
+    g_assert_cmpmem(bytes, length, PATTERN_CONTENT, sizeof(PATTERN_CONTENT));
+    g_variant_unref(content);
+    g_variant_unref(patterns);
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+    test_bus_up();
+
+    g_test_add("/advertisement-monitor/lifecycle", Fixture, NULL,
+               fixture_set_up, test_monitor_lifecycle, fixture_tear_down);
+    g_test_add("/advertisement-monitor/properties", Fixture, NULL,
+               fixture_set_up, test_monitor_properties, fixture_tear_down);
+
+    int result = g_test_run();
+    test_bus_down();
+    return result;
+}
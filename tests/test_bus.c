@@ -0,0 +1,117 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include "test_bus.h"
+
+static const char *const BLUEZ_DBUS = "org.bluez";
+static const guint32 DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER = 1;
+
+static GTestDBus *test_bus = NULL;
+
+void test_bus_up(void) {
+    g_assert(test_bus == NULL);
+
+    test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_bus);
+}
+
+void test_bus_down(void) {
+    g_assert(test_bus != NULL);
+
+    g_test_dbus_down(test_bus);
+    g_object_unref(test_bus);
+    test_bus = NULL;
+}
+
+GDBusConnection *test_bus_connect(void) {
+    g_assert(test_bus != NULL);
+
+    GError *error = NULL;
+    GDBusConnection *connection = g_dbus_connection_new_for_address_sync(
+            g_test_dbus_get_bus_address(test_bus),
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+            NULL,
+            NULL,
+            &error);
+    g_assert_no_error(error);
+    return connection;
+}
+
+void test_bus_own_bluez(GDBusConnection *connection) {
+    g_assert(connection != NULL);
+
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_sync(connection,
+                                                   "org.freedesktop.DBus",
+                                                   "/org/freedesktop/DBus",
+                                                   "org.freedesktop.DBus",
+                                                   "RequestName",
+                                                   g_variant_new("(su)", BLUEZ_DBUS, 0),
+                                                   G_VARIANT_TYPE("(u)"),
+                                                   G_DBUS_CALL_FLAGS_NONE,
+                                                   -1,
+                                                   NULL,
+                                                   &error);
+    g_assert_no_error(error);
+
+    guint32 reply = 0;
+    g_variant_get(result, "(u)", &reply);
+    g_assert_cmpuint(reply, ==, DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER);
+    g_variant_unref(result);
+}
+
+static gboolean wait_timeout_cb(gpointer user_data) {
+    *(gboolean *) user_data = TRUE;
+    return G_SOURCE_REMOVE;
+}
+
+gboolean test_bus_wait_until(TestBusCondition condition, gpointer user_data, guint timeout_ms) {
+    g_assert(condition != NULL);
+
+    gboolean timed_out = FALSE;
+    guint timeout_id = g_timeout_add(timeout_ms, wait_timeout_cb, &timed_out);
+    while (!condition(user_data) && !timed_out) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    if (!timed_out) {
+        g_source_remove(timeout_id);
+    }
+    return condition(user_data);
+}
+
+typedef struct count_condition {
+    const guint *counter;
+    guint count;
+} CountCondition;
+
+static gboolean count_reached(gpointer user_data) {
+    CountCondition *condition = (CountCondition *) user_data;
+    return *condition->counter >= condition->count;
+}
+
+gboolean test_bus_wait_for_count(const guint *counter, guint count, guint timeout_ms) {
+    g_assert(counter != NULL);
+
+    CountCondition condition = {counter, count};
+    return test_bus_wait_until(count_reached, &condition, timeout_ms);
+}
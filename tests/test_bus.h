@@ -0,0 +1,62 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#ifndef BINC_TEST_BUS_H
+#define BINC_TEST_BUS_H
+
+#include <gio/gio.h>
+
+/**
+ * Start a private session bus for the tests of this process, needs dbus-daemon
+ */
+void test_bus_up(void);
+
+void test_bus_down(void);
+
+/**
+ * Open a new connection to the private bus. The caller owns the reference.
+ */
+GDBusConnection *test_bus_connect(void);
+
+/**
+ * Make connection the owner of org.bluez, so the calls the library makes to BlueZ reach the objects it exports
+ */
+void test_bus_own_bluez(GDBusConnection *connection);
+
+typedef gboolean (*TestBusCondition)(gpointer user_data);
+
+/**
+ * Iterate the default main context until condition returns TRUE or timeout_ms expires
+ *
+ * @return TRUE if the condition was met
+ */
+gboolean test_bus_wait_until(TestBusCondition condition, gpointer user_data, guint timeout_ms);
+
+/**
+ * Iterate the default main context until counter reaches count or timeout_ms expires
+ *
+ * @return TRUE if the count was reached
+ */
+gboolean test_bus_wait_for_count(const guint *counter, guint count, guint timeout_ms);
+
+#endif //BINC_TEST_BUS_H
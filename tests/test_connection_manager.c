@@ -0,0 +1,239 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <gio/gio.h>
+#include "adapter.h"
+#include "adapter_internal.h"
+#include "connection_manager.h"
+#include "device.h"
+#include "test_bus.h"
+
+static const char *const ADAPTER_PATH = "/org/bluez/hci0";
+static const char *const DEVICE_PATH = "/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E";
+static const char *const OTHER_DEVICE_PATH = "/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7F";
+static const guint SAMPLES = 200;
+static const guint ATTEMPT_TIMEOUT_MS = 100;
+static const guint CONNECT_FAILS_AFTER_DISCONNECT_MS = 50;
+static const guint WAIT_TIMEOUT_MS = 5000;
+
+static const char *const device_xml =
+        "<node>"
+        "   <interface name='org.bluez.Device1'>"
+        "       <method name='Connect'/>"
+        "       <method name='Disconnect'/>"
+        "       <property name='Address' type='s' access='read'/>"
+        "   </interface>"
+        "</node>";
+
+typedef struct fixture {
+    GDBusConnection *connection;
+    Adapter *adapter;
+    ConnectionManager *manager;
+
+    // Stub device whose Connect only fails some time after Disconnect was called, like BlueZ aborting a page
+    GDBusConnection *bluez;
+    GDBusNodeInfo *info;
+    guint registration;
+    guint other_registration;
+    GDBusMethodInvocation *pending_connect;
+    guint connects;
+    gint64 second_connect_at;
+    gint64 first_connect_failed_at;
+    guint gave_up;
+    guint connects_at_first_give_up;
+} Fixture;
+
+static void fixture_set_up(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->connection = test_bus_connect();
+    fixture->adapter = binc_adapter_create(fixture->connection, ADAPTER_PATH);
+    fixture->manager = binc_adapter_get_connection_manager(fixture->adapter);
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    binc_adapter_free(fixture->adapter);
+    g_object_unref(fixture->connection);
+
+    if (fixture->bluez != NULL) {
+        g_assert_null(fixture->pending_connect);
+        g_dbus_connection_unregister_object(fixture->bluez, fixture->registration);
+        g_dbus_connection_unregister_object(fixture->bluez, fixture->other_registration);
+        g_dbus_node_info_unref(fixture->info);
+        g_object_unref(fixture->bluez);
+    }
+}
+
+static gboolean fail_pending_connect(gpointer user_data) {
+    Fixture *fixture = (Fixture *) user_data;
+    if (fixture->first_connect_failed_at == 0) {
+        fixture->first_connect_failed_at = g_get_monotonic_time();
+    }
+    g_dbus_method_invocation_return_dbus_error(fixture->pending_connect, "org.bluez.Error.Failed", "Page Timeout");
+    fixture->pending_connect = NULL;
+    return G_SOURCE_REMOVE;
+}
+
+static void stub_method_call(__attribute__((unused)) GDBusConnection *connection,
+                             __attribute__((unused)) const gchar *sender,
+                             __attribute__((unused)) const gchar *object_path,
+                             __attribute__((unused)) const gchar *interface_name,
+                             const gchar *method_name,
+                             __attribute__((unused)) GVariant *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer user_data) {
+    Fixture *fixture = (Fixture *) user_data;
+
+    if (g_str_equal(method_name, "Connect")) {
+        g_assert_null(fixture->pending_connect);
+        fixture->connects++;
+        if (fixture->connects == 2) {
+            fixture->second_connect_at = g_get_monotonic_time();
+        }
+        fixture->pending_connect = invocation;
+    } else {
+        g_dbus_method_invocation_return_value(invocation, NULL);
+        if (fixture->pending_connect != NULL) {
+            g_timeout_add(CONNECT_FAILS_AFTER_DISCONNECT_MS, fail_pending_connect, fixture);
+        }
+    }
+}
+
+static GVariant *stub_get_property(__attribute__((unused)) GDBusConnection *connection,
+                                   __attribute__((unused)) const gchar *sender,
+                                   const gchar *object_path,
+                                   __attribute__((unused)) const gchar *interface_name,
+                                   __attribute__((unused)) const gchar *property_name,
+                                   __attribute__((unused)) GError **error,
+                                   __attribute__((unused)) gpointer user_data) {
+    return g_variant_new_string(g_str_equal(object_path, DEVICE_PATH) ? "C4:0A:1B:2C:3D:7E" : "C4:0A:1B:2C:3D:7F");
+}
+
+static const GDBusInterfaceVTable stub_vtable = {
+        .method_call = stub_method_call,
+        .get_property = stub_get_property
+};
+
+static void on_gave_up(ConnectionManager *manager, __attribute__((unused)) Device *device,
+                       __attribute__((unused)) guint attempts) {
+    Fixture *fixture = (Fixture *) binc_adapter_get_user_data(binc_connection_manager_get_adapter(manager));
+    if (fixture->gave_up++ == 0) {
+        fixture->connects_at_first_give_up = fixture->connects;
+    }
+}
+
+static void assert_delay_between(const ConnectionManager *manager, guint attempts, guint min_ms, guint max_ms) {
+    guint lowest = G_MAXUINT;
+    guint highest = 0;
+    for (guint i = 0; i < SAMPLES; i++) {
+        guint delay = binc_internal_connection_manager_backoff_delay(manager, attempts);
+        g_assert_cmpuint(delay, >=, min_ms);
+        g_assert_cmpuint(delay, <=, max_ms);
+        lowest = MIN(lowest, delay);
+        highest = MAX(highest, delay);
+    }
+
+    // Randomized so devices that failed together don't retry together
+    g_assert_cmpuint(lowest, <, highest);
+}
+
+static void test_backoff_doubles(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    binc_connection_manager_set_retry_policy(fixture->manager, 0, 100, 10000);
+
+    assert_delay_between(fixture->manager, 1, 50, 100);
+    assert_delay_between(fixture->manager, 2, 100, 200);
+    assert_delay_between(fixture->manager, 3, 200, 400);
+    assert_delay_between(fixture->manager, 4, 400, 800);
+}
+
+static void test_backoff_is_capped(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    binc_connection_manager_set_retry_policy(fixture->manager, 0, 100, 1000);
+
+    assert_delay_between(fixture->manager, 4, 400, 800);
+    assert_delay_between(fixture->manager, 5, 500, 1000);
+    assert_delay_between(fixture->manager, 10, 500, 1000);
+    assert_delay_between(fixture->manager, 1000, 500, 1000);
+}
+
+static void test_retry_waits_for_aborted_attempt(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->bluez = test_bus_connect();
+    test_bus_own_bluez(fixture->bluez);
+
+    GError *error = NULL;
+    fixture->info = g_dbus_node_info_new_for_xml(device_xml, &error);
+    g_assert_no_error(error);
+    fixture->registration = g_dbus_connection_register_object(fixture->bluez, DEVICE_PATH,
+                                                              fixture->info->interfaces[0], &stub_vtable,
+                                                              fixture, NULL, &error);
+    g_assert_no_error(error);
+    fixture->other_registration = g_dbus_connection_register_object(fixture->bluez, OTHER_DEVICE_PATH,
+                                                                    fixture->info->interfaces[0], &stub_vtable,
+                                                                    fixture, NULL, &error);
+    g_assert_no_error(error);
+
+    binc_adapter_set_user_data(fixture->adapter, fixture);
+    binc_connection_manager_set_attempt_timeout(fixture->manager, ATTEMPT_TIMEOUT_MS);
+    binc_connection_manager_set_retry_policy(fixture->manager, 2, 10, 20);
+    binc_connection_manager_set_gave_up_cb(fixture->manager, on_gave_up);
+    binc_connection_manager_set_max_in_flight(fixture->manager, 1);
+
+    Device *device = binc_internal_adapter_find_or_load_device(fixture->adapter, DEVICE_PATH);
+    Device *other_device = binc_internal_adapter_find_or_load_device(fixture->adapter, OTHER_DEVICE_PATH);
+    binc_connection_manager_connect(fixture->manager, device, 1);
+    binc_connection_manager_connect(fixture->manager, other_device, 0);
+    g_assert_true(test_bus_wait_for_count(&fixture->gave_up, 1, WAIT_TIMEOUT_MS));
+    g_assert_false(binc_connection_manager_is_pending(fixture->manager, device));
+
+    // The backoff is far shorter than aborting takes, still the retry only started after the first Connect ended
+    g_assert_cmpuint(fixture->connects_at_first_give_up, ==, 2);
+    g_assert_cmpint(fixture->second_connect_at, >=, fixture->first_connect_failed_at);
+
+    // Giving up released the slot, so the queued device gets its attempts too
+    g_assert_true(test_bus_wait_for_count(&fixture->gave_up, 2, WAIT_TIMEOUT_MS));
+    g_assert_cmpuint(fixture->connects, ==, 4);
+
+    // Each attempt is charged once
+    ConnectionManagerStats stats;
+    binc_connection_manager_get_stats(fixture->manager, &stats);
+    g_assert_cmpuint(stats.attempts, ==, 4);
+    g_assert_cmpuint(stats.timeouts, ==, 4);
+    g_assert_cmpuint(stats.attempt_failures, ==, 4);
+    g_assert_cmpuint(stats.gave_up, ==, 2);
+    g_assert_cmpuint(stats.waiting, ==, 0);
+    g_assert_cmpuint(stats.in_flight, ==, 0);
+    g_assert_cmpuint(stats.backing_off, ==, 0);
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+    test_bus_up();
+
+    g_test_add("/connection-manager/backoff-doubles", Fixture, NULL,
+               fixture_set_up, test_backoff_doubles, fixture_tear_down);
+    g_test_add("/connection-manager/backoff-is-capped", Fixture, NULL,
+               fixture_set_up, test_backoff_is_capped, fixture_tear_down);
+    g_test_add("/connection-manager/retry-waits-for-aborted-attempt", Fixture, NULL,
+               fixture_set_up, test_retry_waits_for_aborted_attempt, fixture_tear_down);
+
+    int result = g_test_run();
+    test_bus_down();
+    return result;
+}
@@ -0,0 +1,313 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include "adapter.h"
+#include "adapter_internal.h"
+#include "device_snapshot.h"
+#include "signal_dispatcher.h"
+#include "test_bus.h"
+
+static const char *const ADAPTER_PATH = "/org/bluez/hci0";
+static const char *const DEVICE_PATH = "/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E";
+static const guint WAIT_TIMEOUT_MS = 5000;
+
+static const char *const object_manager_xml =
+        "<node>"
+        "   <interface name='org.freedesktop.DBus.ObjectManager'>"
+        "       <method name='GetManagedObjects'>"
+        "           <arg name='objects' type='a{oa{sa{sv}}}' direction='out'/>"
+        "       </method>"
+        "   </interface>"
+        "</node>";
+
+typedef struct fixture {
+    GDBusConnection *connection;
+    Adapter *adapter;
+    GByteArray *snapshot;
+    char *filename;
+
+    // Stub BlueZ object tree and an adapter that seeds its mirror from it
+    GDBusConnection *bluez;
+    GDBusNodeInfo *info;
+    guint registration;
+    GVariant *objects;
+    GDBusConnection *client;
+    Adapter *client_adapter;
+} Fixture;
+
+static void put_u16(GByteArray *out, guint16 value) {
+    guint16 le = GUINT16_TO_LE(value);
+    g_byte_array_append(out, (const guint8 *) &le, sizeof(le));
+}
+
+static void put_u32(GByteArray *out, guint32 value) {
+    guint32 le = GUINT32_TO_LE(value);
+    g_byte_array_append(out, (const guint8 *) &le, sizeof(le));
+}
+
+static void put_string(GByteArray *out, const char *value) {
+    put_u16(out, (guint16) strlen(value));
+    g_byte_array_append(out, (const guint8 *) value, (guint) strlen(value));
+}
+
+/**
+ * Build a snapshot with one device by hand, following the documented layout
+ */
+static GByteArray *create_snapshot(void) {
+    GByteArray *out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8 *) "BINCDEVS", 8);
+    put_u16(out, 1);
+    put_u16(out, 0);
+    put_u32(out, 1);
+
+    GByteArray *record = g_byte_array_new();
+    const guint8 address[] = {0xC4, 0x0A, 0x1B, 0x2C, 0x3D, 0x7E};
+    g_byte_array_append(record, address, sizeof(address));
+    const guint8 type_flags_bonding[] = {BINC_ADDRESS_RANDOM, 0x03, BINC_BONDED};
+    g_byte_array_append(record, type_flags_bonding, sizeof(type_flags_bonding));
+    put_u16(record, (guint16) -60);
+    put_u16(record, 4);
+    put_string(record, "Sensor");
+    put_string(record, "Kitchen");
+
+    BincUuid uuid;
+    put_u16(record, 1);
+    binc_uuid_parse("180d", &uuid);
+    g_byte_array_append(record, uuid.bytes, sizeof(uuid.bytes));
+
+    const guint8 manufacturer_payload[] = {0x01, 0x02, 0x03};
+    put_u16(record, 1);
+    put_u16(record, 0x004C);
+    put_u16(record, sizeof(manufacturer_payload));
+    g_byte_array_append(record, manufacturer_payload, sizeof(manufacturer_payload));
+
+    const guint8 service_payload[] = {0xAA, 0xBB};
+    put_u16(record, 1);
+    binc_uuid_parse("feaa", &uuid);
+    g_byte_array_append(record, uuid.bytes, sizeof(uuid.bytes));
+    put_u16(record, sizeof(service_payload));
+    g_byte_array_append(record, service_payload, sizeof(service_payload));
+
+    put_u32(out, record->len);
+    g_byte_array_append(out, record->data, record->len);
+    g_byte_array_free(record, TRUE);
+    return out;
+}
+
+static void fixture_set_up(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->connection = test_bus_connect();
+    fixture->adapter = binc_adapter_create(fixture->connection, ADAPTER_PATH);
+    fixture->snapshot = create_snapshot();
+
+    GError *error = NULL;
+    int fd = g_file_open_tmp("binc-snapshot-XXXXXX", &fixture->filename, &error);
+    g_assert_no_error(error);
+    g_close(fd, NULL);
+    g_file_set_contents(fixture->filename, (const gchar *) fixture->snapshot->data, fixture->snapshot->len, &error);
+    g_assert_no_error(error);
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    if (fixture->client_adapter != NULL) {
+        binc_adapter_free(fixture->client_adapter);
+        g_object_unref(fixture->client);
+        g_dbus_connection_unregister_object(fixture->bluez, fixture->registration);
+        g_dbus_node_info_unref(fixture->info);
+        g_variant_unref(fixture->objects);
+        g_object_unref(fixture->bluez);
+    }
+    g_remove(fixture->filename);
+    g_free(fixture->filename);
+    g_byte_array_free(fixture->snapshot, TRUE);
+    binc_adapter_free(fixture->adapter);
+    g_object_unref(fixture->connection);
+}
+
+static void count_record(__attribute__((unused)) const char *path,
+                         __attribute__((unused)) GVariant *properties,
+                         __attribute__((unused)) BondingState bonding_state,
+                         gpointer user_data) {
+    (*(guint *) user_data)++;
+}
+
+static void stub_method_call(__attribute__((unused)) GDBusConnection *connection,
+                             __attribute__((unused)) const gchar *sender,
+                             __attribute__((unused)) const gchar *object_path,
+                             __attribute__((unused)) const gchar *interface_name,
+                             __attribute__((unused)) const gchar *method_name,
+                             __attribute__((unused)) GVariant *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer user_data) {
+    Fixture *fixture = (Fixture *) user_data;
+    g_dbus_method_invocation_return_value(invocation, g_variant_new_tuple(&fixture->objects, 1));
+}
+
+static const GDBusInterfaceVTable stub_vtable = {
+        .method_call = stub_method_call
+};
+
+/**
+ * Let a stub own org.bluez and serve objects from GetManagedObjects, then create an adapter on a new connection
+ */
+static void start_stub_bluez(Fixture *fixture, GVariant *objects) {
+    fixture->objects = g_variant_ref_sink(objects);
+    fixture->bluez = test_bus_connect();
+    test_bus_own_bluez(fixture->bluez);
+
+    GError *error = NULL;
+    fixture->info = g_dbus_node_info_new_for_xml(object_manager_xml, &error);
+    g_assert_no_error(error);
+    fixture->registration = g_dbus_connection_register_object(fixture->bluez, "/", fixture->info->interfaces[0],
+                                                              &stub_vtable, fixture, NULL, &error);
+    g_assert_no_error(error);
+
+    fixture->client = test_bus_connect();
+    fixture->client_adapter = binc_adapter_create(fixture->client, ADAPTER_PATH);
+}
+
+static gboolean is_seeded(gpointer user_data) {
+    Fixture *fixture = (Fixture *) user_data;
+    return binc_signal_dispatcher_get_object_tree(fixture->client) != NULL;
+}
+
+static void test_restore(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    g_assert_cmpint(binc_adapter_load_device_cache(fixture->adapter, fixture->filename), ==, 1);
+
+    Device *device = binc_adapter_get_device_by_path(fixture->adapter, DEVICE_PATH);
+    g_assert_nonnull(device);
+    g_assert_true(binc_device_is_restored(device));
+    g_assert_cmpstr(binc_device_get_address(device), ==, "C4:0A:1B:2C:3D:7E");
+    g_assert_cmpstr(binc_device_get_address_type(device), ==, "random");
+    g_assert_cmpstr(binc_device_get_name(device), ==, "Sensor");
+    g_assert_cmpstr(binc_device_get_alias(device), ==, "Kitchen");
+    g_assert_cmpint(binc_device_get_rssi(device), ==, -60);
+    g_assert_cmpint(binc_device_get_txpower(device), ==, 4);
+    g_assert_true(binc_device_get_paired(device));
+    g_assert_true(binc_device_get_trusted(device));
+    g_assert_cmpint(binc_device_get_bonding_state(device), ==, BINC_BONDED);
+    g_assert_true(binc_device_has_service(device, "180d"));
+
+    GHashTable *manufacturer_data = binc_device_get_manufacturer_data(device);
+    g_assert_nonnull(manufacturer_data);
+    int company_id = 0x004C;
+    GByteArray *payload = g_hash_table_lookup(manufacturer_data, &company_id);
+    g_assert_nonnull(payload);
+    g_assert_cmpuint(payload->len, ==, 3);
+    g_assert_cmpuint(payload->data[2], ==, 0x03);
+
+    GHashTable *service_data = binc_device_get_service_data(device);
+    g_assert_nonnull(service_data);
+    payload = g_hash_table_lookup(service_data, "0000feaa-0000-1000-8000-00805f9b34fb");
+    g_assert_nonnull(payload);
+    g_assert_cmpuint(payload->len, ==, 2);
+}
+
+static void test_drops_unknown(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    start_stub_bluez(fixture, g_variant_new_array(G_VARIANT_TYPE("{oa{sa{sv}}}"), NULL, 0));
+
+    // Restored before the mirror is seeded, so the device is only dropped once it is
+    g_assert_cmpint(binc_adapter_load_device_cache(fixture->client_adapter, fixture->filename), ==, 1);
+    g_assert_nonnull(binc_adapter_get_device_by_path(fixture->client_adapter, DEVICE_PATH));
+
+    g_assert_true(test_bus_wait_until(is_seeded, fixture, WAIT_TIMEOUT_MS));
+    g_assert_null(binc_adapter_get_device_by_path(fixture->client_adapter, DEVICE_PATH));
+
+    // Once seeded, devices unknown to BlueZ are not restored at all
+    g_assert_cmpint(binc_adapter_load_device_cache(fixture->client_adapter, fixture->filename), ==, 1);
+    g_assert_null(binc_adapter_get_device_by_path(fixture->client_adapter, DEVICE_PATH));
+}
+
+static void test_reconciles_known(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    GVariant *objects = g_variant_parse(G_VARIANT_TYPE("a{oa{sa{sv}}}"),
+                                        "{objectpath '/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E': "
+                                        "{'org.bluez.Device1': {'Address': <'C4:0A:1B:2C:3D:7E'>, 'Name': <'Live'>}}}",
+                                        NULL, NULL, NULL);
+    g_assert_nonnull(objects);
+    start_stub_bluez(fixture, objects);
+
+    g_assert_cmpint(binc_adapter_load_device_cache(fixture->client_adapter, fixture->filename), ==, 1);
+    g_assert_true(test_bus_wait_until(is_seeded, fixture, WAIT_TIMEOUT_MS));
+
+    Device *device = binc_adapter_get_device_by_path(fixture->client_adapter, DEVICE_PATH);
+    g_assert_nonnull(device);
+    g_assert_false(binc_device_is_restored(device));
+    g_assert_cmpstr(binc_device_get_name(device), ==, "Live");
+}
+
+static void test_round_trip(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    g_assert_cmpint(binc_adapter_load_device_cache(fixture->adapter, fixture->filename), ==, 1);
+
+    GByteArray *encoded = binc_device_snapshot_encode(fixture->adapter);
+    g_assert_cmpmem(encoded->data, encoded->len, fixture->snapshot->data, fixture->snapshot->len);
+    g_byte_array_free(encoded, TRUE);
+}
+
+static void test_rejects_invalid(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    GByteArray *snapshot = fixture->snapshot;
+    guint records = 0;
+
+    // Wrong magic
+    snapshot->data[0] = 'X';
+    g_assert_cmpint(binc_device_snapshot_decode(snapshot->data, snapshot->len, ADAPTER_PATH, count_record, &records),
+                    ==, -1);
+    snapshot->data[0] = 'B';
+
+    // Unknown version
+    snapshot->data[8] = 2;
+    g_assert_cmpint(binc_device_snapshot_decode(snapshot->data, snapshot->len, ADAPTER_PATH, count_record, &records),
+                    ==, -1);
+    snapshot->data[8] = 1;
+
+    // Too short for a header
+    g_assert_cmpint(binc_device_snapshot_decode(snapshot->data, 10, ADAPTER_PATH, count_record, &records), ==, -1);
+
+    // A truncated record is dropped, not decoded halfway
+    g_assert_cmpint(binc_device_snapshot_decode(snapshot->data, snapshot->len - 1, ADAPTER_PATH, count_record,
+                                                &records), ==, 0);
+    g_assert_cmpuint(records, ==, 0);
+
+    g_assert_cmpint(binc_device_snapshot_decode(snapshot->data, snapshot->len, ADAPTER_PATH, count_record, &records),
+                    ==, 1);
+    g_assert_cmpuint(records, ==, 1);
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+    test_bus_up();
+
+    g_test_add("/device-snapshot/restore", Fixture, NULL, fixture_set_up, test_restore, fixture_tear_down);
+    g_test_add("/device-snapshot/drops-unknown", Fixture, NULL,
+               fixture_set_up, test_drops_unknown, fixture_tear_down);
+    g_test_add("/device-snapshot/reconciles-known", Fixture, NULL,
+               fixture_set_up, test_reconciles_known, fixture_tear_down);
+    g_test_add("/device-snapshot/round-trip", Fixture, NULL, fixture_set_up, test_round_trip, fixture_tear_down);
+    g_test_add("/device-snapshot/rejects-invalid", Fixture, NULL,
+               fixture_set_up, test_rejects_invalid, fixture_tear_down);
+
+    int result = g_test_run();
+    test_bus_down();
+    return result;
+}
@@ -0,0 +1,329 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <gio/gio.h>
+#include "gatt_queue.h"
+#include "test_bus.h"
+
+static const char *const INTERFACE_CHARACTERISTIC = "org.bluez.GattCharacteristic1";
+static const char *const FIRST_PATH = "/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E/service0001/char0002";
+static const char *const SECOND_PATH = "/org/bluez/hci0/dev_C4_0A_1B_2C_3D_7E/service0001/char0004";
+static const char *const BLUEZ_ERROR_IN_PROGRESS = "org.bluez.Error.InProgress";
+static const guint WAIT_TIMEOUT_MS = 5000;
+
+static const char *const characteristic_xml =
+        "<node>"
+        "   <interface name='org.bluez.GattCharacteristic1'>"
+        "       <method name='ReadValue'>"
+        "           <arg name='options' type='a{sv}' direction='in'/>"
+        "           <arg name='value' type='ay' direction='out'/>"
+        "       </method>"
+        "   </interface>"
+        "</node>";
+
+/**
+ * Characteristic exported by the stub BlueZ, answering the first in_progress_replies reads with InProgress.
+ * With hold set, the reply to the next read waits in held until the test sends it.
+ */
+typedef struct stub_characteristic {
+    char name;
+    guint in_progress_replies;
+    gboolean hold;
+    GDBusMethodInvocation *held;
+    guint calls;
+    GString *log; // Borrowed, names of the characteristics in the order they were called
+} StubCharacteristic;
+
+typedef struct fixture {
+    GDBusConnection *bluez;
+    GDBusConnection *client;
+    GString *log;
+    StubCharacteristic first;
+    StubCharacteristic second;
+    guint registrations[2];
+    GattQueue *queue;
+    guint completed;
+    char completion_order[3];
+    GError *errors[2];
+    guint8 values[2];
+} Fixture;
+
+typedef struct read_request {
+    Fixture *fixture;
+    guint index;
+} ReadRequest;
+
+static void reply_value(const StubCharacteristic *stub, GDBusMethodInvocation *invocation) {
+    guint8 value = (guint8) stub->name;
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(@ay)", g_variant_new_fixed_array(
+            G_VARIANT_TYPE_BYTE, &value, 1, sizeof(guint8))));
+}
+
+static void stub_method_call(__attribute__((unused)) GDBusConnection *connection,
+                             __attribute__((unused)) const gchar *sender,
+                             __attribute__((unused)) const gchar *object_path,
+                             __attribute__((unused)) const gchar *interface_name,
+                             __attribute__((unused)) const gchar *method_name,
+                             __attribute__((unused)) GVariant *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer user_data) {
+    StubCharacteristic *stub = (StubCharacteristic *) user_data;
+    stub->calls++;
+    g_string_append_c(stub->log, stub->name);
+
+    if (stub->in_progress_replies > 0) {
+        stub->in_progress_replies--;
+        g_dbus_method_invocation_return_dbus_error(invocation, BLUEZ_ERROR_IN_PROGRESS, "In Progress");
+        return;
+    }
+
+    if (stub->hold) {
+        stub->hold = FALSE;
+        stub->held = invocation;
+        return;
+    }
+
+    reply_value(stub, invocation);
+}
+
+static const GDBusInterfaceVTable stub_vtable = {
+        .method_call = stub_method_call
+};
+
+static void fixture_set_up(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->bluez = test_bus_connect();
+    test_bus_own_bluez(fixture->bluez);
+    fixture->client = test_bus_connect();
+    fixture->log = g_string_new(NULL);
+    fixture->first = (StubCharacteristic) {.name = 'A', .log = fixture->log};
+    fixture->second = (StubCharacteristic) {.name = 'B', .log = fixture->log};
+
+    GError *error = NULL;
+    GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(characteristic_xml, &error);
+    g_assert_no_error(error);
+    fixture->registrations[0] = g_dbus_connection_register_object(fixture->bluez, FIRST_PATH, info->interfaces[0],
+                                                                  &stub_vtable, &fixture->first, NULL, &error);
+    g_assert_no_error(error);
+    fixture->registrations[1] = g_dbus_connection_register_object(fixture->bluez, SECOND_PATH, info->interfaces[0],
+                                                                  &stub_vtable, &fixture->second, NULL, &error);
+    g_assert_no_error(error);
+    g_dbus_node_info_unref(info);
+
+    fixture->queue = binc_gatt_queue_create(fixture->client);
+}
+
+static void fixture_tear_down(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    binc_gatt_queue_free(fixture->queue);
+    for (guint i = 0; i < G_N_ELEMENTS(fixture->errors); i++) {
+        g_clear_error(&fixture->errors[i]);
+    }
+    g_dbus_connection_unregister_object(fixture->bluez, fixture->registrations[0]);
+    g_dbus_connection_unregister_object(fixture->bluez, fixture->registrations[1]);
+    g_string_free(fixture->log, TRUE);
+    g_object_unref(fixture->client);
+    g_object_unref(fixture->bluez);
+}
+
+static void read_cb(GVariant *result, const GError *error, gpointer user_data) {
+    ReadRequest *request = (ReadRequest *) user_data;
+    Fixture *fixture = request->fixture;
+
+    fixture->completion_order[fixture->completed++] = (char) ('0' + request->index);
+    if (error != NULL) {
+        fixture->errors[request->index] = g_error_copy(error);
+        return;
+    }
+
+    GVariant *value = g_variant_get_child_value(result, 0);
+    gsize length = 0;
+    const guint8 *data = g_variant_get_fixed_array(value, &length, sizeof(guint8));
+    g_assert_cmpuint(length, ==, 1);
+    fixture->values[request->index] = data[0];
+    g_variant_unref(value);
+}
+
+static void queue_cancellable_read(Fixture *fixture, const char *path, guint index, GCancellable *cancellable) {
+    ReadRequest *request = g_new0(ReadRequest, 1);
+    request->fixture = fixture;
+    request->index = index;
+    binc_gatt_queue_call(fixture->queue, path, INTERFACE_CHARACTERISTIC, "ReadValue",
+                         g_variant_new("(@a{sv})", g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0)),
+                         G_VARIANT_TYPE("(ay)"), FALSE, cancellable, read_cb, request, g_free);
+}
+
+static void queue_read(Fixture *fixture, const char *path, guint index) {
+    queue_cancellable_read(fixture, path, index, NULL);
+}
+
+static void test_in_progress_is_retried(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->first.in_progress_replies = 2;
+
+    gint64 start = g_get_monotonic_time();
+    queue_read(fixture, FIRST_PATH, 0);
+    g_assert_true(test_bus_wait_for_count(&fixture->completed, 1, WAIT_TIMEOUT_MS));
+
+    g_assert_no_error(fixture->errors[0]);
+    g_assert_cmpuint(fixture->values[0], ==, 'A');
+    g_assert_cmpuint(fixture->first.calls, ==, 3);
+
+    // Backoff of 20 ms doubling per retry
+    g_assert_cmpint(g_get_monotonic_time() - start, >=, (20 + 40) * 1000);
+
+    GattQueueStats stats;
+    binc_gatt_queue_get_stats(fixture->queue, &stats);
+    g_assert_cmpuint(stats.operations, ==, 1);
+    g_assert_cmpuint(stats.retries, ==, 2);
+    g_assert_cmpuint(stats.failures, ==, 0);
+}
+
+static void test_retries_give_up(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->first.in_progress_replies = G_MAXUINT;
+
+    queue_read(fixture, FIRST_PATH, 0);
+    g_assert_true(test_bus_wait_for_count(&fixture->completed, 1, WAIT_TIMEOUT_MS));
+
+    g_assert_nonnull(fixture->errors[0]);
+    gchar *remote_error = g_dbus_error_get_remote_error(fixture->errors[0]);
+    g_assert_cmpstr(remote_error, ==, BLUEZ_ERROR_IN_PROGRESS);
+    g_free(remote_error);
+
+    // The first call and five retries
+    g_assert_cmpuint(fixture->first.calls, ==, 6);
+
+    GattQueueStats stats;
+    binc_gatt_queue_get_stats(fixture->queue, &stats);
+    g_assert_cmpuint(stats.retries, ==, 5);
+    g_assert_cmpuint(stats.failures, ==, 1);
+}
+
+static void test_retry_keeps_order(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->first.in_progress_replies = 1;
+
+    queue_read(fixture, FIRST_PATH, 0);
+    queue_read(fixture, SECOND_PATH, 1);
+    g_assert_true(test_bus_wait_for_count(&fixture->completed, 2, WAIT_TIMEOUT_MS));
+
+    g_assert_no_error(fixture->errors[0]);
+    g_assert_no_error(fixture->errors[1]);
+    g_assert_cmpstr(fixture->log->str, ==, "AAB");
+    g_assert_cmpstr(fixture->completion_order, ==, "01");
+}
+
+static void test_cancel_queued_call(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->first.hold = TRUE;
+    GCancellable *cancellable = g_cancellable_new();
+
+    queue_read(fixture, FIRST_PATH, 0);
+    queue_cancellable_read(fixture, SECOND_PATH, 1, cancellable);
+    g_assert_true(test_bus_wait_for_count(&fixture->first.calls, 1, WAIT_TIMEOUT_MS));
+
+    // The cancelled read completes while the read in front of it is still running
+    g_cancellable_cancel(cancellable);
+    g_assert_true(test_bus_wait_for_count(&fixture->completed, 1, WAIT_TIMEOUT_MS));
+    g_assert_cmpstr(fixture->completion_order, ==, "1");
+    g_assert_error(fixture->errors[1], G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+    reply_value(&fixture->first, fixture->first.held);
+    fixture->first.held = NULL;
+    g_assert_true(test_bus_wait_for_count(&fixture->completed, 2, WAIT_TIMEOUT_MS));
+    g_assert_no_error(fixture->errors[0]);
+    g_assert_cmpuint(fixture->second.calls, ==, 0);
+
+    GattQueueStats stats;
+    binc_gatt_queue_get_stats(fixture->queue, &stats);
+    g_assert_cmpuint(stats.cancelled, ==, 1);
+    g_assert_cmpuint(stats.depth, ==, 0);
+    g_object_unref(cancellable);
+}
+
+static gboolean queue_has_retried(gpointer user_data) {
+    GattQueueStats stats;
+    binc_gatt_queue_get_stats((GattQueue *) user_data, &stats);
+    return stats.retries > 0;
+}
+
+static void test_cancel_retrying_call(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    fixture->first.in_progress_replies = G_MAXUINT;
+    GCancellable *cancellable = g_cancellable_new();
+
+    queue_cancellable_read(fixture, FIRST_PATH, 0, cancellable);
+    queue_read(fixture, SECOND_PATH, 1);
+    g_assert_true(test_bus_wait_until(queue_has_retried, fixture->queue, WAIT_TIMEOUT_MS));
+
+    // The read waiting for its retry gives up its slot, so the next read runs
+    g_cancellable_cancel(cancellable);
+    g_assert_true(test_bus_wait_for_count(&fixture->completed, 2, WAIT_TIMEOUT_MS));
+    g_assert_cmpstr(fixture->completion_order, ==, "01");
+    g_assert_error(fixture->errors[0], G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    g_assert_no_error(fixture->errors[1]);
+    g_assert_cmpuint(fixture->first.calls, ==, 1);
+    g_object_unref(cancellable);
+}
+
+static gboolean queue_is_idle(gpointer user_data) {
+    GattQueueStats stats;
+    binc_gatt_queue_get_stats((GattQueue *) user_data, &stats);
+    return stats.in_flight == 0;
+}
+
+static void test_cancel_all_completes_running_calls(Fixture *fixture, __attribute__((unused)) gconstpointer user_data) {
+    queue_read(fixture, FIRST_PATH, 0);
+    queue_read(fixture, SECOND_PATH, 1);
+
+    // The first read was sent, the second is still queued, both complete before cancel_all returns
+    binc_gatt_queue_cancel_all(fixture->queue);
+    g_assert_cmpuint(fixture->completed, ==, 2);
+    g_assert_error(fixture->errors[0], G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    g_assert_error(fixture->errors[1], G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+    // The running call keeps its slot until its reply arrives, without calling back again
+    g_assert_true(test_bus_wait_until(queue_is_idle, fixture->queue, WAIT_TIMEOUT_MS));
+    g_assert_cmpuint(fixture->completed, ==, 2);
+
+    GattQueueStats stats;
+    binc_gatt_queue_get_stats(fixture->queue, &stats);
+    g_assert_cmpuint(stats.operations, ==, 2);
+    g_assert_cmpuint(stats.cancelled, ==, 2);
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+    test_bus_up();
+
+    g_test_add("/gatt-queue/in-progress-is-retried", Fixture, NULL,
+               fixture_set_up, test_in_progress_is_retried, fixture_tear_down);
+    g_test_add("/gatt-queue/retries-give-up", Fixture, NULL,
+               fixture_set_up, test_retries_give_up, fixture_tear_down);
+    g_test_add("/gatt-queue/retry-keeps-order", Fixture, NULL,
+               fixture_set_up, test_retry_keeps_order, fixture_tear_down);
+    g_test_add("/gatt-queue/cancel-queued-call", Fixture, NULL,
+               fixture_set_up, test_cancel_queued_call, fixture_tear_down);
+    g_test_add("/gatt-queue/cancel-retrying-call", Fixture, NULL,
+               fixture_set_up, test_cancel_retrying_call, fixture_tear_down);
+    g_test_add("/gatt-queue/cancel-all-completes-running-calls", Fixture, NULL,
+               fixture_set_up, test_cancel_all_completes_running_calls, fixture_tear_down);
+
+    int result = g_test_run();
+    test_bus_down();
+    return result;
+}
@@ -0,0 +1,96 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <glib.h>
+#include "rssi_filter.h"
+
+static void test_none_passes_through(void) {
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_NONE};
+    RssiFilterState state;
+    binc_rssi_filter_reset(&state);
+
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -70), ==, -70);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -40), ==, -40);
+}
+
+static void test_ema(void) {
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_EMA, .ema_alpha = 0.5};
+    RssiFilterState state;
+    binc_rssi_filter_reset(&state);
+
+    // The first sample initializes the estimate, later ones move it halfway
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -80), ==, -80);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -60), ==, -70);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -60), ==, -65);
+}
+
+static void test_kalman_converges(void) {
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_KALMAN, .kalman_process_noise = 0.01,
+            .kalman_measurement_noise = 4.0};
+    RssiFilterState state;
+    binc_rssi_filter_reset(&state);
+
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -90), ==, -90);
+    short estimate = 0;
+    for (int i = 0; i < 200; i++) {
+        estimate = binc_rssi_filter_apply(&config, &state, -60);
+        g_assert_cmpint(estimate, >=, -90);
+        g_assert_cmpint(estimate, <=, -60);
+    }
+    g_assert_cmpint(estimate, ==, -60);
+}
+
+static void test_median_rejects_outliers(void) {
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_MEDIAN, .median_window = 5};
+    RssiFilterState state;
+    binc_rssi_filter_reset(&state);
+
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -70), ==, -70);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -72), ==, -71);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -20), ==, -70);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -71), ==, -71);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -100), ==, -71);
+
+    // The window is full, so the oldest sample is replaced from here on
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -73), ==, -72);
+}
+
+static void test_reset(void) {
+    RssiFilterConfig config = {.type = BINC_RSSI_FILTER_EMA, .ema_alpha = 0.1};
+    RssiFilterState state;
+    binc_rssi_filter_reset(&state);
+
+    binc_rssi_filter_apply(&config, &state, -90);
+    binc_rssi_filter_reset(&state);
+    g_assert_cmpint(binc_rssi_filter_apply(&config, &state, -50), ==, -50);
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/rssi-filter/none", test_none_passes_through);
+    g_test_add_func("/rssi-filter/ema", test_ema);
+    g_test_add_func("/rssi-filter/kalman-converges", test_kalman_converges);
+    g_test_add_func("/rssi-filter/median-rejects-outliers", test_median_rejects_outliers);
+    g_test_add_func("/rssi-filter/reset", test_reset);
+    return g_test_run();
+}
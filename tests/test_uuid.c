@@ -0,0 +1,102 @@
+/*
+ *   Copyright (c) 2022 Martijn van Welie
+ *
+ *   Permission is hereby granted, free of charge, to any person obtaining a copy
+ *   of this software and associated documentation files (the "Software"), to deal
+ *   in the Software without restriction, including without limitation the rights
+ *   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *   copies of the Software, and to permit persons to whom the Software is
+ *   furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in all
+ *   copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *   SOFTWARE.
+ *
+ */
+
+#include <glib.h>
+#include "uuid.h"
+
+static const char *const HEART_RATE_SERVICE = "0000180d-0000-1000-8000-00805f9b34fb";
+
+static void assert_uuid_string(const BincUuid *uuid, const char *expected) {
+    char buffer[BINC_UUID_STRING_LENGTH];
+    binc_uuid_format(uuid, buffer);
+    g_assert_cmpstr(buffer, ==, expected);
+}
+
+static void test_parse_full(void) {
+    BincUuid uuid;
+    g_assert_true(binc_uuid_parse("6E400001-B5A3-F393-E0A9-E50E24DCCA9E", &uuid));
+    assert_uuid_string(&uuid, "6e400001-b5a3-f393-e0a9-e50e24dcca9e");
+    g_assert_cmpuint(uuid.bytes[0], ==, 0x6E);
+    g_assert_cmpuint(uuid.bytes[15], ==, 0x9E);
+}
+
+static void test_parse_short_forms(void) {
+    BincUuid uuid;
+    g_assert_true(binc_uuid_parse("180d", &uuid));
+    assert_uuid_string(&uuid, HEART_RATE_SERVICE);
+
+    g_assert_true(binc_uuid_parse("0x180D", &uuid));
+    assert_uuid_string(&uuid, HEART_RATE_SERVICE);
+
+    g_assert_true(binc_uuid_parse("0000180d", &uuid));
+    assert_uuid_string(&uuid, HEART_RATE_SERVICE);
+
+    BincUuid from16;
+    binc_uuid_from_uuid16(0x180D, &from16);
+    g_assert_true(binc_uuid_equal(&uuid, &from16));
+
+    BincUuid from32;
+    binc_uuid_from_uuid32(0x1234ABCD, &from32);
+    assert_uuid_string(&from32, "1234abcd-0000-1000-8000-00805f9b34fb");
+}
+
+static void test_parse_invalid(void) {
+    BincUuid uuid;
+    g_assert_false(binc_uuid_parse("", &uuid));
+    g_assert_false(binc_uuid_parse("180", &uuid));
+    g_assert_false(binc_uuid_parse("18xd", &uuid));
+    g_assert_false(binc_uuid_parse("0000180d-0000-1000-8000-00805f9b34f", &uuid));
+    g_assert_false(binc_uuid_parse("0000180d-0000-1000-8000-00805f9b34fbb", &uuid));
+    g_assert_false(binc_uuid_parse("0000180d+0000-1000-8000-00805f9b34fb", &uuid));
+    g_assert_false(binc_uuid_parse("0000180g-0000-1000-8000-00805f9b34fb", &uuid));
+}
+
+static void test_equal_and_hash(void) {
+    BincUuid uuid, same, other;
+    g_assert_true(binc_uuid_parse(HEART_RATE_SERVICE, &uuid));
+    g_assert_true(binc_uuid_parse("180D", &same));
+    g_assert_true(binc_uuid_parse("180f", &other));
+
+    g_assert_true(binc_uuid_equal(&uuid, &same));
+    g_assert_false(binc_uuid_equal(&uuid, &other));
+    g_assert_cmpuint(binc_uuid_hash(&uuid), ==, binc_uuid_hash(&same));
+    g_assert_cmpuint(binc_uuid_hash(&uuid), !=, binc_uuid_hash(&other));
+}
+
+static void test_interned_string(void) {
+    BincUuid uuid;
+    g_assert_true(binc_uuid_parse("180d", &uuid));
+    const char *interned = binc_uuid_to_interned_string(&uuid);
+    g_assert_cmpstr(interned, ==, HEART_RATE_SERVICE);
+    g_assert_true(interned == g_intern_string(HEART_RATE_SERVICE));
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/uuid/parse-full", test_parse_full);
+    g_test_add_func("/uuid/parse-short-forms", test_parse_short_forms);
+    g_test_add_func("/uuid/parse-invalid", test_parse_invalid);
+    g_test_add_func("/uuid/equal-and-hash", test_equal_and_hash);
+    g_test_add_func("/uuid/interned-string", test_interned_string);
+    return g_test_run();
+}